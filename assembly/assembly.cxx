@@ -1,6 +1,17 @@
 #include "assembly.hxx"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+#include "layout/layout.hxx"
+#include "../os/trace.hxx"
 
 using namespace std;
 using namespace assembly;
@@ -19,6 +30,11 @@ static auto can_be_encoded_in_8bits(i64 n) -> bool {
     return numeric_limits<i8>::min() <= n && n <= numeric_limits<u8>::max();
 }
 
+// True if n is a valid i8, which is required for immediates that the CPU sign-extends
+static auto can_be_sign_extended_from_8bits(i64 n) -> bool {
+    return numeric_limits<i8>::min() <= n && n <= numeric_limits<i8>::max();
+}
+
 static auto register_width(mnemo_t::arg_t::reg_t reg) -> mnemo_t::width_t {
     switch (reg) {
         case mnemo_t::arg_t::reg_t::Al:
@@ -56,7 +72,26 @@ static auto register_width(mnemo_t::arg_t::reg_t reg) -> mnemo_t::width_t {
         case mnemo_t::arg_t::reg_t::Rbp:
         case mnemo_t::arg_t::reg_t::Rsi:
         case mnemo_t::arg_t::reg_t::Rdi:
+        case mnemo_t::arg_t::reg_t::Rip:
             return mnemo_t::width_t::Qword;
+        case mnemo_t::arg_t::reg_t::Xmm0:
+        case mnemo_t::arg_t::reg_t::Xmm1:
+        case mnemo_t::arg_t::reg_t::Xmm2:
+        case mnemo_t::arg_t::reg_t::Xmm3:
+        case mnemo_t::arg_t::reg_t::Xmm4:
+        case mnemo_t::arg_t::reg_t::Xmm5:
+        case mnemo_t::arg_t::reg_t::Xmm6:
+        case mnemo_t::arg_t::reg_t::Xmm7:
+            return mnemo_t::width_t::Xmmword;
+        case mnemo_t::arg_t::reg_t::Ymm0:
+        case mnemo_t::arg_t::reg_t::Ymm1:
+        case mnemo_t::arg_t::reg_t::Ymm2:
+        case mnemo_t::arg_t::reg_t::Ymm3:
+        case mnemo_t::arg_t::reg_t::Ymm4:
+        case mnemo_t::arg_t::reg_t::Ymm5:
+        case mnemo_t::arg_t::reg_t::Ymm6:
+        case mnemo_t::arg_t::reg_t::Ymm7:
+            return mnemo_t::width_t::Ymmword;
         default:
             throw logic_error("Unsupported register! register_width");
     }
@@ -69,41 +104,57 @@ static auto reg_to_number(mnemo_t::arg_t::reg_t reg) -> u8 {
         case mnemo_t::arg_t::reg_t::Ax:
         case mnemo_t::arg_t::reg_t::Eax:
         case mnemo_t::arg_t::reg_t::Rax:
+        case mnemo_t::arg_t::reg_t::Xmm0:
+        case mnemo_t::arg_t::reg_t::Ymm0:
             return 0b000;
         case mnemo_t::arg_t::reg_t::Cl:
         case mnemo_t::arg_t::reg_t::Cx:
         case mnemo_t::arg_t::reg_t::Ecx:
         case mnemo_t::arg_t::reg_t::Rcx:
+        case mnemo_t::arg_t::reg_t::Xmm1:
+        case mnemo_t::arg_t::reg_t::Ymm1:
             return 0b001;
         case mnemo_t::arg_t::reg_t::Dl:
         case mnemo_t::arg_t::reg_t::Dx:
         case mnemo_t::arg_t::reg_t::Edx:
         case mnemo_t::arg_t::reg_t::Rdx:
+        case mnemo_t::arg_t::reg_t::Xmm2:
+        case mnemo_t::arg_t::reg_t::Ymm2:
             return 0b010;
         case mnemo_t::arg_t::reg_t::Bl:
         case mnemo_t::arg_t::reg_t::Bx:
         case mnemo_t::arg_t::reg_t::Ebx:
         case mnemo_t::arg_t::reg_t::Rbx:
+        case mnemo_t::arg_t::reg_t::Xmm3:
+        case mnemo_t::arg_t::reg_t::Ymm3:
             return 0b011;
         case mnemo_t::arg_t::reg_t::Ah:
         case mnemo_t::arg_t::reg_t::Sp:
         case mnemo_t::arg_t::reg_t::Esp:
         case mnemo_t::arg_t::reg_t::Rsp:
+        case mnemo_t::arg_t::reg_t::Xmm4:
+        case mnemo_t::arg_t::reg_t::Ymm4:
             return 0b100;
         case mnemo_t::arg_t::reg_t::Ch:
         case mnemo_t::arg_t::reg_t::Bp:
         case mnemo_t::arg_t::reg_t::Ebp:
         case mnemo_t::arg_t::reg_t::Rbp:
+        case mnemo_t::arg_t::reg_t::Xmm5:
+        case mnemo_t::arg_t::reg_t::Ymm5:
             return 0b101;
         case mnemo_t::arg_t::reg_t::Dh:
         case mnemo_t::arg_t::reg_t::Si:
         case mnemo_t::arg_t::reg_t::Esi:
         case mnemo_t::arg_t::reg_t::Rsi:
+        case mnemo_t::arg_t::reg_t::Xmm6:
+        case mnemo_t::arg_t::reg_t::Ymm6:
             return 0b110;
         case mnemo_t::arg_t::reg_t::Bh:
         case mnemo_t::arg_t::reg_t::Di:
         case mnemo_t::arg_t::reg_t::Edi:
         case mnemo_t::arg_t::reg_t::Rdi:
+        case mnemo_t::arg_t::reg_t::Xmm7:
+        case mnemo_t::arg_t::reg_t::Ymm7:
             return 0b111;
         default:
             throw logic_error("Unsupported register!");
@@ -136,18 +187,29 @@ static auto scale_and_index_and_base_to_sib(u8 scale, u8 index, u8 base) -> u8 {
     return (scale << 6) | (index << 3) | (base << 0);
 }
 
-// For mnemos that only allow imms up to 32 bits. 32 bit value will be sign-extended in memory to 64 bits
-static auto assert_imm_not_larger_than_32_bits(mnemo_t::width_t &width, imm_t imm, const string &msg) -> void {
+// For mnemos that only allow imms up to 32 bits. 32 bit value will be sign-extended in memory to 64 bits.
+// The error message is only built on failure, so the check does not allocate.
+static auto assert_imm_not_larger_than_32_bits(mnemo_t::width_t &width, imm_t imm, const char *action,
+                                               const char *where) -> void {
     if (width == mnemo_t::width_t::Qword) {
         width = mnemo_t::width_t::Dword;
         if (!can_be_encoded_in_32bits(imm))
-            throw logic_error(msg);
+            throw logic_error(string("Attempted to ") + action + " immediate 64 bit value @ " + where);
     }
 }
 
+// Output of the mnemo encoders. Besides the bytes it holds the position of the disp32 of the last RIP-relative memory
+// operand, -1 if there was none, which assemble_detailed uses to fix up displacements of constant pool operands and
+// counters once the layout is known.
+struct code_buffer_t : pmr::vector<u8> {
+    using pmr::vector<u8>::vector;
+
+    i64 rip_disp_position = -1;
+};
+
 // Put an "address-size override" prefix if address width = dword
 // In 64 bit mode switches address width from 64 bits to 32 bits
-static auto push_ASOR_if_dword(vector<u8> &out, const mnemo_t::arg_t::memory_t &memory_field) -> void {
+static auto push_ASOR_if_dword(pmr::vector<u8> &out, const mnemo_t::arg_t::memory_t &memory_field) -> void {
     // If index register is defined and its width does not match that of base, throw and error
     if (memory_field.index != mnemo_t::arg_t::reg_t::Undef &&
         register_width(memory_field.index) != register_width(memory_field.base)) {
@@ -161,20 +223,20 @@ static auto push_ASOR_if_dword(vector<u8> &out, const mnemo_t::arg_t::memory_t &
 
 // Put an "operand-size override" prefix if operand width = word
 // In 64 bit mode switches operand width from 32 bits to 16 bits
-static auto push_OSOR_if_word(vector<u8> &out, mnemo_t::width_t width) -> void {
+static auto push_OSOR_if_word(pmr::vector<u8> &out, mnemo_t::width_t width) -> void {
     if (width == mnemo_t::width_t::Word) {
         out.push_back(0x66);
     }
 }
 
 // Put a REX prefix if operand width = qword
-static auto push_rex_if_qword(vector<u8> &out, mnemo_t::width_t width) -> void {
+static auto push_rex_if_qword(pmr::vector<u8> &out, mnemo_t::width_t width) -> void {
     if (width == mnemo_t::width_t::Qword) {
         out.push_back(0b01001000);
     }
 }
 
-static auto append_disp(vector<u8> &out, disp_t a_disp) -> void {
+static auto append_disp(pmr::vector<u8> &out, disp_t a_disp) -> void {
     // Append the disp
     if (a_disp == 0) {
         // no disp
@@ -194,7 +256,29 @@ static auto append_disp(vector<u8> &out, disp_t a_disp) -> void {
     }
 }
 
-static auto append_imm_upto_64(vector<u8> &out, mnemo_t::width_t width, imm_t a_imm) -> void {
+// With mod = 00, a base of ebp or rbp means RIP-relative or no base, so these bases always take a disp8 or disp32
+static auto has_bp_base(const mnemo_t::arg_t::memory_t &memory) -> bool {
+    return memory.base == mnemo_t::arg_t::reg_t::Ebp || memory.base == mnemo_t::arg_t::reg_t::Rbp;
+}
+
+// Appends disp of a memory operand. RIP-relative addressing always uses a disp32.
+static auto append_memory_disp(code_buffer_t &out, const mnemo_t::arg_t::memory_t &memory) -> void {
+    if (memory.base != mnemo_t::arg_t::reg_t::Rip) {
+        if (memory.disp == 0 && has_bp_base(memory))
+            out.push_back(0);
+        append_disp(out, memory.disp);
+        return;
+    }
+    out.rip_disp_position = i64(out.size());
+    u32 disp = u32(memory.disp);
+    for (u8 i = 0; i < 4; i++) {
+        out.push_back(disp & 0xff);
+        disp >>= 8;
+    }
+}
+
+template<typename out_t>
+static auto append_imm_upto_64(out_t &out, mnemo_t::width_t width, imm_t a_imm) -> void {
     switch (width) {
         case mnemo_t::width_t::Byte: {
             // Write i8
@@ -246,11 +330,15 @@ static auto append_imm_upto_64(vector<u8> &out, mnemo_t::width_t width, imm_t a_
     }
 }
 
-// Pushes opcode1 if mnemo.width == byte, else opcode2
-static auto
-push_operand_width_prefixes_and_opcode(vector<u8> &out, mnemo_t::width_t width, u8 opcode1, u8 opcode2) -> void {
+static auto push_operand_width_prefixes(pmr::vector<u8> &out, mnemo_t::width_t width) -> void {
     push_OSOR_if_word(out, width);
     push_rex_if_qword(out, width);
+}
+
+// Pushes opcode1 if mnemo.width == byte, else opcode2
+static auto
+push_operand_width_prefixes_and_opcode(pmr::vector<u8> &out, mnemo_t::width_t width, u8 opcode1, u8 opcode2) -> void {
+    push_operand_width_prefixes(out, width);
     switch (width) {
         case mnemo_t::width_t::Byte:
             out.push_back(opcode1);
@@ -265,6 +353,81 @@ push_operand_width_prefixes_and_opcode(vector<u8> &out, mnemo_t::width_t width,
     }
 }
 
+// Mandatory SIMD prefix of a vector instruction. Values match the VEX "pp" field.
+enum class simd_prefix_t : u8 {
+    None = 0b00,
+    P66 = 0b01,
+    PF3 = 0b10,
+    PF2 = 0b11,
+};
+
+// Opcode map of a vector instruction. Values match the VEX "mmmmm" field.
+enum class opcode_map_t : u8 {
+    M0F = 0b00001,
+    M0F38 = 0b00010,
+    M0F3A = 0b00011,
+};
+
+// Describes how a vector mnemo is encoded
+struct vector_encoding_t {
+    simd_prefix_t prefix;
+    opcode_map_t map;
+    u8 load_opcode; // reg <- r/m form
+    u8 store_opcode; // r/m <- reg form, 0x00 if the mnemo does not have one
+    bool w; // REX.W for legacy encoding, VEX.W for VEX encoding
+};
+
+// Legacy SSE encoding: [66/F2/F3] [REX.W] 0F [38/3A] opcode
+static auto push_legacy_simd_prefixes_and_opcode(pmr::vector<u8> &out, const vector_encoding_t &encoding, u8 opcode) -> void {
+    switch (encoding.prefix) {
+        case simd_prefix_t::None:
+            break;
+        case simd_prefix_t::P66:
+            out.push_back(0x66);
+            break;
+        case simd_prefix_t::PF3:
+            out.push_back(0xf3);
+            break;
+        case simd_prefix_t::PF2:
+            out.push_back(0xf2);
+            break;
+    }
+    if (encoding.w) {
+        out.push_back(0b01001000);
+    }
+    out.push_back(0x0f);
+    switch (encoding.map) {
+        case opcode_map_t::M0F:
+            break;
+        case opcode_map_t::M0F38:
+            out.push_back(0x38);
+            break;
+        case opcode_map_t::M0F3A:
+            out.push_back(0x3a);
+            break;
+    }
+    out.push_back(opcode);
+}
+
+// VEX encoding: C5 [R vvvv L pp] opcode
+//           or: C4 [R X B mmmmm] [W vvvv L pp] opcode
+// R, X, B and vvvv are stored inverted. Only registers 0-7 are supported, so R, X and B are always 1.
+// The two byte form is used whenever possible, it implies the 0F map and W = 0.
+// `vvvv` is the number of the extra source register, pass 0 when the mnemo does not use it.
+static auto push_vex_prefix_and_opcode(pmr::vector<u8> &out, const vector_encoding_t &encoding, u8 vvvv, bool l, u8 opcode) -> void {
+    u8 inverted_vvvv = (~vvvv) & 0b1111;
+    u8 w_vvvv_l_pp = (inverted_vvvv << 3) | (u8(l) << 2) | u8(encoding.prefix);
+    if (encoding.map == opcode_map_t::M0F && !encoding.w) {
+        out.push_back(0xc5);
+        out.push_back(0b10000000 | w_vvvv_l_pp);
+    } else {
+        out.push_back(0xc4);
+        out.push_back(0b11100000 | u8(encoding.map));
+        out.push_back((u8(encoding.w) << 7) | w_vvvv_l_pp);
+    }
+    out.push_back(opcode);
+}
+
 struct assemble_memory_mnemo_result {
     u8 mod;
     u8 rm;
@@ -280,10 +443,22 @@ static auto assemble_memory_mnemo(const mnemo_t::arg_t::memory_t &memory) -> ass
     u8 index = 0xFF;
     u8 base = 0xFF;
 
+    // RIP-relative addressing is encoded as mod = 00, rm = 101 followed by a disp32 and has no SIB form
+    if (memory.base == mnemo_t::arg_t::reg_t::Rip) {
+        if (memory.scale != mnemo_t::arg_t::memory_t::scale_t::S0)
+            throw logic_error("RIP-relative memory operand can not have an index @ assemble_memory_mnemo");
+        assemble_memory_mnemo_result result{};
+        result.mod = 0b00;
+        result.rm = 0b101;
+        result.sib = 0b11111111; // Should not be used
+        result.sib_eh = false;
+        return result;
+    }
+
     // Fill in "mod" and "rm"
 
     // Choose disp size
-    if (memory.disp == 0) {
+    if (memory.disp == 0 && !has_bp_base(memory)) {
         // no disp
         mod = 0b00;
     } else if (-128 <= memory.disp && memory.disp <= 127) {
@@ -295,11 +470,10 @@ static auto assemble_memory_mnemo(const mnemo_t::arg_t::memory_t &memory) -> ass
     }
 
     // Short address form does not allow using "index"/"scale" or using "esp"/"rsp" as a base register.
-    // It also disallows using "ebp" base without displacement.
+    // "ebp"/"rbp" bases always have a displacement, so they never need the SIB byte.
     bool is_short = !(memory.scale != mnemo_t::arg_t::memory_t::scale_t::S0 ||
                       memory.base == mnemo_t::arg_t::reg_t::Esp ||
-                      memory.base == mnemo_t::arg_t::reg_t::Rsp ||
-                      (memory.disp == 0b00 && memory.base == mnemo_t::arg_t::reg_t::Rbp));
+                      memory.base == mnemo_t::arg_t::reg_t::Rsp);
 
     if (is_short) {
         // Encode addressing without SIB byte
@@ -313,8 +487,8 @@ static auto assemble_memory_mnemo(const mnemo_t::arg_t::memory_t &memory) -> ass
 
         // Fill in SIB
 
-        // NOTE: Put simply, SIB adressing does not allow to adress [scaled index] + [EBP].
-        // Instead that bit combination means no base ([scaled index] + disp32).
+        // NOTE: Put simply, SIB adressing does not allow to adress [scaled index] + [EBP] with mod 00.
+        // Instead that bit combination means no base ([scaled index] + disp32), so EBP takes a zero disp8.
         // (00 xxx 100) (xx xxx 101)
         // mod reg rm    ss index base
         //
@@ -322,8 +496,7 @@ static auto assemble_memory_mnemo(const mnemo_t::arg_t::memory_t &memory) -> ass
         // Instead that bit combination means no index ([base] + dispxx). scale has no effect in this case
         // (xx xxx 100) (nn 100 xxx)
         // mod reg rm    ss index base
-        if ((mod == 0b00 && memory.base == mnemo_t::arg_t::reg_t::Ebp) ||
-            memory.index == mnemo_t::arg_t::reg_t::Esp) {
+        if (memory.index == mnemo_t::arg_t::reg_t::Esp) {
             throw logic_error("Unsupported operation.");
             // TO DO: handle corner cases
         }
@@ -354,6 +527,34 @@ static auto assemble_memory_mnemo(const mnemo_t::arg_t::memory_t &memory) -> ass
     return result;
 }
 
+// Appends ModR/M byte, SIB byte and disp for an r/m operand that is either a register or memory
+static auto append_modrm_for_rm_arg(code_buffer_t &out, u8 reg, const mnemo_t::arg_t &rm_arg) -> void {
+    if (rm_arg.tag == mnemo_t::arg_t::tag_t::Register) {
+        out.push_back(mod_and_reg_and_rm_to_modrm(0b11, reg, reg_to_number(rm_arg.data.reg)));
+    } else if (rm_arg.tag == mnemo_t::arg_t::tag_t::Memory) {
+        assemble_memory_mnemo_result result = assemble_memory_mnemo(rm_arg.data.memory);
+        out.push_back(mod_and_reg_and_rm_to_modrm(result.mod, reg, result.rm));
+        if (result.sib_eh) {
+            out.push_back(result.sib);
+        }
+        append_memory_disp(out, rm_arg.data.memory);
+    } else {
+        throw logic_error("Expected register or memory r/m operand @ append_modrm_for_rm_arg");
+    }
+}
+
+// A template for a mnemo with a single r/m operand, where the reg field of ModR/M holds an opcode extension (/digit).
+// For example:
+// neg r/m32 ; F7 /3
+static auto assemble_digit_mnemos_template(code_buffer_t &out, mnemo_t::width_t width, const mnemo_t::arg_t &rm_arg,
+                                           u8 digit, u8 opcode1, u8 opcode2) -> void {
+    if (rm_arg.tag == mnemo_t::arg_t::tag_t::Memory) {
+        push_ASOR_if_dword(out, rm_arg.data.memory);
+    }
+    push_operand_width_prefixes_and_opcode(out, width, opcode1, opcode2);
+    append_modrm_for_rm_arg(out, digit, rm_arg);
+}
+
 // A template for a mnemo which operates on memory and a register.
 // These mnemos are encoded in a similar way and only differ in opcodes used.
 //
@@ -365,7 +566,7 @@ static auto assemble_memory_mnemo(const mnemo_t::arg_t::memory_t &memory) -> ass
 // mov r/m32 r32 ; MR
 // mov r32 r/m32 ; RM
 static auto
-assemble_memory_register_mnemos_template(vector<u8> &out, const mnemo_t &mnemo, u8 opcode1, u8 opcode2) -> void {
+assemble_memory_register_mnemos_template(code_buffer_t &out, const mnemo_t &mnemo, u8 opcode1, u8 opcode2) -> void {
     const mnemo_t::arg_t *memory_arg;
     const mnemo_t::arg_t *register_arg;
     if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Memory && mnemo.a2.tag == mnemo_t::arg_t::tag_t::Register) {
@@ -391,10 +592,10 @@ assemble_memory_register_mnemos_template(vector<u8> &out, const mnemo_t &mnemo,
         out.push_back(result.sib);
     }
 
-    append_disp(out, memory_arg->data.memory.disp);
+    append_memory_disp(out, memory_arg->data.memory);
 }
 
-static auto assemble_mnemo_mov(vector<u8> &out, const mnemo_t &mnemo) -> void {
+static auto assemble_mnemo_mov(code_buffer_t &out, const mnemo_t &mnemo) -> void {
     if (mnemo.tag != mnemo_t::tag_t::Mov)
         throw logic_error("Wrong mnemo!");
 
@@ -409,11 +610,24 @@ static auto assemble_mnemo_mov(vector<u8> &out, const mnemo_t &mnemo) -> void {
     } else if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Register &&
                mnemo.a2.tag == mnemo_t::arg_t::tag_t::Immediate) {
         u8 opcode_shift = reg_to_number(mnemo.a1.data.reg);
+        imm_t imm = mnemo.a2.data.imm;
+
+        if (mnemo.width == mnemo_t::width_t::Qword && 0 <= imm && imm <= imm_t(numeric_limits<u32>::max())) {
+            // mov r32, imm32 zero-extends into the whole register and needs no REX prefix
+            out.push_back(0xb8 + opcode_shift);
+            append_imm_upto_64(out, mnemo_t::width_t::Dword, imm);
+        } else if (mnemo.width == mnemo_t::width_t::Qword && can_be_encoded_in_32bits(imm)) {
+            // mov r/m64, imm32 sign-extends
+            push_rex_if_qword(out, mnemo.width);
+            out.push_back(0xc7);
+            out.push_back(mod_and_reg_and_rm_to_modrm(0b11, 0, opcode_shift));
+            append_imm_upto_64(out, mnemo_t::width_t::Dword, imm);
+        } else {
+            push_operand_width_prefixes_and_opcode(out, mnemo.width, 0xb0 + opcode_shift, 0xb8 + opcode_shift);
 
-        push_operand_width_prefixes_and_opcode(out, mnemo.width, 0xb0 + opcode_shift, 0xb8 + opcode_shift);
-
-        // Write imm
-        append_imm_upto_64(out, mnemo.width, mnemo.a2.data.imm);
+            // Write imm
+            append_imm_upto_64(out, mnemo.width, imm);
+        }
     } else if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Memory &&
                mnemo.a2.tag == mnemo_t::arg_t::tag_t::Register) {
         assemble_memory_register_mnemos_template(out, mnemo, 0x88, 0x89);
@@ -433,20 +647,25 @@ static auto assemble_mnemo_mov(vector<u8> &out, const mnemo_t &mnemo) -> void {
             out.push_back(result.sib);
         }
 
-        append_disp(out, mnemo.a1.data.memory.disp);
+        append_memory_disp(out, mnemo.a1.data.memory);
 
         mnemo_t::width_t width = mnemo.width;
-        assert_imm_not_larger_than_32_bits(width, mnemo.a2.data.imm,
-                                           "Attempted to move immediate 64 bit value to memory using MOV @ assemble_mnemo_mov");
+        assert_imm_not_larger_than_32_bits(width, mnemo.a2.data.imm, "move", "assemble_mnemo_mov");
         append_imm_upto_64(out, width, mnemo.a2.data.imm);
     } else {
         throw logic_error("Unsupported mov shape!");
     }
 }
 
-static auto assemble_mnemo_add(vector<u8> &out, const mnemo_t &mnemo) -> void {
-    if (mnemo.tag != mnemo_t::tag_t::Add)
-        throw logic_error("Wrong mnemo!");
+// `add`, `or`, `and`, `sub`, `xor` and `cmp` are encoded in the same way and only differ in their /digit value.
+// Their opcodes are:
+// 8 * digit + {0, 1} - MR
+// 8 * digit + {2, 3} - RM
+// 8 * digit + {4, 5} - short form for al/ax/eax/rax and an immediate
+// 0x80, 0x81 /digit  - r/m and an immediate
+// 0x83 /digit        - r/m and a sign-extended imm8
+static auto assemble_mnemo_alu_template(code_buffer_t &out, const mnemo_t &mnemo, u8 digit, const char *name) -> void {
+    u8 opcode_base = digit * 8;
 
     if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Register &&
         mnemo.a2.tag == mnemo_t::arg_t::tag_t::Register) {
@@ -454,86 +673,192 @@ static auto assemble_mnemo_add(vector<u8> &out, const mnemo_t &mnemo) -> void {
         u8 rm = reg_to_number(mnemo.a1.data.reg);
         u8 reg = reg_to_number(mnemo.a2.data.reg);
 
-        push_operand_width_prefixes_and_opcode(out, mnemo.width, 0x00, 0x01);
+        push_operand_width_prefixes_and_opcode(out, mnemo.width, opcode_base + 0, opcode_base + 1);
         out.push_back(mod_and_reg_and_rm_to_modrm(mod, reg, rm));
     } else if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Register &&
                mnemo.a2.tag == mnemo_t::arg_t::tag_t::Immediate) {
-        // Add has three encoding variantions:
-        // 1. Special short encod for al/ax/eax/rax
-        // 2. Special short encod for imm8 operand and reg of any width
+        // These mnemos have three encoding variantions:
+        // 1. Special short encod for imm8 operand and reg of any width
+        // 2. Special short encod for al/ax/eax/rax
         // 3. Normal
-        if (can_be_encoded_in_8bits(mnemo.a2.data.imm) && mnemo.width != mnemo_t::width_t::Byte) {
-            // Will add a sign-extended imm8 to a register
+        if (can_be_sign_extended_from_8bits(mnemo.a2.data.imm) && mnemo.width != mnemo_t::width_t::Byte) {
+            // Will use a sign-extended imm8
             u8 mod = 0b11;
             u8 rm = reg_to_number(mnemo.a1.data.reg);
-            u8 reg = 0; // Exactly 0 (/digit value)
 
             push_operand_width_prefixes_and_opcode(out, mnemo.width, 0xee, 0x83);
-            out.push_back(mod_and_reg_and_rm_to_modrm(mod, reg, rm));
+            out.push_back(mod_and_reg_and_rm_to_modrm(mod, digit, rm));
 
             append_imm_upto_64(out, mnemo_t::width_t::Byte, mnemo.a2.data.imm);
         } else if (mnemo.a1.data.reg == mnemo_t::arg_t::reg_t::Al ||
                    mnemo.a1.data.reg == mnemo_t::arg_t::reg_t::Ax ||
                    mnemo.a1.data.reg == mnemo_t::arg_t::reg_t::Eax ||
                    mnemo.a1.data.reg == mnemo_t::arg_t::reg_t::Rax) {
-            push_operand_width_prefixes_and_opcode(out, mnemo.width, 0x04, 0x05);
+            push_operand_width_prefixes_and_opcode(out, mnemo.width, opcode_base + 4, opcode_base + 5);
 
             mnemo_t::width_t width = mnemo.width;
-            assert_imm_not_larger_than_32_bits(width, mnemo.a2.data.imm,
-                                               "Attempted to add immediate 64 bit value to memory using MOV @ assemble_mnemo_add");
+            assert_imm_not_larger_than_32_bits(width, mnemo.a2.data.imm, name, "assemble_mnemo_alu_template");
             append_imm_upto_64(out, width, mnemo.a2.data.imm);
         } else {
             u8 mod = 0b11;
             u8 rm = reg_to_number(mnemo.a1.data.reg);
-            u8 reg = 0; // Exactly 0 (/digit value)
 
             push_operand_width_prefixes_and_opcode(out, mnemo.width, 0x80, 0x81);
-            out.push_back(mod_and_reg_and_rm_to_modrm(mod, reg, rm));
+            out.push_back(mod_and_reg_and_rm_to_modrm(mod, digit, rm));
 
             mnemo_t::width_t width = mnemo.width;
-            assert_imm_not_larger_than_32_bits(width, mnemo.a2.data.imm,
-                                               "Attempted to add immediate 64 bit value to memory using MOV @ assemble_mnemo_add");
+            assert_imm_not_larger_than_32_bits(width, mnemo.a2.data.imm, name, "assemble_mnemo_alu_template");
             append_imm_upto_64(out, width, mnemo.a2.data.imm);
         }
     } else if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Memory &&
                mnemo.a2.tag == mnemo_t::arg_t::tag_t::Register) {
-        assemble_memory_register_mnemos_template(out, mnemo, 0x00, 0x01);
+        assemble_memory_register_mnemos_template(out, mnemo, opcode_base + 0, opcode_base + 1);
     } else if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Register &&
                mnemo.a2.tag == mnemo_t::arg_t::tag_t::Memory) {
-        assemble_memory_register_mnemos_template(out, mnemo, 0x02, 0x03);
+        assemble_memory_register_mnemos_template(out, mnemo, opcode_base + 2, opcode_base + 3);
     } else if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Memory &&
                mnemo.a2.tag == mnemo_t::arg_t::tag_t::Immediate) {
-        u8 reg = 0; // Exactly 0 (/digit value)
+        if (can_be_sign_extended_from_8bits(mnemo.a2.data.imm) && mnemo.width != mnemo_t::width_t::Byte) {
+            // Will use a sign-extended imm8
+            assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, digit, 0xee, 0x83);
+            append_imm_upto_64(out, mnemo_t::width_t::Byte, mnemo.a2.data.imm);
+        } else {
+            // Will use a full imm
+            assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, digit, 0x80, 0x81);
 
-        assemble_memory_mnemo_result result = assemble_memory_mnemo(mnemo.a1.data.memory);
+            mnemo_t::width_t width = mnemo.width;
+            assert_imm_not_larger_than_32_bits(width, mnemo.a2.data.imm, name, "assemble_mnemo_alu_template");
+            append_imm_upto_64(out, width, mnemo.a2.data.imm);
+        }
+    } else {
+        throw logic_error(string("Unsupported ") + name + " shape!");
+    }
+}
 
-        push_ASOR_if_dword(out, mnemo.a1.data.memory);
-        if (can_be_encoded_in_8bits(mnemo.a2.data.imm) && mnemo.width != mnemo_t::width_t::Byte) {
-            // Will add a sign-extended imm8 to a memory
-            push_operand_width_prefixes_and_opcode(out, mnemo.width, 0xee, 0x83);
+static auto assemble_mnemo_test(code_buffer_t &out, const mnemo_t &mnemo) -> void {
+    if (mnemo.tag != mnemo_t::tag_t::Test)
+        throw logic_error("Wrong mnemo!");
+
+    if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Register &&
+        mnemo.a2.tag == mnemo_t::arg_t::tag_t::Register) {
+        u8 mod = 0b11;
+        u8 rm = reg_to_number(mnemo.a1.data.reg);
+        u8 reg = reg_to_number(mnemo.a2.data.reg);
+
+        push_operand_width_prefixes_and_opcode(out, mnemo.width, 0x84, 0x85);
+        out.push_back(mod_and_reg_and_rm_to_modrm(mod, reg, rm));
+    } else if ((mnemo.a1.tag == mnemo_t::arg_t::tag_t::Memory &&
+                mnemo.a2.tag == mnemo_t::arg_t::tag_t::Register) ||
+               (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Register &&
+                mnemo.a2.tag == mnemo_t::arg_t::tag_t::Memory)) {
+        // `test` is commutative, so RM shape is encoded as MR
+        assemble_memory_register_mnemos_template(out, mnemo, 0x84, 0x85);
+    } else if (mnemo.a2.tag == mnemo_t::arg_t::tag_t::Immediate) {
+        // `test` has no sign-extended imm8 form
+        if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Register &&
+            (mnemo.a1.data.reg == mnemo_t::arg_t::reg_t::Al ||
+             mnemo.a1.data.reg == mnemo_t::arg_t::reg_t::Ax ||
+             mnemo.a1.data.reg == mnemo_t::arg_t::reg_t::Eax ||
+             mnemo.a1.data.reg == mnemo_t::arg_t::reg_t::Rax)) {
+            push_operand_width_prefixes_and_opcode(out, mnemo.width, 0xa8, 0xa9);
         } else {
-            // Will add a full imm to a memory
-            push_operand_width_prefixes_and_opcode(out, mnemo.width, 0x80, 0x81);
-        }
-        out.push_back(mod_and_reg_and_rm_to_modrm(result.mod, reg, result.rm));
-        if (result.sib_eh) {
-            out.push_back(result.sib);
+            assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, 0, 0xf6, 0xf7);
         }
-        append_disp(out, mnemo.a1.data.memory.disp);
 
         mnemo_t::width_t width = mnemo.width;
-        assert_imm_not_larger_than_32_bits(width, mnemo.a2.data.imm,
-                                           "Attempted to add immediate 64 bit value to memory using MOV @ assemble_mnemo_add");
+        assert_imm_not_larger_than_32_bits(width, mnemo.a2.data.imm, "test", "assemble_mnemo_test");
         append_imm_upto_64(out, width, mnemo.a2.data.imm);
     } else {
-        throw logic_error("Unsupported add shape!");
+        throw logic_error("Unsupported test shape!");
+    }
+}
+
+static auto assemble_mnemo_lea(code_buffer_t &out, const mnemo_t &mnemo) -> void {
+    if (mnemo.tag != mnemo_t::tag_t::Lea)
+        throw logic_error("Wrong mnemo!");
+
+    if (mnemo.a1.tag != mnemo_t::arg_t::tag_t::Register || mnemo.a2.tag != mnemo_t::arg_t::tag_t::Memory)
+        throw logic_error("Unsupported lea shape!");
+    if (mnemo.width == mnemo_t::width_t::Byte)
+        throw logic_error("Unsupported width! @ assemble_mnemo_lea");
+
+    assemble_memory_register_mnemos_template(out, mnemo, 0x8d, 0x8d);
+}
+
+// imul r, r/m       ; 0F AF /r
+// imul r, r/m, imm8 ; 6B /r ib
+// imul r, r/m, imm  ; 69 /r iw/id
+// `imul r, imm` is an alias for `imul r, r, imm`
+static auto assemble_mnemo_imul(code_buffer_t &out, const mnemo_t &mnemo) -> void {
+    if (mnemo.tag != mnemo_t::tag_t::Imul)
+        throw logic_error("Wrong mnemo!");
+
+    if (mnemo.a1.tag != mnemo_t::arg_t::tag_t::Register)
+        throw logic_error("Unsupported imul shape!");
+    if (mnemo.width == mnemo_t::width_t::Byte)
+        throw logic_error("Unsupported width! @ assemble_mnemo_imul");
+
+    u8 reg = reg_to_number(mnemo.a1.data.reg);
+
+    const mnemo_t::arg_t *rm_arg;
+    const mnemo_t::arg_t *imm_arg;
+    if (mnemo.a2.tag == mnemo_t::arg_t::tag_t::Immediate) {
+        rm_arg = &mnemo.a1;
+        imm_arg = &mnemo.a2;
+    } else {
+        rm_arg = &mnemo.a2;
+        imm_arg = mnemo.a3.tag == mnemo_t::arg_t::tag_t::Immediate ? &mnemo.a3 : nullptr;
+    }
+
+    if (rm_arg->tag == mnemo_t::arg_t::tag_t::Memory) {
+        push_ASOR_if_dword(out, rm_arg->data.memory);
+    }
+    push_operand_width_prefixes(out, mnemo.width);
+    if (imm_arg == nullptr) {
+        out.push_back(0x0f);
+        out.push_back(0xaf);
+        append_modrm_for_rm_arg(out, reg, *rm_arg);
+    } else if (can_be_sign_extended_from_8bits(imm_arg->data.imm)) {
+        out.push_back(0x6b);
+        append_modrm_for_rm_arg(out, reg, *rm_arg);
+        append_imm_upto_64(out, mnemo_t::width_t::Byte, imm_arg->data.imm);
+    } else {
+        out.push_back(0x69);
+        append_modrm_for_rm_arg(out, reg, *rm_arg);
+
+        mnemo_t::width_t width = mnemo.width;
+        assert_imm_not_larger_than_32_bits(width, imm_arg->data.imm, "multiply by", "assemble_mnemo_imul");
+        append_imm_upto_64(out, width, imm_arg->data.imm);
+    }
+}
+
+// `shl`, `shr` and `sar` only differ in their /digit value.
+// shl r/m, 1   ; D0/D1 /digit
+// shl r/m, cl  ; D2/D3 /digit
+// shl r/m, imm ; C0/C1 /digit ib
+static auto assemble_mnemo_shift_template(code_buffer_t &out, const mnemo_t &mnemo, u8 digit) -> void {
+    if (mnemo.a2.tag == mnemo_t::arg_t::tag_t::Register) {
+        if (mnemo.a2.data.reg != mnemo_t::arg_t::reg_t::Cl)
+            throw logic_error("Shift count register should be cl @ assemble_mnemo_shift_template");
+        assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, digit, 0xd2, 0xd3);
+    } else if (mnemo.a2.tag == mnemo_t::arg_t::tag_t::Immediate) {
+        if (mnemo.a2.data.imm == 1) {
+            assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, digit, 0xd0, 0xd1);
+        } else {
+            if (!can_be_encoded_in_8bits(mnemo.a2.data.imm))
+                throw logic_error("Shift count should fit in 8 bits @ assemble_mnemo_shift_template");
+            assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, digit, 0xc0, 0xc1);
+            append_imm_upto_64(out, mnemo_t::width_t::Byte, mnemo.a2.data.imm);
+        }
+    } else {
+        throw logic_error("Unsupported shift shape!");
     }
 }
 
 // `pop` operates similarly to `push` save for different opcodes and inability to accept immediate arguments.
 // Based on this, I can unify two functions under a template, where argument chooses what operation to encode.
 template<bool is_push>
-static auto assemble_mnemo_push_pop_template(vector<u8> &out, const mnemo_t &mnemo) -> void {
+static auto assemble_mnemo_push_pop_template(code_buffer_t &out, const mnemo_t &mnemo) -> void {
     if (is_push) {
         if (mnemo.tag != mnemo_t::tag_t::Push)
             throw logic_error("Wrong mnemo!");
@@ -574,7 +899,7 @@ static auto assemble_mnemo_push_pop_template(vector<u8> &out, const mnemo_t &mne
             if (result.sib_eh) {
                 out.push_back(result.sib);
             }
-            append_disp(out, mnemo.a1.data.memory.disp);
+            append_memory_disp(out, mnemo.a1.data.memory);
             break;
         }
         case mnemo_t::arg_t::tag_t::Immediate: {
@@ -597,138 +922,1235 @@ static auto assemble_mnemo_push_pop_template(vector<u8> &out, const mnemo_t &mne
     }
 }
 
-static auto assemble_mnemo(vector<u8> &out, const mnemo_t &mnemo) -> void {
-    mnemo.check_validity();
+static auto is_vector_register(mnemo_t::arg_t::reg_t reg) -> bool {
+    mnemo_t::width_t width = register_width(reg);
+    return width == mnemo_t::width_t::Xmmword || width == mnemo_t::width_t::Ymmword;
+}
 
-    switch (mnemo.tag) {
-        case mnemo_t::tag_t::Mov: {
-            assemble_mnemo_mov(out, mnemo);
-            break;
-        }
-        case mnemo_t::tag_t::Add: {
-            assemble_mnemo_add(out, mnemo);
-            break;
-        }
-        case mnemo_t::tag_t::Push: {
-            assemble_mnemo_push_pop_template<true>(out, mnemo);
-            break;
-        }
-        case mnemo_t::tag_t::Pop: {
-            assemble_mnemo_push_pop_template<false>(out, mnemo);
-            break;
-        }
-        case mnemo_t::tag_t::Ret: {
-            out.push_back(0xc3);
-            break;
-        }
+// Vector mnemos occupy a contiguous range of mnemo_t::tag_t, VEX encoded ones are at its end
+static auto is_vector_mnemo(mnemo_t::tag_t tag) -> bool {
+    return mnemo_t::tag_t::Movdqu <= tag && tag <= mnemo_t::tag_t::Vzeroupper;
+}
+
+static auto is_vex_mnemo(mnemo_t::tag_t tag) -> bool {
+    return mnemo_t::tag_t::Vmovdqu <= tag && tag <= mnemo_t::tag_t::Vzeroupper;
+}
+
+// Mnemos which move data between a general purpose register (or memory) and a vector register
+static auto is_vector_gpr_transfer_mnemo(mnemo_t::tag_t tag) -> bool {
+    switch (tag) {
+        case mnemo_t::tag_t::Movd:
+        case mnemo_t::tag_t::Movq:
+        case mnemo_t::tag_t::Vmovd:
+        case mnemo_t::tag_t::Vmovq:
+            return true;
         default:
-            throw logic_error("Unimplemented mnemo.tag!");
+            return false;
     }
 }
 
-namespace assembly {
-    auto assemble(const vector<mnemo_t> &mnemos) -> vector<u8> {
-        vector<u8> result{};
-        for (const mnemo_t &mnemo:mnemos) {
-            assemble_mnemo(result, mnemo);
-        }
-        return result;
+static auto is_broadcast_mnemo(mnemo_t::tag_t tag) -> bool {
+    return mnemo_t::tag_t::Vpbroadcastb <= tag && tag <= mnemo_t::tag_t::Vbroadcastsd;
+}
+
+static auto vector_encoding(mnemo_t::tag_t tag) -> vector_encoding_t {
+    switch (tag) {
+        case mnemo_t::tag_t::Movdqu:
+        case mnemo_t::tag_t::Vmovdqu:
+            return {simd_prefix_t::PF3, opcode_map_t::M0F, 0x6f, 0x7f, false};
+        case mnemo_t::tag_t::Movdqa:
+        case mnemo_t::tag_t::Vmovdqa:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x6f, 0x7f, false};
+        case mnemo_t::tag_t::Movups:
+        case mnemo_t::tag_t::Vmovups:
+            return {simd_prefix_t::None, opcode_map_t::M0F, 0x10, 0x11, false};
+        case mnemo_t::tag_t::Movaps:
+        case mnemo_t::tag_t::Vmovaps:
+            return {simd_prefix_t::None, opcode_map_t::M0F, 0x28, 0x29, false};
+        case mnemo_t::tag_t::Movd:
+        case mnemo_t::tag_t::Vmovd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x6e, 0x7e, false};
+        case mnemo_t::tag_t::Movq:
+        case mnemo_t::tag_t::Vmovq:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x6e, 0x7e, true};
+        case mnemo_t::tag_t::Paddb:
+        case mnemo_t::tag_t::Vpaddb:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xfc, 0x00, false};
+        case mnemo_t::tag_t::Paddw:
+        case mnemo_t::tag_t::Vpaddw:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xfd, 0x00, false};
+        case mnemo_t::tag_t::Paddd:
+        case mnemo_t::tag_t::Vpaddd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xfe, 0x00, false};
+        case mnemo_t::tag_t::Paddq:
+        case mnemo_t::tag_t::Vpaddq:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xd4, 0x00, false};
+        case mnemo_t::tag_t::Psubb:
+        case mnemo_t::tag_t::Vpsubb:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xf8, 0x00, false};
+        case mnemo_t::tag_t::Psubw:
+        case mnemo_t::tag_t::Vpsubw:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xf9, 0x00, false};
+        case mnemo_t::tag_t::Psubd:
+        case mnemo_t::tag_t::Vpsubd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xfa, 0x00, false};
+        case mnemo_t::tag_t::Psubq:
+        case mnemo_t::tag_t::Vpsubq:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xfb, 0x00, false};
+        case mnemo_t::tag_t::Pand:
+        case mnemo_t::tag_t::Vpand:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xdb, 0x00, false};
+        case mnemo_t::tag_t::Pandn:
+        case mnemo_t::tag_t::Vpandn:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xdf, 0x00, false};
+        case mnemo_t::tag_t::Por:
+        case mnemo_t::tag_t::Vpor:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xeb, 0x00, false};
+        case mnemo_t::tag_t::Pxor:
+        case mnemo_t::tag_t::Vpxor:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xef, 0x00, false};
+        case mnemo_t::tag_t::Pcmpeqb:
+        case mnemo_t::tag_t::Vpcmpeqb:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x74, 0x00, false};
+        case mnemo_t::tag_t::Pcmpeqw:
+        case mnemo_t::tag_t::Vpcmpeqw:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x75, 0x00, false};
+        case mnemo_t::tag_t::Pcmpeqd:
+        case mnemo_t::tag_t::Vpcmpeqd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x76, 0x00, false};
+        case mnemo_t::tag_t::Pcmpgtb:
+        case mnemo_t::tag_t::Vpcmpgtb:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x64, 0x00, false};
+        case mnemo_t::tag_t::Pcmpgtw:
+        case mnemo_t::tag_t::Vpcmpgtw:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x65, 0x00, false};
+        case mnemo_t::tag_t::Pcmpgtd:
+        case mnemo_t::tag_t::Vpcmpgtd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x66, 0x00, false};
+        case mnemo_t::tag_t::Pmovmskb:
+        case mnemo_t::tag_t::Vpmovmskb:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0xd7, 0x00, false};
+        case mnemo_t::tag_t::Pshufb:
+        case mnemo_t::tag_t::Vpshufb:
+            return {simd_prefix_t::P66, opcode_map_t::M0F38, 0x00, 0x00, false};
+        case mnemo_t::tag_t::Addps:
+        case mnemo_t::tag_t::Vaddps:
+            return {simd_prefix_t::None, opcode_map_t::M0F, 0x58, 0x00, false};
+        case mnemo_t::tag_t::Addpd:
+        case mnemo_t::tag_t::Vaddpd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x58, 0x00, false};
+        case mnemo_t::tag_t::Subps:
+        case mnemo_t::tag_t::Vsubps:
+            return {simd_prefix_t::None, opcode_map_t::M0F, 0x5c, 0x00, false};
+        case mnemo_t::tag_t::Subpd:
+        case mnemo_t::tag_t::Vsubpd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x5c, 0x00, false};
+        case mnemo_t::tag_t::Mulps:
+        case mnemo_t::tag_t::Vmulps:
+            return {simd_prefix_t::None, opcode_map_t::M0F, 0x59, 0x00, false};
+        case mnemo_t::tag_t::Mulpd:
+        case mnemo_t::tag_t::Vmulpd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F, 0x59, 0x00, false};
+        case mnemo_t::tag_t::Xorps:
+        case mnemo_t::tag_t::Vxorps:
+            return {simd_prefix_t::None, opcode_map_t::M0F, 0x57, 0x00, false};
+        case mnemo_t::tag_t::Vpbroadcastb:
+            return {simd_prefix_t::P66, opcode_map_t::M0F38, 0x78, 0x00, false};
+        case mnemo_t::tag_t::Vpbroadcastw:
+            return {simd_prefix_t::P66, opcode_map_t::M0F38, 0x79, 0x00, false};
+        case mnemo_t::tag_t::Vpbroadcastd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F38, 0x58, 0x00, false};
+        case mnemo_t::tag_t::Vpbroadcastq:
+            return {simd_prefix_t::P66, opcode_map_t::M0F38, 0x59, 0x00, false};
+        case mnemo_t::tag_t::Vbroadcastss:
+            return {simd_prefix_t::P66, opcode_map_t::M0F38, 0x18, 0x00, false};
+        case mnemo_t::tag_t::Vbroadcastsd:
+            return {simd_prefix_t::P66, opcode_map_t::M0F38, 0x19, 0x00, false};
+        case mnemo_t::tag_t::Vzeroupper:
+            return {simd_prefix_t::None, opcode_map_t::M0F, 0x77, 0x00, false};
+        default:
+            throw logic_error("Not a vector mnemo @ vector_encoding");
     }
+}
 
-    mnemo_t::arg_t mnemo_t::arg_t::imm(imm_t imm) {
-        return {
-                .tag=tag_t::Immediate,
-                .data {.imm = imm},
-        };
+// Encodes both legacy SSE and VEX mnemos.
+//
+// Operand Encoding variants are:
+// RM  - `paddd xmm1, xmm2/m128`, `pmovmskb r32, xmm1`
+// MR  - `movdqu m128, xmm1`, `movd r/m32, xmm1` (only mnemos with a store opcode)
+// RVM - `vpaddd ymm1, ymm2, ymm3/m256` (VEX only, second operand goes to VEX.vvvv)
+static auto assemble_mnemo_vector(code_buffer_t &out, const mnemo_t &mnemo) -> void {
+    bool is_vex = is_vex_mnemo(mnemo.tag);
+    vector_encoding_t encoding = vector_encoding(mnemo.tag);
+    bool l = mnemo.width == mnemo_t::width_t::Ymmword;
+
+    // movq xmm1, xmm2 ; F3 0F 7E /r, zeroes the upper half of xmm1
+    if ((mnemo.tag == mnemo_t::tag_t::Movq || mnemo.tag == mnemo_t::tag_t::Vmovq) &&
+        mnemo.a1.tag == mnemo_t::arg_t::tag_t::Register && is_vector_register(mnemo.a1.data.reg) &&
+        mnemo.a2.tag == mnemo_t::arg_t::tag_t::Register && is_vector_register(mnemo.a2.data.reg))
+        encoding = {simd_prefix_t::PF3, opcode_map_t::M0F, 0x7e, 0x00, false};
+
+    if (mnemo.tag == mnemo_t::tag_t::Vzeroupper) {
+        push_vex_prefix_and_opcode(out, encoding, 0, false, encoding.load_opcode);
+        return;
     }
 
-    mnemo_t::arg_t mnemo_t::arg_t::reg(mnemo_t::arg_t::reg_t reg) {
-        arg_t o{};
-        o.tag = tag_t::Register;
-        o.data.reg = reg;
-        return o;
+    const mnemo_t::arg_t *register_arg;
+    const mnemo_t::arg_t *rm_arg;
+    u8 vvvv = 0;
+    u8 opcode;
+    if (mnemo.get_arity() == 3) {
+        // RVM
+        if (mnemo.a2.tag != mnemo_t::arg_t::tag_t::Register)
+            throw logic_error("Second operand of a three-operand mnemo should be a register @ assemble_mnemo_vector");
+        register_arg = &mnemo.a1;
+        vvvv = reg_to_number(mnemo.a2.data.reg);
+        rm_arg = &mnemo.a3;
+        opcode = encoding.load_opcode;
+    } else if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Memory ||
+               (is_vector_gpr_transfer_mnemo(mnemo.tag) && mnemo.a1.tag == mnemo_t::arg_t::tag_t::Register &&
+                !is_vector_register(mnemo.a1.data.reg))) {
+        // MR
+        if (encoding.store_opcode == 0x00)
+            throw logic_error("Mnemo can not store to memory @ assemble_mnemo_vector");
+        register_arg = &mnemo.a2;
+        rm_arg = &mnemo.a1;
+        opcode = encoding.store_opcode;
+    } else {
+        // RM
+        register_arg = &mnemo.a1;
+        rm_arg = &mnemo.a2;
+        opcode = encoding.load_opcode;
     }
 
-    mnemo_t::arg_t mnemo_t::arg_t::mem(mnemo_t::arg_t::reg_t base, mnemo_t::arg_t::reg_t index,
-                                       mnemo_t::arg_t::memory_t::scale_t scale, disp_t disp) {
-        // If scale is S0, the index register should be Undef
-        if (scale == mnemo_t::arg_t::memory_t::scale_t::S0 && index != mnemo_t::arg_t::reg_t::Undef)
-            throw logic_error("if scale is S0, the index register should be Undef");
+    if (register_arg->tag != mnemo_t::arg_t::tag_t::Register)
+        throw logic_error("Unsupported vector mnemo shape @ assemble_mnemo_vector");
+    if ((mnemo.tag == mnemo_t::tag_t::Pmovmskb || mnemo.tag == mnemo_t::tag_t::Vpmovmskb) &&
+        rm_arg->tag != mnemo_t::arg_t::tag_t::Register)
+        throw logic_error("pmovmskb only accepts a register source @ assemble_mnemo_vector");
 
-        arg_t o{};
-        o.tag = tag_t::Memory;
-        o.data.memory = {
-                .base=base,
-                .index=index,
-                .scale=scale,
-                .disp=disp,
-        };
-        return o;
+    u8 reg = reg_to_number(register_arg->data.reg);
+
+    if (rm_arg->tag == mnemo_t::arg_t::tag_t::Memory) {
+        push_ASOR_if_dword(out, rm_arg->data.memory);
     }
+    if (is_vex) {
+        push_vex_prefix_and_opcode(out, encoding, vvvv, l, opcode);
+    } else {
+        push_legacy_simd_prefixes_and_opcode(out, encoding, opcode);
+    }
+    append_modrm_for_rm_arg(out, reg, *rm_arg);
+}
 
-    auto mnemo_t::arg_t::print() const -> void {
-        switch (this->tag) {
-            case tag_t::Immediate:
-                cout << this->data.imm;
-                break;
-            case tag_t::Register:
-                print_reg(this->data.reg);
-                break;
-            case tag_t::Memory:
-                cout << "[";
+// popcnt r, r/m ; F3 0F B8 /r
+// lzcnt r, r/m  ; F3 0F BD /r
+// tzcnt r, r/m  ; F3 0F BC /r
+// F3 is a mandatory prefix and goes after the operand-size override but before REX.
+static auto assemble_mnemo_bit_count(code_buffer_t &out, const mnemo_t &mnemo, u8 opcode) -> void {
+    if (mnemo.a1.tag != mnemo_t::arg_t::tag_t::Register)
+        throw logic_error("Unsupported bit count mnemo shape!");
+    if (mnemo.width == mnemo_t::width_t::Byte)
+        throw logic_error("Unsupported width! @ assemble_mnemo_bit_count");
+
+    if (mnemo.a2.tag == mnemo_t::arg_t::tag_t::Memory) {
+        push_ASOR_if_dword(out, mnemo.a2.data.memory);
+    }
+    push_OSOR_if_word(out, mnemo.width);
+    out.push_back(0xf3);
+    push_rex_if_qword(out, mnemo.width);
+    out.push_back(0x0f);
+    out.push_back(opcode);
+    append_modrm_for_rm_arg(out, reg_to_number(mnemo.a1.data.reg), mnemo.a2);
+}
 
-                print_reg(this->data.memory.base);
+// Operand order of VEX encoded general purpose mnemos
+enum class bmi_operands_t {
+    RVM, // andn r, r(vvvv), r/m
+    RMV, // bextr r, r/m, r(vvvv)
+    VM, // blsr r(vvvv), r/m ; reg field of ModR/M holds /digit
+};
 
-                // Print index with scale if there is one
-                if (this->data.memory.scale != memory_t::scale_t::S0) {
-                    cout << " + ";
+struct bmi_encoding_t {
+    vector_encoding_t vex;
+    bmi_operands_t operands;
+    u8 digit;
+};
 
-                    print_reg(this->data.memory.index);
+static auto bmi_encoding(mnemo_t::tag_t tag) -> bmi_encoding_t {
+    switch (tag) {
+        case mnemo_t::tag_t::Andn:
+            return {{simd_prefix_t::None, opcode_map_t::M0F38, 0xf2, 0x00, false}, bmi_operands_t::RVM, 0};
+        case mnemo_t::tag_t::Bextr:
+            return {{simd_prefix_t::None, opcode_map_t::M0F38, 0xf7, 0x00, false}, bmi_operands_t::RMV, 0};
+        case mnemo_t::tag_t::Blsr:
+            return {{simd_prefix_t::None, opcode_map_t::M0F38, 0xf3, 0x00, false}, bmi_operands_t::VM, 1};
+        case mnemo_t::tag_t::Blsmsk:
+            return {{simd_prefix_t::None, opcode_map_t::M0F38, 0xf3, 0x00, false}, bmi_operands_t::VM, 2};
+        case mnemo_t::tag_t::Blsi:
+            return {{simd_prefix_t::None, opcode_map_t::M0F38, 0xf3, 0x00, false}, bmi_operands_t::VM, 3};
+        case mnemo_t::tag_t::Bzhi:
+            return {{simd_prefix_t::None, opcode_map_t::M0F38, 0xf5, 0x00, false}, bmi_operands_t::RMV, 0};
+        case mnemo_t::tag_t::Pdep:
+            return {{simd_prefix_t::PF2, opcode_map_t::M0F38, 0xf5, 0x00, false}, bmi_operands_t::RVM, 0};
+        case mnemo_t::tag_t::Pext:
+            return {{simd_prefix_t::PF3, opcode_map_t::M0F38, 0xf5, 0x00, false}, bmi_operands_t::RVM, 0};
+        case mnemo_t::tag_t::Shlx:
+            return {{simd_prefix_t::P66, opcode_map_t::M0F38, 0xf7, 0x00, false}, bmi_operands_t::RMV, 0};
+        case mnemo_t::tag_t::Shrx:
+            return {{simd_prefix_t::PF2, opcode_map_t::M0F38, 0xf7, 0x00, false}, bmi_operands_t::RMV, 0};
+        case mnemo_t::tag_t::Sarx:
+            return {{simd_prefix_t::PF3, opcode_map_t::M0F38, 0xf7, 0x00, false}, bmi_operands_t::RMV, 0};
+        default:
+            throw logic_error("Not a BMI mnemo @ bmi_encoding");
+    }
+}
 
-                    // Print scale if it is not S1
-                    if (this->data.memory.scale != memory_t::scale_t::S1) {
-                        cout << " * ";
+// BMI1/BMI2 mnemos are VEX encoded with L = 0 and VEX.W selecting 64 bit operand size
+static auto assemble_mnemo_bmi(code_buffer_t &out, const mnemo_t &mnemo) -> void {
+    if (mnemo.width != mnemo_t::width_t::Dword && mnemo.width != mnemo_t::width_t::Qword)
+        throw logic_error("Unsupported width! @ assemble_mnemo_bmi");
+
+    bmi_encoding_t encoding = bmi_encoding(mnemo.tag);
+    encoding.vex.w = mnemo.width == mnemo_t::width_t::Qword;
+
+    const mnemo_t::arg_t *vvvv_arg;
+    const mnemo_t::arg_t *rm_arg;
+    u8 reg;
+    switch (encoding.operands) {
+        case bmi_operands_t::RVM:
+            if (mnemo.a1.tag != mnemo_t::arg_t::tag_t::Register)
+                throw logic_error("Unsupported BMI mnemo shape!");
+            reg = reg_to_number(mnemo.a1.data.reg);
+            vvvv_arg = &mnemo.a2;
+            rm_arg = &mnemo.a3;
+            break;
+        case bmi_operands_t::RMV:
+            if (mnemo.a1.tag != mnemo_t::arg_t::tag_t::Register)
+                throw logic_error("Unsupported BMI mnemo shape!");
+            reg = reg_to_number(mnemo.a1.data.reg);
+            rm_arg = &mnemo.a2;
+            vvvv_arg = &mnemo.a3;
+            break;
+        case bmi_operands_t::VM:
+            reg = encoding.digit;
+            vvvv_arg = &mnemo.a1;
+            rm_arg = &mnemo.a2;
+            break;
+    }
+    if (vvvv_arg->tag != mnemo_t::arg_t::tag_t::Register)
+        throw logic_error("Unsupported BMI mnemo shape!");
 
-                        switch (this->data.memory.scale) {
-                            case memory_t::scale_t::S1:
-                                cout << "1";
-                                break;
-                            case memory_t::scale_t::S2:
-                                cout << "2";
-                                break;
-                            case memory_t::scale_t::S4:
-                                cout << "4";
-                                break;
-                            case memory_t::scale_t::S8:
-                                cout << "8";
-                                break;
-                            default:
-                                throw logic_error("unreachable");
-                        }
-                    }
-                }
+    if (rm_arg->tag == mnemo_t::arg_t::tag_t::Memory) {
+        push_ASOR_if_dword(out, rm_arg->data.memory);
+    }
+    push_vex_prefix_and_opcode(out, encoding.vex, reg_to_number(vvvv_arg->data.reg), false, encoding.vex.load_opcode);
+    append_modrm_for_rm_arg(out, reg, *rm_arg);
+}
 
-                // Print disp if it is not zero
-                if (this->data.memory.disp != 0) {
-                    if (this->data.memory.disp > 0)
-                        cout << " + ";
-                    else
-                        cout << " - ";
-                    cout << abs(this->data.memory.disp);
-                }
-                cout << "]";
-                break;
-            default:
-                throw logic_error("unreachable");
-        }
+// cmovcc r, r/m ; 0F 40+cc /r
+static auto assemble_mnemo_cmovcc(code_buffer_t &out, const mnemo_t &mnemo) -> void {
+    if (mnemo.a1.tag != mnemo_t::arg_t::tag_t::Register)
+        throw logic_error("Unsupported cmovcc shape!");
+    if (mnemo.width == mnemo_t::width_t::Byte)
+        throw logic_error("Unsupported width! @ assemble_mnemo_cmovcc");
+
+    if (mnemo.a2.tag == mnemo_t::arg_t::tag_t::Memory) {
+        push_ASOR_if_dword(out, mnemo.a2.data.memory);
     }
+    push_operand_width_prefixes(out, mnemo.width);
+    out.push_back(0x0f);
+    out.push_back(0x40 + u8(mnemo.cond));
+    append_modrm_for_rm_arg(out, reg_to_number(mnemo.a1.data.reg), mnemo.a2);
+}
 
-    auto mnemo_t::arg_t::print_reg(reg_t reg) -> void {
-        switch (reg) {
-            case reg_t::Al:
-                cout << "al";
-                break;
-            case reg_t::Bl:
+// setcc r/m8 ; 0F 90+cc /0
+static auto assemble_mnemo_setcc(code_buffer_t &out, const mnemo_t &mnemo) -> void {
+    if (mnemo.width != mnemo_t::width_t::Byte)
+        throw logic_error("Unsupported width! @ assemble_mnemo_setcc");
+
+    if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Memory) {
+        push_ASOR_if_dword(out, mnemo.a1.data.memory);
+    }
+    out.push_back(0x0f);
+    out.push_back(0x90 + u8(mnemo.cond));
+    append_modrm_for_rm_arg(out, 0, mnemo.a1);
+}
+
+// jmp r/m64  ; FF /4
+// call r/m64 ; FF /2
+// Operand size is always 64 bits, so no REX.W is needed.
+static auto assemble_mnemo_indirect_branch(code_buffer_t &out, const mnemo_t &mnemo, u8 digit) -> void {
+    if (mnemo.width != mnemo_t::width_t::Qword)
+        throw logic_error("Unsupported width! @ assemble_mnemo_indirect_branch");
+
+    if (mnemo.a1.tag == mnemo_t::arg_t::tag_t::Memory) {
+        push_ASOR_if_dword(out, mnemo.a1.data.memory);
+    }
+    out.push_back(0xff);
+    append_modrm_for_rm_arg(out, digit, mnemo.a1);
+}
+
+// True for branches whose target is a label. These are encoded by `assemble_detailed` once layout is known.
+static auto is_label_branch(const mnemo_t &mnemo) -> bool {
+    switch (mnemo.tag) {
+        case mnemo_t::tag_t::Jmp:
+        case mnemo_t::tag_t::Jcc:
+        case mnemo_t::tag_t::Call:
+        case mnemo_t::tag_t::Loop:
+            return mnemo.a1.tag == mnemo_t::arg_t::tag_t::Label;
+        default:
+            return false;
+    }
+}
+
+// `call` only has a rel32 form and `loop` only has a rel8 form
+static auto has_short_branch_form(const mnemo_t &mnemo) -> bool {
+    return mnemo.tag != mnemo_t::tag_t::Call;
+}
+
+static auto has_long_branch_form(const mnemo_t &mnemo) -> bool {
+    return mnemo.tag != mnemo_t::tag_t::Loop;
+}
+
+static auto branch_size(const mnemo_t &mnemo, bool is_short) -> u64 {
+    switch (mnemo.tag) {
+        case mnemo_t::tag_t::Jmp:
+            return is_short ? 2 : 5;
+        case mnemo_t::tag_t::Jcc:
+            return is_short ? 2 : 6;
+        case mnemo_t::tag_t::Call:
+            return 5;
+        case mnemo_t::tag_t::Loop:
+            return 2;
+        default:
+            throw logic_error("Not a branch @ branch_size");
+    }
+}
+
+// jmp rel8  ; EB cb
+// jmp rel32 ; E9 cd
+// jcc rel8  ; 70+cc cb
+// jcc rel32 ; 0F 80+cc cd
+// call rel32 ; E8 cd
+// loop rel8 ; E2 cb
+// `disp` is relative to the end of the branch.
+template<typename out_t>
+static auto assemble_label_branch(out_t &out, const mnemo_t &mnemo, bool is_short, i32 disp) -> void {
+    switch (mnemo.tag) {
+        case mnemo_t::tag_t::Jmp:
+            out.push_back(is_short ? 0xeb : 0xe9);
+            break;
+        case mnemo_t::tag_t::Jcc:
+            if (is_short) {
+                out.push_back(0x70 + u8(mnemo.cond));
+            } else {
+                out.push_back(0x0f);
+                out.push_back(0x80 + u8(mnemo.cond));
+            }
+            break;
+        case mnemo_t::tag_t::Call:
+            out.push_back(0xe8);
+            break;
+        case mnemo_t::tag_t::Loop:
+            out.push_back(0xe2);
+            break;
+        default:
+            throw logic_error("Not a branch @ assemble_label_branch");
+    }
+    append_imm_upto_64(out, is_short ? mnemo_t::width_t::Byte : mnemo_t::width_t::Dword, disp);
+}
+
+// Multi-byte NOP forms recommended by Intel SDM (NOP instruction reference), i-th form is i bytes long
+static constexpr u8 nop_forms[10][9] = {
+        {},
+        {0x90},
+        {0x66, 0x90},
+        {0x0f, 0x1f, 0x00},
+        {0x0f, 0x1f, 0x40, 0x00},
+        {0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+        {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+        {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+// Appends `size` bytes of NOPs. Padding longer than 9 bytes is split into 9 byte NOPs.
+template<typename out_t>
+static auto append_nop_padding(out_t &out, u64 size) -> void {
+    for (; size > 0;) {
+        u64 chunk = min<u64>(size, 9);
+        out.insert(out.end(), nop_forms[chunk], nop_forms[chunk] + chunk);
+        size -= chunk;
+    }
+}
+
+static auto is_power_of_two(u64 n) -> bool {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+// Number of padding bytes needed to move `offset` to a multiple of `alignment`
+static auto padding_to_alignment(u64 offset, u64 alignment) -> u64 {
+    return (alignment - offset % alignment) % alignment;
+}
+
+// Returns the memory argument of a mnemo that refers to a constant pool entry, nullptr if there is none
+static auto constant_memory_arg(const mnemo_t &mnemo) -> const mnemo_t::arg_t * {
+    for (const mnemo_t::arg_t *arg: {&mnemo.a1, &mnemo.a2, &mnemo.a3}) {
+        if (arg->tag == mnemo_t::arg_t::tag_t::Memory && arg->data.memory.constant != 0)
+            return arg;
+    }
+    return nullptr;
+}
+
+// Mnemos with counter probes inserted by `insert_probes`
+struct probed_mnemos_t {
+    vector<mnemo_t> mnemos;
+    // Counter that the RIP-relative operand of i-th mnemo refers to, -1 if none
+    vector<i64> counter_indices;
+    // Index of the input mnemo that i-th mnemo is or counts
+    vector<u64> origins;
+    u64 counter_count;
+};
+
+// Appends a probe which increments `counter` before input mnemo `origin`. Flags and registers are preserved: the
+// probe only uses `mov` and `lea`, and `rax` is saved below the red zone.
+static auto append_probe(probed_mnemos_t &out, u64 counter, u64 origin) -> void {
+    typedef mnemo_t::arg_t arg_t;
+    typedef mnemo_t::arg_t::reg_t reg_t;
+    arg_t counter_arg = arg_t::mem(reg_t::Rip, reg_t::Undef, arg_t::memory_t::scale_t::S0, 0);
+    auto lea = [](reg_t reg, disp_t disp) -> mnemo_t {
+        return {
+                .tag = mnemo_t::tag_t::Lea,
+                .width = mnemo_t::width_t::Qword,
+                .a1 = arg_t::reg(reg),
+                .a2 = arg_t::mem(reg, reg_t::Undef, arg_t::memory_t::scale_t::S0, disp),
+        };
+    };
+    const mnemo_t probe[] = {
+            lea(reg_t::Rsp, -128),
+            {.tag = mnemo_t::tag_t::Push, .width = mnemo_t::width_t::Qword, .a1 = arg_t::reg(reg_t::Rax)},
+            {.tag = mnemo_t::tag_t::Mov, .width = mnemo_t::width_t::Qword, .a1 = arg_t::reg(reg_t::Rax),
+             .a2 = counter_arg},
+            lea(reg_t::Rax, 1),
+            {.tag = mnemo_t::tag_t::Mov, .width = mnemo_t::width_t::Qword, .a1 = counter_arg,
+             .a2 = arg_t::reg(reg_t::Rax)},
+            {.tag = mnemo_t::tag_t::Pop, .width = mnemo_t::width_t::Qword, .a1 = arg_t::reg(reg_t::Rax)},
+            lea(reg_t::Rsp, 128),
+    };
+    for (const mnemo_t &mnemo: probe) {
+        out.mnemos.push_back(mnemo);
+        bool uses_counter = mnemo.tag == mnemo_t::tag_t::Mov;
+        out.counter_indices.push_back(uses_counter ? i64(counter) : -1);
+        out.origins.push_back(origin);
+    }
+}
+
+// Labels and alignment only mark a position, probes go after them so that branches execute the probe
+static auto is_position_mnemo(const mnemo_t &mnemo) -> bool {
+    return mnemo.tag == mnemo_t::tag_t::Label || mnemo.tag == mnemo_t::tag_t::Align;
+}
+
+static auto insert_probes(const vector<mnemo_t> &mnemos, instrument_t mode) -> probed_mnemos_t {
+    // Counter incremented before i-th mnemo, -1 if none
+    vector<i64> probe_counters(mnemos.size(), -1);
+    u64 counter_count = 0;
+    if (mode == instrument_t::Blocks) {
+        vector<layout::basic_block_t> blocks = layout::split_basic_blocks(mnemos);
+        counter_count = blocks.size();
+        for (u64 i = 0; i < blocks.size(); i++) {
+            u64 first = blocks[i].begin;
+            while (first < blocks[i].end && is_position_mnemo(mnemos[first]))
+                first++;
+            if (first < blocks[i].end)
+                probe_counters[first] = i64(i);
+        }
+    } else {
+        counter_count = mnemos.size();
+        for (u64 i = 0; i < mnemos.size(); i++) {
+            if (!is_position_mnemo(mnemos[i]))
+                probe_counters[i] = i64(i);
+        }
+    }
+
+    probed_mnemos_t result{.counter_count = counter_count};
+    for (u64 i = 0; i < mnemos.size(); i++) {
+        if (probe_counters[i] >= 0)
+            append_probe(result, u64(probe_counters[i]), i);
+        result.mnemos.push_back(mnemos[i]);
+        result.counter_indices.push_back(-1);
+        result.origins.push_back(i);
+    }
+    return result;
+}
+
+static auto assemble_mnemo(code_buffer_t &out, const mnemo_t &mnemo) -> void {
+    mnemo.check_validity();
+
+    switch (mnemo.tag) {
+        case mnemo_t::tag_t::Mov: {
+            assemble_mnemo_mov(out, mnemo);
+            break;
+        }
+        case mnemo_t::tag_t::Add: {
+            assemble_mnemo_alu_template(out, mnemo, 0, "add");
+            break;
+        }
+        case mnemo_t::tag_t::Or: {
+            assemble_mnemo_alu_template(out, mnemo, 1, "or");
+            break;
+        }
+        case mnemo_t::tag_t::And: {
+            assemble_mnemo_alu_template(out, mnemo, 4, "and");
+            break;
+        }
+        case mnemo_t::tag_t::Sub: {
+            assemble_mnemo_alu_template(out, mnemo, 5, "sub");
+            break;
+        }
+        case mnemo_t::tag_t::Xor: {
+            assemble_mnemo_alu_template(out, mnemo, 6, "xor");
+            break;
+        }
+        case mnemo_t::tag_t::Cmp: {
+            assemble_mnemo_alu_template(out, mnemo, 7, "cmp");
+            break;
+        }
+        case mnemo_t::tag_t::Test: {
+            assemble_mnemo_test(out, mnemo);
+            break;
+        }
+        case mnemo_t::tag_t::Lea: {
+            assemble_mnemo_lea(out, mnemo);
+            break;
+        }
+        case mnemo_t::tag_t::Imul: {
+            assemble_mnemo_imul(out, mnemo);
+            break;
+        }
+        case mnemo_t::tag_t::Shl: {
+            assemble_mnemo_shift_template(out, mnemo, 4);
+            break;
+        }
+        case mnemo_t::tag_t::Shr: {
+            assemble_mnemo_shift_template(out, mnemo, 5);
+            break;
+        }
+        case mnemo_t::tag_t::Sar: {
+            assemble_mnemo_shift_template(out, mnemo, 7);
+            break;
+        }
+        case mnemo_t::tag_t::Inc: {
+            assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, 0, 0xfe, 0xff);
+            break;
+        }
+        case mnemo_t::tag_t::Dec: {
+            assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, 1, 0xfe, 0xff);
+            break;
+        }
+        case mnemo_t::tag_t::Not: {
+            assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, 2, 0xf6, 0xf7);
+            break;
+        }
+        case mnemo_t::tag_t::Neg: {
+            assemble_digit_mnemos_template(out, mnemo.width, mnemo.a1, 3, 0xf6, 0xf7);
+            break;
+        }
+        case mnemo_t::tag_t::Push: {
+            assemble_mnemo_push_pop_template<true>(out, mnemo);
+            break;
+        }
+        case mnemo_t::tag_t::Pop: {
+            assemble_mnemo_push_pop_template<false>(out, mnemo);
+            break;
+        }
+        case mnemo_t::tag_t::Ret: {
+            out.push_back(0xc3);
+            break;
+        }
+        case mnemo_t::tag_t::Popcnt: {
+            assemble_mnemo_bit_count(out, mnemo, 0xb8);
+            break;
+        }
+        case mnemo_t::tag_t::Lzcnt: {
+            assemble_mnemo_bit_count(out, mnemo, 0xbd);
+            break;
+        }
+        case mnemo_t::tag_t::Tzcnt: {
+            assemble_mnemo_bit_count(out, mnemo, 0xbc);
+            break;
+        }
+        case mnemo_t::tag_t::Andn:
+        case mnemo_t::tag_t::Bextr:
+        case mnemo_t::tag_t::Blsr:
+        case mnemo_t::tag_t::Blsi:
+        case mnemo_t::tag_t::Blsmsk:
+        case mnemo_t::tag_t::Bzhi:
+        case mnemo_t::tag_t::Pdep:
+        case mnemo_t::tag_t::Pext:
+        case mnemo_t::tag_t::Shlx:
+        case mnemo_t::tag_t::Shrx:
+        case mnemo_t::tag_t::Sarx: {
+            assemble_mnemo_bmi(out, mnemo);
+            break;
+        }
+        case mnemo_t::tag_t::Cmovcc: {
+            assemble_mnemo_cmovcc(out, mnemo);
+            break;
+        }
+        case mnemo_t::tag_t::Setcc: {
+            assemble_mnemo_setcc(out, mnemo);
+            break;
+        }
+        case mnemo_t::tag_t::Jmp: {
+            assemble_mnemo_indirect_branch(out, mnemo, 4);
+            break;
+        }
+        case mnemo_t::tag_t::Call: {
+            assemble_mnemo_indirect_branch(out, mnemo, 2);
+            break;
+        }
+        case mnemo_t::tag_t::Jcc:
+        case mnemo_t::tag_t::Loop:
+            throw logic_error("jcc and loop only accept label targets");
+        case mnemo_t::tag_t::Label:
+        case mnemo_t::tag_t::Align:
+            throw logic_error("labels and alignment are laid out by assemble_detailed");
+        default:
+            if (is_vector_mnemo(mnemo.tag)) {
+                assemble_mnemo_vector(out, mnemo);
+                break;
+            }
+            throw logic_error("Unimplemented mnemo.tag!");
+    }
+}
+
+namespace assembly {
+    // Labels live in a fixed size open addressing table whose entries are never removed, so names that are already
+    // interned are found without locking and memory stays bounded. Only inserts take `label_mutex`.
+    static constexpr u64 label_capacity = 1 << 18;
+
+    // At most half of the slots are used, so probe sequences stay short
+    static constexpr u64 label_slot_count = 2 * label_capacity;
+
+    struct label_entry_t {
+        string name;
+        label_t label;
+    };
+
+    static mutex label_mutex;
+    static atomic<const label_entry_t *> label_slots[label_slot_count];
+    static atomic<const label_entry_t *> label_entries[label_capacity];
+    static atomic<u64> label_count;
+
+    auto intern_label(const string &name) -> label_t {
+        u64 first_slot = hash<string>{}(name) % label_slot_count;
+        auto find = [&](u64 &slot) -> const label_entry_t * {
+            for (slot = first_slot;; slot = (slot + 1) % label_slot_count) {
+                const label_entry_t *entry = label_slots[slot].load(memory_order_acquire);
+                if (entry == nullptr || entry->name == name)
+                    return entry;
+            }
+        };
+
+        u64 slot;
+        if (const label_entry_t *entry = find(slot))
+            return entry->label;
+
+        lock_guard<mutex> lock(label_mutex);
+        // Another thread may have inserted the name since the lookup
+        if (const label_entry_t *entry = find(slot))
+            return entry->label;
+        u64 count = label_count.load(memory_order_relaxed);
+        if (count == label_capacity)
+            throw runtime_error("too many distinct labels @ intern_label");
+        auto *entry = new label_entry_t{name, label_t(count)};
+        label_entries[count].store(entry, memory_order_release);
+        label_count.store(count + 1, memory_order_release);
+        label_slots[slot].store(entry, memory_order_release);
+        return entry->label;
+    }
+
+    auto label_name(label_t label) -> string {
+        if (label >= label_count.load(memory_order_acquire))
+            throw logic_error("unknown label @ label_name");
+        return label_entries[label].load(memory_order_acquire)->name;
+    }
+
+    static mutex constant_mutex;
+    static map<vector<u8>, constant_t> constant_ids;
+    static vector<vector<u8>> constant_values = {{}}; // Constant 0 is reserved
+
+    auto intern_constant(const vector<u8> &bytes) -> constant_t {
+        if (bytes.size() != 8 && bytes.size() != 16 && bytes.size() != 32)
+            throw logic_error("constant should be 8, 16 or 32 bytes @ intern_constant");
+        lock_guard<mutex> lock(constant_mutex);
+        auto it = constant_ids.find(bytes);
+        if (it != constant_ids.end())
+            return it->second;
+        auto constant = constant_t(constant_values.size());
+        constant_ids.emplace(bytes, constant);
+        constant_values.push_back(bytes);
+        return constant;
+    }
+
+    // Bytes of a constant never move once interned, even when `constant_values` grows, so the span stays valid after
+    // the lock is released
+    auto constant_span(constant_t constant) -> span<const u8> {
+        lock_guard<mutex> lock(constant_mutex);
+        if (constant == 0 || constant >= constant_values.size())
+            throw logic_error("unknown constant @ constant_span");
+        return constant_values[constant];
+    }
+
+    auto assemble(const vector<mnemo_t> &mnemos) -> vector<u8> {
+        return assemble_detailed(mnemos).code;
+    }
+
+    // Assembles mnemos, resolves branches to labels and inserts alignment padding.
+    //
+    // Branch relaxation starts with every branch in its short (rel8) form where one exists and
+    // iteratively grows branches whose displacement does not fit in 8 bits to rel32.
+    // Branches only ever grow, so the layout converges even though alignment padding may shrink.
+    //
+    // Constants referenced by `[const ...]` operands are placed after the code, each once, and their RIP-relative
+    // displacements are fixed up after the layout is known. Counters of probes follow the constants.
+    //
+    // `counter_indices` is empty without instrumentation, otherwise i-th mnemo refers to that counter.
+    //
+    // Code goes to `code`, a std or pmr vector of bytes, and temporaries are allocated from `resource`. Everything
+    // else is reported in `details`; without it labels are not recorded, and relocatable code and source maps are
+    // not supported.
+    template<typename code_t>
+    static auto assemble_with_counters(span<const mnemo_t> mnemos, const vector<i64> &counter_indices,
+                                       u64 counter_count, const assemble_options &options,
+                                       pmr::memory_resource *resource, code_t &code,
+                                       assemble_result *details) -> void {
+        if (details == nullptr && (options.relocatable || options.source_map))
+            throw logic_error("relocatable code and source maps are only reported by assemble_detailed");
+
+        // Mnemos other than labels, label branches and alignment do not depend on layout, so they are encoded once.
+        // Bytes of i-th mnemo are at [encoded_offsets[i], encoded_offsets[i + 1]) in `encoded`.
+        code_buffer_t encoded(resource);
+        pmr::vector<u64> encoded_offsets(mnemos.size() + 1, resource);
+        pmr::vector<bool> is_short(mnemos.size(), false, resource);
+        // Maps a label to index of the mnemo that defines it
+        pmr::unordered_map<label_t, u64> label_indices(resource);
+        // disp32 at `disp_position` in `encoded` should point at `constant` + `disp`
+        struct constant_fixup_t {
+            u64 mnemo_index;
+            u64 disp_position;
+            constant_t constant;
+            disp_t disp;
+        };
+        pmr::vector<constant_fixup_t> constant_fixups(resource);
+        // disp32 at `disp_position` in `encoded` should point at `counter`
+        struct counter_fixup_t {
+            u64 mnemo_index;
+            u64 disp_position;
+            u64 counter;
+        };
+        pmr::vector<counter_fixup_t> counter_fixups(resource);
+
+        for (u64 i = 0; i < mnemos.size(); i++) {
+            const mnemo_t &mnemo = mnemos[i];
+            encoded_offsets[i] = encoded.size();
+            if (mnemo.tag == mnemo_t::tag_t::Label) {
+                mnemo.check_validity();
+                if (mnemo.a1.tag != mnemo_t::arg_t::tag_t::Label)
+                    throw logic_error("label mnemo should have a label argument");
+                if (!label_indices.emplace(mnemo.a1.data.label, i).second)
+                    throw logic_error("label \"" + label_name(mnemo.a1.data.label) + "\" is defined twice");
+            } else if (mnemo.tag == mnemo_t::tag_t::Align) {
+                mnemo.check_validity();
+                if (mnemo.a1.tag != mnemo_t::arg_t::tag_t::Immediate || !is_power_of_two(u64(mnemo.a1.data.imm)))
+                    throw logic_error("align argument should be a power of two");
+            } else if (is_label_branch(mnemo)) {
+                mnemo.check_validity();
+                is_short[i] = has_short_branch_form(mnemo);
+            } else {
+                encoded.rip_disp_position = -1;
+                assemble_mnemo(encoded, mnemo);
+                if (const mnemo_t::arg_t *arg = constant_memory_arg(mnemo)) {
+                    if (encoded.rip_disp_position < 0)
+                        throw logic_error("constant operand was not encoded RIP-relative");
+                    constant_fixups.push_back({i, u64(encoded.rip_disp_position), arg->data.memory.constant,
+                                               arg->data.memory.disp});
+                } else if (!counter_indices.empty() && counter_indices[i] >= 0) {
+                    counter_fixups.push_back({i, u64(encoded.rip_disp_position), u64(counter_indices[i])});
+                }
+            }
+        }
+        encoded_offsets[mnemos.size()] = encoded.size();
+
+        // Labels that are aligned automatically: `call` targets and targets of backward branches
+        pmr::vector<bool> is_auto_aligned(mnemos.size(), false, resource);
+        for (u64 i = 0; i < mnemos.size(); i++) {
+            if (!is_label_branch(mnemos[i]))
+                continue;
+            auto it = label_indices.find(mnemos[i].a1.data.label);
+            if (it == label_indices.end()) {
+                if (!options.relocatable)
+                    throw logic_error("label \"" + label_name(mnemos[i].a1.data.label) + "\" is not defined");
+                if (!has_long_branch_form(mnemos[i]))
+                    throw logic_error("external label \"" + label_name(mnemos[i].a1.data.label) +
+                                      "\" needs a rel32 branch");
+                // The linker resolves external targets, so they always get a rel32
+                is_short[i] = false;
+                continue;
+            }
+            if (options.auto_align && (mnemos[i].tag == mnemo_t::tag_t::Call || it->second < i))
+                is_auto_aligned[it->second] = true;
+        }
+        if (options.auto_align && !is_power_of_two(options.auto_alignment))
+            throw logic_error("auto_alignment should be a power of two");
+        u64 auto_align_budget = encoded.size() * options.auto_align_budget_percent / 100;
+
+        // Offset of i-th mnemo in the output is offsets[i], padding inserted before it is paddings[i]
+        pmr::vector<u64> offsets(mnemos.size() + 1, resource);
+        pmr::vector<u64> paddings(mnemos.size(), 0, resource);
+        u64 iterations = 0;
+        for (bool changed = true; changed;) {
+            changed = false;
+            iterations++;
+
+            u64 offset = 0;
+            u64 auto_padding = 0;
+            for (u64 i = 0; i < mnemos.size(); i++) {
+                const mnemo_t &mnemo = mnemos[i];
+                paddings[i] = 0;
+                if (mnemo.tag == mnemo_t::tag_t::Align) {
+                    paddings[i] = padding_to_alignment(offset, u64(mnemo.a1.data.imm));
+                } else if (is_auto_aligned[i]) {
+                    u64 padding = padding_to_alignment(offset, options.auto_alignment);
+                    if (padding <= options.auto_align_max_skip && auto_padding + padding <= auto_align_budget) {
+                        paddings[i] = padding;
+                        auto_padding += padding;
+                    }
+                }
+                offset += paddings[i];
+
+                offsets[i] = offset;
+                if (is_label_branch(mnemo))
+                    offset += branch_size(mnemo, is_short[i]);
+                else
+                    offset += encoded_offsets[i + 1] - encoded_offsets[i];
+            }
+            offsets[mnemos.size()] = offset;
+
+            for (u64 i = 0; i < mnemos.size(); i++) {
+                if (!is_label_branch(mnemos[i]) || !is_short[i])
+                    continue;
+                // Relative to the end of the branch, which is before any padding of the next mnemo
+                u64 end = offsets[i] + branch_size(mnemos[i], true);
+                i64 disp = i64(offsets[label_indices[mnemos[i].a1.data.label]]) - i64(end);
+                if (!can_be_sign_extended_from_8bits(disp)) {
+                    if (!has_long_branch_form(mnemos[i]))
+                        throw logic_error("branch target is out of rel8 range");
+                    is_short[i] = false;
+                    changed = true;
+                }
+            }
+        }
+
+        // Constant pool layout. Constants are ordered from largest to smallest, so once the pool start is aligned
+        // to the largest constant every constant is aligned to its own size without padding in between.
+        pmr::vector<pair<constant_t, span<const u8>>> pool(resource);
+        for (const constant_fixup_t &fixup: constant_fixups) {
+            bool is_new = none_of(pool.begin(), pool.end(), [&](const pair<constant_t, span<const u8>> &entry) {
+                return entry.first == fixup.constant;
+            });
+            if (is_new)
+                pool.emplace_back(fixup.constant, constant_span(fixup.constant));
+        }
+        stable_sort(pool.begin(), pool.end(), [](const auto &a, const auto &b) {
+            return a.second.size() > b.second.size();
+        });
+        u64 code_size = offsets[mnemos.size()];
+        u64 pool_alignment = pool.empty() ? 1 : pool.front().second.size();
+        // Relocatable code keeps its pool in a separate section
+        u64 pool_offset = options.relocatable ? 0 : code_size + padding_to_alignment(code_size, pool_alignment);
+        pmr::unordered_map<constant_t, u64> constant_offsets(resource);
+        u64 pool_size = 0;
+        for (const auto &[constant, bytes]: pool) {
+            constant_offsets.emplace(constant, pool_offset + pool_size);
+            pool_size += bytes.size();
+        }
+
+        // Counters start on the first page after the pool, leaving room for the loader's trap, so stores to them
+        // never hit a page holding instructions and cause self-modifying code machine clears
+        u64 counter_offset = pool_offset + pool_size + 2;
+        counter_offset += padding_to_alignment(counter_offset, counter_alignment);
+
+        assemble_result local_details{};
+        assemble_result &result = details != nullptr ? *details : local_details;
+        code.reserve(pool_offset + pool_size);
+        u64 next_fixup = 0;
+        u64 next_counter_fixup = 0;
+        for (u64 i = 0; i < mnemos.size(); i++) {
+            append_nop_padding(code, paddings[i]);
+            result.alignment_padding += paddings[i];
+
+            if (mnemos[i].tag == mnemo_t::tag_t::Label && details != nullptr)
+                result.labels.emplace_back(mnemos[i].a1.data.label, offsets[i]);
+            else if (options.source_map && mnemos[i].tag != mnemo_t::tag_t::Align)
+                result.source_map.entries.push_back({u32(offsets[i]), u32(i)});
+
+            if (is_label_branch(mnemos[i]) && !label_indices.contains(mnemos[i].a1.data.label)) {
+                // rel32 is the last field of the branch and relative to its end
+                assemble_label_branch(code, mnemos[i], false, 0);
+                result.relocations.push_back({offsets[i] + branch_size(mnemos[i], false) - 4,
+                                              relocation_t::target_t::Label, mnemos[i].a1.data.label, -4});
+            } else if (is_label_branch(mnemos[i])) {
+                u64 end = offsets[i] + branch_size(mnemos[i], is_short[i]);
+                i64 disp = i64(offsets[label_indices[mnemos[i].a1.data.label]]) - i64(end);
+                assemble_label_branch(code, mnemos[i], is_short[i], i32(disp));
+                if (is_short[i] && has_long_branch_form(mnemos[i]))
+                    result.relaxation_bytes_saved += branch_size(mnemos[i], false) - branch_size(mnemos[i], true);
+            } else {
+                code.insert(code.end(), encoded.begin() + i64(encoded_offsets[i]),
+                            encoded.begin() + i64(encoded_offsets[i + 1]));
+            }
+
+            // RIP-relative disp is relative to the end of the instruction
+            for (; next_fixup < constant_fixups.size() && constant_fixups[next_fixup].mnemo_index == i; next_fixup++) {
+                const constant_fixup_t &fixup = constant_fixups[next_fixup];
+                u64 end = offsets[i] + encoded_offsets[i + 1] - encoded_offsets[i];
+                u64 position = offsets[i] + fixup.disp_position - encoded_offsets[i];
+                if (options.relocatable) {
+                    result.relocations.push_back({position, relocation_t::target_t::Rodata, 0,
+                                                  i64(constant_offsets[fixup.constant]) + fixup.disp -
+                                                  i64(end - position)});
+                    continue;
+                }
+                i64 disp = i64(constant_offsets[fixup.constant]) + fixup.disp - i64(end);
+                if (!can_be_encoded_in_32bits(disp))
+                    throw logic_error("constant is out of disp32 range");
+                for (u8 j = 0; j < 4; j++) {
+                    code[position + j] = u8(disp & 0xff);
+                    disp >>= 8;
+                }
+            }
+            for (; next_counter_fixup < counter_fixups.size() &&
+                   counter_fixups[next_counter_fixup].mnemo_index == i; next_counter_fixup++) {
+                const counter_fixup_t &fixup = counter_fixups[next_counter_fixup];
+                u64 end = offsets[i] + encoded_offsets[i + 1] - encoded_offsets[i];
+                u64 position = offsets[i] + fixup.disp_position - encoded_offsets[i];
+                i64 disp = i64(counter_offset + fixup.counter * sizeof(u64)) - i64(end);
+                if (!can_be_encoded_in_32bits(disp))
+                    throw logic_error("counter is out of disp32 range");
+                for (u8 j = 0; j < 4; j++) {
+                    code[position + j] = u8(disp & 0xff);
+                    disp >>= 8;
+                }
+            }
+        }
+
+        // Gap between code and constants is filled with int3, so falling through into the pool traps
+        if (!options.relocatable)
+            code.resize(pool_offset, 0xcc);
+        for (const auto &[constant, bytes]: pool) {
+            if (options.relocatable)
+                result.rodata.insert(result.rodata.end(), bytes.begin(), bytes.end());
+            else
+                code.insert(code.end(), bytes.begin(), bytes.end());
+        }
+        result.source_map.code_size = code_size;
+        result.counter_offset = counter_offset;
+        result.counter_count = counter_count;
+        result.constant_pool_offset = pool_offset;
+        result.rodata_alignment = pool_alignment;
+        result.constant_count = pool.size();
+        result.relaxation_iterations = iterations;
+    }
+
+    auto assemble_detailed(const vector<mnemo_t> &mnemos, const assemble_options &options) -> assemble_result {
+        TRACE_SPAN("assemble");
+        if (!options.block_counts.empty()) {
+            if (options.instrument != instrument_t::None)
+                throw logic_error("profile-guided layout and instrumentation can not be combined");
+            if (options.source_map)
+                throw logic_error("profile-guided layout does not produce a source map");
+            layout::layout_result laid_out = layout::layout_function(mnemos, options.block_counts);
+            assemble_options without_profile = options;
+            without_profile.block_counts.clear();
+            assemble_result result = assemble_detailed(laid_out.mnemos, without_profile);
+            result.layout = laid_out.report;
+            return result;
+        }
+        if (options.source_map && !options.source_offsets.empty() && options.source_offsets.size() != mnemos.size())
+            throw logic_error("there should be one source offset per mnemo");
+
+        assemble_result result{};
+        if (options.instrument == instrument_t::None) {
+            assemble_with_counters(mnemos, {}, 0, options, pmr::get_default_resource(), result.code, &result);
+        } else {
+            // Counters are written by the code itself, so they have no place in a read-only object file section
+            if (options.relocatable)
+                throw logic_error("instrumented code can not be relocatable");
+            probed_mnemos_t probed = insert_probes(mnemos, options.instrument);
+            assemble_with_counters(probed.mnemos, probed.counter_indices, probed.counter_count, options,
+                                   pmr::get_default_resource(), result.code, &result);
+            for (source_map_t::entry_t &entry: result.source_map.entries)
+                entry.mnemo_index = u32(probed.origins[entry.mnemo_index]);
+        }
+        if (options.source_map)
+            result.source_map.source_offsets = options.source_offsets;
+        return result;
+    }
+
+    auto assemble(span<const mnemo_t> mnemos, pmr::memory_resource *resource) -> pmr::vector<u8> {
+        TRACE_SPAN("assemble");
+        pmr::vector<u8> code(resource);
+        assemble_with_counters(mnemos, {}, 0, {}, resource, code, nullptr);
+        return code;
+    }
+
+    auto source_map_t::find_mnemo(u64 code_offset) const -> i64 {
+        if (code_offset >= this->code_size)
+            return -1;
+        auto it = upper_bound(this->entries.begin(), this->entries.end(), code_offset,
+                              [](u64 offset, const entry_t &entry) { return offset < entry.code_offset; });
+        if (it == this->entries.begin())
+            return -1;
+        return i64(prev(it)->mnemo_index);
+    }
+
+    auto source_map_t::find_source_offset(u64 code_offset) const -> i64 {
+        i64 mnemo = this->find_mnemo(code_offset);
+        if (mnemo < 0 || u64(mnemo) >= this->source_offsets.size())
+            return -1;
+        return i64(this->source_offsets[u64(mnemo)]);
+    }
+
+    mnemo_t::arg_t mnemo_t::arg_t::imm(imm_t imm) {
+        return {
+                .tag=tag_t::Immediate,
+                .data {.imm = imm},
+        };
+    }
+
+    mnemo_t::arg_t mnemo_t::arg_t::reg(mnemo_t::arg_t::reg_t reg) {
+        arg_t o{};
+        o.tag = tag_t::Register;
+        o.data.reg = reg;
+        return o;
+    }
+
+    mnemo_t::arg_t mnemo_t::arg_t::mem(mnemo_t::arg_t::reg_t base, mnemo_t::arg_t::reg_t index,
+                                       mnemo_t::arg_t::memory_t::scale_t scale, disp_t disp) {
+        // If scale is S0, the index register should be Undef
+        if (scale == mnemo_t::arg_t::memory_t::scale_t::S0 && index != mnemo_t::arg_t::reg_t::Undef)
+            throw logic_error("if scale is S0, the index register should be Undef");
+
+        arg_t o{};
+        o.tag = tag_t::Memory;
+        o.data.memory = {
+                .base=base,
+                .index=index,
+                .scale=scale,
+                .disp=disp,
+        };
+        return o;
+    }
+
+    mnemo_t::arg_t mnemo_t::arg_t::constant(constant_t constant) {
+        arg_t o{};
+        o.tag = tag_t::Memory;
+        o.data.memory = {
+                .base=reg_t::Rip,
+                .index=reg_t::Undef,
+                .scale=memory_t::scale_t::S0,
+                .disp=0,
+                .constant=constant,
+        };
+        return o;
+    }
+
+    mnemo_t::arg_t mnemo_t::arg_t::label(label_t label) {
+        arg_t o{};
+        o.tag = tag_t::Label;
+        o.data.label = label;
+        return o;
+    }
+
+    auto mnemo_t::arg_t::print() const -> void {
+        switch (this->tag) {
+            case tag_t::Immediate:
+                cout << this->data.imm;
+                break;
+            case tag_t::Register:
+                print_reg(this->data.reg);
+                break;
+            case tag_t::Memory:
+                cout << "[";
+
+                if (this->data.memory.constant != 0) {
+                    // Constants are printed as qword lanes
+                    span<const u8> bytes = constant_span(this->data.memory.constant);
+                    cout << "const ";
+                    for (u64 i = 0; i < bytes.size(); i += 8) {
+                        u64 lane = 0;
+                        for (u64 j = 0; j < 8; j++)
+                            lane |= u64(bytes[i + j]) << (8 * j);
+                        cout << (i == 0 ? "" : ", ") << "0x" << hex << lane << dec;
+                    }
+                } else {
+                    print_reg(this->data.memory.base);
+                }
+
+                // Print index with scale if there is one
+                if (this->data.memory.scale != memory_t::scale_t::S0) {
+                    cout << " + ";
+
+                    print_reg(this->data.memory.index);
+
+                    // Print scale if it is not S1
+                    if (this->data.memory.scale != memory_t::scale_t::S1) {
+                        cout << " * ";
+
+                        switch (this->data.memory.scale) {
+                            case memory_t::scale_t::S1:
+                                cout << "1";
+                                break;
+                            case memory_t::scale_t::S2:
+                                cout << "2";
+                                break;
+                            case memory_t::scale_t::S4:
+                                cout << "4";
+                                break;
+                            case memory_t::scale_t::S8:
+                                cout << "8";
+                                break;
+                            default:
+                                throw logic_error("unreachable");
+                        }
+                    }
+                }
+
+                // Print disp if it is not zero
+                if (this->data.memory.disp != 0) {
+                    if (this->data.memory.disp > 0)
+                        cout << " + ";
+                    else
+                        cout << " - ";
+                    cout << abs(this->data.memory.disp);
+                }
+                cout << "]";
+                break;
+            case tag_t::Label:
+                cout << label_name(this->data.label);
+                break;
+            default:
+                throw logic_error("unreachable");
+        }
+    }
+
+    auto mnemo_t::arg_t::print_reg(reg_t reg) -> void {
+        switch (reg) {
+            case reg_t::Al:
+                cout << "al";
+                break;
+            case reg_t::Bl:
                 cout << "bl";
                 break;
             case reg_t::Cl:
@@ -809,6 +2231,57 @@ namespace assembly {
             case reg_t::Rdi:
                 cout << "rdi";
                 break;
+            case reg_t::Rip:
+                cout << "rip";
+                break;
+            case reg_t::Xmm0:
+                cout << "xmm0";
+                break;
+            case reg_t::Xmm1:
+                cout << "xmm1";
+                break;
+            case reg_t::Xmm2:
+                cout << "xmm2";
+                break;
+            case reg_t::Xmm3:
+                cout << "xmm3";
+                break;
+            case reg_t::Xmm4:
+                cout << "xmm4";
+                break;
+            case reg_t::Xmm5:
+                cout << "xmm5";
+                break;
+            case reg_t::Xmm6:
+                cout << "xmm6";
+                break;
+            case reg_t::Xmm7:
+                cout << "xmm7";
+                break;
+            case reg_t::Ymm0:
+                cout << "ymm0";
+                break;
+            case reg_t::Ymm1:
+                cout << "ymm1";
+                break;
+            case reg_t::Ymm2:
+                cout << "ymm2";
+                break;
+            case reg_t::Ymm3:
+                cout << "ymm3";
+                break;
+            case reg_t::Ymm4:
+                cout << "ymm4";
+                break;
+            case reg_t::Ymm5:
+                cout << "ymm5";
+                break;
+            case reg_t::Ymm6:
+                cout << "ymm6";
+                break;
+            case reg_t::Ymm7:
+                cout << "ymm7";
+                break;
             default:
                 throw logic_error("unsupported register. print_reg");
         }
@@ -829,9 +2302,342 @@ namespace assembly {
             case tag_t::Pop:
                 cout << "pop";
                 break;
+            case tag_t::Sub:
+                cout << "sub";
+                break;
+            case tag_t::And:
+                cout << "and";
+                break;
+            case tag_t::Or:
+                cout << "or";
+                break;
+            case tag_t::Xor:
+                cout << "xor";
+                break;
+            case tag_t::Cmp:
+                cout << "cmp";
+                break;
+            case tag_t::Test:
+                cout << "test";
+                break;
+            case tag_t::Lea:
+                cout << "lea";
+                break;
+            case tag_t::Imul:
+                cout << "imul";
+                break;
+            case tag_t::Shl:
+                cout << "shl";
+                break;
+            case tag_t::Shr:
+                cout << "shr";
+                break;
+            case tag_t::Sar:
+                cout << "sar";
+                break;
+            case tag_t::Inc:
+                cout << "inc";
+                break;
+            case tag_t::Dec:
+                cout << "dec";
+                break;
+            case tag_t::Neg:
+                cout << "neg";
+                break;
+            case tag_t::Not:
+                cout << "not";
+                break;
             case tag_t::Ret:
                 cout << "ret";
                 break;
+            case tag_t::Popcnt:
+                cout << "popcnt";
+                break;
+            case tag_t::Lzcnt:
+                cout << "lzcnt";
+                break;
+            case tag_t::Tzcnt:
+                cout << "tzcnt";
+                break;
+            case tag_t::Andn:
+                cout << "andn";
+                break;
+            case tag_t::Bextr:
+                cout << "bextr";
+                break;
+            case tag_t::Blsr:
+                cout << "blsr";
+                break;
+            case tag_t::Blsi:
+                cout << "blsi";
+                break;
+            case tag_t::Blsmsk:
+                cout << "blsmsk";
+                break;
+            case tag_t::Bzhi:
+                cout << "bzhi";
+                break;
+            case tag_t::Pdep:
+                cout << "pdep";
+                break;
+            case tag_t::Pext:
+                cout << "pext";
+                break;
+            case tag_t::Shlx:
+                cout << "shlx";
+                break;
+            case tag_t::Shrx:
+                cout << "shrx";
+                break;
+            case tag_t::Sarx:
+                cout << "sarx";
+                break;
+            case tag_t::Cmovcc:
+                cout << "cmov";
+                print_cond(this->cond);
+                break;
+            case tag_t::Setcc:
+                cout << "set";
+                print_cond(this->cond);
+                break;
+            case tag_t::Label:
+                cout << "label";
+                break;
+            case tag_t::Jmp:
+                cout << "jmp";
+                break;
+            case tag_t::Jcc:
+                cout << "j";
+                print_cond(this->cond);
+                break;
+            case tag_t::Call:
+                cout << "call";
+                break;
+            case tag_t::Loop:
+                cout << "loop";
+                break;
+            case tag_t::Align:
+                cout << "align";
+                break;
+            case tag_t::Movdqu:
+                cout << "movdqu";
+                break;
+            case tag_t::Movdqa:
+                cout << "movdqa";
+                break;
+            case tag_t::Movups:
+                cout << "movups";
+                break;
+            case tag_t::Movaps:
+                cout << "movaps";
+                break;
+            case tag_t::Movd:
+                cout << "movd";
+                break;
+            case tag_t::Movq:
+                cout << "movq";
+                break;
+            case tag_t::Paddb:
+                cout << "paddb";
+                break;
+            case tag_t::Paddw:
+                cout << "paddw";
+                break;
+            case tag_t::Paddd:
+                cout << "paddd";
+                break;
+            case tag_t::Paddq:
+                cout << "paddq";
+                break;
+            case tag_t::Psubb:
+                cout << "psubb";
+                break;
+            case tag_t::Psubw:
+                cout << "psubw";
+                break;
+            case tag_t::Psubd:
+                cout << "psubd";
+                break;
+            case tag_t::Psubq:
+                cout << "psubq";
+                break;
+            case tag_t::Pand:
+                cout << "pand";
+                break;
+            case tag_t::Pandn:
+                cout << "pandn";
+                break;
+            case tag_t::Por:
+                cout << "por";
+                break;
+            case tag_t::Pxor:
+                cout << "pxor";
+                break;
+            case tag_t::Pcmpeqb:
+                cout << "pcmpeqb";
+                break;
+            case tag_t::Pcmpeqw:
+                cout << "pcmpeqw";
+                break;
+            case tag_t::Pcmpeqd:
+                cout << "pcmpeqd";
+                break;
+            case tag_t::Pcmpgtb:
+                cout << "pcmpgtb";
+                break;
+            case tag_t::Pcmpgtw:
+                cout << "pcmpgtw";
+                break;
+            case tag_t::Pcmpgtd:
+                cout << "pcmpgtd";
+                break;
+            case tag_t::Pmovmskb:
+                cout << "pmovmskb";
+                break;
+            case tag_t::Pshufb:
+                cout << "pshufb";
+                break;
+            case tag_t::Addps:
+                cout << "addps";
+                break;
+            case tag_t::Addpd:
+                cout << "addpd";
+                break;
+            case tag_t::Subps:
+                cout << "subps";
+                break;
+            case tag_t::Subpd:
+                cout << "subpd";
+                break;
+            case tag_t::Mulps:
+                cout << "mulps";
+                break;
+            case tag_t::Mulpd:
+                cout << "mulpd";
+                break;
+            case tag_t::Xorps:
+                cout << "xorps";
+                break;
+            case tag_t::Vmovdqu:
+                cout << "vmovdqu";
+                break;
+            case tag_t::Vmovdqa:
+                cout << "vmovdqa";
+                break;
+            case tag_t::Vmovups:
+                cout << "vmovups";
+                break;
+            case tag_t::Vmovaps:
+                cout << "vmovaps";
+                break;
+            case tag_t::Vmovd:
+                cout << "vmovd";
+                break;
+            case tag_t::Vmovq:
+                cout << "vmovq";
+                break;
+            case tag_t::Vpaddb:
+                cout << "vpaddb";
+                break;
+            case tag_t::Vpaddw:
+                cout << "vpaddw";
+                break;
+            case tag_t::Vpaddd:
+                cout << "vpaddd";
+                break;
+            case tag_t::Vpaddq:
+                cout << "vpaddq";
+                break;
+            case tag_t::Vpsubb:
+                cout << "vpsubb";
+                break;
+            case tag_t::Vpsubw:
+                cout << "vpsubw";
+                break;
+            case tag_t::Vpsubd:
+                cout << "vpsubd";
+                break;
+            case tag_t::Vpsubq:
+                cout << "vpsubq";
+                break;
+            case tag_t::Vpand:
+                cout << "vpand";
+                break;
+            case tag_t::Vpandn:
+                cout << "vpandn";
+                break;
+            case tag_t::Vpor:
+                cout << "vpor";
+                break;
+            case tag_t::Vpxor:
+                cout << "vpxor";
+                break;
+            case tag_t::Vpcmpeqb:
+                cout << "vpcmpeqb";
+                break;
+            case tag_t::Vpcmpeqw:
+                cout << "vpcmpeqw";
+                break;
+            case tag_t::Vpcmpeqd:
+                cout << "vpcmpeqd";
+                break;
+            case tag_t::Vpcmpgtb:
+                cout << "vpcmpgtb";
+                break;
+            case tag_t::Vpcmpgtw:
+                cout << "vpcmpgtw";
+                break;
+            case tag_t::Vpcmpgtd:
+                cout << "vpcmpgtd";
+                break;
+            case tag_t::Vpmovmskb:
+                cout << "vpmovmskb";
+                break;
+            case tag_t::Vpshufb:
+                cout << "vpshufb";
+                break;
+            case tag_t::Vaddps:
+                cout << "vaddps";
+                break;
+            case tag_t::Vaddpd:
+                cout << "vaddpd";
+                break;
+            case tag_t::Vsubps:
+                cout << "vsubps";
+                break;
+            case tag_t::Vsubpd:
+                cout << "vsubpd";
+                break;
+            case tag_t::Vmulps:
+                cout << "vmulps";
+                break;
+            case tag_t::Vmulpd:
+                cout << "vmulpd";
+                break;
+            case tag_t::Vxorps:
+                cout << "vxorps";
+                break;
+            case tag_t::Vpbroadcastb:
+                cout << "vpbroadcastb";
+                break;
+            case tag_t::Vpbroadcastw:
+                cout << "vpbroadcastw";
+                break;
+            case tag_t::Vpbroadcastd:
+                cout << "vpbroadcastd";
+                break;
+            case tag_t::Vpbroadcastq:
+                cout << "vpbroadcastq";
+                break;
+            case tag_t::Vbroadcastss:
+                cout << "vbroadcastss";
+                break;
+            case tag_t::Vbroadcastsd:
+                cout << "vbroadcastsd";
+                break;
+            case tag_t::Vzeroupper:
+                cout << "vzeroupper";
+                break;
             default:
                 throw logic_error("unimplemented mnemo.tag");
         }
@@ -849,6 +2655,12 @@ namespace assembly {
                 std::cout << ' ';
 
                 this->a2.print();
+
+                if (this->get_arity() >= 3) {
+                    std::cout << ' ';
+
+                    this->a3.print();
+                }
             }
         }
 
@@ -869,6 +2681,12 @@ namespace assembly {
             case width_t::Qword:
                 cout << "QWORD";
                 break;
+            case width_t::Xmmword:
+                cout << "XMMWORD";
+                break;
+            case width_t::Ymmword:
+                cout << "YMMWORD";
+                break;
             case width_t::NotSet:
                 cout << "NotSet";
                 break;
@@ -877,18 +2695,134 @@ namespace assembly {
         }
     }
 
+    auto mnemo_t::print_cond(cond_t cond) -> void {
+        switch (cond) {
+            case cond_t::O:
+                cout << "o";
+                break;
+            case cond_t::No:
+                cout << "no";
+                break;
+            case cond_t::B:
+                cout << "b";
+                break;
+            case cond_t::Ae:
+                cout << "ae";
+                break;
+            case cond_t::E:
+                cout << "e";
+                break;
+            case cond_t::Ne:
+                cout << "ne";
+                break;
+            case cond_t::Be:
+                cout << "be";
+                break;
+            case cond_t::A:
+                cout << "a";
+                break;
+            case cond_t::S:
+                cout << "s";
+                break;
+            case cond_t::Ns:
+                cout << "ns";
+                break;
+            case cond_t::P:
+                cout << "p";
+                break;
+            case cond_t::Np:
+                cout << "np";
+                break;
+            case cond_t::L:
+                cout << "l";
+                break;
+            case cond_t::Ge:
+                cout << "ge";
+                break;
+            case cond_t::Le:
+                cout << "le";
+                break;
+            case cond_t::G:
+                cout << "g";
+                break;
+            default:
+                throw logic_error("unimplemented cond_t. print_cond");
+        }
+    }
+
     // Perform basic validity checks for a mnemonic
     auto mnemo_t::check_validity() const -> void {
         if (this->tag == mnemo_t::tag_t::Undef)
             throw logic_error("mnemo has Undef tag. assemble_mnemo");
         if (this->width == mnemo_t::width_t::Undef)
             throw logic_error("mnemo has Undef width. assemble_mnemo");
+        if (is_vector_mnemo(this->tag)) {
+            this->check_vector_validity();
+            return;
+        }
         if (this->a1.tag == mnemo_t::arg_t::tag_t::Register && register_width(this->a1.data.reg) != this->width) {
             throw logic_error("arg1 register width does not match instruction width");
         }
-        if (this->a2.tag == mnemo_t::arg_t::tag_t::Register && register_width(this->a2.data.reg) != this->width) {
+        // Shift count register is always cl
+        bool is_shift = this->tag == tag_t::Shl || this->tag == tag_t::Shr || this->tag == tag_t::Sar;
+        if (this->a2.tag == mnemo_t::arg_t::tag_t::Register && register_width(this->a2.data.reg) != this->width &&
+            !is_shift) {
             throw logic_error("arg2 register width does not match instruction width");
         }
+        if (this->a3.tag == mnemo_t::arg_t::tag_t::Register && register_width(this->a3.data.reg) != this->width) {
+            throw logic_error("arg3 register width does not match instruction width");
+        }
+    }
+
+    // In vector mnemos width is the vector length: XMMWORD for SSE and VEX.128, YMMWORD for VEX.256.
+    // General purpose register operands of `movd`, `movq` and `pmovmskb` are checked separately.
+    auto mnemo_t::check_vector_validity() const -> void {
+        if (this->tag == tag_t::Vzeroupper)
+            return;
+        if (this->width != width_t::Xmmword && this->width != width_t::Ymmword)
+            throw logic_error("vector mnemo width should be XMMWORD or YMMWORD");
+        if (this->width == width_t::Ymmword && !is_vex_mnemo(this->tag))
+            throw logic_error("legacy SSE mnemos only operate on xmm registers");
+        if (this->width == width_t::Ymmword && is_vector_gpr_transfer_mnemo(this->tag))
+            throw logic_error("movd/movq only operate on xmm registers");
+        if (this->width == width_t::Xmmword && this->tag == tag_t::Vbroadcastsd)
+            throw logic_error("vbroadcastsd only operates on ymm registers");
+
+        const arg_t *args[] = {&this->a1, &this->a2, &this->a3};
+        for (u8 i = 0; i < this->get_arity(); i++) {
+            const arg_t &arg = *args[i];
+            if (arg.tag != arg_t::tag_t::Register)
+                continue;
+
+            if (is_vector_register(arg.data.reg)) {
+                if ((this->tag == tag_t::Pmovmskb || this->tag == tag_t::Vpmovmskb) && i == 0)
+                    throw logic_error("pmovmskb destination should be a 32 or 64 bit register");
+                // Broadcasts always read from an xmm register
+                width_t expected_width = is_broadcast_mnemo(this->tag) && i == 1 ? width_t::Xmmword : this->width;
+                if (register_width(arg.data.reg) != expected_width)
+                    throw logic_error("vector register width does not match instruction width");
+            } else if (is_vector_gpr_transfer_mnemo(this->tag)) {
+                bool is_q = this->tag == tag_t::Movq || this->tag == tag_t::Vmovq;
+                if (register_width(arg.data.reg) != (is_q ? width_t::Qword : width_t::Dword))
+                    throw logic_error("movd expects a 32 bit register and movq expects a 64 bit register");
+            } else if (this->tag == tag_t::Pmovmskb || this->tag == tag_t::Vpmovmskb) {
+                if (i != 0 || (register_width(arg.data.reg) != width_t::Dword &&
+                               register_width(arg.data.reg) != width_t::Qword))
+                    throw logic_error("pmovmskb destination should be a 32 or 64 bit register");
+            } else {
+                throw logic_error("vector mnemo does not accept general purpose registers");
+            }
+        }
+
+        if (is_vector_gpr_transfer_mnemo(this->tag)) {
+            auto is_xmm = [](const arg_t &arg) {
+                return arg.tag == arg_t::tag_t::Register && is_vector_register(arg.data.reg);
+            };
+            bool is_q = this->tag == tag_t::Movq || this->tag == tag_t::Vmovq;
+            if (is_xmm(this->a1) == is_xmm(this->a2) && !(is_q && is_xmm(this->a1)))
+                throw logic_error("movd moves between an xmm register and a register or memory, movq also "
+                                  "between two xmm registers");
+        }
     }
 
     // Returns arity of a mnemo (how many arguments it takes)
@@ -896,13 +2830,68 @@ namespace assembly {
         switch (this->tag) {
             case tag_t::Mov:
             case tag_t::Add:
+            case tag_t::Sub:
+            case tag_t::And:
+            case tag_t::Or:
+            case tag_t::Xor:
+            case tag_t::Cmp:
+            case tag_t::Test:
+            case tag_t::Lea:
+            case tag_t::Shl:
+            case tag_t::Shr:
+            case tag_t::Sar:
+            case tag_t::Popcnt:
+            case tag_t::Lzcnt:
+            case tag_t::Tzcnt:
+            case tag_t::Blsr:
+            case tag_t::Blsi:
+            case tag_t::Blsmsk:
+            case tag_t::Cmovcc:
                 return 2;
+            case tag_t::Andn:
+            case tag_t::Bextr:
+            case tag_t::Bzhi:
+            case tag_t::Pdep:
+            case tag_t::Pext:
+            case tag_t::Shlx:
+            case tag_t::Shrx:
+            case tag_t::Sarx:
+                return 3;
+            case tag_t::Imul:
+                return this->a3.tag == arg_t::tag_t::Undef ? 2 : 3;
             case tag_t::Push:
             case tag_t::Pop:
+            case tag_t::Inc:
+            case tag_t::Dec:
+            case tag_t::Neg:
+            case tag_t::Not:
+            case tag_t::Setcc:
+            case tag_t::Label:
+            case tag_t::Jmp:
+            case tag_t::Jcc:
+            case tag_t::Call:
+            case tag_t::Loop:
+            case tag_t::Align:
                 return 1;
             case tag_t::Ret:
+            case tag_t::Vzeroupper:
                 return 0;
+            case tag_t::Vmovdqu:
+            case tag_t::Vmovdqa:
+            case tag_t::Vmovups:
+            case tag_t::Vmovaps:
+            case tag_t::Vmovd:
+            case tag_t::Vmovq:
+            case tag_t::Vpmovmskb:
+                return 2;
             default:
+                if (is_broadcast_mnemo(this->tag))
+                    return 2;
+                // Other VEX mnemos take a non-destructive extra source operand
+                if (is_vex_mnemo(this->tag))
+                    return 3;
+                if (is_vector_mnemo(this->tag))
+                    return 2;
                 throw logic_error("unhandled mnemo.tag @ get_arity");
         }
     }
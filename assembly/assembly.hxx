@@ -1,11 +1,33 @@
 #pragma once
 
+#include <memory_resource>
+#include <span>
+#include <utility>
+
 #include "../strvec.hxx"
 #include "../int.hxx"
 
 namespace assembly {
     typedef i32 disp_t;
     typedef i64 imm_t;
+    // Labels are interned, so the same name always maps to the same label_t
+    typedef u32 label_t;
+
+    // Interned names are kept for the lifetime of the process. Interning fails with `runtime_error` once 2^18
+    // distinct names are interned, so generated code should reuse label names instead of making them unique.
+    auto intern_label(const string &name) -> label_t;
+
+    auto label_name(label_t label) -> string;
+
+    // Constants of `[const ...]` operands are interned, so equal constants share a constant pool entry.
+    // Constant 0 is reserved and means the memory operand is not a constant.
+    typedef u32 constant_t;
+
+    // Interns a constant of 8, 16 or 32 bytes
+    auto intern_constant(const vector<u8> &bytes) -> constant_t;
+
+    // Bytes of an interned constant, valid for the lifetime of the process
+    auto constant_span(constant_t constant) -> std::span<const u8>;
 
     struct mnemo_t {
         struct arg_t {
@@ -43,6 +65,23 @@ namespace assembly {
                 Rbp,
                 Rsi,
                 Rdi,
+                Xmm0,
+                Xmm1,
+                Xmm2,
+                Xmm3,
+                Xmm4,
+                Xmm5,
+                Xmm6,
+                Xmm7,
+                Ymm0,
+                Ymm1,
+                Ymm2,
+                Ymm3,
+                Ymm4,
+                Ymm5,
+                Ymm6,
+                Ymm7,
+                Rip, // Only used as a memory base, disp is relative to the end of the instruction
             };
 
             struct memory_t {
@@ -58,6 +97,9 @@ namespace assembly {
                 } scale;
 
                 disp_t disp;
+
+                // If set, base is Rip and the operand refers to this constant pool entry (plus disp)
+                constant_t constant;
             };
 
             enum class tag_t {
@@ -65,11 +107,13 @@ namespace assembly {
                 Immediate,
                 Register,
                 Memory,
+                Label,
             } tag;
             union {
                 imm_t imm;
                 reg_t reg;
                 memory_t memory;
+                label_t label;
             } data;
 
             static arg_t imm(imm_t imm);
@@ -78,6 +122,10 @@ namespace assembly {
 
             static arg_t mem(reg_t base, reg_t index, memory_t::scale_t scale, disp_t disp);
 
+            static arg_t label(label_t label);
+
+            static arg_t constant(constant_t constant);
+
             auto print() const -> void;
 
             auto static print_reg(reg_t reg) -> void;
@@ -90,8 +138,148 @@ namespace assembly {
             Push,
             Pop,
             Ret,
+            Sub,
+            And,
+            Or,
+            Xor,
+            Cmp,
+            Test,
+            Lea,
+            Imul,
+            Shl,
+            Shr,
+            Sar,
+            Inc,
+            Dec,
+            Neg,
+            Not,
+
+            // SSE2 (legacy encoded)
+            Movdqu,
+            Movdqa,
+            Movups,
+            Movaps,
+            Movd,
+            Movq,
+            Paddb,
+            Paddw,
+            Paddd,
+            Paddq,
+            Psubb,
+            Psubw,
+            Psubd,
+            Psubq,
+            Pand,
+            Pandn,
+            Por,
+            Pxor,
+            Pcmpeqb,
+            Pcmpeqw,
+            Pcmpeqd,
+            Pcmpgtb,
+            Pcmpgtw,
+            Pcmpgtd,
+            Pmovmskb,
+            Pshufb,
+            Addps,
+            Addpd,
+            Subps,
+            Subpd,
+            Mulps,
+            Mulpd,
+            Xorps,
+
+            // AVX/AVX2 (VEX encoded)
+            Vmovdqu,
+            Vmovdqa,
+            Vmovups,
+            Vmovaps,
+            Vmovd,
+            Vmovq,
+            Vpaddb,
+            Vpaddw,
+            Vpaddd,
+            Vpaddq,
+            Vpsubb,
+            Vpsubw,
+            Vpsubd,
+            Vpsubq,
+            Vpand,
+            Vpandn,
+            Vpor,
+            Vpxor,
+            Vpcmpeqb,
+            Vpcmpeqw,
+            Vpcmpeqd,
+            Vpcmpgtb,
+            Vpcmpgtw,
+            Vpcmpgtd,
+            Vpmovmskb,
+            Vpshufb,
+            Vaddps,
+            Vaddpd,
+            Vsubps,
+            Vsubpd,
+            Vmulps,
+            Vmulpd,
+            Vxorps,
+            Vpbroadcastb,
+            Vpbroadcastw,
+            Vpbroadcastd,
+            Vpbroadcastq,
+            Vbroadcastss,
+            Vbroadcastsd,
+            Vzeroupper,
+
+            // Bit manipulation (POPCNT, LZCNT, BMI1, BMI2)
+            Popcnt,
+            Lzcnt,
+            Tzcnt,
+            Andn,
+            Bextr,
+            Blsr,
+            Blsi,
+            Blsmsk,
+            Bzhi,
+            Pdep,
+            Pext,
+            Shlx,
+            Shrx,
+            Sarx,
+
+            // Conditional mnemos, condition is stored in `cond`
+            Cmovcc,
+            Setcc,
+
+            // Control flow
+            Label, // Pseudo mnemo which defines label a1 at its position
+            Jmp,
+            Jcc,
+            Call,
+            Loop,
+            Align, // Pseudo mnemo which pads code with NOPs up to a multiple of a1 bytes
         } tag;
 
+        // Condition code of conditional mnemos (`cmovcc`, `setcc`, `jcc`). Values match the condition encoding in opcodes.
+        enum class cond_t : u8 {
+            O = 0x0,
+            No = 0x1,
+            B = 0x2, // Also C, Nae
+            Ae = 0x3, // Also Nb, Nc
+            E = 0x4, // Also Z
+            Ne = 0x5, // Also Nz
+            Be = 0x6, // Also Na
+            A = 0x7, // Also Nbe
+            S = 0x8,
+            Ns = 0x9,
+            P = 0xa, // Also Pe
+            Np = 0xb, // Also Po
+            L = 0xc, // Also Nge
+            Ge = 0xd, // Also Nl
+            Le = 0xe, // Also Ng
+            G = 0xf, // Also Nle
+        } cond;
+
         enum class width_t {
             Undef,
             NotSet, // Used in instructions which don't care about width like `ret`
@@ -99,18 +287,175 @@ namespace assembly {
             Word,
             Dword,
             Qword,
+            Xmmword, // Vector length of SSE and VEX.128 instructions
+            Ymmword, // Vector length of VEX.256 instructions
         } width;
 
-        arg_t a1, a2;
+        // a3 is only used by three-operand instructions
+        arg_t a1, a2, a3;
 
         auto print() const -> void;
 
         auto check_validity() const -> void;
 
+        auto check_vector_validity() const -> void;
+
         [[nodiscard]] auto get_arity() const -> u8;
 
         auto static print_width(width_t width) -> void;
+
+        auto static print_cond(cond_t cond) -> void;
+    };
+
+    enum class instrument_t {
+        None,
+        Blocks, // One counter per basic block as split by `layout::split_basic_blocks`
+        Mnemos, // One counter per mnemo, labels and `align`s keep a zero counter
+    };
+
+    // Instrumentation counters are placed on their own pages, which should be at least this aligned
+    static constexpr u64 counter_alignment = 4096;
+
+    struct assemble_options {
+        // Automatically align `call` targets and targets of backward branches (loop heads)
+        bool auto_align = false;
+
+        // Alignment of automatically aligned labels, should be a power of two
+        u64 auto_alignment = 16;
+
+        // A label is left unaligned if aligning it takes more padding than this
+        u64 auto_align_max_skip = 10;
+
+        // Total automatic padding is limited to this percentage of code size before padding
+        u64 auto_align_budget_percent = 10;
+
+        // Produce code for an object file: branches to labels that are not defined become relocations against
+        // external symbols, and constants go to `assemble_result::rodata` instead of a pool after the code
+        bool relocatable = false;
+
+        // Executions of every basic block as split by `layout::split_basic_blocks`. If not empty, blocks are
+        // reordered by `layout::layout_function` before assembling: hot paths fall through and never executed
+        // blocks move to the end.
+        vector<u64> block_counts;
+
+        // Count executions by incrementing a counter before every block or mnemo. Probes preserve flags and
+        // registers but use the stack below the red zone. Counters are addressed RIP-relative at
+        // `assemble_result::counter_offset`, so the loader has to place them there; see jit/instrument.hxx.
+        instrument_t instrument = instrument_t::None;
+
+        // Produce `assemble_result::source_map`. Not supported together with `block_counts`.
+        bool source_map = false;
+
+        // Position of every mnemo in its source, see `parse::parse_with_source_offsets`. Copied into the source map.
+        vector<u64> source_offsets;
+    };
+
+    // Maps bytes of assembled code back to the mnemos and source they were assembled from
+    struct source_map_t {
+        struct entry_t {
+            // The instruction spans from here up to the next entry, the last one up to `code_size`
+            u32 code_offset;
+            u32 mnemo_index;
+        };
+
+        // One entry per instruction, sorted by offset. Alignment padding belongs to the preceding instruction and
+        // counter probes to the mnemo they count.
+        vector<entry_t> entries;
+
+        // Instructions end here, constants follow
+        u64 code_size;
+
+        // Copied from `assemble_options::source_offsets`, indexed by mnemo
+        vector<u64> source_offsets;
+
+        // Index of the mnemo assembled at `code_offset`, -1 if the offset is not inside an instruction
+        [[nodiscard]] auto find_mnemo(u64 code_offset) const -> i64;
+
+        // Source position of the mnemo assembled at `code_offset`, -1 if it is unknown
+        [[nodiscard]] auto find_source_offset(u64 code_offset) const -> i64;
+    };
+
+    // Expected effect of a profile-guided layout, estimated from block counts
+    struct layout_report {
+        // False if the mnemos were left unchanged, e.g. without any executed block
+        bool applied;
+
+        // 64 byte lines overlapping executed blocks, assuming the code starts at a line boundary
+        u64 hot_cache_lines_before;
+        u64 hot_cache_lines_after;
+
+        // Executed taken branches, including `jmp`s inserted for moved fall-throughs
+        u64 taken_branches_before;
+        u64 taken_branches_after;
+
+        u64 cold_block_count;
+
+        auto print() const -> void;
+    };
+
+    // A 32-bit field in relocatable code which the linker fills with `target + addend - field address`
+    struct relocation_t {
+        enum class target_t {
+            Label, // An external symbol
+            Rodata, // Start of `assemble_result::rodata`
+        };
+
+        u64 offset;
+        target_t target;
+        // Only for Label targets
+        label_t label;
+        i64 addend;
+    };
+
+    struct assemble_result {
+        vector<u8> code;
+
+        // Bytes of NOP padding inserted by `align` and automatic alignment
+        u64 alignment_padding;
+
+        // Number of branch relaxation passes until the layout stopped changing
+        u64 relaxation_iterations;
+
+        // Bytes saved by encoding branches with rel8 instead of rel32
+        u64 relaxation_bytes_saved;
+
+        // Constant pool is placed after the code at this offset, each constant aligned to its size
+        u64 constant_pool_offset;
+
+        // Number of distinct constants in the constant pool
+        u64 constant_count;
+
+        // Offsets of defined labels in `code`, in order of definition
+        vector<std::pair<label_t, u64>> labels;
+
+        // Only for relocatable code
+        vector<relocation_t> relocations;
+        // Constant pool of relocatable code, aligned to `rodata_alignment`
+        vector<u8> rodata;
+        u64 rodata_alignment;
+
+        // Only if `assemble_options::block_counts` was given
+        layout_report layout;
+
+        // Only for instrumented code: `counter_count` u64 counters, not part of `code`, are expected at this offset
+        // from the start of the code. The offset is a multiple of `counter_alignment` beyond the end of `code`, so
+        // code loaded at an aligned address keeps its counters on separate pages.
+        u64 counter_offset;
+        u64 counter_count;
+
+        // Only if `assemble_options::source_map` was set
+        source_map_t source_map;
     };
 
+    // Changes whenever `assemble` may produce different bytes for the same mnemos, so persisted code of an older
+    // assembler is not reused
+    static constexpr u32 assembler_version = 1;
+
     auto assemble(const vector<mnemo_t> &mnemos) -> vector<u8>;
+
+    auto assemble_detailed(const vector<mnemo_t> &mnemos, const assemble_options &options = {}) -> assemble_result;
+
+    // Like `assemble`, but every temporary and the returned code are allocated from `resource`. With a reused
+    // monotonic arena, assembling does not touch the global heap.
+    auto assemble(std::span<const mnemo_t> mnemos, std::pmr::memory_resource *resource) -> std::pmr::vector<u8>;
 }
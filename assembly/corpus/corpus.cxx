@@ -0,0 +1,418 @@
+#include "corpus.hxx"
+
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <optional>
+#include <random>
+
+#include "../assembly.hxx"
+#include "../parse/parse.hxx"
+
+using namespace std;
+
+using assembly::mnemo_t;
+
+namespace assembly::corpus {
+    // Every mnemonic accepted by the parser, conditional ones are listed without their condition code
+    static const char *const gp_mnemo_names[] = {
+            "mov", "add", "push", "pop", "ret", "sub", "and", "or", "xor", "cmp", "test", "lea", "imul", "shl", "shr",
+            "sar", "inc", "dec", "neg", "not", "popcnt", "lzcnt", "tzcnt", "andn", "bextr", "blsr", "blsi", "blsmsk",
+            "bzhi", "pdep", "pext", "shlx", "shrx", "sarx", "jmp", "call", "loop", "align", "cmov", "set", "j",
+    };
+
+    static const char *const vector_mnemo_names[] = {
+            "movdqu", "movdqa", "movups", "movaps", "movd", "movq", "paddb", "paddw", "paddd", "paddq", "psubb",
+            "psubw", "psubd", "psubq", "pand", "pandn", "por", "pxor", "pcmpeqb", "pcmpeqw", "pcmpeqd", "pcmpgtb",
+            "pcmpgtw", "pcmpgtd", "pmovmskb", "pshufb", "addps", "addpd", "subps", "subpd", "mulps", "mulpd", "xorps",
+            "vmovdqu", "vmovdqa", "vmovups", "vmovaps", "vmovd", "vmovq", "vpaddb", "vpaddw", "vpaddd", "vpaddq",
+            "vpsubb", "vpsubw", "vpsubd", "vpsubq", "vpand", "vpandn", "vpor", "vpxor", "vpcmpeqb", "vpcmpeqw",
+            "vpcmpeqd", "vpcmpgtb", "vpcmpgtw", "vpcmpgtd", "vpmovmskb", "vpshufb", "vaddps", "vaddpd", "vsubps",
+            "vsubpd", "vmulps", "vmulpd", "vxorps", "vpbroadcastb", "vpbroadcastw", "vpbroadcastd", "vpbroadcastq",
+            "vbroadcastss", "vbroadcastsd", "vzeroupper",
+    };
+
+    static const char *const cond_names[] = {
+            "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g",
+    };
+
+    // Width keywords, NotSet is written as nothing
+    static const char *const width_names[] = {"", "BYTE", "WORD", "DWORD", "QWORD", "XMMWORD", "YMMWORD"};
+
+    static const char *const gp_registers[4][8] = {
+            {"al",  "bl",  "cl",  "dl",  "ah",  "bh",  "ch",  "dh"},
+            {"ax",  "bx",  "cx",  "dx",  "sp",  "bp",  "si",  "di"},
+            {"eax", "ebx", "ecx", "edx", "esp", "ebp", "esi", "edi"},
+            {"rax", "rbx", "rcx", "rdx", "rsp", "rbp", "rsi", "rdi"},
+    };
+
+    // Lines between label definitions
+    static constexpr u64 label_interval = 8;
+
+    // Labels past the last block, so forward branches from the last blocks have a target
+    static constexpr u64 trailing_label_count = 4;
+
+    // Random operands tried for a line before falling back to the operands the form was accepted with
+    static constexpr u64 instantiation_attempts = 8;
+
+    // Bytes of the scratch frame addressed by memory operands of executable corpora, 32 byte aligned
+    static constexpr u64 scratch_size = 256;
+
+    // Shape characters, one per operand:
+    // r - general purpose register of the mnemo width, d/q - 32/64 bit general purpose register, c - cl,
+    // v - vector register of the mnemo width, x - xmm register, i - immediate, m - memory, k - constant, l - label
+    static auto operand_kinds(u64 width) -> const char * {
+        switch (width) {
+            case 0:
+                return "il";
+            case 5:
+                return "vdqimk";
+            case 6:
+                return "vxdqimk";
+            default:
+                return "rcimk";
+        }
+    }
+
+    struct form_t {
+        const char *name;
+        u64 width;
+        string shape;
+    };
+
+    struct catalog_t {
+        vector<form_t> forms;
+
+        // Indices into `forms` per mnemonic, so every mnemonic is drawn equally often
+        vector<vector<u64>> by_name;
+    };
+
+    static auto mnemo_name(const char *name, u64 cond) -> string {
+        string s = name;
+        if (s == "cmov" || s == "set" || s == "j")
+            s += cond_names[cond];
+        return s;
+    }
+
+    static auto is_label_branch(const string &name) -> bool {
+        return name == "jmp" || name == "j" || name == "loop";
+    }
+
+    // Label all lines are validated against, so forms with label operands are accepted
+    static const string validation_target = "corpus_target";
+
+    static auto line(const form_t &form, u64 cond, const vector<string> &operands) -> string {
+        string s = mnemo_name(form.name, cond);
+        if (form.width != 0)
+            s += string(" ") + width_names[form.width];
+        for (u64 i = 0; i < operands.size(); i++)
+            s += (i == 0 ? " " : ", ") + operands[i];
+        return s + "\n";
+    }
+
+    // Returns the code of `source`, or nothing if the parser or the assembler rejects it
+    static auto assemble_line(const string &source) -> optional<vector<u8>> {
+        auto parsed = assembly::parse::parse(validation_target + ":\n" + source);
+        if (!parsed)
+            return nullopt;
+        try {
+            return assembly::assemble(parsed.value().data);
+        } catch (const exception &) {
+            return nullopt;
+        }
+    }
+
+    static auto constant_operand(u64 width, const vector<i64> &lanes) -> string {
+        u64 lane_count = width == 6 ? 4 : width == 5 ? 2 : 1;
+        string s = "[const ";
+        for (u64 i = 0; i < lane_count; i++)
+            s += (i == 0 ? "" : ", ") + to_string(lanes[i % lanes.size()]);
+        return s + "]";
+    }
+
+    static auto vector_register(u64 width, u64 index) -> string {
+        return (width == 6 ? "ymm" : "xmm") + to_string(index);
+    }
+
+    // Operands forms are tried with, also safe to execute as a fallback in executable corpora
+    static auto probe_operand(char kind, u64 width) -> string {
+        switch (kind) {
+            case 'r':
+                return gp_registers[width - 1][3];
+            case 'd':
+                return "edx";
+            case 'q':
+                return "rdx";
+            case 'c':
+                return "cl";
+            case 'v':
+                return vector_register(width, 1);
+            case 'x':
+                return "xmm2";
+            case 'i':
+                return "1";
+            case 'm':
+                return "[rsp + 32]";
+            case 'k':
+                return constant_operand(width, {1, 2, 3, 4});
+            default:
+                return validation_target;
+        }
+    }
+
+    static auto random_gp_register(mt19937_64 &rng, u64 size, bool executable) -> string {
+        // rsp and rbp hold the frame of executable corpora
+        while (true) {
+            u64 index = rng() % 8;
+            if (!executable || size == 0 || (index != 4 && index != 5))
+                return gp_registers[size][index];
+        }
+    }
+
+    static auto random_imm(mt19937_64 &rng) -> i64 {
+        switch (rng() % 4) {
+            case 0:
+                return i64(rng() % 16);
+            case 1:
+                return i64(rng() % 256) - 128;
+            case 2:
+                return i64(i32(rng()));
+            default:
+                return i64(rng());
+        }
+    }
+
+    static auto random_memory(mt19937_64 &rng, bool executable) -> string {
+        if (executable)
+            return "[rsp + " + to_string(32 * (rng() % (scratch_size / 32))) + "]";
+
+        i64 disp = rng() % 2 == 0 ? i64(rng() % 256) - 128 : i64(i32(rng()));
+        switch (rng() % 4) {
+            case 0:
+                return "[rip + " + to_string(disp) + "]";
+            case 1:
+                return "[" + random_gp_register(rng, 3, false) + "]";
+            default: {
+                // 32 bit addresses are less common, but encoded differently
+                u64 size = rng() % 4 == 0 ? 2 : 3;
+                string index = gp_registers[size][rng() % 8];
+                while (index == "esp" || index == "rsp")
+                    index = gp_registers[size][rng() % 8];
+                return "[" + random_gp_register(rng, size, false) + " + " + index + " * " +
+                       to_string(1 << (rng() % 4)) + " + " + to_string(disp) + "]";
+            }
+        }
+    }
+
+    static auto random_operand(mt19937_64 &rng, char kind, u64 width, bool executable, const string &label) -> string {
+        switch (kind) {
+            case 'r':
+                return random_gp_register(rng, width - 1, executable);
+            case 'd':
+                return random_gp_register(rng, 2, executable);
+            case 'q':
+                return random_gp_register(rng, 3, executable);
+            case 'c':
+                return "cl";
+            case 'v':
+                return vector_register(width, rng() % 8);
+            case 'x':
+                return vector_register(5, rng() % 8);
+            case 'i':
+                return to_string(random_imm(rng));
+            case 'm':
+                return random_memory(rng, executable);
+            case 'k':
+                return constant_operand(width, {i64(rng()), i64(rng()), i64(rng()), i64(rng())});
+            default:
+                return label;
+        }
+    }
+
+    // Adds the forms of one mnemonic at one width and returns the code of every accepted shape. `unsized` holds the
+    // code of the mnemonic without a width, forms where the width makes no difference are only kept without one.
+    static auto add_forms(catalog_t &catalog, const char *name, u64 width,
+                          const map<string, vector<u8>> &unsized) -> map<string, vector<u8>> {
+        string kinds = operand_kinds(width);
+        vector<string> shapes = {""};
+        for (u64 arity = 1, first = 0; arity <= 3; arity++) {
+            u64 last = shapes.size();
+            for (u64 s = first; s < last; s++)
+                for (char kind: kinds)
+                    shapes.push_back(shapes[s] + kind);
+            first = last;
+        }
+
+        // The assembler ignores operands past the ones a mnemonic takes, so a form whose code does not change
+        // when its last operand is dropped is not a form of its own
+        map<string, vector<u8>> accepted{};
+        for (const string &shape: shapes) {
+            form_t form = {name, width, shape};
+            vector<string> operands{};
+            for (char kind: shape)
+                operands.push_back(probe_operand(kind, width));
+            optional<vector<u8>> code = assemble_line(line(form, 0, operands));
+            if (!code)
+                continue;
+            accepted.emplace(shape, *code);
+            auto shorter = shape.empty() ? accepted.end() : accepted.find(shape.substr(0, shape.size() - 1));
+            if (shorter != accepted.end() && shorter->second == *code)
+                continue;
+            auto same = unsized.find(shape);
+            if (same != unsized.end() && same->second == *code)
+                continue;
+            catalog.by_name.back().push_back(catalog.forms.size());
+            catalog.forms.push_back(form);
+        }
+        return accepted;
+    }
+
+    static auto build_catalog() -> catalog_t {
+        catalog_t catalog{};
+        for (const char *name: gp_mnemo_names) {
+            catalog.by_name.emplace_back();
+            map<string, vector<u8>> unsized = add_forms(catalog, name, 0, {});
+            for (u64 width = 1; width <= 4; width++)
+                add_forms(catalog, name, width, unsized);
+        }
+        for (const char *name: vector_mnemo_names) {
+            catalog.by_name.emplace_back();
+            map<string, vector<u8>> unsized = add_forms(catalog, name, 0, {});
+            for (u64 width: {5, 6})
+                add_forms(catalog, name, width, unsized);
+        }
+        return catalog;
+    }
+
+    // Vector mnemonics are not interpreted, and `lea` of a stack slot returns an address
+    static auto is_interpretable(const form_t &form) -> bool {
+        string name = form.name;
+        if (name == "lea")
+            return false;
+        return none_of(begin(vector_mnemo_names), end(vector_mnemo_names), [&](const char *vector_name) {
+            return name == vector_name;
+        });
+    }
+
+    // Mnemonics leaving some flags undefined, which may differ between processors and the interpreter
+    static auto leaves_flags_undefined(const string &name) -> bool {
+        return name == "imul" || name == "shl" || name == "shr" || name == "sar" || name == "lzcnt" ||
+               name == "tzcnt" || name == "andn" || name == "bextr" || name == "blsr" || name == "blsi" ||
+               name == "blsmsk" || name == "bzhi";
+    }
+
+    static auto is_executable(const form_t &form) -> bool {
+        string name = form.name;
+        if (name == "push" || name == "pop" || name == "call" || name == "ret")
+            return false;
+        if (is_label_branch(name) && form.shape != "l")
+            return false;
+        // Constants live next to the code, which is not writable
+        if (!form.shape.empty() && form.shape[0] == 'k')
+            return false;
+        if (name == "popcnt")
+            return __builtin_cpu_supports("popcnt");
+        if (name == "andn" || name == "bextr" || name == "blsr" || name == "blsi" || name == "blsmsk")
+            return __builtin_cpu_supports("bmi");
+        if (name == "bzhi" || name == "pdep" || name == "pext" || name == "shlx" || name == "shrx" || name == "sarx")
+            return __builtin_cpu_supports("bmi2");
+        if (name[0] == 'v')
+            return __builtin_cpu_supports("avx2");
+        return true;
+    }
+
+    auto generate_corpus(const corpus_options &options) -> corpus_t {
+        static const catalog_t catalog = build_catalog();
+
+        vector<vector<u64>> by_name{};
+        u64 form_count = 0;
+        for (const vector<u64> &forms: catalog.by_name) {
+            vector<u64> allowed{};
+            for (u64 form: forms)
+                if (!options.executable || (is_executable(catalog.forms[form]) &&
+                                            (!options.interpretable || is_interpretable(catalog.forms[form]))))
+                    allowed.push_back(form);
+            form_count += allowed.size();
+            if (!allowed.empty())
+                by_name.push_back(move(allowed));
+        }
+
+        mt19937_64 rng(options.seed);
+        u64 block_count = (options.line_count + label_interval - 1) / label_interval;
+        u64 label_count = block_count + trailing_label_count;
+        auto label_name = [](u64 label) { return ".L" + to_string(label); };
+
+        string source{};
+        if (options.executable) {
+            source += "push QWORD rbx\n"
+                      "push QWORD rbp\n"
+                      "mov QWORD rbp, rsp\n"
+                      "and QWORD rsp, -32\n"
+                      "sub QWORD rsp, " + to_string(scratch_size) + "\n";
+            // Registers and the scratch frame start out zero and the flags defined, so the result only depends on the
+            // program
+            for (u64 offset = 0; offset < scratch_size; offset += 8)
+                source += "mov QWORD [rsp + " + to_string(offset) + "], 0\n";
+            if (!options.interpretable) {
+                for (u64 i = 0; i < 8; i++)
+                    source += __builtin_cpu_supports("avx2")
+                              ? "vpxor YMMWORD " + vector_register(6, i) + ", " + vector_register(6, i) + ", " +
+                                vector_register(6, i) + "\n"
+                              : "pxor XMMWORD " + vector_register(5, i) + ", " + vector_register(5, i) + "\n";
+            }
+            for (u64 i = 0; i < 8; i++) {
+                if (i != 4 && i != 5)
+                    source += string("xor DWORD ") + gp_registers[2][i] + ", " + gp_registers[2][i] + "\n";
+            }
+        }
+        for (u64 i = 0; i < options.line_count; i++) {
+            u64 block = i / label_interval;
+            if (i % label_interval == 0)
+                source += label_name(block) + ":\n";
+
+            const vector<u64> &forms = by_name[rng() % by_name.size()];
+            const form_t &form = catalog.forms[forms[rng() % forms.size()]];
+            u64 cond = rng() % size(cond_names);
+            // Branches of executable corpora only go forward, so the program always terminates
+            u64 target = options.executable ? block + 1 + rng() % trailing_label_count : rng() % label_count;
+
+            vector<string> operands{};
+            for (u64 attempt = 0;; attempt++) {
+                operands.clear();
+                for (char kind: form.shape) {
+                    operands.push_back(attempt < instantiation_attempts
+                                       ? random_operand(rng, kind, form.width, options.executable, validation_target)
+                                       : probe_operand(kind, form.width));
+                }
+                if (attempt == instantiation_attempts || assemble_line(line(form, cond, operands)))
+                    break;
+            }
+            // `loop` only has a rel8 form, so it targets a label right behind it
+            bool is_short = string(form.name) == "loop";
+            for (u64 o = 0; o < operands.size(); o++)
+                if (form.shape[o] == 'l')
+                    operands[o] = is_short ? ".S" + to_string(i) : label_name(target);
+            source += line(form, cond, operands);
+            if (options.interpretable && leaves_flags_undefined(form.name))
+                source += "test DWORD eax, eax\n";
+            if (is_short)
+                source += ".S" + to_string(i) + ":\n";
+        }
+        for (u64 label = block_count; label < label_count; label++)
+            source += label_name(label) + ":\n";
+        if (options.executable) {
+            source += "mov QWORD rsp, rbp\n"
+                      "pop QWORD rbp\n"
+                      "pop QWORD rbx\n";
+            if (!options.interpretable && __builtin_cpu_supports("avx2"))
+                source += "vzeroupper\n";
+        }
+        source += "ret\n";
+
+        return {
+                .source = source,
+                .line_count = options.line_count,
+                .form_count = form_count,
+        };
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../../int.hxx"
+#include "../../strvec.hxx"
+
+namespace assembly::corpus {
+    struct corpus_options {
+        // Instruction lines, label definitions come on top of these
+        u64 line_count = 10000;
+
+        u64 seed = 1;
+
+        // Only draw forms that are safe to call as a `jit_func_t`: no stack manipulation, calls or backward branches,
+        // memory operands only address a scratch frame, callee-saved registers are preserved and instruction set
+        // extensions are limited to the ones this CPU supports
+        bool executable = false;
+
+        // With `executable`, only draw forms `jit::interpret` supports and whose results do not depend on where the
+        // stack is, so the program returns the same value natively and interpreted: no vector forms and no `lea`.
+        // Lines leaving flags undefined are followed by a `test`, which defines them again.
+        bool interpretable = false;
+    };
+
+    struct corpus_t {
+        string source;
+
+        // Instruction lines, not counting label definitions, prologue and epilogue
+        u64 line_count;
+
+        // Distinct forms (mnemonic, width and operand shape) lines were drawn from
+        u64 form_count;
+    };
+
+    // Generates a random valid program. Forms are found once per process by trying every mnemonic the parser knows
+    // with every width and operand shape, and keeping the ones the assembler accepts. Every generated line is
+    // assembled before it is emitted, so the program always parses and assembles.
+    auto generate_corpus(const corpus_options &options = {}) -> corpus_t;
+}
@@ -0,0 +1,222 @@
+#include "elf.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+// Structures and constants of the ELF-64 Object File Format and the System V AMD64 psABI
+namespace assembly::elf {
+    struct elf64_header_t {
+        u8 ident[16];
+        u16 type;
+        u16 machine;
+        u32 version;
+        u64 entry;
+        u64 program_header_offset;
+        u64 section_header_offset;
+        u32 flags;
+        u16 header_size;
+        u16 program_header_size;
+        u16 program_header_count;
+        u16 section_header_size;
+        u16 section_header_count;
+        u16 section_names_index;
+    };
+
+    struct elf64_section_header_t {
+        u32 name;
+        u32 type;
+        u64 flags;
+        u64 address;
+        u64 offset;
+        u64 size;
+        u32 link;
+        u32 info;
+        u64 alignment;
+        u64 entry_size;
+    };
+
+    struct elf64_symbol_t {
+        u32 name;
+        u8 info;
+        u8 other;
+        u16 section_index;
+        u64 value;
+        u64 size;
+    };
+
+    struct elf64_rela_t {
+        u64 offset;
+        u64 info;
+        i64 addend;
+    };
+
+    static_assert(sizeof(elf64_header_t) == 64 && sizeof(elf64_section_header_t) == 64);
+    static_assert(sizeof(elf64_symbol_t) == 24 && sizeof(elf64_rela_t) == 24);
+
+    static constexpr u16 et_rel = 1;
+    static constexpr u16 em_x86_64 = 62;
+
+    static constexpr u32 sht_progbits = 1;
+    static constexpr u32 sht_symtab = 2;
+    static constexpr u32 sht_strtab = 3;
+    static constexpr u32 sht_rela = 4;
+
+    static constexpr u64 shf_alloc = 0x2;
+    static constexpr u64 shf_execinstr = 0x4;
+    static constexpr u64 shf_info_link = 0x40;
+
+    static constexpr u8 stb_local = 0;
+    static constexpr u8 stb_global = 1;
+    static constexpr u8 stt_notype = 0;
+    static constexpr u8 stt_func = 2;
+    static constexpr u8 stt_section = 3;
+
+    static constexpr u32 r_x86_64_pc32 = 2;
+    static constexpr u32 r_x86_64_plt32 = 4;
+
+    // Section header indices
+    enum section_t : u16 {
+        Null,
+        Text,
+        Rodata,
+        RelaText,
+        Symtab,
+        Strtab,
+        Shstrtab,
+        NoteGnuStack,
+        SectionCount,
+    };
+
+    // A string table, which starts with an empty string
+    struct string_table_t {
+        vector<u8> bytes{0};
+
+        auto add(const string &s) -> u32 {
+            u32 offset = u32(this->bytes.size());
+            this->bytes.insert(this->bytes.end(), s.begin(), s.end());
+            this->bytes.push_back(0);
+            return offset;
+        }
+    };
+
+    template<typename T>
+    static auto append_struct(vector<u8> &out, const T &value) -> void {
+        const u8 *bytes = reinterpret_cast<const u8 *>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    static auto align_output(vector<u8> &out, u64 alignment) -> void {
+        out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+    }
+
+    auto write_object(const vector<mnemo_t> &mnemos, const object_options &options) -> vector<u8> {
+        assemble_options assemble = options.assemble;
+        assemble.relocatable = true;
+        assemble_result assembled = assemble_detailed(mnemos, assemble);
+
+        unordered_map<label_t, u64> defined(assembled.labels.begin(), assembled.labels.end());
+        vector<label_t> exported{};
+        for (const string &name: options.exported) {
+            label_t label = intern_label(name);
+            if (!defined.contains(label))
+                throw logic_error("exported label \"" + name + "\" is not defined");
+            exported.push_back(label);
+        }
+
+        // Symbols: null, section symbols, local labels, then globals, as locals have to come first
+        string_table_t strtab{};
+        vector<elf64_symbol_t> symbols{};
+        symbols.push_back({});
+        symbols.push_back({0, u8(stb_local << 4 | stt_section), 0, Text, 0, 0});
+        u32 rodata_symbol = u32(symbols.size());
+        symbols.push_back({0, u8(stb_local << 4 | stt_section), 0, Rodata, 0, 0});
+        for (const auto &[label, offset]: assembled.labels) {
+            if (find(exported.begin(), exported.end(), label) == exported.end())
+                symbols.push_back({strtab.add(label_name(label)), u8(stb_local << 4 | stt_notype), 0, Text, offset,
+                                   0});
+        }
+        u32 first_global = u32(symbols.size());
+        for (label_t label: exported)
+            symbols.push_back({strtab.add(label_name(label)), u8(stb_global << 4 | stt_func), 0, Text,
+                               defined[label], 0});
+        unordered_map<label_t, u32> external_symbols{};
+        for (const relocation_t &relocation: assembled.relocations) {
+            if (relocation.target != relocation_t::target_t::Label || external_symbols.contains(relocation.label))
+                continue;
+            external_symbols.emplace(relocation.label, u32(symbols.size()));
+            symbols.push_back({strtab.add(label_name(relocation.label)), u8(stb_global << 4 | stt_notype), 0, Null,
+                               0, 0});
+        }
+
+        vector<elf64_rela_t> relas{};
+        for (const relocation_t &relocation: assembled.relocations) {
+            if (relocation.target == relocation_t::target_t::Label) {
+                u64 symbol = external_symbols[relocation.label];
+                relas.push_back({relocation.offset, symbol << 32 | r_x86_64_plt32, relocation.addend});
+            } else {
+                relas.push_back({relocation.offset, u64(rodata_symbol) << 32 | r_x86_64_pc32, relocation.addend});
+            }
+        }
+
+        string_table_t shstrtab{};
+        elf64_section_header_t sections[SectionCount] = {};
+        sections[Text] = {shstrtab.add(".text"), sht_progbits, shf_alloc | shf_execinstr, 0, 0, 0, 0, 0, 16, 0};
+        sections[Rodata] = {shstrtab.add(".rodata"), sht_progbits, shf_alloc, 0, 0, 0, 0, 0,
+                            assembled.rodata_alignment, 0};
+        sections[RelaText] = {shstrtab.add(".rela.text"), sht_rela, shf_info_link, 0, 0, 0, Symtab, Text, 8,
+                              sizeof(elf64_rela_t)};
+        sections[Symtab] = {shstrtab.add(".symtab"), sht_symtab, 0, 0, 0, 0, Strtab, first_global, 8,
+                            sizeof(elf64_symbol_t)};
+        sections[Strtab] = {shstrtab.add(".strtab"), sht_strtab, 0, 0, 0, 0, 0, 0, 1, 0};
+        sections[Shstrtab] = {shstrtab.add(".shstrtab"), sht_strtab, 0, 0, 0, 0, 0, 0, 1, 0};
+        sections[NoteGnuStack] = {shstrtab.add(".note.GNU-stack"), sht_progbits, 0, 0, 0, 0, 0, 0, 1, 0};
+
+        // Section contents follow the ELF header, the section header table comes last
+        vector<u8> out(sizeof(elf64_header_t), 0);
+        auto place = [&](section_t section, const u8 *data, u64 size) {
+            align_output(out, max<u64>(sections[section].alignment, 1));
+            sections[section].offset = out.size();
+            sections[section].size = size;
+            out.insert(out.end(), data, data + size);
+        };
+        place(Text, assembled.code.data(), assembled.code.size());
+        place(Rodata, assembled.rodata.data(), assembled.rodata.size());
+        place(RelaText, reinterpret_cast<const u8 *>(relas.data()), relas.size() * sizeof(elf64_rela_t));
+        place(Symtab, reinterpret_cast<const u8 *>(symbols.data()), symbols.size() * sizeof(elf64_symbol_t));
+        place(Strtab, strtab.bytes.data(), strtab.bytes.size());
+        place(Shstrtab, shstrtab.bytes.data(), shstrtab.bytes.size());
+        sections[NoteGnuStack].offset = out.size();
+
+        align_output(out, 8);
+        u64 section_header_offset = out.size();
+        for (const elf64_section_header_t &section: sections)
+            append_struct(out, section);
+
+        elf64_header_t header = {
+                .ident = {0x7f, 'E', 'L', 'F', 2 /* 64-bit */, 1 /* little endian */, 1 /* version */},
+                .type = et_rel,
+                .machine = em_x86_64,
+                .version = 1,
+                .section_header_offset = section_header_offset,
+                .header_size = sizeof(elf64_header_t),
+                .section_header_size = sizeof(elf64_section_header_t),
+                .section_header_count = SectionCount,
+                .section_names_index = Shstrtab,
+        };
+        memcpy(out.data(), &header, sizeof(header));
+        return out;
+    }
+
+    auto write_object_file(const string &path, const vector<mnemo_t> &mnemos, const object_options &options) -> void {
+        vector<u8> object = write_object(mnemos, options);
+        ofstream file(path, ios::binary | ios::trunc);
+        file.write(reinterpret_cast<const char *>(object.data()), i64(object.size()));
+        if (!file)
+            throw runtime_error("could not write object file " + path);
+    }
+}
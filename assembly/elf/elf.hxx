@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../../int.hxx"
+#include "../../strvec.hxx"
+#include "../assembly.hxx"
+
+namespace assembly::elf {
+    struct object_options {
+        // Labels exported as global function symbols, every other defined label is a local symbol
+        vector<string> exported;
+
+        assemble_options assemble;
+    };
+
+    // Assembles mnemos into an ELF64 x86-64 relocatable object (`.o`) that the system linker accepts.
+    //
+    // Code goes to `.text` and constants to `.rodata`. Branches to labels that are not defined are calls to
+    // external symbols with R_X86_64_PLT32 relocations, constant operands use R_X86_64_PC32 relocations against
+    // `.rodata`. The object has a `.note.GNU-stack` section, so linking it does not make the stack executable.
+    auto write_object(const vector<mnemo_t> &mnemos, const object_options &options) -> vector<u8>;
+
+    auto write_object_file(const string &path, const vector<mnemo_t> &mnemos, const object_options &options) -> void;
+}
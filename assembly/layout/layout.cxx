@@ -0,0 +1,264 @@
+#include "layout.hxx"
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+namespace assembly::layout {
+    static constexpr u64 cache_line_size = 64;
+
+    static auto starts_block(const mnemo_t &mnemo) -> bool {
+        return mnemo.tag == mnemo_t::tag_t::Label || mnemo.tag == mnemo_t::tag_t::Align;
+    }
+
+    static auto is_terminator(const mnemo_t &mnemo) -> bool {
+        switch (mnemo.tag) {
+            case mnemo_t::tag_t::Jmp:
+            case mnemo_t::tag_t::Jcc:
+            case mnemo_t::tag_t::Loop:
+            case mnemo_t::tag_t::Ret:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static auto can_fall_through(const mnemo_t &mnemo) -> bool {
+        return mnemo.tag != mnemo_t::tag_t::Jmp && mnemo.tag != mnemo_t::tag_t::Ret;
+    }
+
+    static auto jmp_to(label_t label) -> mnemo_t {
+        return {
+                .tag = mnemo_t::tag_t::Jmp,
+                .width = mnemo_t::width_t::NotSet,
+                .a1 = mnemo_t::arg_t::label(label),
+        };
+    }
+
+    auto split_basic_blocks(const vector<mnemo_t> &mnemos) -> vector<basic_block_t> {
+        vector<basic_block_t> blocks{};
+        unordered_map<label_t, i64> label_blocks{};
+        for (u64 i = 0; i < mnemos.size(); i++) {
+            if (i == 0 || (starts_block(mnemos[i]) && !starts_block(mnemos[i - 1])) || is_terminator(mnemos[i - 1])) {
+                if (!blocks.empty())
+                    blocks.back().end = i;
+                blocks.push_back({i, mnemos.size(), -1, -1});
+            }
+            if (mnemos[i].tag == mnemo_t::tag_t::Label)
+                label_blocks[mnemos[i].a1.data.label] = i64(blocks.size() - 1);
+        }
+
+        for (u64 b = 0; b < blocks.size(); b++) {
+            const mnemo_t &last = mnemos[blocks[b].end - 1];
+            if (can_fall_through(last) && b + 1 < blocks.size())
+                blocks[b].fallthrough = i64(b + 1);
+            if (is_terminator(last) && last.tag != mnemo_t::tag_t::Ret && last.a1.tag == mnemo_t::arg_t::tag_t::Label) {
+                auto it = label_blocks.find(last.a1.data.label);
+                if (it != label_blocks.end())
+                    blocks[b].target = it->second;
+            }
+        }
+        return blocks;
+    }
+
+    struct edge_t {
+        u64 from;
+        u64 to;
+        u64 weight;
+        bool is_fallthrough;
+    };
+
+    // Lines of the code overlapped by hot blocks. `labels[b]` is at the start of block b in `mnemos`, and blocks
+    // are laid out in `order`.
+    static auto hot_cache_lines(const vector<mnemo_t> &mnemos, const vector<label_t> &labels, const vector<u64> &order,
+                                const vector<bool> &is_hot) -> u64 {
+        assemble_options options{};
+        options.relocatable = true;
+        assemble_result result = assemble_detailed(mnemos, options);
+        unordered_map<label_t, u64> offsets(result.labels.begin(), result.labels.end());
+
+        set<u64> lines{};
+        for (u64 k = 0; k < order.size(); k++) {
+            u64 begin = offsets[labels[order[k]]];
+            u64 end = k + 1 < order.size() ? offsets[labels[order[k + 1]]] : result.code.size();
+            if (!is_hot[order[k]] || begin == end)
+                continue;
+            for (u64 line = begin / cache_line_size; line <= (end - 1) / cache_line_size; line++)
+                lines.insert(line);
+        }
+        return lines.size();
+    }
+
+    auto layout_function(const vector<mnemo_t> &mnemos, const vector<u64> &block_counts,
+                         const layout_options &options) -> layout_result {
+        vector<basic_block_t> blocks = split_basic_blocks(mnemos);
+        if (block_counts.size() != blocks.size())
+            throw logic_error("block counts do not match the basic blocks");
+
+        layout_result unchanged = {mnemos, mnemos.size(), {}};
+        u64 n = blocks.size();
+        vector<bool> is_hot(n);
+        for (u64 b = 0; b < n; b++)
+            is_hot[b] = block_counts[b] > options.cold_threshold;
+        bool has_loop = any_of(mnemos.begin(), mnemos.end(), [](const mnemo_t &mnemo) {
+            return mnemo.tag == mnemo_t::tag_t::Loop;
+        });
+        if (n == 0 || has_loop || can_fall_through(mnemos[blocks.back().end - 1]) || !is_hot[0])
+            return unchanged;
+
+        vector<edge_t> edges{};
+        for (u64 b = 0; b < n; b++) {
+            if (blocks[b].fallthrough != -1) {
+                u64 to = u64(blocks[b].fallthrough);
+                edges.push_back({b, to, min(block_counts[b], block_counts[to]), true});
+            }
+            if (blocks[b].target != -1) {
+                u64 to = u64(blocks[b].target);
+                edges.push_back({b, to, min(block_counts[b], block_counts[to]), false});
+            }
+        }
+
+        // Merge chains along the heaviest edges, the entry block stays at the head of its chain
+        vector<vector<u64>> chains(n);
+        vector<u64> chain_of(n);
+        for (u64 b = 0; b < n; b++) {
+            chains[b] = {b};
+            chain_of[b] = b;
+        }
+        vector<edge_t> by_weight = edges;
+        stable_sort(by_weight.begin(), by_weight.end(), [](const edge_t &a, const edge_t &b) {
+            return a.weight > b.weight;
+        });
+        for (const edge_t &edge: by_weight) {
+            u64 from_chain = chain_of[edge.from];
+            u64 to_chain = chain_of[edge.to];
+            if (edge.weight == 0 || !is_hot[edge.from] || !is_hot[edge.to] || edge.to == 0 ||
+                from_chain == to_chain || chains[from_chain].back() != edge.from || chains[to_chain].front() != edge.to)
+                continue;
+            for (u64 b: chains[to_chain]) {
+                chains[from_chain].push_back(b);
+                chain_of[b] = from_chain;
+            }
+            chains[to_chain].clear();
+        }
+
+        // Entry chain, other hot chains by their hottest block, then cold blocks in program order
+        auto hottest = [&](u64 chain) -> u64 {
+            u64 count = 0;
+            for (u64 b: chains[chain])
+                count = max(count, block_counts[b]);
+            return count;
+        };
+        vector<u64> hot_chains{};
+        for (u64 c = 0; c < n; c++) {
+            if (!chains[c].empty() && c != chain_of[0] && is_hot[chains[c].front()])
+                hot_chains.push_back(c);
+        }
+        stable_sort(hot_chains.begin(), hot_chains.end(), [&](u64 a, u64 b) {
+            return hottest(a) > hottest(b);
+        });
+        vector<u64> order = chains[chain_of[0]];
+        for (u64 c: hot_chains)
+            order.insert(order.end(), chains[c].begin(), chains[c].end());
+        u64 hot_block_count = order.size();
+        for (u64 b = 0; b < n; b++) {
+            if (!is_hot[b])
+                order.push_back(b);
+        }
+
+        // Every block needs a label, as its predecessor may branch to it now
+        vector<label_t> labels(n);
+        vector<bool> has_label(n, false);
+        for (u64 b = 0; b < n; b++) {
+            for (u64 i = blocks[b].begin; i < blocks[b].end && starts_block(mnemos[i]) && !has_label[b]; i++) {
+                if (mnemos[i].tag == mnemo_t::tag_t::Label) {
+                    labels[b] = mnemos[i].a1.data.label;
+                    has_label[b] = true;
+                }
+            }
+            if (!has_label[b])
+                labels[b] = intern_label(options.label_prefix + ".bb" + to_string(b));
+        }
+
+        // Block placed after each block. Hot code never falls through into the cold region, so the cold region
+        // can be moved away from the function.
+        vector<i64> next_of(n, -1);
+        for (u64 k = 0; k + 1 < n; k++) {
+            if (k + 1 != hot_block_count)
+                next_of[order[k]] = i64(order[k + 1]);
+        }
+
+        layout_result result{};
+        result.cold_begin = 0;
+        for (u64 k = 0; k < n; k++) {
+            u64 b = order[k];
+            i64 next = next_of[b];
+            if (k == hot_block_count)
+                result.cold_begin = result.mnemos.size();
+            if (!has_label[b])
+                result.mnemos.push_back({.tag = mnemo_t::tag_t::Label, .width = mnemo_t::width_t::NotSet,
+                                         .a1 = mnemo_t::arg_t::label(labels[b])});
+
+            const basic_block_t &block = blocks[b];
+            const mnemo_t &last = mnemos[block.end - 1];
+            bool has_terminator = is_terminator(last);
+            result.mnemos.insert(result.mnemos.end(), mnemos.begin() + i64(block.begin),
+                                 mnemos.begin() + i64(block.end - (has_terminator ? 1 : 0)));
+
+            if (last.tag == mnemo_t::tag_t::Jcc && block.target != -1 && block.target == next &&
+                block.fallthrough != next) {
+                mnemo_t inverted = last;
+                inverted.cond = mnemo_t::cond_t(u8(last.cond) ^ 1);
+                inverted.a1 = mnemo_t::arg_t::label(labels[block.fallthrough]);
+                result.mnemos.push_back(inverted);
+                continue;
+            }
+            bool is_jmp_to_next = last.tag == mnemo_t::tag_t::Jmp && block.target != -1 && block.target == next;
+            if (has_terminator && !is_jmp_to_next)
+                result.mnemos.push_back(last);
+            if (block.fallthrough != -1 && block.fallthrough != next)
+                result.mnemos.push_back(jmp_to(labels[block.fallthrough]));
+        }
+        if (hot_block_count == n)
+            result.cold_begin = result.mnemos.size();
+
+        result.report.applied = true;
+        result.report.cold_block_count = n - hot_block_count;
+        for (const edge_t &edge: edges) {
+            if (!edge.is_fallthrough)
+                result.report.taken_branches_before += edge.weight;
+            if (next_of[edge.from] != i64(edge.to))
+                result.report.taken_branches_after += edge.weight;
+        }
+
+        vector<mnemo_t> labeled{};
+        for (u64 b = 0; b < n; b++) {
+            if (!has_label[b])
+                labeled.push_back({.tag = mnemo_t::tag_t::Label, .width = mnemo_t::width_t::NotSet,
+                                   .a1 = mnemo_t::arg_t::label(labels[b])});
+            labeled.insert(labeled.end(), mnemos.begin() + i64(blocks[b].begin), mnemos.begin() + i64(blocks[b].end));
+        }
+        vector<u64> program_order(n);
+        for (u64 b = 0; b < n; b++)
+            program_order[b] = b;
+        result.report.hot_cache_lines_before = hot_cache_lines(labeled, labels, program_order, is_hot);
+        result.report.hot_cache_lines_after = hot_cache_lines(result.mnemos, labels, order, is_hot);
+        return result;
+    }
+}
+
+namespace assembly {
+    auto layout_report::print() const -> void {
+        if (!this->applied) {
+            std::cout << "layout unchanged\n";
+            return;
+        }
+        std::cout << "hot cache lines: " << this->hot_cache_lines_before << " -> " << this->hot_cache_lines_after
+                  << ", taken branches: " << this->taken_branches_before << " -> " << this->taken_branches_after
+                  << ", cold blocks: " << this->cold_block_count << "\n";
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../../int.hxx"
+#include "../../strvec.hxx"
+#include "../assembly.hxx"
+
+namespace assembly::layout {
+    struct basic_block_t {
+        // Mnemos [begin, end) of the function
+        u64 begin;
+        u64 end;
+
+        // Successor blocks, -1 if there is none. `fallthrough` is -1 after `jmp` and `ret`, `target` is -1 unless
+        // the block ends with a branch to a label defined in the function.
+        i64 fallthrough;
+        i64 target;
+    };
+
+    // Splits mnemos into basic blocks in program order, block 0 is the entry. A block starts at the first mnemo, at
+    // a run of labels and `align`s, and after `jmp`, `jcc`, `loop` and `ret`.
+    auto split_basic_blocks(const vector<mnemo_t> &mnemos) -> vector<basic_block_t>;
+
+    struct layout_options {
+        // Blocks executed at most this many times are cold
+        u64 cold_threshold = 0;
+
+        // Prefix of labels created for blocks without a label
+        string label_prefix = ".layout";
+    };
+
+    struct layout_result {
+        vector<mnemo_t> mnemos;
+
+        // Cold blocks are mnemos [cold_begin, mnemos.size()). Hot blocks do not fall through into them, so they
+        // may be assembled apart from the hot blocks.
+        u64 cold_begin;
+
+        layout_report report;
+    };
+
+    // Pettis-Hansen style block layout. Blocks are chained along the heaviest edges first, so the most executed
+    // successor of a block falls through, then chains are placed by descending execution count after the entry
+    // chain and cold blocks follow in program order. Conditional branches are inverted or followed by a `jmp`
+    // where the fall-through moved.
+    //
+    // Edge counts are estimated from block counts as the smaller count of the two blocks. Functions which contain
+    // `loop`, whose rel8 target could move out of range, or which may fall off their end are left unchanged.
+    auto layout_function(const vector<mnemo_t> &mnemos, const vector<u64> &block_counts,
+                         const layout_options &options = {}) -> layout_result;
+}
@@ -1,5 +1,7 @@
 #include "parse.hxx"
 
+#include "../../os/trace.hxx"
+
 // Parse assembly text using parser combinators
 
 using namespace std;
@@ -19,84 +21,420 @@ static auto make_error(parsec::strive s, const char *what) -> ParserError {
 
 static auto parse_register(strive tail) -> ParserResultResult<reg_t> {
     return OptionParserResult<reg_t>().choice([=]() {
-        return consume_prefix_str(tail, "al", reg_t::Al);
+        return consume_word_str(tail, "al", reg_t::Al);
+    }).choice([=]() {
+        return consume_word_str(tail, "bl", reg_t::Bl);
+    }).choice([=]() {
+        return consume_word_str(tail, "cl", reg_t::Cl);
+    }).choice([=]() {
+        return consume_word_str(tail, "dl", reg_t::Dl);
+    }).choice([=]() {
+        return consume_word_str(tail, "ah", reg_t::Ah);
+    }).choice([=]() {
+        return consume_word_str(tail, "bh", reg_t::Bh);
+    }).choice([=]() {
+        return consume_word_str(tail, "ch", reg_t::Ch);
+    }).choice([=]() {
+        return consume_word_str(tail, "dh", reg_t::Dh);
+    }).choice([=]() {
+        return consume_word_str(tail, "ax", reg_t::Ax);
+    }).choice([=]() {
+        return consume_word_str(tail, "bx", reg_t::Bx);
+    }).choice([=]() {
+        return consume_word_str(tail, "cx", reg_t::Cx);
+    }).choice([=]() {
+        return consume_word_str(tail, "dx", reg_t::Dx);
+    }).choice([=]() {
+        return consume_word_str(tail, "sp", reg_t::Sp);
+    }).choice([=]() {
+        return consume_word_str(tail, "bp", reg_t::Bp);
     }).choice([=]() {
-        return consume_prefix_str(tail, "bl", reg_t::Bl);
+        return consume_word_str(tail, "si", reg_t::Si);
     }).choice([=]() {
-        return consume_prefix_str(tail, "cl", reg_t::Cl);
+        return consume_word_str(tail, "di", reg_t::Di);
     }).choice([=]() {
-        return consume_prefix_str(tail, "dl", reg_t::Dl);
+        return consume_word_str(tail, "eax", reg_t::Eax);
     }).choice([=]() {
-        return consume_prefix_str(tail, "ah", reg_t::Ah);
+        return consume_word_str(tail, "ebx", reg_t::Ebx);
     }).choice([=]() {
-        return consume_prefix_str(tail, "bh", reg_t::Bh);
+        return consume_word_str(tail, "ecx", reg_t::Ecx);
     }).choice([=]() {
-        return consume_prefix_str(tail, "ch", reg_t::Ch);
+        return consume_word_str(tail, "edx", reg_t::Edx);
     }).choice([=]() {
-        return consume_prefix_str(tail, "dh", reg_t::Dh);
+        return consume_word_str(tail, "esp", reg_t::Esp);
     }).choice([=]() {
-        return consume_prefix_str(tail, "ax", reg_t::Ax);
+        return consume_word_str(tail, "ebp", reg_t::Ebp);
     }).choice([=]() {
-        return consume_prefix_str(tail, "bx", reg_t::Bx);
+        return consume_word_str(tail, "esi", reg_t::Esi);
     }).choice([=]() {
-        return consume_prefix_str(tail, "cx", reg_t::Cx);
+        return consume_word_str(tail, "edi", reg_t::Edi);
     }).choice([=]() {
-        return consume_prefix_str(tail, "dx", reg_t::Dx);
+        return consume_word_str(tail, "rax", reg_t::Rax);
     }).choice([=]() {
-        return consume_prefix_str(tail, "sp", reg_t::Sp);
+        return consume_word_str(tail, "rbx", reg_t::Rbx);
     }).choice([=]() {
-        return consume_prefix_str(tail, "bp", reg_t::Bp);
+        return consume_word_str(tail, "rcx", reg_t::Rcx);
     }).choice([=]() {
-        return consume_prefix_str(tail, "si", reg_t::Si);
+        return consume_word_str(tail, "rdx", reg_t::Rdx);
     }).choice([=]() {
-        return consume_prefix_str(tail, "di", reg_t::Di);
+        return consume_word_str(tail, "rsp", reg_t::Rsp);
     }).choice([=]() {
-        return consume_prefix_str(tail, "eax", reg_t::Eax);
+        return consume_word_str(tail, "rbp", reg_t::Rbp);
     }).choice([=]() {
-        return consume_prefix_str(tail, "ebx", reg_t::Ebx);
+        return consume_word_str(tail, "rsi", reg_t::Rsi);
     }).choice([=]() {
-        return consume_prefix_str(tail, "ecx", reg_t::Ecx);
+        return consume_word_str(tail, "rdi", reg_t::Rdi);
     }).choice([=]() {
-        return consume_prefix_str(tail, "edx", reg_t::Edx);
+        return consume_word_str(tail, "rip", reg_t::Rip);
     }).choice([=]() {
-        return consume_prefix_str(tail, "esp", reg_t::Esp);
+        return consume_word_str(tail, "xmm0", reg_t::Xmm0);
     }).choice([=]() {
-        return consume_prefix_str(tail, "ebp", reg_t::Ebp);
+        return consume_word_str(tail, "xmm1", reg_t::Xmm1);
     }).choice([=]() {
-        return consume_prefix_str(tail, "esi", reg_t::Esi);
+        return consume_word_str(tail, "xmm2", reg_t::Xmm2);
     }).choice([=]() {
-        return consume_prefix_str(tail, "edi", reg_t::Edi);
+        return consume_word_str(tail, "xmm3", reg_t::Xmm3);
     }).choice([=]() {
-        return consume_prefix_str(tail, "rax", reg_t::Rax);
+        return consume_word_str(tail, "xmm4", reg_t::Xmm4);
     }).choice([=]() {
-        return consume_prefix_str(tail, "rbx", reg_t::Rbx);
+        return consume_word_str(tail, "xmm5", reg_t::Xmm5);
     }).choice([=]() {
-        return consume_prefix_str(tail, "rcx", reg_t::Rcx);
+        return consume_word_str(tail, "xmm6", reg_t::Xmm6);
     }).choice([=]() {
-        return consume_prefix_str(tail, "rdx", reg_t::Rdx);
+        return consume_word_str(tail, "xmm7", reg_t::Xmm7);
     }).choice([=]() {
-        return consume_prefix_str(tail, "rsp", reg_t::Rsp);
+        return consume_word_str(tail, "ymm0", reg_t::Ymm0);
     }).choice([=]() {
-        return consume_prefix_str(tail, "rbp", reg_t::Rbp);
+        return consume_word_str(tail, "ymm1", reg_t::Ymm1);
     }).choice([=]() {
-        return consume_prefix_str(tail, "rsi", reg_t::Rsi);
+        return consume_word_str(tail, "ymm2", reg_t::Ymm2);
     }).choice([=]() {
-        return consume_prefix_str(tail, "rdi", reg_t::Rdi);
+        return consume_word_str(tail, "ymm3", reg_t::Ymm3);
+    }).choice([=]() {
+        return consume_word_str(tail, "ymm4", reg_t::Ymm4);
+    }).choice([=]() {
+        return consume_word_str(tail, "ymm5", reg_t::Ymm5);
+    }).choice([=]() {
+        return consume_word_str(tail, "ymm6", reg_t::Ymm6);
+    }).choice([=]() {
+        return consume_word_str(tail, "ymm7", reg_t::Ymm7);
     }).unwrap_or(make_error(tail, "expected register"));
 }
 
 static auto parse_mnemo_name(strive tail) -> ParserResultResult<mnemo_t::tag_t> {
-    return consume_prefix_str(tail, "mov", mnemo_t::tag_t::Mov).choice([=]() {
-        return consume_prefix_str(tail, "add", mnemo_t::tag_t::Add);
+    return consume_word_str(tail, "mov", mnemo_t::tag_t::Mov).choice([=]() {
+        return consume_word_str(tail, "add", mnemo_t::tag_t::Add);
+    }).choice([=]() {
+        return consume_word_str(tail, "push", mnemo_t::tag_t::Push);
+    }).choice([=]() {
+        return consume_word_str(tail, "pop", mnemo_t::tag_t::Pop);
+    }).choice([=]() {
+        return consume_word_str(tail, "ret", mnemo_t::tag_t::Ret);
+    }).choice([=]() {
+        return consume_word_str(tail, "sub", mnemo_t::tag_t::Sub);
+    }).choice([=]() {
+        return consume_word_str(tail, "and", mnemo_t::tag_t::And);
+    }).choice([=]() {
+        return consume_word_str(tail, "or", mnemo_t::tag_t::Or);
+    }).choice([=]() {
+        return consume_word_str(tail, "xor", mnemo_t::tag_t::Xor);
+    }).choice([=]() {
+        return consume_word_str(tail, "cmp", mnemo_t::tag_t::Cmp);
+    }).choice([=]() {
+        return consume_word_str(tail, "test", mnemo_t::tag_t::Test);
+    }).choice([=]() {
+        return consume_word_str(tail, "lea", mnemo_t::tag_t::Lea);
+    }).choice([=]() {
+        return consume_word_str(tail, "imul", mnemo_t::tag_t::Imul);
+    }).choice([=]() {
+        return consume_word_str(tail, "shl", mnemo_t::tag_t::Shl);
+    }).choice([=]() {
+        return consume_word_str(tail, "shr", mnemo_t::tag_t::Shr);
+    }).choice([=]() {
+        return consume_word_str(tail, "sar", mnemo_t::tag_t::Sar);
+    }).choice([=]() {
+        return consume_word_str(tail, "inc", mnemo_t::tag_t::Inc);
+    }).choice([=]() {
+        return consume_word_str(tail, "dec", mnemo_t::tag_t::Dec);
+    }).choice([=]() {
+        return consume_word_str(tail, "neg", mnemo_t::tag_t::Neg);
+    }).choice([=]() {
+        return consume_word_str(tail, "not", mnemo_t::tag_t::Not);
+    }).choice([=]() {
+        return consume_word_str(tail, "movdqu", mnemo_t::tag_t::Movdqu);
+    }).choice([=]() {
+        return consume_word_str(tail, "movdqa", mnemo_t::tag_t::Movdqa);
+    }).choice([=]() {
+        return consume_word_str(tail, "movups", mnemo_t::tag_t::Movups);
+    }).choice([=]() {
+        return consume_word_str(tail, "movaps", mnemo_t::tag_t::Movaps);
+    }).choice([=]() {
+        return consume_word_str(tail, "movd", mnemo_t::tag_t::Movd);
+    }).choice([=]() {
+        return consume_word_str(tail, "movq", mnemo_t::tag_t::Movq);
+    }).choice([=]() {
+        return consume_word_str(tail, "paddb", mnemo_t::tag_t::Paddb);
+    }).choice([=]() {
+        return consume_word_str(tail, "paddw", mnemo_t::tag_t::Paddw);
+    }).choice([=]() {
+        return consume_word_str(tail, "paddd", mnemo_t::tag_t::Paddd);
+    }).choice([=]() {
+        return consume_word_str(tail, "paddq", mnemo_t::tag_t::Paddq);
+    }).choice([=]() {
+        return consume_word_str(tail, "psubb", mnemo_t::tag_t::Psubb);
+    }).choice([=]() {
+        return consume_word_str(tail, "psubw", mnemo_t::tag_t::Psubw);
+    }).choice([=]() {
+        return consume_word_str(tail, "psubd", mnemo_t::tag_t::Psubd);
+    }).choice([=]() {
+        return consume_word_str(tail, "psubq", mnemo_t::tag_t::Psubq);
+    }).choice([=]() {
+        return consume_word_str(tail, "pand", mnemo_t::tag_t::Pand);
+    }).choice([=]() {
+        return consume_word_str(tail, "pandn", mnemo_t::tag_t::Pandn);
+    }).choice([=]() {
+        return consume_word_str(tail, "por", mnemo_t::tag_t::Por);
+    }).choice([=]() {
+        return consume_word_str(tail, "pxor", mnemo_t::tag_t::Pxor);
+    }).choice([=]() {
+        return consume_word_str(tail, "pcmpeqb", mnemo_t::tag_t::Pcmpeqb);
+    }).choice([=]() {
+        return consume_word_str(tail, "pcmpeqw", mnemo_t::tag_t::Pcmpeqw);
+    }).choice([=]() {
+        return consume_word_str(tail, "pcmpeqd", mnemo_t::tag_t::Pcmpeqd);
+    }).choice([=]() {
+        return consume_word_str(tail, "pcmpgtb", mnemo_t::tag_t::Pcmpgtb);
+    }).choice([=]() {
+        return consume_word_str(tail, "pcmpgtw", mnemo_t::tag_t::Pcmpgtw);
+    }).choice([=]() {
+        return consume_word_str(tail, "pcmpgtd", mnemo_t::tag_t::Pcmpgtd);
+    }).choice([=]() {
+        return consume_word_str(tail, "pmovmskb", mnemo_t::tag_t::Pmovmskb);
+    }).choice([=]() {
+        return consume_word_str(tail, "pshufb", mnemo_t::tag_t::Pshufb);
+    }).choice([=]() {
+        return consume_word_str(tail, "addps", mnemo_t::tag_t::Addps);
+    }).choice([=]() {
+        return consume_word_str(tail, "addpd", mnemo_t::tag_t::Addpd);
+    }).choice([=]() {
+        return consume_word_str(tail, "subps", mnemo_t::tag_t::Subps);
+    }).choice([=]() {
+        return consume_word_str(tail, "subpd", mnemo_t::tag_t::Subpd);
+    }).choice([=]() {
+        return consume_word_str(tail, "mulps", mnemo_t::tag_t::Mulps);
+    }).choice([=]() {
+        return consume_word_str(tail, "mulpd", mnemo_t::tag_t::Mulpd);
+    }).choice([=]() {
+        return consume_word_str(tail, "xorps", mnemo_t::tag_t::Xorps);
+    }).choice([=]() {
+        return consume_word_str(tail, "vmovdqu", mnemo_t::tag_t::Vmovdqu);
+    }).choice([=]() {
+        return consume_word_str(tail, "vmovdqa", mnemo_t::tag_t::Vmovdqa);
+    }).choice([=]() {
+        return consume_word_str(tail, "vmovups", mnemo_t::tag_t::Vmovups);
+    }).choice([=]() {
+        return consume_word_str(tail, "vmovaps", mnemo_t::tag_t::Vmovaps);
+    }).choice([=]() {
+        return consume_word_str(tail, "vmovd", mnemo_t::tag_t::Vmovd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vmovq", mnemo_t::tag_t::Vmovq);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpaddb", mnemo_t::tag_t::Vpaddb);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpaddw", mnemo_t::tag_t::Vpaddw);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpaddd", mnemo_t::tag_t::Vpaddd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpaddq", mnemo_t::tag_t::Vpaddq);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpsubb", mnemo_t::tag_t::Vpsubb);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpsubw", mnemo_t::tag_t::Vpsubw);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpsubd", mnemo_t::tag_t::Vpsubd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpsubq", mnemo_t::tag_t::Vpsubq);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpand", mnemo_t::tag_t::Vpand);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpandn", mnemo_t::tag_t::Vpandn);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpor", mnemo_t::tag_t::Vpor);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpxor", mnemo_t::tag_t::Vpxor);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpcmpeqb", mnemo_t::tag_t::Vpcmpeqb);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpcmpeqw", mnemo_t::tag_t::Vpcmpeqw);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpcmpeqd", mnemo_t::tag_t::Vpcmpeqd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpcmpgtb", mnemo_t::tag_t::Vpcmpgtb);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpcmpgtw", mnemo_t::tag_t::Vpcmpgtw);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpcmpgtd", mnemo_t::tag_t::Vpcmpgtd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpmovmskb", mnemo_t::tag_t::Vpmovmskb);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpshufb", mnemo_t::tag_t::Vpshufb);
+    }).choice([=]() {
+        return consume_word_str(tail, "vaddps", mnemo_t::tag_t::Vaddps);
+    }).choice([=]() {
+        return consume_word_str(tail, "vaddpd", mnemo_t::tag_t::Vaddpd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vsubps", mnemo_t::tag_t::Vsubps);
+    }).choice([=]() {
+        return consume_word_str(tail, "vsubpd", mnemo_t::tag_t::Vsubpd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vmulps", mnemo_t::tag_t::Vmulps);
+    }).choice([=]() {
+        return consume_word_str(tail, "vmulpd", mnemo_t::tag_t::Vmulpd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vxorps", mnemo_t::tag_t::Vxorps);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpbroadcastb", mnemo_t::tag_t::Vpbroadcastb);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpbroadcastw", mnemo_t::tag_t::Vpbroadcastw);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpbroadcastd", mnemo_t::tag_t::Vpbroadcastd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vpbroadcastq", mnemo_t::tag_t::Vpbroadcastq);
+    }).choice([=]() {
+        return consume_word_str(tail, "vbroadcastss", mnemo_t::tag_t::Vbroadcastss);
+    }).choice([=]() {
+        return consume_word_str(tail, "vbroadcastsd", mnemo_t::tag_t::Vbroadcastsd);
+    }).choice([=]() {
+        return consume_word_str(tail, "vzeroupper", mnemo_t::tag_t::Vzeroupper);
+    }).choice([=]() {
+        return consume_word_str(tail, "popcnt", mnemo_t::tag_t::Popcnt);
     }).choice([=]() {
-        return consume_prefix_str(tail, "push", mnemo_t::tag_t::Push);
+        return consume_word_str(tail, "lzcnt", mnemo_t::tag_t::Lzcnt);
     }).choice([=]() {
-        return consume_prefix_str(tail, "pop", mnemo_t::tag_t::Pop);
+        return consume_word_str(tail, "tzcnt", mnemo_t::tag_t::Tzcnt);
     }).choice([=]() {
-        return consume_prefix_str(tail, "ret", mnemo_t::tag_t::Ret);
+        return consume_word_str(tail, "andn", mnemo_t::tag_t::Andn);
+    }).choice([=]() {
+        return consume_word_str(tail, "bextr", mnemo_t::tag_t::Bextr);
+    }).choice([=]() {
+        return consume_word_str(tail, "blsr", mnemo_t::tag_t::Blsr);
+    }).choice([=]() {
+        return consume_word_str(tail, "blsi", mnemo_t::tag_t::Blsi);
+    }).choice([=]() {
+        return consume_word_str(tail, "blsmsk", mnemo_t::tag_t::Blsmsk);
+    }).choice([=]() {
+        return consume_word_str(tail, "bzhi", mnemo_t::tag_t::Bzhi);
+    }).choice([=]() {
+        return consume_word_str(tail, "pdep", mnemo_t::tag_t::Pdep);
+    }).choice([=]() {
+        return consume_word_str(tail, "pext", mnemo_t::tag_t::Pext);
+    }).choice([=]() {
+        return consume_word_str(tail, "shlx", mnemo_t::tag_t::Shlx);
+    }).choice([=]() {
+        return consume_word_str(tail, "shrx", mnemo_t::tag_t::Shrx);
+    }).choice([=]() {
+        return consume_word_str(tail, "sarx", mnemo_t::tag_t::Sarx);
+    }).choice([=]() {
+        return consume_word_str(tail, "jmp", mnemo_t::tag_t::Jmp);
+    }).choice([=]() {
+        return consume_word_str(tail, "call", mnemo_t::tag_t::Call);
+    }).choice([=]() {
+        return consume_word_str(tail, "loop", mnemo_t::tag_t::Loop);
+    }).choice([=]() {
+        return consume_word_str(tail, "align", mnemo_t::tag_t::Align);
     }).unwrap_or(make_error(tail, "expected mnemo name"));
 }
 
+static auto parse_cond(strive tail) -> ParserResultResult<mnemo_t::cond_t> {
+    return consume_word_str(tail, "o", mnemo_t::cond_t::O).choice([=]() {
+        return consume_word_str(tail, "no", mnemo_t::cond_t::No);
+    }).choice([=]() {
+        return consume_word_str(tail, "b", mnemo_t::cond_t::B);
+    }).choice([=]() {
+        return consume_word_str(tail, "c", mnemo_t::cond_t::B);
+    }).choice([=]() {
+        return consume_word_str(tail, "nae", mnemo_t::cond_t::B);
+    }).choice([=]() {
+        return consume_word_str(tail, "ae", mnemo_t::cond_t::Ae);
+    }).choice([=]() {
+        return consume_word_str(tail, "nb", mnemo_t::cond_t::Ae);
+    }).choice([=]() {
+        return consume_word_str(tail, "nc", mnemo_t::cond_t::Ae);
+    }).choice([=]() {
+        return consume_word_str(tail, "e", mnemo_t::cond_t::E);
+    }).choice([=]() {
+        return consume_word_str(tail, "z", mnemo_t::cond_t::E);
+    }).choice([=]() {
+        return consume_word_str(tail, "ne", mnemo_t::cond_t::Ne);
+    }).choice([=]() {
+        return consume_word_str(tail, "nz", mnemo_t::cond_t::Ne);
+    }).choice([=]() {
+        return consume_word_str(tail, "be", mnemo_t::cond_t::Be);
+    }).choice([=]() {
+        return consume_word_str(tail, "na", mnemo_t::cond_t::Be);
+    }).choice([=]() {
+        return consume_word_str(tail, "a", mnemo_t::cond_t::A);
+    }).choice([=]() {
+        return consume_word_str(tail, "nbe", mnemo_t::cond_t::A);
+    }).choice([=]() {
+        return consume_word_str(tail, "s", mnemo_t::cond_t::S);
+    }).choice([=]() {
+        return consume_word_str(tail, "ns", mnemo_t::cond_t::Ns);
+    }).choice([=]() {
+        return consume_word_str(tail, "p", mnemo_t::cond_t::P);
+    }).choice([=]() {
+        return consume_word_str(tail, "pe", mnemo_t::cond_t::P);
+    }).choice([=]() {
+        return consume_word_str(tail, "np", mnemo_t::cond_t::Np);
+    }).choice([=]() {
+        return consume_word_str(tail, "po", mnemo_t::cond_t::Np);
+    }).choice([=]() {
+        return consume_word_str(tail, "l", mnemo_t::cond_t::L);
+    }).choice([=]() {
+        return consume_word_str(tail, "nge", mnemo_t::cond_t::L);
+    }).choice([=]() {
+        return consume_word_str(tail, "ge", mnemo_t::cond_t::Ge);
+    }).choice([=]() {
+        return consume_word_str(tail, "nl", mnemo_t::cond_t::Ge);
+    }).choice([=]() {
+        return consume_word_str(tail, "le", mnemo_t::cond_t::Le);
+    }).choice([=]() {
+        return consume_word_str(tail, "ng", mnemo_t::cond_t::Le);
+    }).choice([=]() {
+        return consume_word_str(tail, "g", mnemo_t::cond_t::G);
+    }).choice([=]() {
+        return consume_word_str(tail, "nle", mnemo_t::cond_t::G);
+    }).unwrap_or(make_error(tail, "expected condition code"));
+}
+
+// Parses a name of a conditional mnemo like "cmovne", "setg" or "jz"
+static auto parse_conditional_mnemo_name(strive tail) -> ParserResultResult<tuple<mnemo_t::tag_t, mnemo_t::cond_t>> {
+    if (ParserResultResult<mnemo_t::tag_t> a = consume_prefix_str(tail, "cmov", mnemo_t::tag_t::Cmovcc).choice([=]() {
+        return consume_prefix_str(tail, "set", mnemo_t::tag_t::Setcc);
+    }).choice([=]() {
+        return consume_prefix_str(tail, "j", mnemo_t::tag_t::Jcc);
+    }).unwrap_or(make_error(tail, "expected conditional mnemo name"))) {
+        if (ParserResultResult<mnemo_t::cond_t> b = parse_cond(a.value().tail)) {
+            return ParserResult(b.value().tail, make_tuple(a.value().data, b.value().data));
+        } else {
+            return b.copy_error();
+        }
+    } else {
+        return a.copy_error();
+    }
+}
+
+// Parses a mnemo name with its condition code, which is only meaningful for conditional mnemos
+static auto parse_mnemo_name_and_cond(strive tail) -> ParserResultResult<tuple<mnemo_t::tag_t, mnemo_t::cond_t>> {
+    if (ParserResultResult<tuple<mnemo_t::tag_t, mnemo_t::cond_t>> a = parse_conditional_mnemo_name(tail)) {
+        return a;
+    } else if (ParserResultResult<mnemo_t::tag_t> b = parse_mnemo_name(tail)) {
+        return ParserResult(b.value().tail, make_tuple(b.value().data, mnemo_t::cond_t::O));
+    } else {
+        return b.copy_error();
+    }
+}
+
 static auto parse_mnemo_width(strive tail) -> ParserResultResult<mnemo_t::width_t> {
     return consume_prefix_str(tail, "BYTE", mnemo_t::width_t::Byte).choice([=]() {
         return consume_prefix_str(tail, "WORD", mnemo_t::width_t::Word);
@@ -104,24 +442,94 @@ static auto parse_mnemo_width(strive tail) -> ParserResultResult<mnemo_t::width_
         return consume_prefix_str(tail, "DWORD", mnemo_t::width_t::Dword);
     }).choice([=]() {
         return consume_prefix_str(tail, "QWORD", mnemo_t::width_t::Qword);
+    }).choice([=]() {
+        return consume_prefix_str(tail, "XMMWORD", mnemo_t::width_t::Xmmword);
+    }).choice([=]() {
+        return consume_prefix_str(tail, "YMMWORD", mnemo_t::width_t::Ymmword);
     }).choice([=]() {
         return consume_prefix_str(tail, "NotSet", mnemo_t::width_t::NotSet);
     }).unwrap_or(make_error(tail, "expected instruction size"));
 }
 
+static auto is_label_start_char(char c) -> bool {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '_' || c == '.';
+}
+
+static auto parse_label_name(strive tail) -> ParserResultResult<string> {
+    // Parses a label name like
+    // loop_start
+    // .L1
+    if (tail.empty() || !is_label_start_char(tail.front()))
+        return make_error(tail, "expected label");
+    return scan_while_char(tail, [](char c) { return is_word_char(c) || c == '.'; });
+}
+
+static auto parse_label(strive tail) -> ParserResultResult<label_t> {
+    if (ParserResultResult<string> a = parse_label_name(tail)) {
+        return ParserResult(a.value().tail, intern_label(a.value().data));
+    } else {
+        return a.copy_error();
+    }
+}
+
+static auto parse_constant(strive tail) -> ParserResultResult<constant_t> {
+    // Parses a constant from the inside of a memory argument as 1, 2 or 4 qword lanes like
+    // const 0x123456789
+    // const 1, 2
+    if (ParserResultResult<monostate> a = consume_prefix_str(tail, "const ", monostate())
+            .unwrap_or(make_error(tail, "expected 'const '"))) {
+        tail = a.value().tail;
+        vector<u8> bytes{};
+        while (true) {
+            if (ParserResultResult<i64> b = parse_i64(tail).unwrap_or(make_error(tail, "expected int literal"))) {
+                u64 lane = u64(b.value().data);
+                for (u8 i = 0; i < 8; i++)
+                    bytes.push_back(u8(lane >> (8 * i)));
+                tail = b.value().tail;
+            } else {
+                return b.copy_error();
+            }
+
+            if (ParserResultResult<monostate> c = consume_prefix_str(tail, ", ", monostate())
+                    .unwrap_or(make_error(tail, "expected ', '"))) {
+                tail = c.value().tail;
+            } else {
+                break;
+            }
+        }
+        if (bytes.size() != 8 && bytes.size() != 16 && bytes.size() != 32)
+            return make_error(tail, "constant should have 1, 2 or 4 qword lanes");
+        return ParserResult(tail, intern_constant(bytes));
+    } else {
+        return a.copy_error();
+    }
+}
+
 static auto parse_arg(strive tail) -> ParserResultResult<arg_t> {
     // Parses an arg from text assembly like
     // 100
     // eax
     // [eax * 2 + 100]
+    // [rip + 16]
+    // [const 1, 2]
+    // loop_start
     //🗿
     if (ParserResultResult<i64> a1 = parse_i64(tail).unwrap_or(make_error(tail, "expected int literal"))) {
         return ParserResult(a1.value().tail, arg_t::imm(a1.value().data));
     } else if (ParserResultResult<reg_t> a2 = parse_register(tail)) {
         return ParserResult(a2.value().tail, arg_t::reg(a2.value().data));
+    } else if (ParserResultResult<label_t> a3 = parse_label(tail)) {
+        return ParserResult(a3.value().tail, arg_t::label(a3.value().data));
     } else if (ParserResultResult<monostate> a = consume_prefix_char(tail, '[')
             .unwrap_or(make_error(tail, "expected a memory argument"))) {
-        if (ParserResultResult<reg_t> b = parse_register(a.value().tail)) {
+        if (ParserResultResult<constant_t> b = parse_constant(a.value().tail)) {
+            if (ParserResultResult<monostate> c = consume_prefix_char(b.value().tail, ']')
+                    .unwrap_or(make_error(b.value().tail, "expected ']'"))) {
+                return ParserResult(c.value().tail, arg_t::constant(b.value().data));
+            } else {
+                return c.copy_error();
+            }
+        } else if (ParserResultResult<reg_t> b = parse_register(a.value().tail)) {
             reg_t base = b.value().data;
 
             // Maybe parse an index with scale
@@ -188,13 +596,39 @@ static auto parse_arg(strive tail) -> ParserResultResult<arg_t> {
     }
 }
 
+static auto parse_label_definition(strive tail) -> ParserResultResult<mnemo_t> {
+    // Parses a line from text assembly like
+    // loop_start:
+    // Label is only interned once the line is known to be a label definition
+    if (ParserResultResult<string> a = parse_label_name(tail)) {
+        if (ParserResultResult<monostate> b = consume_prefix_str(a.value().tail, ":\n", monostate())
+                .unwrap_or(make_error(a.value().tail, "expected ':' and a newline"))) {
+            mnemo_t mnemo = {
+                    .tag = mnemo_t::tag_t::Label,
+                    .width = mnemo_t::width_t::NotSet,
+                    .a1 = arg_t::label(intern_label(a.value().data)),
+            };
+
+            return ParserResult(b.value().tail, mnemo);
+        } else {
+            return b.copy_error();
+        }
+    } else {
+        return a.copy_error();
+    }
+}
+
 static auto parse_line(strive tail) -> ParserResultResult<mnemo_t> {
     // Parses a line from text assembly like
     // mov eax, 100
+    if (ParserResultResult<mnemo_t> label = parse_label_definition(tail)) {
+        return label;
+    }
 
     // Parse mnemo tag
-    if (ParserResultResult<mnemo_t::tag_t> a = parse_mnemo_name(tail)) {
-        mnemo_t::tag_t tag = a.value().data;
+    if (ParserResultResult<tuple<mnemo_t::tag_t, mnemo_t::cond_t>> a = parse_mnemo_name_and_cond(tail)) {
+        mnemo_t::tag_t tag = get<0>(a.value().data);
+        mnemo_t::cond_t cond = get<1>(a.value().data);
 
         // Skip spaces
         ParserResult<monostate> b = skip_while_char(a.value().tail, [](char c) { return c == ' '; });
@@ -211,6 +645,7 @@ static auto parse_line(strive tail) -> ParserResultResult<mnemo_t> {
 
         arg_t arg1{};
         arg_t arg2{};
+        arg_t arg3{};
         // Maybe parse arg1
         if (ParserResultResult<mnemo_t::arg_t> d = parse_arg(c.tail)) {
             arg1 = d.value().data;
@@ -223,6 +658,18 @@ static auto parse_line(strive tail) -> ParserResultResult<mnemo_t> {
                 if (ParserResultResult<mnemo_t::arg_t> f = parse_arg(e.value().tail)) {
                     arg2 = f.value().data;
                     c.tail = f.value().tail;
+
+                    // Skip ", "
+                    if (ParserResultResult<monostate> g = consume_prefix_str(f.value().tail, ", ", monostate())
+                            .unwrap_or(make_error(f.value().tail, "expected ', '"))) {
+                        // Maybe parse arg3
+                        if (ParserResultResult<mnemo_t::arg_t> h = parse_arg(g.value().tail)) {
+                            arg3 = h.value().data;
+                            c.tail = h.value().tail;
+                        } else {
+                            return h.copy_error();
+                        }
+                    }
                 } else {
                     return f.copy_error();
                 }
@@ -234,9 +681,11 @@ static auto parse_line(strive tail) -> ParserResultResult<mnemo_t> {
                 .unwrap_or(make_error(c.tail, "expected a newline"))) {
             mnemo_t mnemo = {
                     .tag = tag,
+                    .cond = cond,
                     .width = width,
                     .a1 = arg1,
                     .a2 = arg2,
+                    .a3 = arg3,
             };
 
             return ParserResult(d.value().tail, mnemo);
@@ -248,23 +697,56 @@ static auto parse_line(strive tail) -> ParserResultResult<mnemo_t> {
     }
 }
 
+// Parses multiline assembly text, passing every mnemo and the offset of its line to `on_mnemo`
+template<typename F>
+static auto parse_lines(strive tail, F &&on_mnemo) -> ParserResultResult<monostate> {
+    for (; !tail.empty();) {
+        u64 source_offset = tail.get_start();
+        if (ParserResultResult<mnemo_t> result1 = parse_line(tail)) {
+            // If result is available, continue iteration
+            tail = result1.value().tail;
+            on_mnemo(result1.value().data, source_offset);
+        } else {
+            return result1.copy_error();
+        }
+    }
+
+    return ParserResult(tail, monostate{});
+}
+
 namespace assembly::parse {
     auto parse(strive tail) -> ParserResultResult<vector<mnemo_t>> {
-        // Parses multiline assembly text
-
+        TRACE_SPAN("parse");
         vector<mnemo_t> result{};
+        ParserResultResult<monostate> lines = parse_lines(tail, [&](const mnemo_t &mnemo, u64) {
+            result.push_back(mnemo);
+        });
+        if (!lines)
+            return lines.copy_error();
+        return ParserResult(lines.value().tail, move(result));
+    }
 
-        for (; !tail.empty();) {
-            if (ParserResultResult<mnemo_t> result1 = parse_line(tail)) {
-                // If result is available, continue iteration
-                tail = result1.value().tail;
-                result.push_back(result1.value().data);
-            } else {
-                return result1.copy_error();
-            }
-        }
+    auto parse(strive tail, pmr::memory_resource *resource) -> ParserResultResult<pmr::vector<mnemo_t>> {
+        TRACE_SPAN("parse");
+        pmr::vector<mnemo_t> result(resource);
+        ParserResultResult<monostate> lines = parse_lines(tail, [&](const mnemo_t &mnemo, u64) {
+            result.push_back(mnemo);
+        });
+        if (!lines)
+            return lines.copy_error();
+        return ParserResult(lines.value().tail, move(result));
+    }
 
-        return ParserResult(tail, result);
+    auto parse_with_source_offsets(strive tail) -> ParserResultResult<parsed_source_t> {
+        TRACE_SPAN("parse");
+        parsed_source_t result{};
+        ParserResultResult<monostate> lines = parse_lines(tail, [&](const mnemo_t &mnemo, u64 source_offset) {
+            result.mnemos.push_back(mnemo);
+            result.source_offsets.push_back(source_offset);
+        });
+        if (!lines)
+            return lines.copy_error();
+        return ParserResult(lines.value().tail, move(result));
     }
 
     auto test() -> void {
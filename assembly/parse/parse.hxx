@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <memory_resource>
 
 #include "../../strvec.hxx"
 #include "../assembly.hxx"
@@ -33,5 +34,20 @@ namespace assembly::parse {
 
     auto parse(parsec::strive tail) -> ParserResultResult<vector<mnemo_t>>;
 
+    // Like `parse`, the mnemo vector is allocated from `resource`. Label names seen for the first time are still
+    // interned on the global heap.
+    auto parse(parsec::strive tail, std::pmr::memory_resource *resource)
+            -> ParserResultResult<std::pmr::vector<mnemo_t>>;
+
+    struct parsed_source_t {
+        vector<mnemo_t> mnemos;
+
+        // Position of every mnemo in the source, as returned by `strive::get_start()`
+        vector<u64> source_offsets;
+    };
+
+    // Like `parse`, also keeps where every mnemo was parsed from, see `assemble_options::source_offsets`
+    auto parse_with_source_offsets(parsec::strive tail) -> ParserResultResult<parsed_source_t>;
+
     auto test() -> void;
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "allocations.hxx"
+
+#include <iomanip>
+#include <iostream>
+
+#include "../assembly/assembly.hxx"
+#include "../assembly/parse/parse.hxx"
+#include "../jit/compile.hxx"
+#include "../os/heap.hxx"
+#include "../os/stats.hxx"
+
+using namespace std;
+
+using assembly::mnemo_t;
+
+namespace bench {
+    // Lines of the corpus, repeated with distinct labels
+    static constexpr u64 repeat_count = 250;
+
+    static auto corpus() -> string {
+        string source{};
+        for (u64 i = 0; i < repeat_count; i++) {
+            string label = "l" + to_string(i);
+            source += label + ":\n"
+                      "mov QWORD rax, [rbx + rcx * 8 + 16]\n"
+                      "add QWORD rax, 12345\n"
+                      "vpaddd YMMWORD ymm0, ymm1, ymm2\n"
+                      "cmp QWORD rax, rdx\n"
+                      "jne " + label + "\n";
+        }
+        return source + "ret\n";
+    }
+
+    static auto print_phase(const char *name, heap_counts_t counts, u64 items) -> void {
+        cout << setw(10) << name << setw(12) << fixed << setprecision(2) << double(counts.allocations) / double(items)
+             << " allocations" << setw(12) << double(counts.bytes) / double(items) << " bytes per item ("
+             << items << " items)\n";
+    }
+
+    // Heap allocations per parsed line and per assembled mnemo, directly and through `jit::compile`
+    auto bench_allocations() -> void {
+        if (!heap_accounting_enabled) {
+            cout << "Heap allocation accounting is off, configure with -DCPLASTANE_BENCH_ALLOC_ACCOUNTING=ON\n";
+            return;
+        }
+        string source = corpus();
+        vector<mnemo_t> mnemos{};
+        heap_counts_t parse_counts = count_allocations([&]() {
+            mnemos = assembly::parse::unwrap_or_log_error(assembly::parse::parse(source)).data;
+        });
+        heap_counts_t assemble_counts = count_allocations([&]() { assembly::assemble(mnemos); });
+
+        stats_t before = stats_read();
+        jit::compile(source);
+        stats_t after = stats_read();
+        auto phase_counts = [&](compile_phase_t phase) -> heap_counts_t {
+            const phase_allocations_t &a = after.allocations[size_t(phase)], &b = before.allocations[size_t(phase)];
+            return {a.allocations - b.allocations, a.bytes - b.bytes};
+        };
+
+        cout << "Heap allocations of " << mnemos.size() << " lines\n";
+        print_phase("parse", parse_counts, mnemos.size());
+        print_phase("assemble", assemble_counts, mnemos.size());
+        cout << "jit::compile phases\n";
+        print_phase("parse", phase_counts(compile_phase_t::Parse), mnemos.size());
+        print_phase("assemble", phase_counts(compile_phase_t::Assemble), mnemos.size());
+        print_phase("load", phase_counts(compile_phase_t::Load), 1);
+    }
+}
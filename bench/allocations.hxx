@@ -0,0 +1,5 @@
+#pragma once
+
+namespace bench {
+    auto bench_allocations() -> void;
+}
@@ -0,0 +1,61 @@
+#include "arithmetic.hxx"
+
+#include <iostream>
+
+#include "../assembly/assembly.hxx"
+#include "../assembly/parse/parse.hxx"
+#include "../jit/bench.hxx"
+
+using namespace std;
+
+using assembly::mnemo_t;
+
+namespace bench {
+    struct arithmetic_case {
+        const char *name;
+        // One or more lines of assembly, unrolled by `jit::bench`
+        const char *body;
+        // Number of instructions in `body`
+        u64 body_size;
+    };
+
+    static auto run_case(const arithmetic_case &c) -> void {
+        vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(assembly::parse::parse(c.body)).data;
+        jit::bench_result result = jit::bench(mnemos);
+
+        cout << c.name << ": " << double(c.body_size) / result.tsc.median << " instr/tsc tick\n";
+        jit::print_bench_result(result);
+    }
+
+    auto bench_arithmetic() -> void {
+        arithmetic_case cases[] = {
+                {"add dependent chain", "add QWORD rax, rcx\n", 1},
+                {"add independent", "add QWORD rax, rdi\n"
+                                    "add QWORD rcx, rdi\n"
+                                    "add QWORD rdx, rdi\n"
+                                    "add QWORD rsi, rdi\n", 4},
+                {"xor/and/or independent", "xor QWORD rax, rdi\n"
+                                           "and QWORD rcx, rdi\n"
+                                           "or QWORD rdx, rdi\n"
+                                           "sub QWORD rsi, rdi\n", 4},
+                {"imul dependent chain", "imul QWORD rax, rcx\n", 1},
+                {"imul independent", "imul QWORD rax, rdi\n"
+                                     "imul QWORD rcx, rdi\n"
+                                     "imul QWORD rdx, rdi\n"
+                                     "imul QWORD rsi, rdi\n", 4},
+                {"lea 3-component", "lea QWORD rax, [rax + rcx * 4 + 8]\n", 1},
+                {"shl/shr imm", "shl QWORD rax, 3\n"
+                                "shr QWORD rcx, 2\n", 2},
+                {"inc/dec/neg/not", "inc QWORD rax\n"
+                                    "dec QWORD rcx\n"
+                                    "neg QWORD rdx\n"
+                                    "not QWORD rsi\n", 4},
+                {"cmp/test", "cmp QWORD rax, rcx\n"
+                             "test QWORD rdx, rsi\n", 2},
+        };
+
+        cout << ">> Arithmetic throughput, per snippet execution\n";
+        for (const arithmetic_case &c : cases)
+            run_case(c);
+    }
+}
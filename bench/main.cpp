@@ -0,0 +1,19 @@
+#include <fstream>
+
+#include "allocations.hxx"
+#include "arithmetic.hxx"
+#include "scaling.hxx"
+#include "../os/trace.hxx"
+
+// Usage: cplastane_bench [trace.json], the trace can be opened in chrome://tracing or Perfetto
+int main(int argc, char **argv) {
+    if (argc > 1)
+        trace_start();
+    bench::bench_arithmetic();
+    bench::bench_scaling();
+    bench::bench_allocations();
+    if (argc > 1) {
+        trace_stop();
+        std::ofstream(argv[1]) << trace_format_chrome(trace_read());
+    }
+}
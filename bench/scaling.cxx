@@ -0,0 +1,80 @@
+#include "scaling.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "../assembly/assembly.hxx"
+#include "../assembly/parse/parse.hxx"
+#include "../jit/compile.hxx"
+#include "../jit/jit.hxx"
+#include "../os/alloc.hxx"
+
+using namespace std;
+
+using assembly::mnemo_t;
+
+namespace bench {
+    // Compile and call iterations per thread
+    static constexpr u64 iteration_count = 20000;
+
+    // Returns compile and call iterations per second over all threads
+    template<typename F>
+    static auto run_threads(u64 thread_count, F iteration) -> double {
+        auto start_time = chrono::steady_clock::now();
+        vector<thread> threads{};
+        for (u64 t = 0; t < thread_count; t++) {
+            threads.emplace_back([&]() {
+                for (u64 i = 0; i < iteration_count; i++)
+                    iteration(i);
+            });
+        }
+        for (thread &t: threads)
+            t.join();
+        auto end_time = chrono::steady_clock::now();
+
+        double seconds = chrono::duration<double>(end_time - start_time).count();
+        return double(thread_count * iteration_count) / seconds;
+    }
+
+    // Every iteration assembles a snippet, loads it into executable memory, calls and frees it.
+    // The arena path uses `jit::compile`, the mmap path maps every block on its own like `eval_mc` used to.
+    auto bench_scaling() -> void {
+        vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                "mov QWORD rax, 1\n"
+                "add QWORD rax, 2\n"
+                "imul QWORD rax, rax\n"
+                "ret\n")).data;
+
+        auto arena_iteration = [&](u64) {
+            jit::function_t f = jit::compile(mnemos);
+            f();
+        };
+        auto mmap_iteration = [&](u64) {
+            vector<u8> code = assembly::assemble(mnemos);
+            void *mem = alloc_executable(code.size());
+            memcpy(mem, code.data(), code.size());
+            flush_instruction_cache(mem, code.size());
+            reinterpret_cast<jit::jit_func_t>(mem)();
+            dealloc(mem, code.size());
+        };
+
+        u64 max_thread_count = max(4u, thread::hardware_concurrency());
+        cout << ">> Compile and call scaling (" << iteration_count << " iterations per thread, "
+             << thread::hardware_concurrency() << " hardware threads)\n";
+        double arena_single = 0;
+        double mmap_single = 0;
+        for (u64 thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+            double arena = run_threads(thread_count, arena_iteration);
+            double mmap = run_threads(thread_count, mmap_iteration);
+            if (thread_count == 1) {
+                arena_single = arena;
+                mmap_single = mmap;
+            }
+            cout << thread_count << " threads: arena " << u64(arena) << " /s (x" << arena / arena_single
+                 << "), mmap " << u64(mmap) << " /s (x" << mmap / mmap_single << ")\n";
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#include <fstream>
+#include <string>
+
+#include "throughput.hxx"
+
+// Usage: cplastane_suite [results.json] [line_count] [seed], results are appended as one JSON object per line
+int main(int argc, char **argv) {
+    bench::suite_options options{};
+    if (argc > 2)
+        options.line_count = std::stoull(argv[2]);
+    if (argc > 3)
+        options.seed = std::stoull(argv[3]);
+
+    bench::suite_result_t result = bench::run_suite(options);
+    bench::print_suite_result(result);
+    if (argc > 1)
+        std::ofstream(argv[1], std::ios::app) << bench::format_suite_json(result);
+}
@@ -0,0 +1,121 @@
+#include "throughput.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "../../assembly/assembly.hxx"
+#include "../../assembly/corpus/corpus.hxx"
+#include "../../assembly/parse/parse.hxx"
+#include "../../jit/compile.hxx"
+
+using namespace std;
+
+using assembly::mnemo_t;
+using assembly::corpus::corpus_t;
+using assembly::corpus::generate_corpus;
+
+namespace bench {
+    // Distinct executable programs the latency iterations cycle through
+    static constexpr u64 latency_program_count = 16;
+
+    // Latency iterations that are not measured
+    static constexpr u64 latency_warmup_count = 16;
+
+    static auto seconds_since(chrono::steady_clock::time_point start) -> double {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Value below which `fraction` of the values are
+    static auto percentile(vector<double> values, double fraction) -> double {
+        sort(values.begin(), values.end());
+        return values[min(values.size() - 1, u64(fraction * double(values.size())))];
+    }
+
+    auto run_suite(const suite_options &options) -> suite_result_t {
+        corpus_t corpus = generate_corpus({.line_count = options.line_count, .seed = options.seed});
+
+        vector<double> parse_rates{};
+        vector<double> assemble_rates{};
+        vector<double> byte_rates{};
+        u64 code_size = 0;
+        for (u64 r = 0; r < options.repeat_count; r++) {
+            auto start = chrono::steady_clock::now();
+            vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(assembly::parse::parse(corpus.source)).data;
+            double parse_seconds = seconds_since(start);
+
+            start = chrono::steady_clock::now();
+            vector<u8> code = assembly::assemble(mnemos);
+            double assemble_seconds = seconds_since(start);
+
+            u64 instruction_count = count_if(mnemos.begin(), mnemos.end(), [](const mnemo_t &mnemo) {
+                return mnemo.tag != mnemo_t::tag_t::Label;
+            });
+            parse_rates.push_back(double(mnemos.size()) / parse_seconds);
+            assemble_rates.push_back(double(instruction_count) / assemble_seconds);
+            byte_rates.push_back(double(code.size()) / assemble_seconds);
+            code_size = code.size();
+        }
+
+        vector<string> programs{};
+        for (u64 p = 0; p < latency_program_count; p++)
+            programs.push_back(generate_corpus({
+                    .line_count = options.latency_line_count,
+                    .seed = options.seed + p,
+                    .executable = true,
+            }).source);
+        vector<double> latencies{};
+        for (u64 i = 0; i < latency_warmup_count + options.latency_iteration_count; i++) {
+            auto start = chrono::steady_clock::now();
+            jit::function_t f = jit::compile(programs[i % programs.size()]);
+            f();
+            double seconds = seconds_since(start);
+            if (i >= latency_warmup_count)
+                latencies.push_back(seconds * 1e9);
+        }
+
+        return {
+                .options = options,
+                .form_count = corpus.form_count,
+                .metrics = {
+                        {"parse", "lines/s", percentile(parse_rates, 0.5)},
+                        {"assemble", "instructions/s", percentile(assemble_rates, 0.5)},
+                        {"assemble_bytes", "bytes/s", percentile(byte_rates, 0.5)},
+                        {"code_size", "bytes", double(code_size)},
+                        {"compile_call_latency_p50", "ns", percentile(latencies, 0.5)},
+                        {"compile_call_latency_p90", "ns", percentile(latencies, 0.9)},
+                        {"compile_call_latency_p99", "ns", percentile(latencies, 0.99)},
+                },
+        };
+    }
+
+    auto print_suite_result(const suite_result_t &result) -> void {
+        cout << ">> Throughput suite (" << result.options.line_count << " lines drawn from " << result.form_count
+             << " forms, seed " << result.options.seed << ")\n";
+        for (const suite_metric_t &metric: result.metrics)
+            cout << setw(26) << metric.name << setw(18) << fixed << setprecision(0) << metric.value << " "
+                 << metric.unit << "\n";
+    }
+
+    auto format_suite_json(const suite_result_t &result) -> string {
+        ostringstream s{};
+        s << setprecision(10);
+        s << "{\"assembler_version\": " << assembly::assembler_version
+          << ", \"line_count\": " << result.options.line_count
+          << ", \"seed\": " << result.options.seed
+          << ", \"repeat_count\": " << result.options.repeat_count
+          << ", \"latency_line_count\": " << result.options.latency_line_count
+          << ", \"latency_iteration_count\": " << result.options.latency_iteration_count
+          << ", \"form_count\": " << result.form_count
+          << ", \"metrics\": [";
+        for (u64 i = 0; i < result.metrics.size(); i++) {
+            const suite_metric_t &metric = result.metrics[i];
+            s << (i == 0 ? "" : ", ") << "{\"name\": \"" << metric.name << "\", \"unit\": \"" << metric.unit
+              << "\", \"value\": " << metric.value << "}";
+        }
+        s << "]}\n";
+        return s.str();
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../../int.hxx"
+#include "../../strvec.hxx"
+
+namespace bench {
+    struct suite_options {
+        // Lines of the corpus parsed and assembled in every repetition
+        u64 line_count = 20000;
+
+        u64 seed = 1;
+
+        // Throughput is the median over repetitions
+        u64 repeat_count = 7;
+
+        // Lines of the executable corpus compiled and called in every latency iteration
+        u64 latency_line_count = 64;
+
+        u64 latency_iteration_count = 2000;
+    };
+
+    struct suite_metric_t {
+        string name;
+        string unit;
+        double value;
+    };
+
+    struct suite_result_t {
+        suite_options options;
+        u64 form_count;
+        vector<suite_metric_t> metrics;
+    };
+
+    // Measures parse lines/s, assemble instructions/s and bytes/s over a generated corpus, and the latency of
+    // `jit::compile` of an executable corpus followed by a call
+    auto run_suite(const suite_options &options = {}) -> suite_result_t;
+
+    auto print_suite_result(const suite_result_t &result) -> void;
+
+    // One JSON object with the options and every metric, stable across releases so results can be compared
+    auto format_suite_json(const suite_result_t &result) -> string;
+}
@@ -0,0 +1,197 @@
+#include "arena.hxx"
+
+#include <atomic>
+#include <bit>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "../os/alloc.hxx"
+#include "../os/stats.hxx"
+
+using namespace std;
+
+namespace jit {
+    struct arena_t;
+
+    // Start of every chunk, blocks follow it
+    struct alignas(64) chunk_header_t {
+        // Blocks carved from the chunk and not freed yet. Updated by the owner thread only, remote frees are counted
+        // when the owner drains them.
+        u64 live_count;
+    };
+
+    // Precedes the code of every block
+    struct block_header_t {
+        arena_t *owner; // nullptr for large blocks
+        block_header_t *next; // Link in free lists and the remote free stack
+        u32 size_class;
+        u32 size; // Requested by the caller
+        chunk_header_t *chunk; // nullptr for large blocks
+    };
+
+    static_assert(sizeof(block_header_t) == 32);
+
+    static constexpr size_t chunk_size = 1024 * 1024;
+    static constexpr size_t min_class_shift = 6; // 64 byte blocks
+    static constexpr size_t size_class_count = 11; // Up to 64 KiB blocks
+
+    static auto class_block_size(u32 size_class) -> size_t {
+        return size_t(1) << (size_class + min_class_shift);
+    }
+
+    struct arena_t {
+        // Owner thread only
+        block_header_t *free_lists[size_class_count]{};
+        chunk_header_t *bump_chunk = nullptr;
+        u8 *bump = nullptr;
+        u8 *bump_end = nullptr;
+
+        // Pushed by other threads, taken as a whole by the owner
+        atomic<block_header_t *> remote_frees{nullptr};
+
+        // Unmaps a chunk whose blocks are all free. Its blocks are unlinked from the free lists first, which walks
+        // every free block, but chunks only become empty after a burst of frees.
+        auto release_chunk(chunk_header_t *chunk) -> void {
+            for (block_header_t *&head: this->free_lists) {
+                for (block_header_t **link = &head; *link != nullptr;) {
+                    if ((*link)->chunk == chunk)
+                        *link = (*link)->next;
+                    else
+                        link = &(*link)->next;
+                }
+            }
+            unmap_executable(chunk, chunk_size);
+        }
+
+        // Puts a block freed by any thread on its free list. The chunk being carved is kept even when it is empty,
+        // so a thread that compiles and frees one function at a time does not map and unmap it every time.
+        auto free(block_header_t *block) -> void {
+            block->next = this->free_lists[block->size_class];
+            this->free_lists[block->size_class] = block;
+            if (--block->chunk->live_count == 0 && block->chunk != this->bump_chunk)
+                this->release_chunk(block->chunk);
+        }
+
+        auto drain_remote_frees() -> void {
+            block_header_t *block = this->remote_frees.exchange(nullptr, memory_order_acquire);
+            while (block != nullptr) {
+                block_header_t *next = block->next;
+                this->free(block);
+                block = next;
+            }
+        }
+
+        auto alloc(u32 size_class) -> block_header_t * {
+            if (this->free_lists[size_class] == nullptr)
+                this->drain_remote_frees();
+            if (block_header_t *block = this->free_lists[size_class]) {
+                this->free_lists[size_class] = block->next;
+                block->chunk->live_count++;
+                return block;
+            }
+
+            size_t block_size = class_block_size(size_class);
+            if (this->bump == nullptr || size_t(this->bump_end - this->bump) < block_size) {
+                // The rest of the old chunk is left unused
+                chunk_header_t *old_chunk = this->bump_chunk;
+                this->bump_chunk = reinterpret_cast<chunk_header_t *>(map_executable(chunk_size));
+                this->bump_chunk->live_count = 0;
+                this->bump = reinterpret_cast<u8 *>(this->bump_chunk + 1);
+                this->bump_end = reinterpret_cast<u8 *>(this->bump_chunk) + chunk_size;
+                if (old_chunk != nullptr && old_chunk->live_count == 0)
+                    this->release_chunk(old_chunk);
+            }
+            auto *block = reinterpret_cast<block_header_t *>(this->bump);
+            this->bump += block_size;
+            block->chunk = this->bump_chunk;
+            block->chunk->live_count++;
+            return block;
+        }
+    };
+
+    // Arenas are never destroyed, because blocks may outlive the thread that allocated them
+    static mutex abandoned_arenas_mutex;
+    static vector<arena_t *> abandoned_arenas;
+
+    // Trivially destructible, so it can be read while thread-local objects are being destroyed
+    static thread_local arena_t *current_arena = nullptr;
+
+    struct arena_registration_t {
+        arena_t *arena;
+
+        arena_registration_t() {
+            {
+                lock_guard<mutex> lock(abandoned_arenas_mutex);
+                if (abandoned_arenas.empty()) {
+                    this->arena = new arena_t();
+                } else {
+                    this->arena = abandoned_arenas.back();
+                    abandoned_arenas.pop_back();
+                }
+            }
+            current_arena = this->arena;
+        }
+
+        ~arena_registration_t() {
+            current_arena = nullptr;
+            lock_guard<mutex> lock(abandoned_arenas_mutex);
+            abandoned_arenas.push_back(this->arena);
+        }
+    };
+
+    static auto this_thread_arena() -> arena_t & {
+        static thread_local arena_registration_t registration;
+        return *registration.arena;
+    }
+
+    static auto large_mapping_size(size_t size) -> size_t {
+        return sizeof(block_header_t) + size;
+    }
+
+    auto arena_alloc(size_t size) -> void * {
+        if (size > numeric_limits<u32>::max())
+            throw logic_error("executable block too large");
+
+        size_t block_size = sizeof(block_header_t) + size;
+        block_header_t *block;
+        if (block_size > class_block_size(size_class_count - 1)) {
+            block = reinterpret_cast<block_header_t *>(map_executable(large_mapping_size(size)));
+            block->owner = nullptr;
+            block->size_class = 0;
+            block->chunk = nullptr;
+        } else {
+            u32 size_class = u32(max<size_t>(bit_width(block_size - 1), min_class_shift) - min_class_shift);
+            arena_t &arena = this_thread_arena();
+            block = arena.alloc(size_class);
+            block->owner = &arena;
+            block->size_class = size_class;
+        }
+        block->next = nullptr;
+        block->size = u32(size);
+
+        stats_add(stat_t::AllocCount, 1);
+        stats_add(stat_t::BytesUsed, i64(size));
+        return block + 1;
+    }
+
+    auto arena_free(void *mem) -> void {
+        block_header_t *block = reinterpret_cast<block_header_t *>(mem) - 1;
+        stats_add(stat_t::FreeCount, 1);
+        stats_add(stat_t::BytesUsed, -i64(block->size));
+
+        arena_t *owner = block->owner;
+        if (owner == nullptr) {
+            unmap_executable(block, large_mapping_size(block->size));
+        } else if (owner == current_arena) {
+            owner->free(block);
+        } else {
+            block_header_t *head = owner->remote_frees.load(memory_order_relaxed);
+            do {
+                block->next = head;
+            } while (!owner->remote_frees.compare_exchange_weak(head, block, memory_order_release,
+                                                                memory_order_relaxed));
+        }
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../int.hxx"
+
+namespace jit {
+    // Thread-local executable arenas. Every thread allocates from its own arena without locks or system calls once
+    // the arena has memory. Blocks may be freed from any thread: frees by the owner go to its free lists, other
+    // threads push the block to the owner's lock-free remote free stack, which the owner drains when it runs out.
+    //
+    // Blocks up to 64 KiB come from 1 MiB chunks in power of two size classes, larger blocks are mapped on their
+    // own. A chunk is unmapped once all its blocks are freed, except the one the arena is carving blocks from, and
+    // the arena of an exited thread is adopted by the next new thread.
+    // Code is 32 byte aligned, enough for any constant pool entry.
+
+    auto arena_alloc(size_t size) -> void *;
+
+    // `mem` must come from `arena_alloc`
+    auto arena_free(void *mem) -> void;
+}
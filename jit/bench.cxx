@@ -0,0 +1,155 @@
+#include "bench.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <x86intrin.h>
+
+#include "jit.hxx"
+#include "../assembly/parse/parse.hxx"
+#include "../os/counters.hxx"
+
+using namespace std;
+
+using assembly::mnemo_t;
+
+namespace jit {
+    // Raw per-measurement values of one harness
+    struct bench_samples_t {
+        vector<double> tsc;
+        vector<double> ns;
+        vector<double> counters[hardware_counter_count];
+        u64 code_size;
+    };
+
+    static auto harness(const vector<mnemo_t> &snippet, u64 unroll_count, u64 loop_count) -> vector<mnemo_t> {
+        auto parse = [](const string &source) -> vector<mnemo_t> {
+            return assembly::parse::unwrap_or_log_error(assembly::parse::parse(source)).data;
+        };
+        vector<mnemo_t> mnemos = parse("push QWORD rbx\n"
+                                       "push QWORD rbp\n"
+                                       "push DWORD " + to_string(loop_count) + "\n"
+                                       "jit_bench_loop:\n");
+        for (u64 i = 0; i < unroll_count; i++)
+            mnemos.insert(mnemos.end(), snippet.begin(), snippet.end());
+        vector<mnemo_t> epilogue = parse("dec QWORD [rsp]\n"
+                                         "jnz jit_bench_loop\n"
+                                         "add QWORD rsp, 8\n"
+                                         "pop QWORD rbp\n"
+                                         "pop QWORD rbx\n"
+                                         "ret\n");
+        mnemos.insert(mnemos.end(), epilogue.begin(), epilogue.end());
+        return mnemos;
+    }
+
+    static auto measure(const vector<mnemo_t> &mnemos, const bench_options &options,
+                        hardware_counters_t &counters) -> bench_samples_t {
+        vector<u8> code = assembly::assemble(mnemos);
+        function_t f(code, "jit_bench");
+
+        for (u64 i = 0; i < options.warmup_count; i++)
+            f();
+
+        bench_samples_t samples{};
+        samples.code_size = code.size();
+        for (u64 i = 0; i < options.measurement_count; i++) {
+            counters.start();
+            auto start_time = chrono::steady_clock::now();
+            _mm_lfence();
+            u64 start_tsc = __rdtsc();
+            _mm_lfence();
+
+            f();
+
+            u32 aux;
+            u64 end_tsc = __rdtscp(&aux);
+            _mm_lfence();
+            auto end_time = chrono::steady_clock::now();
+            counters.stop();
+
+            samples.tsc.push_back(double(end_tsc - start_tsc));
+            samples.ns.push_back(double(chrono::duration_cast<chrono::nanoseconds>(end_time - start_time).count()));
+            for (size_t c = 0; c < hardware_counter_count; c++)
+                samples.counters[c].push_back(double(counters.read(hardware_counter_t(c))));
+        }
+        return samples;
+    }
+
+    static auto median(vector<double> values) -> double {
+        sort(values.begin(), values.end());
+        size_t n = values.size();
+        return n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    }
+
+    static auto statistic(const vector<double> &samples, const vector<double> &baseline, double executions,
+                          bool available) -> bench_statistic {
+        if (!available || samples.empty())
+            return {false, 0, 0, 0, 0};
+
+        double baseline_median = median(baseline);
+        vector<double> values{};
+        for (double sample: samples)
+            values.push_back((sample - baseline_median) / executions);
+
+        double m = median(values);
+        vector<double> deviations{};
+        for (double value: values)
+            deviations.push_back(abs(value - m));
+
+        auto [min_it, max_it] = minmax_element(values.begin(), values.end());
+        return {true, m, median(deviations), *min_it, *max_it};
+    }
+
+    auto bench(const vector<mnemo_t> &snippet, const bench_options &options) -> bench_result {
+        if (options.unroll_count == 0 || options.loop_count == 0 || options.measurement_count == 0)
+            throw logic_error("bench counts should not be 0");
+        bool has_labels = any_of(snippet.begin(), snippet.end(), [](const mnemo_t &mnemo) {
+            return mnemo.tag == mnemo_t::tag_t::Label;
+        });
+        if (has_labels && options.unroll_count > 1)
+            throw logic_error("snippets with labels can not be unrolled");
+
+        cpu_pin_t pin(options.cpu);
+        hardware_counters_t counters{};
+
+        bench_samples_t baseline = measure(harness({}, 0, options.loop_count), options, counters);
+        bench_samples_t samples = measure(harness(snippet, options.unroll_count, options.loop_count), options,
+                                          counters);
+
+        double executions = double(options.unroll_count * options.loop_count);
+        auto counter_statistic = [&](hardware_counter_t counter) -> bench_statistic {
+            return statistic(samples.counters[size_t(counter)], baseline.counters[size_t(counter)], executions,
+                             counters.is_available(counter));
+        };
+
+        bench_result result{};
+        result.tsc = statistic(samples.tsc, baseline.tsc, executions, true);
+        result.ns = statistic(samples.ns, baseline.ns, executions, true);
+        result.cycles = counter_statistic(hardware_counter_t::Cycles);
+        result.instructions = counter_statistic(hardware_counter_t::Instructions);
+        result.uops = counter_statistic(hardware_counter_t::Uops);
+        result.branch_misses = counter_statistic(hardware_counter_t::BranchMisses);
+        result.pinned = pin.is_pinned();
+        result.code_size = samples.code_size;
+        return result;
+    }
+
+    auto print_bench_result(const bench_result &result) -> void {
+        auto print = [](const char *name, const bench_statistic &s) {
+            cout << "  " << name << ": ";
+            if (s.available)
+                cout << s.median << " (mad " << s.mad << ", min " << s.min << ", max " << s.max << ")\n";
+            else
+                cout << "unavailable\n";
+        };
+        print("tsc ticks", result.tsc);
+        print("ns", result.ns);
+        print("cycles", result.cycles);
+        print("instructions", result.instructions);
+        print("uops", result.uops);
+        print("branch misses", result.branch_misses);
+        cout << "  " << result.code_size << " bytes of code" << (result.pinned ? "" : ", not pinned") << "\n";
+    }
+}
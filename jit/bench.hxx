@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+#include "../assembly/assembly.hxx"
+
+namespace jit {
+    struct bench_options {
+        // Copies of the snippet in the loop body. Snippets with labels can only be used with 1.
+        u64 unroll_count = 100;
+
+        // Loop iterations per measurement, should fit in i32
+        u64 loop_count = 100;
+
+        // Calls before measuring
+        u64 warmup_count = 10;
+
+        // Measurements, statistics are computed over these
+        u64 measurement_count = 101;
+
+        // CPU to pin to while measuring, -1 for the CPU the thread is running on
+        int cpu = -1;
+    };
+
+    // Per snippet execution, after subtracting the cost of the empty harness
+    struct bench_statistic {
+        bool available;
+        double median;
+        // Median absolute deviation from the median
+        double mad;
+        double min;
+        double max;
+    };
+
+    struct bench_result {
+        bench_statistic tsc;
+        bench_statistic ns;
+        bench_statistic cycles;
+        bench_statistic instructions;
+        bench_statistic uops;
+        bench_statistic branch_misses;
+
+        bool pinned;
+        u64 code_size;
+    };
+
+    // Measures a snippet like nanoBench does. The snippet is unrolled inside a generated loop:
+    //
+    // push rbx
+    // push rbp
+    // push loop_count       ; the counter lives on the stack, so the snippet may clobber any register
+    // loop:
+    // <snippet> * unroll_count
+    // dec QWORD [rsp]
+    // jnz loop
+    // add rsp, 8
+    // pop rbp
+    // pop rbx
+    // ret
+    //
+    // Each measurement reads the TSC with `lfence; rdtsc` and `rdtscp; lfence` and the hardware counters from
+    // os/counters.hxx. The same harness without the snippet is measured first and its median is subtracted.
+    auto bench(const vector<assembly::mnemo_t> &snippet, const bench_options &options = {}) -> bench_result;
+
+    auto print_bench_result(const bench_result &result) -> void;
+}
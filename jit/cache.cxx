@@ -0,0 +1,64 @@
+#include "cache.hxx"
+
+#include "compile.hxx"
+
+using namespace std;
+
+namespace jit {
+    code_cache_t::code_cache_t(code_cache_options options) : options(options) {}
+
+    auto code_cache_t::evict() -> void {
+        // Walk from the least recently used end, skipping pinned blocks
+        auto it = this->entries.end();
+        while (this->stats.byte_count > this->options.byte_budget && it != this->entries.begin()) {
+            --it;
+            if (it->code.use_count() > 1)
+                continue;
+            this->stats.byte_count -= it->byte_count;
+            this->stats.entry_count--;
+            this->stats.evictions++;
+            this->index.erase(it->source);
+            it = this->entries.erase(it);
+        }
+    }
+
+    auto code_cache_t::get(const string &source, const string &name) -> code_handle_t {
+        {
+            lock_guard<std::mutex> lock(this->mutex);
+            auto found = this->index.find(source);
+            if (found != this->index.end()) {
+                this->stats.hits++;
+                this->entries.splice(this->entries.begin(), this->entries, found->second);
+                return found->second->code;
+            }
+            this->stats.misses++;
+        }
+
+        auto code = make_shared<const function_t>(compile(source, name));
+
+        lock_guard<std::mutex> lock(this->mutex);
+        // Another thread may have compiled the same source meanwhile
+        auto found = this->index.find(source);
+        if (found != this->index.end()) {
+            this->entries.splice(this->entries.begin(), this->entries, found->second);
+            return found->second->code;
+        }
+        u64 byte_count = code->get_size() + 2;
+        this->entries.push_front({source, code, byte_count});
+        this->index.emplace(source, this->entries.begin());
+        this->stats.entry_count++;
+        this->stats.byte_count += byte_count;
+        this->evict();
+        return code;
+    }
+
+    auto code_cache_t::trim() -> void {
+        lock_guard<std::mutex> lock(this->mutex);
+        this->evict();
+    }
+
+    auto code_cache_t::get_stats() const -> code_cache_stats {
+        lock_guard<std::mutex> lock(this->mutex);
+        return this->stats;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+#include "jit.hxx"
+
+namespace jit {
+    struct code_cache_options {
+        // Bytes of code the cache keeps before evicting, including the `ud2` trap of every block
+        u64 byte_budget = 16 * 1024 * 1024;
+    };
+
+    struct code_cache_stats {
+        u64 hits;
+        u64 misses;
+        u64 evictions;
+        u64 entry_count;
+        u64 byte_count;
+    };
+
+    // A block stays pinned, and is not evicted, while any handle to it exists
+    typedef std::shared_ptr<const function_t> code_handle_t;
+
+    // Compiled functions keyed by their source text. Once the cached code exceeds the byte budget, least recently
+    // used blocks without handles are freed. If every block is pinned the cache stays over budget until handles
+    // are released. Freed blocks return to the executable arenas, which give memory back to the OS only once every
+    // block of a 1 MiB chunk is freed, see jit/arena.hxx. All members are thread safe.
+    class code_cache_t {
+        struct entry_t {
+            string source;
+            code_handle_t code;
+            u64 byte_count;
+        };
+
+        code_cache_options options;
+
+        mutable std::mutex mutex;
+        // Most recently used first
+        std::list<entry_t> entries;
+        std::unordered_map<string, std::list<entry_t>::iterator> index;
+        code_cache_stats stats{};
+
+        auto evict() -> void;
+
+    public:
+        explicit code_cache_t(code_cache_options options = {});
+
+        code_cache_t(const code_cache_t &) = delete;
+
+        auto operator=(const code_cache_t &) -> code_cache_t & = delete;
+
+        // Returns the cached function for `source`, compiling it outside the lock on a miss.
+        // Throws `runtime_error` on parsing errors like `compile`.
+        auto get(const string &source, const string &name = {}) -> code_handle_t;
+
+        // Frees unpinned blocks until the cache is within budget, for example after handles were released
+        auto trim() -> void;
+
+        [[nodiscard]] auto get_stats() const -> code_cache_stats;
+    };
+}
@@ -0,0 +1,127 @@
+#include "compile.hxx"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <variant>
+
+#include "../assembly/parse/parse.hxx"
+#include "../os/stats.hxx"
+#include "../util/mpsc_queue/mpsc_queue.hxx"
+
+using namespace std;
+
+using assembly::mnemo_t;
+
+namespace jit {
+    struct compile_job_t {
+        variant<string, vector<mnemo_t>> input;
+        string name;
+        promise<function_t> result;
+    };
+
+    // Compiler threads. Jobs go to one queue per priority shared by all workers, so any idle worker takes the
+    // oldest High job before any Normal one. Submission stays lock-free; workers take turns popping because the
+    // queues allow a single consumer at a time.
+    class compiler_pool_t {
+        MpscQueue<compile_job_t> queues[2]; // Indexed by compile_priority_t
+        mutex pop_mutex;
+        // Incremented after every push, workers sleep on it when the queues are empty
+        atomic<u32> signal{0};
+        vector<std::thread> workers;
+        atomic<bool> stopping{false};
+
+        auto pop_job() -> optional<compile_job_t> {
+            lock_guard<mutex> lock(this->pop_mutex);
+            if (optional<compile_job_t> job = this->queues[u64(compile_priority_t::High)].pop())
+                return job;
+            return this->queues[u64(compile_priority_t::Normal)].pop();
+        }
+
+        static auto run_job(compile_job_t &job) -> void {
+            try {
+                if (holds_alternative<string>(job.input))
+                    job.result.set_value(compile(get<string>(job.input), job.name));
+                else
+                    job.result.set_value(compile(get<vector<mnemo_t>>(job.input), job.name));
+            } catch (...) {
+                job.result.set_exception(current_exception());
+            }
+        }
+
+        auto run() -> void {
+            while (true) {
+                // Read signal before checking queues, so a push after the check wakes the wait below
+                u32 seen = this->signal.load(memory_order_acquire);
+                while (optional<compile_job_t> job = this->pop_job())
+                    run_job(*job);
+                if (this->stopping.load(memory_order_acquire))
+                    return;
+                this->signal.wait(seen, memory_order_acquire);
+            }
+        }
+
+    public:
+        explicit compiler_pool_t(u64 worker_count) {
+            for (u64 i = 0; i < worker_count; i++)
+                this->workers.emplace_back([this]() { this->run(); });
+        }
+
+        // Finishes queued jobs before joining workers
+        ~compiler_pool_t() {
+            this->stopping.store(true, memory_order_release);
+            this->signal.fetch_add(1, memory_order_release);
+            this->signal.notify_all();
+            for (std::thread &worker: this->workers)
+                worker.join();
+        }
+
+        auto submit(compile_job_t job, compile_priority_t priority) -> future<function_t> {
+            future<function_t> result = job.result.get_future();
+            this->queues[u64(priority)].push(move(job));
+            this->signal.fetch_add(1, memory_order_release);
+            this->signal.notify_one();
+            return result;
+        }
+    };
+
+    static auto compiler_pool() -> compiler_pool_t & {
+        // Leave one hardware thread to the caller
+        static compiler_pool_t pool(max(2u, thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    auto compile(const vector<mnemo_t> &mnemos, const string &name) -> function_t {
+        stats_add(stat_t::CompileCount, 1);
+        vector<u8> code{};
+        {
+            stats_timer_t timer(compile_phase_t::Assemble);
+            timer.set_items(mnemos.size());
+            code = assembly::assemble(mnemos);
+        }
+        return function_t(code, name);
+    }
+
+    auto compile(const string &source, const string &name) -> function_t {
+        assembly::parse::ParserResultResult<vector<mnemo_t>> mnemos = [&]() {
+            stats_timer_t timer(compile_phase_t::Parse);
+            assembly::parse::ParserResultResult<vector<mnemo_t>> parsed = assembly::parse::parse(source);
+            if (parsed.is_ok())
+                timer.set_items(parsed.value().data.size());
+            return parsed;
+        }();
+        if (!mnemos.is_ok())
+            throw runtime_error(string("parsing error: ") + mnemos.error().what);
+        return compile(mnemos.value().data, name);
+    }
+
+    auto compile_async(vector<mnemo_t> mnemos, compile_priority_t priority, string name) -> future<function_t> {
+        return compiler_pool().submit({move(mnemos), move(name), {}}, priority);
+    }
+
+    auto compile_async(string source, compile_priority_t priority, string name) -> future<function_t> {
+        return compiler_pool().submit({move(source), move(name), {}}, priority);
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <future>
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+#include "../assembly/assembly.hxx"
+#include "jit.hxx"
+
+namespace jit {
+    enum class compile_priority_t {
+        Normal,
+        High, // Taken by the next free worker before any queued Normal jobs
+    };
+
+    // Assembles mnemos on the caller's thread. `name` identifies the code in profilers.
+    auto compile(const vector<assembly::mnemo_t> &mnemos, const string &name = {}) -> function_t;
+
+    // Parses and assembles source text on the caller's thread. Throws `runtime_error` on parsing errors.
+    auto compile(const string &source, const string &name = {}) -> function_t;
+
+    // Queues compilation to the background compiler pool. Submission pushes to a lock-free queue and never waits
+    // for the assembler. The future holds the compiled function or the exception thrown while compiling it.
+    auto compile_async(vector<assembly::mnemo_t> mnemos, compile_priority_t priority = compile_priority_t::Normal,
+                       string name = {}) -> std::future<function_t>;
+
+    auto compile_async(string source, compile_priority_t priority = compile_priority_t::Normal,
+                       string name = {}) -> std::future<function_t>;
+}
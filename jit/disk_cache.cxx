@@ -0,0 +1,285 @@
+#include "disk_cache.hxx"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+
+#include "../assembly/assembly.hxx"
+#include "../assembly/parse/parse.hxx"
+#include "../util/util.hxx"
+
+#if defined(unix) || defined(__unix__) || defined(__unix)
+#define CPLASTANE_UNIX
+#endif
+
+#ifdef CPLASTANE_UNIX
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#endif
+
+using namespace std;
+
+namespace jit {
+    static constexpr u64 file_magic = 0x45484341434c5043; // "CPLCACHE"
+    static constexpr u32 file_format_version = 2;
+    static constexpr u32 record_magic = 0x45444f43; // "CODE"
+
+    struct file_header_t {
+        u64 magic;
+        u32 format_version;
+        u32 reserved;
+    };
+
+    struct record_header_t {
+        u32 magic;
+        u32 assembler_version;
+        u64 code_size;
+        u64 checksum;
+        u8 key[32];
+    };
+
+    static_assert(sizeof(file_header_t) == 16 && sizeof(record_header_t) == 56);
+
+    static auto padded_size(u64 size) -> u64 {
+        return (size + 7) / 8 * 8;
+    }
+
+    // Checksum of a record: its header with the checksum field zeroed, which includes the key and code size,
+    // followed by its code
+    static auto record_checksum(record_header_t header, const u8 *code) -> u64 {
+        header.checksum = 0;
+        string bytes(reinterpret_cast<const char *>(&header), sizeof(header));
+        bytes.append(reinterpret_cast<const char *>(code), header.code_size);
+        array<u8, 32> digest = sha256(bytes);
+        u64 result;
+        memcpy(&result, digest.data(), sizeof(result));
+        return result;
+    }
+
+    static auto is_record_intact(const u8 *record) -> bool {
+        record_header_t header{};
+        memcpy(&header, record, sizeof(header));
+        return record_checksum(header, record + sizeof(header)) == header.checksum;
+    }
+
+    auto disk_cache_t::key_hash_t::operator()(const array<u8, 32> &key) const -> size_t {
+        // Keys are already uniformly distributed
+        size_t hash;
+        memcpy(&hash, key.data(), sizeof(hash));
+        return hash;
+    }
+
+#ifdef CPLASTANE_UNIX
+
+    static auto open_cache_file(const string &path) -> int {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd == -1)
+            throw runtime_error("could not open code cache " + path);
+        return fd;
+    }
+
+    disk_cache_t::disk_cache_t(const string &directory) : path(directory + "/code.cache") {
+        filesystem::create_directories(directory);
+        this->fd = open_cache_file(this->path);
+        this->load();
+    }
+
+    disk_cache_t::~disk_cache_t() {
+        if (this->mapping != nullptr)
+            munmap(const_cast<u8 *>(this->mapping), this->mapping_size);
+        if (this->fd != -1)
+            close(this->fd);
+    }
+
+    // Holds a flock on the cache file. Appends take it shared, and replacing a file of an unknown format takes it
+    // exclusive, so processes that opened the same file replace it only once.
+    class file_lock_t {
+        int fd;
+
+    public:
+        file_lock_t(int fd, int operation) : fd(fd) {
+            while (flock(fd, operation) != 0) {
+                if (errno != EINTR)
+                    throw runtime_error("could not lock code cache");
+            }
+        }
+
+        ~file_lock_t() {
+            flock(this->fd, LOCK_UN);
+        }
+    };
+
+    static auto read_file_header(int fd) -> optional<file_header_t> {
+        file_header_t header{};
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != file_magic ||
+            header.format_version != file_format_version)
+            return nullopt;
+        return header;
+    }
+
+    // Renames a new file holding only the file header over `path`. Truncating in place would make other processes
+    // fault on their next read of a mapping of the old file.
+    static auto replace_with_empty_file(const string &path) -> void {
+        string temporary = path + ".tmp" + to_string(getpid());
+        int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1)
+            throw runtime_error("could not initialize code cache");
+        file_header_t header = {file_magic, file_format_version, 0};
+        bool written = write(fd, &header, sizeof(header)) == sizeof(header);
+        close(fd);
+        if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+            unlink(temporary.c_str());
+            throw runtime_error("could not initialize code cache");
+        }
+    }
+
+    auto disk_cache_t::load() -> void {
+        if (!read_file_header(this->fd)) {
+            // Empty file or an unknown format. Processes that opened it take turns, the first one replaces it and
+            // the others find the new file when they open the path again.
+            int old_fd = this->fd;
+            this->fd = -1;
+            try {
+                file_lock_t lock(old_fd, LOCK_EX);
+                this->fd = open_cache_file(this->path);
+                if (!read_file_header(this->fd)) {
+                    replace_with_empty_file(this->path);
+                    close(this->fd);
+                    this->fd = -1;
+                    this->fd = open_cache_file(this->path);
+                }
+            } catch (...) {
+                close(old_fd);
+                throw;
+            }
+            close(old_fd);
+        }
+
+        struct stat file_stat{};
+        fstat(this->fd, &file_stat);
+        u64 size = file_stat.st_size;
+        if (size <= sizeof(file_header_t))
+            return;
+
+        void *mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, this->fd, 0);
+        if (mem == MAP_FAILED)
+            throw runtime_error("could not map code cache");
+        this->mapping = reinterpret_cast<const u8 *>(mem);
+        this->mapping_size = size;
+
+        u64 offset = sizeof(file_header_t);
+        // Start of the last record that was loaded. When the header after it is bad, its own code size may have been
+        // wrong, so the search for the next record starts inside it.
+        u64 last_record = 0;
+        // Set while searching for the next record after a corrupt one
+        bool searching = false;
+        while (offset + sizeof(record_header_t) <= size) {
+            record_header_t record{};
+            memcpy(&record, this->mapping + offset, sizeof(record));
+            const u8 *code = this->mapping + offset + sizeof(record);
+            bool fits = record.magic == record_magic && record.code_size <= size - offset - sizeof(record) &&
+                        padded_size(record.code_size) <= size - offset - sizeof(record);
+            // A record magic found while searching may be part of code, only a matching checksum is trusted
+            if (!fits || (searching && record_checksum(record, code) != record.checksum)) {
+                if (!searching) {
+                    this->stats.skipped++;
+                    searching = true;
+                    offset = last_record != 0 ? last_record : offset;
+                }
+                offset++;
+                continue;
+            }
+
+            searching = false;
+            last_record = offset;
+            offset += sizeof(record) + padded_size(record.code_size);
+            if (record.assembler_version != assembly::assembler_version) {
+                this->stats.skipped++;
+                continue;
+            }
+            array<u8, 32> key{};
+            memcpy(key.data(), record.key, key.size());
+            // Later entries replace earlier ones
+            this->entries[key] = {this->mapping + last_record, code, record.code_size, false};
+            this->stats.loaded++;
+        }
+
+        // A tail shorter than a record header, new records are appended after it and found by searching
+        if (!searching && offset != size)
+            this->stats.skipped++;
+    }
+
+    auto disk_cache_t::append(const array<u8, 32> &key, const vector<u8> &code) -> void {
+        record_header_t record = {record_magic, assembly::assembler_version, code.size(), 0, {}};
+        memcpy(record.key, key.data(), key.size());
+        record.checksum = record_checksum(record, code.data());
+
+        vector<u8> buffer(sizeof(record) + padded_size(code.size()), 0);
+        memcpy(buffer.data(), &record, sizeof(record));
+        memcpy(buffer.data() + sizeof(record), code.data(), code.size());
+        // A failed or partial write only loses this entry, later loads skip over it
+        file_lock_t lock(this->fd, LOCK_SH);
+        [[maybe_unused]] ssize_t written = write(this->fd, buffer.data(), buffer.size());
+    }
+
+#else
+
+    disk_cache_t::disk_cache_t(const string &) {}
+
+    disk_cache_t::~disk_cache_t() = default;
+
+    auto disk_cache_t::load() -> void {}
+
+    auto disk_cache_t::append(const array<u8, 32> &, const vector<u8> &) -> void {}
+
+#endif
+
+    auto disk_cache_t::assemble(const string &source) -> vector<u8> {
+        array<u8, 32> key = sha256(source);
+        {
+            lock_guard<std::mutex> lock(this->mutex);
+            auto found = this->entries.find(key);
+            if (found != this->entries.end()) {
+                entry_t &entry = found->second;
+                if (!entry.verified && !is_record_intact(entry.record)) {
+                    this->stats.skipped++;
+                    this->entries.erase(found);
+                } else {
+                    entry.verified = true;
+                    this->stats.hits++;
+                    return {entry.code, entry.code + entry.size};
+                }
+            }
+            this->stats.misses++;
+        }
+
+        assembly::parse::ParserResultResult<vector<assembly::mnemo_t>> mnemos = assembly::parse::parse(source);
+        if (!mnemos.is_ok())
+            throw runtime_error(string("parsing error: ") + mnemos.error().what);
+        vector<u8> code = assembly::assemble(mnemos.value().data);
+
+        lock_guard<std::mutex> lock(this->mutex);
+        if (!this->entries.contains(key)) {
+            this->append(key, code);
+            const vector<u8> &stored = this->appended.emplace_back(code);
+            this->entries[key] = {nullptr, stored.data(), stored.size(), true};
+        }
+        return code;
+    }
+
+    auto disk_cache_t::compile(const string &source, const string &name) -> function_t {
+        return function_t(this->assemble(source), name);
+    }
+
+    auto disk_cache_t::get_stats() -> disk_cache_stats {
+        lock_guard<std::mutex> lock(this->mutex);
+        return this->stats;
+    }
+}
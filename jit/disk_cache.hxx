@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <unordered_map>
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+#include "jit.hxx"
+
+namespace jit {
+    struct disk_cache_stats {
+        // Entries found in the file when it was opened
+        u64 loaded;
+        // Entries skipped because of an other assembler version or a bad checksum, and corrupt or truncated regions
+        // of the file
+        u64 skipped;
+        u64 hits;
+        u64 misses;
+    };
+
+    // Assembled code persisted in `<directory>/code.cache`, keyed by the SHA-256 of the source text and
+    // `assembly::assembler_version`. A hit loads ready bytes without parsing or assembling.
+    //
+    // The file is append-only: a 16 byte file header followed by records of a 56 byte header and the code padded to
+    // 8 bytes. The file is mapped read-only when opened and new entries are appended with one `write` each, so
+    // several processes can share it. Loading never writes to the file; a file of an other format is replaced by
+    // renaming a new one over it, so processes that still map the old file keep reading its contents.
+    //
+    // The checksum of a record covers its header, key and code, and is checked on the first lookup. A record with a
+    // bad header, or a torn one left by a process that was killed while appending, is skipped: the next record is
+    // found by scanning for a record magic and only trusted if its checksum matches. On systems without mmap
+    // nothing is persisted.
+    class disk_cache_t {
+        struct entry_t {
+            // Header of the record in the mapping, nullptr for entries appended by this process
+            const u8 *record;
+            const u8 *code;
+            u64 size;
+            bool verified;
+        };
+
+        struct key_hash_t {
+            auto operator()(const std::array<u8, 32> &key) const -> size_t;
+        };
+
+        string path;
+        int fd = -1;
+        const u8 *mapping = nullptr;
+        u64 mapping_size = 0;
+
+        std::mutex mutex;
+        std::unordered_map<std::array<u8, 32>, entry_t, key_hash_t> entries;
+        // Code appended since the file was mapped, entries point into it
+        vector<vector<u8>> appended;
+        disk_cache_stats stats{};
+
+        auto load() -> void;
+
+        auto append(const std::array<u8, 32> &key, const vector<u8> &code) -> void;
+
+    public:
+        // Creates the directory and the file if they do not exist
+        explicit disk_cache_t(const string &directory);
+
+        disk_cache_t(const disk_cache_t &) = delete;
+
+        auto operator=(const disk_cache_t &) -> disk_cache_t & = delete;
+
+        ~disk_cache_t();
+
+        // Returns the code of `source`, parsing and assembling it on a miss.
+        // Throws `runtime_error` on parsing errors like `compile`.
+        auto assemble(const string &source) -> vector<u8>;
+
+        auto compile(const string &source, const string &name = {}) -> function_t;
+
+        [[nodiscard]] auto get_stats() -> disk_cache_stats;
+    };
+}
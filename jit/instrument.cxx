@@ -0,0 +1,41 @@
+#include "instrument.hxx"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "../os/stats.hxx"
+
+using namespace std;
+
+namespace jit {
+    instrumented_function_t::instrumented_function_t(const vector<assembly::mnemo_t> &mnemos,
+                                                     assembly::instrument_t mode, const string &name) {
+        if (mode == assembly::instrument_t::None)
+            throw logic_error("instrumented function needs an instrumentation mode");
+        stats_add(stat_t::CompileCount, 1);
+        assembly::assemble_result result{};
+        {
+            stats_timer_t timer(compile_phase_t::Assemble);
+            timer.set_items(mnemos.size());
+            result = assembly::assemble_detailed(mnemos, {.instrument = mode});
+        }
+        this->native = function_t(result.code, result.counter_offset, result.counter_count * sizeof(u64), name);
+        this->counter_offset = result.counter_offset;
+        this->counter_count = result.counter_count;
+    }
+
+    auto instrumented_function_t::operator()() const -> i64 {
+        return this->native();
+    }
+
+    auto instrumented_function_t::get_counts() const -> vector<u64> {
+        vector<u64> counts(this->counter_count);
+        if (this->counter_count != 0)
+            memcpy(counts.data(), this->native.get_code() + this->counter_offset, this->counter_count * sizeof(u64));
+        return counts;
+    }
+
+    auto instrumented_function_t::get_function() const -> const function_t & {
+        return this->native;
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+#include "../assembly/assembly.hxx"
+#include "jit.hxx"
+
+namespace jit {
+    // Native code which counts how often its blocks or mnemos execute, see `assembly::instrument_t`.
+    // Counters live on read-write pages of their own right after the code, which the probes address RIP-relative.
+    class instrumented_function_t {
+        function_t native;
+        u64 counter_offset = 0;
+        u64 counter_count = 0;
+
+    public:
+        instrumented_function_t() = default;
+
+        explicit instrumented_function_t(const vector<assembly::mnemo_t> &mnemos,
+                                         assembly::instrument_t mode = assembly::instrument_t::Blocks,
+                                         const string &name = {});
+
+        auto operator()() const -> i64;
+
+        // Executions so far, by basic block or by mnemo index. Block counts can be passed as
+        // `assemble_options::block_counts` or as a function's entry of `module_profile_t`.
+        [[nodiscard]] auto get_counts() const -> vector<u64>;
+
+        [[nodiscard]] auto get_function() const -> const function_t &;
+    };
+}
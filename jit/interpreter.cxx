@@ -0,0 +1,767 @@
+#include "interpreter.hxx"
+
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+using assembly::mnemo_t;
+using arg_t = mnemo_t::arg_t;
+using reg_t = arg_t::reg_t;
+using width_t = mnemo_t::width_t;
+using tag_t = mnemo_t::tag_t;
+using cond_t = mnemo_t::cond_t;
+
+// Size of the emulated stack
+static constexpr u64 stack_size = 64 * 1024;
+
+// Return addresses pushed by `call` are mnemo indexes tagged with this value in the upper bits
+static constexpr u64 return_address_tag = 0x5eed000000000000;
+static constexpr u64 return_address_tag_mask = 0xffff000000000000;
+
+// Register numbers match the encoding: rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi
+static constexpr u8 rax_number = 0;
+static constexpr u8 rcx_number = 1;
+static constexpr u8 rsp_number = 4;
+
+struct machine_t {
+    u64 regs[8];
+
+    bool cf;
+    bool zf;
+    bool sf;
+    bool of;
+    bool pf;
+
+    vector<u8> stack;
+};
+
+// Location of a general purpose register in the register file
+struct gpr_t {
+    u8 number;
+    u8 shift; // 8 for ah, ch, dh and bh
+    width_t width;
+};
+
+static auto find_gpr(reg_t reg, gpr_t &gpr) -> bool {
+    switch (reg) {
+        case reg_t::Al:
+            gpr = {0, 0, width_t::Byte};
+            return true;
+        case reg_t::Cl:
+            gpr = {1, 0, width_t::Byte};
+            return true;
+        case reg_t::Dl:
+            gpr = {2, 0, width_t::Byte};
+            return true;
+        case reg_t::Bl:
+            gpr = {3, 0, width_t::Byte};
+            return true;
+        case reg_t::Ah:
+            gpr = {0, 8, width_t::Byte};
+            return true;
+        case reg_t::Ch:
+            gpr = {1, 8, width_t::Byte};
+            return true;
+        case reg_t::Dh:
+            gpr = {2, 8, width_t::Byte};
+            return true;
+        case reg_t::Bh:
+            gpr = {3, 8, width_t::Byte};
+            return true;
+        case reg_t::Ax:
+            gpr = {0, 0, width_t::Word};
+            return true;
+        case reg_t::Cx:
+            gpr = {1, 0, width_t::Word};
+            return true;
+        case reg_t::Dx:
+            gpr = {2, 0, width_t::Word};
+            return true;
+        case reg_t::Bx:
+            gpr = {3, 0, width_t::Word};
+            return true;
+        case reg_t::Sp:
+            gpr = {4, 0, width_t::Word};
+            return true;
+        case reg_t::Bp:
+            gpr = {5, 0, width_t::Word};
+            return true;
+        case reg_t::Si:
+            gpr = {6, 0, width_t::Word};
+            return true;
+        case reg_t::Di:
+            gpr = {7, 0, width_t::Word};
+            return true;
+        case reg_t::Eax:
+            gpr = {0, 0, width_t::Dword};
+            return true;
+        case reg_t::Ecx:
+            gpr = {1, 0, width_t::Dword};
+            return true;
+        case reg_t::Edx:
+            gpr = {2, 0, width_t::Dword};
+            return true;
+        case reg_t::Ebx:
+            gpr = {3, 0, width_t::Dword};
+            return true;
+        case reg_t::Esp:
+            gpr = {4, 0, width_t::Dword};
+            return true;
+        case reg_t::Ebp:
+            gpr = {5, 0, width_t::Dword};
+            return true;
+        case reg_t::Esi:
+            gpr = {6, 0, width_t::Dword};
+            return true;
+        case reg_t::Edi:
+            gpr = {7, 0, width_t::Dword};
+            return true;
+        case reg_t::Rax:
+            gpr = {0, 0, width_t::Qword};
+            return true;
+        case reg_t::Rcx:
+            gpr = {1, 0, width_t::Qword};
+            return true;
+        case reg_t::Rdx:
+            gpr = {2, 0, width_t::Qword};
+            return true;
+        case reg_t::Rbx:
+            gpr = {3, 0, width_t::Qword};
+            return true;
+        case reg_t::Rsp:
+            gpr = {4, 0, width_t::Qword};
+            return true;
+        case reg_t::Rbp:
+            gpr = {5, 0, width_t::Qword};
+            return true;
+        case reg_t::Rsi:
+            gpr = {6, 0, width_t::Qword};
+            return true;
+        case reg_t::Rdi:
+            gpr = {7, 0, width_t::Qword};
+            return true;
+        default:
+            return false;
+    }
+}
+
+static auto width_bits(width_t width) -> u8 {
+    switch (width) {
+        case width_t::Byte:
+            return 8;
+        case width_t::Word:
+            return 16;
+        case width_t::Dword:
+            return 32;
+        case width_t::Qword:
+            return 64;
+        default:
+            throw logic_error("Unsupported width! @ width_bits");
+    }
+}
+
+static auto width_mask(width_t width) -> u64 {
+    u8 bits = width_bits(width);
+    return bits == 64 ? ~u64(0) : (u64(1) << bits) - 1;
+}
+
+static auto sign_extend(u64 value, width_t width) -> i64 {
+    u8 shift = 64 - width_bits(width);
+    return i64(value << shift) >> shift;
+}
+
+static auto msb(u64 value, width_t width) -> bool {
+    return (value >> (width_bits(width) - 1)) & 1;
+}
+
+static auto read_reg(const machine_t &m, reg_t reg) -> u64 {
+    gpr_t gpr{};
+    if (!find_gpr(reg, gpr))
+        throw logic_error("Unsupported register! @ read_reg");
+    return (m.regs[gpr.number] >> gpr.shift) & width_mask(gpr.width);
+}
+
+// Like on hardware, 32 bit writes zero-extend into the whole register and 8/16 bit writes keep the other bits
+static auto write_reg(machine_t &m, reg_t reg, u64 value) -> void {
+    gpr_t gpr{};
+    if (!find_gpr(reg, gpr))
+        throw logic_error("Unsupported register! @ write_reg");
+    u64 mask = width_mask(gpr.width);
+    if (gpr.width == width_t::Dword || gpr.width == width_t::Qword) {
+        m.regs[gpr.number] = value & mask;
+    } else {
+        m.regs[gpr.number] = (m.regs[gpr.number] & ~(mask << gpr.shift)) | ((value & mask) << gpr.shift);
+    }
+}
+
+static auto scale_to_multiplier(arg_t::memory_t::scale_t scale) -> u64 {
+    switch (scale) {
+        case arg_t::memory_t::scale_t::S0:
+            return 0;
+        case arg_t::memory_t::scale_t::S1:
+            return 1;
+        case arg_t::memory_t::scale_t::S2:
+            return 2;
+        case arg_t::memory_t::scale_t::S4:
+            return 4;
+        case arg_t::memory_t::scale_t::S8:
+            return 8;
+        default:
+            throw logic_error("Scale is Undef.");
+    }
+}
+
+static auto effective_address(const machine_t &m, const arg_t::memory_t &memory) -> u64 {
+    if (memory.base == reg_t::Rip)
+        throw logic_error("RIP-relative addresses can not be interpreted");
+    u64 address = read_reg(m, memory.base) + u64(i64(memory.disp));
+    if (memory.scale != arg_t::memory_t::scale_t::S0)
+        address += read_reg(m, memory.index) * scale_to_multiplier(memory.scale);
+    // 32 bit base and index registers produce a 32 bit address
+    gpr_t base{};
+    find_gpr(memory.base, base);
+    if (base.width == width_t::Dword)
+        address &= 0xffffffff;
+    return address;
+}
+
+static auto stack_pointer(machine_t &m, u64 address, u64 size) -> u8 * {
+    auto begin = u64(m.stack.data());
+    if (address < begin || address + size > begin + m.stack.size())
+        throw logic_error("memory access outside of the emulated stack @ interpret");
+    return m.stack.data() + (address - begin);
+}
+
+static auto read_memory(machine_t &m, const arg_t::memory_t &memory, u64 size) -> u64 {
+    u64 value = 0;
+    if (memory.constant != 0) {
+        span<const u8> bytes = assembly::constant_span(memory.constant);
+        if (memory.disp < 0 || u64(memory.disp) + size > bytes.size())
+            throw logic_error("memory access outside of the constant @ interpret");
+        memcpy(&value, bytes.data() + memory.disp, size);
+    } else {
+        memcpy(&value, stack_pointer(m, effective_address(m, memory), size), size);
+    }
+    return value;
+}
+
+static auto write_memory(machine_t &m, const arg_t::memory_t &memory, u64 size, u64 value) -> void {
+    if (memory.constant != 0)
+        throw logic_error("constants are read only @ interpret");
+    memcpy(stack_pointer(m, effective_address(m, memory), size), &value, size);
+}
+
+// Reads an operand of `width`. Like in the encoding, qword operations take an imm32 that is sign-extended,
+// only `mov r64, imm` has a full 64 bit immediate.
+static auto read_arg(machine_t &m, const arg_t &arg, width_t width) -> u64 {
+    switch (arg.tag) {
+        case arg_t::tag_t::Immediate:
+            if (width == width_t::Qword)
+                return u64(i64(i32(arg.data.imm)));
+            return u64(arg.data.imm) & width_mask(width);
+        case arg_t::tag_t::Register:
+            return read_reg(m, arg.data.reg);
+        case arg_t::tag_t::Memory:
+            return read_memory(m, arg.data.memory, width_bits(width) / 8);
+        default:
+            throw logic_error("Unsupported operand! @ read_arg");
+    }
+}
+
+static auto write_arg(machine_t &m, const arg_t &arg, width_t width, u64 value) -> void {
+    switch (arg.tag) {
+        case arg_t::tag_t::Register:
+            write_reg(m, arg.data.reg, value);
+            break;
+        case arg_t::tag_t::Memory:
+            write_memory(m, arg.data.memory, width_bits(width) / 8, value);
+            break;
+        default:
+            throw logic_error("Unsupported operand! @ write_arg");
+    }
+}
+
+static auto push_value(machine_t &m, u64 size, u64 value) -> void {
+    m.regs[rsp_number] -= size;
+    memcpy(stack_pointer(m, m.regs[rsp_number], size), &value, size);
+}
+
+static auto pop_value(machine_t &m, u64 size) -> u64 {
+    u64 value = 0;
+    memcpy(&value, stack_pointer(m, m.regs[rsp_number], size), size);
+    m.regs[rsp_number] += size;
+    return value;
+}
+
+// Sets ZF, SF and PF from a result and clears CF and OF, like logic instructions do
+static auto set_logic_flags(machine_t &m, u64 result, width_t width) -> void {
+    result &= width_mask(width);
+    m.zf = result == 0;
+    m.sf = msb(result, width);
+    m.pf = !__builtin_parity(u32(result & 0xff));
+    m.cf = false;
+    m.of = false;
+}
+
+static auto add_with_flags(machine_t &m, u64 a, u64 b, width_t width) -> u64 {
+    u64 mask = width_mask(width);
+    u64 result = (a + b) & mask;
+    set_logic_flags(m, result, width);
+    m.cf = result < (a & mask);
+    m.of = msb(a, width) == msb(b, width) && msb(result, width) != msb(a, width);
+    return result;
+}
+
+static auto sub_with_flags(machine_t &m, u64 a, u64 b, width_t width) -> u64 {
+    u64 mask = width_mask(width);
+    u64 result = (a - b) & mask;
+    set_logic_flags(m, result, width);
+    m.cf = (a & mask) < (b & mask);
+    m.of = msb(a, width) != msb(b, width) && msb(result, width) != msb(a, width);
+    return result;
+}
+
+static auto test_cond(const machine_t &m, cond_t cond) -> bool {
+    switch (cond) {
+        case cond_t::O:
+            return m.of;
+        case cond_t::No:
+            return !m.of;
+        case cond_t::B:
+            return m.cf;
+        case cond_t::Ae:
+            return !m.cf;
+        case cond_t::E:
+            return m.zf;
+        case cond_t::Ne:
+            return !m.zf;
+        case cond_t::Be:
+            return m.cf || m.zf;
+        case cond_t::A:
+            return !m.cf && !m.zf;
+        case cond_t::S:
+            return m.sf;
+        case cond_t::Ns:
+            return !m.sf;
+        case cond_t::P:
+            return m.pf;
+        case cond_t::Np:
+            return !m.pf;
+        case cond_t::L:
+            return m.sf != m.of;
+        case cond_t::Ge:
+            return m.sf == m.of;
+        case cond_t::Le:
+            return m.zf || m.sf != m.of;
+        case cond_t::G:
+            return !m.zf && m.sf == m.of;
+        default:
+            throw logic_error("unreachable");
+    }
+}
+
+static auto shift_with_flags(machine_t &m, const mnemo_t &mnemo, u64 a, u64 count) -> u64 {
+    u8 bits = width_bits(mnemo.width);
+    count &= mnemo.width == width_t::Qword ? 63 : 31;
+    if (count == 0)
+        return a;
+
+    u64 result;
+    bool cf;
+    bool of;
+    switch (mnemo.tag) {
+        case tag_t::Shl:
+            result = count >= bits ? 0 : a << count;
+            cf = count <= bits && ((a >> (bits - count)) & 1);
+            of = msb(result, mnemo.width) != cf;
+            break;
+        case tag_t::Shr:
+            result = count >= bits ? 0 : a >> count;
+            cf = count <= bits && ((a >> (count - 1)) & 1);
+            of = msb(a, mnemo.width);
+            break;
+        case tag_t::Sar:
+            result = u64(sign_extend(a, mnemo.width) >> min<u64>(count, 63));
+            cf = (sign_extend(a, mnemo.width) >> min<u64>(count - 1, 63)) & 1;
+            of = false;
+            break;
+        default:
+            throw logic_error("Wrong mnemo!");
+    }
+    set_logic_flags(m, result, mnemo.width);
+    m.cf = cf;
+    m.of = of;
+    return result & width_mask(mnemo.width);
+}
+
+static auto pdep(u64 src, u64 mask) -> u64 {
+    u64 result = 0;
+    for (u64 bit = 1; mask != 0; bit <<= 1) {
+        u64 lowest = mask & -mask;
+        if (src & bit)
+            result |= lowest;
+        mask &= mask - 1;
+    }
+    return result;
+}
+
+static auto pext(u64 src, u64 mask) -> u64 {
+    u64 result = 0;
+    for (u64 bit = 1; mask != 0; bit <<= 1) {
+        u64 lowest = mask & -mask;
+        if (src & lowest)
+            result |= bit;
+        mask &= mask - 1;
+    }
+    return result;
+}
+
+static auto interpret_bmi(machine_t &m, const mnemo_t &mnemo) -> void {
+    width_t width = mnemo.width;
+    u8 bits = width_bits(width);
+    u64 mask = width_mask(width);
+    u64 result;
+    switch (mnemo.tag) {
+        case tag_t::Andn:
+            result = ~read_arg(m, mnemo.a2, width) & read_arg(m, mnemo.a3, width) & mask;
+            set_logic_flags(m, result, width);
+            break;
+        case tag_t::Bextr: {
+            u64 src = read_arg(m, mnemo.a2, width);
+            u64 control = read_arg(m, mnemo.a3, width);
+            u64 start = control & 0xff;
+            u64 length = (control >> 8) & 0xff;
+            result = start >= bits ? 0 : src >> start;
+            if (length < 64)
+                result &= (u64(1) << length) - 1;
+            set_logic_flags(m, result, width);
+            break;
+        }
+        case tag_t::Blsr: {
+            u64 src = read_arg(m, mnemo.a2, width);
+            result = src & (src - 1) & mask;
+            set_logic_flags(m, result, width);
+            m.cf = src == 0;
+            break;
+        }
+        case tag_t::Blsi: {
+            u64 src = read_arg(m, mnemo.a2, width);
+            result = src & -src & mask;
+            set_logic_flags(m, result, width);
+            m.cf = src != 0;
+            break;
+        }
+        case tag_t::Blsmsk: {
+            u64 src = read_arg(m, mnemo.a2, width);
+            result = (src ^ (src - 1)) & mask;
+            set_logic_flags(m, result, width);
+            m.zf = false;
+            m.cf = src == 0;
+            break;
+        }
+        case tag_t::Bzhi: {
+            u64 src = read_arg(m, mnemo.a2, width);
+            u64 index = read_arg(m, mnemo.a3, width) & 0xff;
+            result = index < bits ? src & ((u64(1) << index) - 1) : src;
+            set_logic_flags(m, result, width);
+            m.cf = index > u64(bits - 1);
+            break;
+        }
+        case tag_t::Pdep:
+            result = pdep(read_arg(m, mnemo.a2, width), read_arg(m, mnemo.a3, width)) & mask;
+            break;
+        case tag_t::Pext:
+            result = pext(read_arg(m, mnemo.a2, width), read_arg(m, mnemo.a3, width)) & mask;
+            break;
+        case tag_t::Shlx:
+        case tag_t::Shrx:
+        case tag_t::Sarx: {
+            u64 src = read_arg(m, mnemo.a2, width);
+            u64 count = read_arg(m, mnemo.a3, width) & (bits - 1);
+            if (mnemo.tag == tag_t::Shlx)
+                result = (src << count) & mask;
+            else if (mnemo.tag == tag_t::Shrx)
+                result = src >> count;
+            else
+                result = u64(sign_extend(src, width) >> count) & mask;
+            break;
+        }
+        default:
+            throw logic_error("Not a BMI mnemo @ interpret_bmi");
+    }
+    write_reg(m, mnemo.a1.data.reg, result);
+}
+
+static auto interpret_bit_count(machine_t &m, const mnemo_t &mnemo) -> void {
+    u8 bits = width_bits(mnemo.width);
+    u64 src = read_arg(m, mnemo.a2, mnemo.width);
+    u64 result;
+    switch (mnemo.tag) {
+        case tag_t::Popcnt:
+            result = __builtin_popcountll(src);
+            set_logic_flags(m, 0, mnemo.width);
+            m.zf = src == 0;
+            m.pf = false;
+            break;
+        case tag_t::Lzcnt:
+            result = src == 0 ? bits : __builtin_clzll(src) - (64 - bits);
+            m.cf = src == 0;
+            m.zf = result == 0;
+            break;
+        case tag_t::Tzcnt:
+            result = src == 0 ? bits : __builtin_ctzll(src);
+            m.cf = src == 0;
+            m.zf = result == 0;
+            break;
+        default:
+            throw logic_error("Wrong mnemo!");
+    }
+    write_reg(m, mnemo.a1.data.reg, result);
+}
+
+static auto is_interpretable_arg(const arg_t &arg) -> bool {
+    gpr_t gpr{};
+    switch (arg.tag) {
+        case arg_t::tag_t::Undef:
+        case arg_t::tag_t::Immediate:
+        case arg_t::tag_t::Label:
+            return true;
+        case arg_t::tag_t::Register:
+            return find_gpr(arg.data.reg, gpr);
+        case arg_t::tag_t::Memory:
+            if (arg.data.memory.constant != 0)
+                return true;
+            return find_gpr(arg.data.memory.base, gpr) &&
+                   (arg.data.memory.scale == arg_t::memory_t::scale_t::S0 || find_gpr(arg.data.memory.index, gpr));
+        default:
+            return false;
+    }
+}
+
+static auto is_interpretable_mnemo(const mnemo_t &mnemo) -> bool {
+    switch (mnemo.tag) {
+        case tag_t::Mov:
+        case tag_t::Add:
+        case tag_t::Push:
+        case tag_t::Pop:
+        case tag_t::Ret:
+        case tag_t::Sub:
+        case tag_t::And:
+        case tag_t::Or:
+        case tag_t::Xor:
+        case tag_t::Cmp:
+        case tag_t::Test:
+        case tag_t::Imul:
+        case tag_t::Shl:
+        case tag_t::Shr:
+        case tag_t::Sar:
+        case tag_t::Inc:
+        case tag_t::Dec:
+        case tag_t::Neg:
+        case tag_t::Not:
+        case tag_t::Popcnt:
+        case tag_t::Lzcnt:
+        case tag_t::Tzcnt:
+        case tag_t::Andn:
+        case tag_t::Bextr:
+        case tag_t::Blsr:
+        case tag_t::Blsi:
+        case tag_t::Blsmsk:
+        case tag_t::Bzhi:
+        case tag_t::Pdep:
+        case tag_t::Pext:
+        case tag_t::Shlx:
+        case tag_t::Shrx:
+        case tag_t::Sarx:
+        case tag_t::Cmovcc:
+        case tag_t::Setcc:
+        case tag_t::Label:
+        case tag_t::Jcc:
+        case tag_t::Loop:
+        case tag_t::Align:
+            break;
+        case tag_t::Lea:
+            // Addresses of constants only exist in assembled code
+            if (mnemo.a2.tag == arg_t::tag_t::Memory && mnemo.a2.data.memory.constant != 0)
+                return false;
+            break;
+        case tag_t::Jmp:
+        case tag_t::Call:
+            // Indirect branches jump to native addresses
+            if (mnemo.a1.tag != arg_t::tag_t::Label)
+                return false;
+            break;
+        default:
+            return false;
+    }
+    return is_interpretable_arg(mnemo.a1) && is_interpretable_arg(mnemo.a2) && is_interpretable_arg(mnemo.a3);
+}
+
+namespace jit {
+    auto is_interpretable(const vector<mnemo_t> &mnemos) -> bool {
+        for (const mnemo_t &mnemo: mnemos) {
+            if (!is_interpretable_mnemo(mnemo))
+                return false;
+        }
+        return true;
+    }
+
+    auto interpret(const vector<mnemo_t> &mnemos) -> i64 {
+        unordered_map<assembly::label_t, u64> label_indices{};
+        for (u64 i = 0; i < mnemos.size(); i++) {
+            if (!is_interpretable_mnemo(mnemos[i]))
+                throw logic_error("mnemo can not be interpreted @ interpret");
+            mnemos[i].check_validity();
+            if (mnemos[i].tag == tag_t::Label && !label_indices.emplace(mnemos[i].a1.data.label, i).second)
+                throw logic_error("label \"" + assembly::label_name(mnemos[i].a1.data.label) + "\" is defined twice");
+        }
+        auto branch_target = [&](const arg_t &arg) -> u64 {
+            auto it = label_indices.find(arg.data.label);
+            if (it == label_indices.end())
+                throw logic_error("label \"" + assembly::label_name(arg.data.label) + "\" is not defined");
+            return it->second;
+        };
+
+        machine_t m{};
+        m.stack.resize(stack_size);
+        // Like on function entry, rsp + 8 is 16 byte aligned. Space above rsp is left for the return address and
+        // space below for the red zone.
+        u64 entry_rsp = ((u64(m.stack.data()) + stack_size - 256) & ~u64(15)) - 8;
+        m.regs[rsp_number] = entry_rsp;
+
+        for (u64 pc = 0; pc < mnemos.size();) {
+            const mnemo_t &mnemo = mnemos[pc];
+            pc++;
+
+            width_t width = mnemo.width;
+            switch (mnemo.tag) {
+                case tag_t::Label:
+                case tag_t::Align:
+                    break;
+                case tag_t::Mov:
+                    if (mnemo.a1.tag == arg_t::tag_t::Register && mnemo.a2.tag == arg_t::tag_t::Immediate)
+                        write_reg(m, mnemo.a1.data.reg, u64(mnemo.a2.data.imm));
+                    else
+                        write_arg(m, mnemo.a1, width, read_arg(m, mnemo.a2, width));
+                    break;
+                case tag_t::Add:
+                    write_arg(m, mnemo.a1, width,
+                              add_with_flags(m, read_arg(m, mnemo.a1, width), read_arg(m, mnemo.a2, width), width));
+                    break;
+                case tag_t::Sub:
+                    write_arg(m, mnemo.a1, width,
+                              sub_with_flags(m, read_arg(m, mnemo.a1, width), read_arg(m, mnemo.a2, width), width));
+                    break;
+                case tag_t::Cmp:
+                    sub_with_flags(m, read_arg(m, mnemo.a1, width), read_arg(m, mnemo.a2, width), width);
+                    break;
+                case tag_t::And:
+                case tag_t::Or:
+                case tag_t::Xor:
+                case tag_t::Test: {
+                    u64 a = read_arg(m, mnemo.a1, width);
+                    u64 b = read_arg(m, mnemo.a2, width);
+                    u64 result = mnemo.tag == tag_t::Or ? a | b : mnemo.tag == tag_t::Xor ? a ^ b : a & b;
+                    set_logic_flags(m, result, width);
+                    if (mnemo.tag != tag_t::Test)
+                        write_arg(m, mnemo.a1, width, result);
+                    break;
+                }
+                case tag_t::Lea:
+                    write_reg(m, mnemo.a1.data.reg, effective_address(m, mnemo.a2.data.memory));
+                    break;
+                case tag_t::Imul: {
+                    const arg_t &a = mnemo.a3.tag == arg_t::tag_t::Undef ? mnemo.a1 : mnemo.a2;
+                    const arg_t &b = mnemo.a3.tag == arg_t::tag_t::Undef ? mnemo.a2 : mnemo.a3;
+                    __int128 product = __int128(sign_extend(read_arg(m, a, width), width)) *
+                                       sign_extend(read_arg(m, b, width), width);
+                    u64 result = u64(product) & width_mask(width);
+                    set_logic_flags(m, result, width);
+                    m.cf = m.of = sign_extend(result, width) != product;
+                    write_reg(m, mnemo.a1.data.reg, result);
+                    break;
+                }
+                case tag_t::Shl:
+                case tag_t::Shr:
+                case tag_t::Sar: {
+                    u64 count = read_arg(m, mnemo.a2, width_t::Byte);
+                    write_arg(m, mnemo.a1, width, shift_with_flags(m, mnemo, read_arg(m, mnemo.a1, width), count));
+                    break;
+                }
+                case tag_t::Inc:
+                case tag_t::Dec: {
+                    // inc and dec keep CF
+                    bool cf = m.cf;
+                    u64 a = read_arg(m, mnemo.a1, width);
+                    u64 result = mnemo.tag == tag_t::Inc ? add_with_flags(m, a, 1, width)
+                                                         : sub_with_flags(m, a, 1, width);
+                    m.cf = cf;
+                    write_arg(m, mnemo.a1, width, result);
+                    break;
+                }
+                case tag_t::Neg:
+                    write_arg(m, mnemo.a1, width, sub_with_flags(m, 0, read_arg(m, mnemo.a1, width), width));
+                    break;
+                case tag_t::Not:
+                    write_arg(m, mnemo.a1, width, ~read_arg(m, mnemo.a1, width) & width_mask(width));
+                    break;
+                case tag_t::Push: {
+                    width_t push_width = width == width_t::Word ? width_t::Word : width_t::Qword;
+                    push_value(m, width_bits(push_width) / 8, read_arg(m, mnemo.a1, push_width));
+                    break;
+                }
+                case tag_t::Pop: {
+                    width_t pop_width = width == width_t::Word ? width_t::Word : width_t::Qword;
+                    write_arg(m, mnemo.a1, pop_width, pop_value(m, width_bits(pop_width) / 8));
+                    break;
+                }
+                case tag_t::Popcnt:
+                case tag_t::Lzcnt:
+                case tag_t::Tzcnt:
+                    interpret_bit_count(m, mnemo);
+                    break;
+                case tag_t::Cmovcc: {
+                    // Like on hardware, a 32 bit cmov zero-extends the destination even if the condition is false
+                    const arg_t &src = test_cond(m, mnemo.cond) ? mnemo.a2 : mnemo.a1;
+                    write_reg(m, mnemo.a1.data.reg, read_arg(m, src, width));
+                    break;
+                }
+                case tag_t::Setcc:
+                    write_arg(m, mnemo.a1, width_t::Byte, test_cond(m, mnemo.cond));
+                    break;
+                case tag_t::Jmp:
+                    pc = branch_target(mnemo.a1);
+                    break;
+                case tag_t::Jcc:
+                    if (test_cond(m, mnemo.cond))
+                        pc = branch_target(mnemo.a1);
+                    break;
+                case tag_t::Loop:
+                    m.regs[rcx_number]--;
+                    if (m.regs[rcx_number] != 0)
+                        pc = branch_target(mnemo.a1);
+                    break;
+                case tag_t::Call:
+                    push_value(m, 8, return_address_tag | pc);
+                    pc = branch_target(mnemo.a1);
+                    break;
+                case tag_t::Ret: {
+                    if (m.regs[rsp_number] == entry_rsp)
+                        return i64(m.regs[rax_number]);
+                    u64 return_address = pop_value(m, 8);
+                    if ((return_address & return_address_tag_mask) != return_address_tag)
+                        throw logic_error("return address was overwritten @ interpret");
+                    pc = return_address & ~return_address_tag_mask;
+                    break;
+                }
+                default:
+                    interpret_bmi(m, mnemo);
+                    break;
+            }
+        }
+
+        throw logic_error("execution ran past the last mnemo @ interpret");
+    }
+}
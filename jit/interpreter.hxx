@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+#include "../assembly/assembly.hxx"
+
+namespace jit {
+    // Returns true if `interpret` supports every mnemo: general purpose integer, bit manipulation, stack and
+    // control flow mnemos with label targets. Vector mnemos and indirect branches are not interpreted.
+    auto is_interpretable(const vector<assembly::mnemo_t> &mnemos) -> bool;
+
+    // Executes mnemos as if they were assembled and called as a `jit_func_t`, without generating code.
+    // Registers, flags and stack are emulated. Memory operands may only address the emulated stack and constants.
+    auto interpret(const vector<assembly::mnemo_t> &mnemos) -> i64;
+}
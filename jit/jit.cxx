@@ -1,23 +1,32 @@
 #include "jit.hxx"
 
 #include <stdexcept>
+#include <cstdio>
 #include <cstring>
+#include <utility>
 
+#include "arena.hxx"
 #include "../os/alloc.hxx"
+#include "../os/perf.hxx"
+#include "../os/stats.hxx"
+#include "../os/trace.hxx"
 
 namespace jit {
-    // The function executes the code at pointer mc as if it was a `jit_func_t` function.
-    auto eval_mc(const u8 *mc, size_t len) -> i64 {
-        // This function places a `ud2` trap after the executable code to catch
-        // malicous programs which overflow the buffer and continue executing.
+    // Copies code to new executable memory and puts a `ud2` trap after it to catch
+    // malicous programs which overflow the buffer and continue executing.
+    static auto load_mc(const u8 *mc, size_t len) -> void * {
         // Extend buffer to accomodate `ud2` trap.
         size_t buf_len = len + 2;
-        void *exec_mc = alloc_executable(len);
-        if (exec_mc == nullptr) {
-            throw std::logic_error("mmap failed");
+        void *exec_mc = nullptr;
+        {
+            TRACE_SPAN("arena_alloc");
+            exec_mc = arena_alloc(buf_len);
         }
 
-        std::memcpy(exec_mc, mc, len);
+        {
+            TRACE_SPAN("copy");
+            std::memcpy(exec_mc, mc, len);
+        }
 
         // Write the `ud2` trap.
         reinterpret_cast<char *>(exec_mc)[buf_len - 2] = 0x0F;
@@ -25,12 +34,120 @@ namespace jit {
 
         flush_instruction_cache(exec_mc, buf_len);
 
+        return exec_mc;
+    }
+
+    // The function executes the code at pointer mc as if it was a `jit_func_t` function.
+    auto eval_mc(const u8 *mc, size_t len) -> i64 {
+        void *exec_mc = load_mc(mc, len);
+
         auto func = (jit_func_t) exec_mc;
 
-        i64 execution_result = func();
+        i64 execution_result = 0;
+        {
+            TRACE_SPAN("execute");
+            execution_result = func();
+        }
 
-        dealloc(exec_mc, buf_len);
+        arena_free(exec_mc);
 
         return execution_result;
     }
-}
\ No newline at end of file
+
+    function_t::function_t(const vector<u8> &mc, const string &name) : mem(nullptr), size(mc.size()) {
+        stats_timer_t timer(compile_phase_t::Load);
+        timer.set_items(1);
+        this->mem = load_mc(mc.data(), mc.size());
+        if (perf_is_enabled()) {
+            char default_name[32];
+            snprintf(default_name, sizeof(default_name), "jit_%lx", u64(this->mem));
+            perf_register_code(this->mem, this->size, name.empty() ? string(default_name) : name);
+        }
+    }
+
+    function_t::function_t(const vector<u8> &mc, const vector<code_symbol_t> &symbols) : mem(nullptr), size(mc.size()) {
+        stats_timer_t timer(compile_phase_t::Load);
+        timer.set_items(1);
+        this->mem = load_mc(mc.data(), mc.size());
+        if (perf_is_enabled()) {
+            for (const code_symbol_t &symbol: symbols)
+                perf_register_code(reinterpret_cast<const u8 *>(this->mem) + symbol.offset, symbol.size, symbol.name);
+        }
+    }
+
+    function_t::function_t(const vector<u8> &mc, u64 data_offset, u64 data_size, const string &name)
+            : mem(nullptr), size(mc.size()), mapping_size(data_offset + data_size) {
+        if (data_offset < mc.size() + 2)
+            throw std::logic_error("data overlaps the code");
+        stats_timer_t timer(compile_phase_t::Load);
+        timer.set_items(1);
+        // Fresh mappings are page aligned and zeroed
+        u8 *exec_mc = reinterpret_cast<u8 *>(alloc_executable(this->mapping_size));
+        try {
+            std::memcpy(exec_mc, mc.data(), mc.size());
+            exec_mc[mc.size()] = 0x0F;
+            exec_mc[mc.size() + 1] = 0x0B;
+            protect_code(exec_mc, data_offset);
+            if (data_size != 0)
+                protect_data(exec_mc + data_offset, data_size);
+            flush_instruction_cache(exec_mc, mc.size() + 2);
+            if (perf_is_enabled()) {
+                char default_name[32];
+                snprintf(default_name, sizeof(default_name), "jit_%lx", u64(exec_mc));
+                perf_register_code(exec_mc, this->size, name.empty() ? string(default_name) : name);
+            }
+        } catch (...) {
+            dealloc(exec_mc, this->mapping_size);
+            throw;
+        }
+        this->mem = exec_mc;
+    }
+
+    function_t::function_t(function_t &&other) noexcept
+            : mem(std::exchange(other.mem, nullptr)), size(std::exchange(other.size, 0)),
+              mapping_size(std::exchange(other.mapping_size, 0)) {}
+
+    auto function_t::operator=(function_t &&other) noexcept -> function_t & {
+        if (this != &other) {
+            this->release();
+            this->mem = std::exchange(other.mem, nullptr);
+            this->size = std::exchange(other.size, 0);
+            this->mapping_size = std::exchange(other.mapping_size, 0);
+        }
+        return *this;
+    }
+
+    function_t::~function_t() {
+        this->release();
+    }
+
+    auto function_t::release() -> void {
+        if (this->mem == nullptr)
+            return;
+        if (this->mapping_size != 0)
+            dealloc(this->mem, this->mapping_size);
+        else
+            arena_free(this->mem);
+        this->mem = nullptr;
+    }
+
+    auto function_t::operator()() const -> i64 {
+        if (this->mem == nullptr)
+            throw std::logic_error("calling an empty function_t");
+        stats_add(stat_t::NativeCallCount, 1);
+        TRACE_SPAN("execute");
+        return reinterpret_cast<jit_func_t>(this->mem)();
+    }
+
+    auto function_t::is_empty() const -> bool {
+        return this->mem == nullptr;
+    }
+
+    auto function_t::get_code() const -> const u8 * {
+        return reinterpret_cast<const u8 *>(this->mem);
+    }
+
+    auto function_t::get_size() const -> size_t {
+        return this->size;
+    }
+}
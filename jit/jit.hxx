@@ -3,9 +3,61 @@
 #include <cstdlib>
 
 #include "../int.hxx"
+#include "../strvec.hxx"
 
 namespace jit {
     typedef i64 (*jit_func_t)();
 
     auto eval_mc(const u8 *mc, size_t len) -> i64;
+
+    // A named range of code, e.g. one function of a module
+    struct code_symbol_t {
+        string name;
+        u64 offset;
+        u64 size;
+    };
+
+    // Owns a copy of machine code in executable memory and calls it as a `jit_func_t`
+    class function_t {
+        void *mem = nullptr;
+        size_t size = 0;
+        // Non-zero if the code has a mapping of its own instead of an arena block
+        size_t mapping_size = 0;
+
+        auto release() -> void;
+
+    public:
+        function_t() = default;
+
+        // `name` identifies the code in profilers, see os/perf.hxx
+        explicit function_t(const vector<u8> &mc, const string &name = {});
+
+        // Registers every symbol with profilers instead of the whole code
+        function_t(const vector<u8> &mc, const vector<code_symbol_t> &symbols);
+
+        // Loads the code into a mapping of its own, followed by `data_size` zeroed bytes at `data_offset` from the
+        // start of the code. Code pages are read-only and executable, data pages read-write and never hold
+        // instructions, so `data_offset` must be a multiple of the page size past the end of the code, see
+        // `assembly::counter_alignment`.
+        function_t(const vector<u8> &mc, u64 data_offset, u64 data_size, const string &name = {});
+
+        function_t(function_t &&other) noexcept;
+
+        auto operator=(function_t &&other) noexcept -> function_t &;
+
+        function_t(const function_t &) = delete;
+
+        auto operator=(const function_t &) -> function_t & = delete;
+
+        ~function_t();
+
+        auto operator()() const -> i64;
+
+        [[nodiscard]] auto is_empty() const -> bool;
+
+        [[nodiscard]] auto get_code() const -> const u8 *;
+
+        // Size of the code, without the trailing `ud2` trap
+        [[nodiscard]] auto get_size() const -> size_t;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "module.hxx"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+using namespace std;
+
+using assembly::relocation_t;
+
+namespace jit {
+    module_t::module_t(function_t code, unordered_map<string, u64> entry_offsets)
+            : code(move(code)), entry_offsets(move(entry_offsets)) {}
+
+    auto module_t::get_entry(const string &name) const -> jit_func_t {
+        auto it = this->entry_offsets.find(name);
+        if (it == this->entry_offsets.end())
+            throw logic_error("module has no function \"" + name + "\"");
+        return reinterpret_cast<jit_func_t>(this->code.get_code() + it->second);
+    }
+
+    auto module_t::operator()(const string &name) const -> i64 {
+        return this->get_entry(name)();
+    }
+
+    auto module_t::get_code() const -> const function_t & {
+        return this->code;
+    }
+
+    static auto align_up(u64 offset, u64 alignment) -> u64 {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    auto link_module(const vector<module_function_t> &functions, const module_options &options) -> module_t {
+        if (options.function_alignment == 0 || options.function_alignment > 32 ||
+            (options.function_alignment & (options.function_alignment - 1)) != 0)
+            throw logic_error("function alignment should be a power of two up to 32");
+
+        assembly::assemble_options assemble_options{};
+        assemble_options.relocatable = true;
+        vector<assembly::assemble_result> assembled{};
+        unordered_map<string, u64> entry_offsets{};
+        vector<u64> rodata_offsets{};
+        vector<code_symbol_t> symbols{};
+
+        // Code of all functions, then the constants of all functions
+        u64 offset = 0;
+        for (const module_function_t &function: functions) {
+            assembled.push_back(assembly::assemble_detailed(function.mnemos, assemble_options));
+            offset = align_up(offset, options.function_alignment);
+            if (!entry_offsets.emplace(function.name, offset).second)
+                throw logic_error("module function \"" + function.name + "\" is defined twice");
+            symbols.push_back({function.name, offset, assembled.back().code.size()});
+            offset += assembled.back().code.size();
+        }
+        for (const assembly::assemble_result &result: assembled) {
+            offset = align_up(offset, result.rodata_alignment);
+            rodata_offsets.push_back(offset);
+            offset += result.rodata.size();
+        }
+
+        // Labels defined by exactly one function can be branched to from other functions
+        unordered_map<string, u64> label_offsets{};
+        unordered_map<string, u64> label_definitions{};
+        for (u64 i = 0; i < functions.size(); i++) {
+            for (const auto &[label, label_offset]: assembled[i].labels) {
+                string name = assembly::label_name(label);
+                label_offsets[name] = entry_offsets[functions[i].name] + label_offset;
+                label_definitions[name]++;
+            }
+        }
+
+        vector<u8> code(offset, 0xcc);
+        for (u64 i = 0; i < functions.size(); i++) {
+            const assembly::assemble_result &result = assembled[i];
+            u64 entry = entry_offsets[functions[i].name];
+            copy(result.code.begin(), result.code.end(), code.begin() + i64(entry));
+            copy(result.rodata.begin(), result.rodata.end(), code.begin() + i64(rodata_offsets[i]));
+
+            for (const relocation_t &relocation: result.relocations) {
+                u64 target;
+                if (relocation.target == relocation_t::target_t::Rodata) {
+                    target = rodata_offsets[i];
+                } else {
+                    string name = assembly::label_name(relocation.label);
+                    if (auto it = entry_offsets.find(name); it != entry_offsets.end())
+                        target = it->second;
+                    else if (label_definitions[name] == 1)
+                        target = label_offsets[name];
+                    else
+                        throw logic_error("branch target \"" + name + "\" is not a module function or a unique label");
+                }
+                u64 field = entry + relocation.offset;
+                i32 value = i32(i64(target) + relocation.addend - i64(field));
+                for (u8 j = 0; j < 4; j++)
+                    code[field + j] = u8(u32(value) >> (8 * j));
+            }
+        }
+
+        return {function_t(code, symbols), move(entry_offsets)};
+    }
+
+    // Prefixes every label defined in the mnemos with `prefix`
+    static auto qualify_labels(vector<assembly::mnemo_t> &mnemos, const string &prefix) -> void {
+        unordered_map<assembly::label_t, assembly::label_t> renamed{};
+        for (const assembly::mnemo_t &mnemo: mnemos) {
+            if (mnemo.tag == assembly::mnemo_t::tag_t::Label) {
+                assembly::label_t label = mnemo.a1.data.label;
+                renamed[label] = assembly::intern_label(prefix + assembly::label_name(label));
+            }
+        }
+        for (assembly::mnemo_t &mnemo: mnemos) {
+            if (mnemo.a1.tag != assembly::mnemo_t::arg_t::tag_t::Label)
+                continue;
+            if (auto it = renamed.find(mnemo.a1.data.label); it != renamed.end())
+                mnemo.a1.data.label = it->second;
+        }
+    }
+
+    auto layout_module(const vector<module_function_t> &functions, const module_profile_t &profile,
+                       const assembly::layout::layout_options &options) -> module_layout_t {
+        u64 n = functions.size();
+        unordered_map<string, u64> function_indices{};
+        for (u64 i = 0; i < n; i++)
+            function_indices.emplace(functions[i].name, i);
+
+        module_layout_t result{};
+        vector<module_function_t> hot(n);
+        vector<module_function_t> cold{};
+        vector<u64> entry_counts(n, 0);
+        // Executed calls and tail calls between two functions, by the pair of function indices
+        map<pair<u64, u64>, u64> call_counts{};
+        for (u64 i = 0; i < n; i++) {
+            const module_function_t &function = functions[i];
+            hot[i] = function;
+            auto counts = profile.find(function.name);
+            if (counts == profile.end())
+                continue;
+
+            vector<assembly::layout::basic_block_t> blocks = assembly::layout::split_basic_blocks(function.mnemos);
+            if (counts->second.size() != blocks.size())
+                throw logic_error("block counts of \"" + function.name + "\" do not match its basic blocks");
+            entry_counts[i] = counts->second.empty() ? 0 : counts->second[0];
+            for (u64 b = 0; b < blocks.size(); b++) {
+                for (u64 m = blocks[b].begin; m < blocks[b].end; m++) {
+                    const assembly::mnemo_t &mnemo = function.mnemos[m];
+                    if ((mnemo.tag != assembly::mnemo_t::tag_t::Call && mnemo.tag != assembly::mnemo_t::tag_t::Jmp) ||
+                        mnemo.a1.tag != assembly::mnemo_t::arg_t::tag_t::Label)
+                        continue;
+                    auto callee = function_indices.find(assembly::label_name(mnemo.a1.data.label));
+                    if (callee != function_indices.end() && callee->second != i)
+                        call_counts[minmax(i, callee->second)] += counts->second[b];
+                }
+            }
+
+            assembly::layout::layout_options function_options = options;
+            function_options.label_prefix = "layout";
+            assembly::layout::layout_result laid_out = assembly::layout::layout_function(
+                    function.mnemos, counts->second, function_options);
+            assembly::layout_report &report = laid_out.report;
+            result.report.applied = result.report.applied || report.applied;
+            result.report.hot_cache_lines_before += report.hot_cache_lines_before;
+            result.report.hot_cache_lines_after += report.hot_cache_lines_after;
+            result.report.taken_branches_before += report.taken_branches_before;
+            result.report.taken_branches_after += report.taken_branches_after;
+            result.report.cold_block_count += report.cold_block_count;
+
+            // Labels of the layout would clash between functions
+            if (report.applied)
+                qualify_labels(laid_out.mnemos, function.name + ".");
+            hot[i].mnemos.assign(laid_out.mnemos.begin(), laid_out.mnemos.begin() + i64(laid_out.cold_begin));
+            if (laid_out.cold_begin < laid_out.mnemos.size()) {
+                cold.push_back({function.name + ".cold", vector<assembly::mnemo_t>(
+                        laid_out.mnemos.begin() + i64(laid_out.cold_begin), laid_out.mnemos.end())});
+            }
+        }
+
+        // Pettis-Hansen: merge the groups of the two functions of the most executed call first
+        vector<vector<u64>> groups(n);
+        vector<u64> group_of(n);
+        for (u64 i = 0; i < n; i++) {
+            groups[i] = {i};
+            group_of[i] = i;
+        }
+        vector<pair<pair<u64, u64>, u64>> calls(call_counts.begin(), call_counts.end());
+        stable_sort(calls.begin(), calls.end(), [](const auto &a, const auto &b) {
+            return a.second > b.second;
+        });
+        for (const auto &[ends, count]: calls) {
+            u64 a = group_of[ends.first];
+            u64 b = group_of[ends.second];
+            if (count == 0 || a == b)
+                continue;
+            for (u64 i: groups[b]) {
+                groups[a].push_back(i);
+                group_of[i] = a;
+            }
+            groups[b].clear();
+        }
+
+        vector<u64> group_order{};
+        vector<u64> group_counts(n, 0);
+        for (u64 g = 0; g < n; g++) {
+            for (u64 i: groups[g])
+                group_counts[g] += entry_counts[i];
+            if (!groups[g].empty())
+                group_order.push_back(g);
+        }
+        stable_sort(group_order.begin(), group_order.end(), [&](u64 a, u64 b) {
+            return group_counts[a] > group_counts[b];
+        });
+        for (u64 g: group_order) {
+            for (u64 i: groups[g])
+                result.functions.push_back(move(hot[i]));
+        }
+        for (module_function_t &function: cold)
+            result.functions.push_back(move(function));
+        return result;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+#include "../assembly/assembly.hxx"
+#include "../assembly/layout/layout.hxx"
+#include "jit.hxx"
+
+namespace jit {
+    struct module_function_t {
+        string name;
+        vector<assembly::mnemo_t> mnemos;
+    };
+
+    struct module_options {
+        // Alignment of every function entry, a power of two up to 32
+        u64 function_alignment = 16;
+    };
+
+    // Several functions linked into one executable block. Functions are laid out contiguously in the given order,
+    // padded with `int3` to `function_alignment`, and followed by the constants of all functions.
+    // A branch to a label that a function does not define is resolved with a direct rel32 to the module function
+    // of that name, or else to the label if exactly one function of the module defines it. So functions of a module
+    // call each other without indirection.
+    class module_t {
+        function_t code;
+        std::unordered_map<string, u64> entry_offsets;
+
+    public:
+        module_t() = default;
+
+        module_t(function_t code, std::unordered_map<string, u64> entry_offsets);
+
+        // Throws `logic_error` if the module has no function `name`
+        [[nodiscard]] auto get_entry(const string &name) const -> jit_func_t;
+
+        auto operator()(const string &name) const -> i64;
+
+        [[nodiscard]] auto get_code() const -> const function_t &;
+    };
+
+    // Throws `logic_error` on duplicate function names and branches to labels that can not be resolved
+    auto link_module(const vector<module_function_t> &functions, const module_options &options = {}) -> module_t;
+
+    // Executions of every basic block of module functions by function name, see `assembly::layout`
+    typedef std::unordered_map<string, vector<u64>> module_profile_t;
+
+    struct module_layout_t {
+        vector<module_function_t> functions;
+
+        // Sum of the reports of all functions
+        assembly::layout_report report;
+    };
+
+    // Profile-guided layout of a module before `link_module`.
+    //
+    // Blocks of every profiled function are reordered by `assembly::layout::layout_function`. Cold blocks are split
+    // into a function `<name>.cold` placed after all other functions. Labels of reordered functions are prefixed by
+    // `<name>.` to keep them unique in the module. Functions are ordered Pettis-Hansen style: functions joined by
+    // the most executed calls and tail calls are placed next to each other, and groups are ordered by executions.
+    auto layout_module(const vector<module_function_t> &functions, const module_profile_t &profile,
+                       const assembly::layout::layout_options &options = {}) -> module_layout_t;
+}
@@ -0,0 +1,151 @@
+#include "patch.hxx"
+
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#include "../assembly/assembly.hxx"
+#include "../os/alloc.hxx"
+#include "../os/stats.hxx"
+
+using namespace std;
+
+using assembly::mnemo_t;
+
+namespace jit {
+    // Epoch based reclamation. A thread inside a guard publishes the global epoch it entered at, a retired block
+    // is tagged with the epoch of its retirement and may be freed once every thread is outside a guard or
+    // entered at a later epoch.
+    static constexpr u64 quiescent = numeric_limits<u64>::max();
+
+    static atomic<u64> global_epoch{1};
+
+    struct thread_record_t {
+        atomic<u64> epoch{quiescent};
+        u64 depth = 0;
+    };
+
+    struct retired_code_t {
+        function_t code;
+        u64 epoch;
+    };
+
+    // Guards the thread registry and the retired list. Entering and leaving guards does not take it.
+    static mutex reclaim_mutex;
+    static vector<thread_record_t *> thread_records;
+    static vector<retired_code_t> retired_code;
+
+    // Registers the thread on its first guard and unregisters it on thread exit
+    struct thread_registration_t {
+        thread_record_t record;
+
+        thread_registration_t() {
+            lock_guard<mutex> lock(reclaim_mutex);
+            thread_records.push_back(&this->record);
+        }
+
+        ~thread_registration_t() {
+            lock_guard<mutex> lock(reclaim_mutex);
+            erase(thread_records, &this->record);
+        }
+    };
+
+    static auto this_thread_record() -> thread_record_t & {
+        static thread_local thread_registration_t registration;
+        return registration.record;
+    }
+
+    epoch_guard_t::epoch_guard_t() {
+        thread_record_t &record = this_thread_record();
+        if (record.depth++ == 0)
+            record.epoch.store(global_epoch.load(memory_order_seq_cst), memory_order_seq_cst);
+    }
+
+    epoch_guard_t::~epoch_guard_t() {
+        thread_record_t &record = this_thread_record();
+        if (--record.depth == 0)
+            record.epoch.store(quiescent, memory_order_release);
+    }
+
+    auto reclaim_retired_code() -> u64 {
+        vector<retired_code_t> freed{};
+        {
+            lock_guard<mutex> lock(reclaim_mutex);
+            u64 oldest = quiescent;
+            for (thread_record_t *record: thread_records)
+                oldest = min(oldest, record->epoch.load(memory_order_seq_cst));
+
+            for (u64 i = 0; i < retired_code.size();) {
+                if (retired_code[i].epoch < oldest) {
+                    freed.push_back(move(retired_code[i]));
+                    retired_code[i] = move(retired_code.back());
+                    retired_code.pop_back();
+                } else {
+                    i++;
+                }
+            }
+        }
+        // Code is unmapped here, outside the lock
+        return freed.size();
+    }
+
+    static constexpr size_t stub_size = 16;
+    static constexpr size_t target_slot_offset = 8;
+
+    patchable_function_t::patchable_function_t(function_t code) : code(move(code)) {
+        if (this->code.is_empty())
+            throw logic_error("patchable function needs code");
+
+        mnemo_t jmp = {
+                .tag = mnemo_t::tag_t::Jmp,
+                .width = mnemo_t::width_t::Qword,
+                .a1 = mnemo_t::arg_t::mem(mnemo_t::arg_t::reg_t::Rip, mnemo_t::arg_t::reg_t::Undef,
+                                          mnemo_t::arg_t::memory_t::scale_t::S0, 2),
+        };
+        vector<u8> stub_code = assembly::assemble({jmp});
+        stub_code.push_back(0x0f); // ud2
+        stub_code.push_back(0x0b);
+        if (stub_code.size() != target_slot_offset)
+            throw logic_error("unexpected patchable function stub size");
+
+        this->stub = reinterpret_cast<u8 *>(alloc_executable(stub_size));
+        memcpy(this->stub, stub_code.data(), stub_code.size());
+        this->target_slot().store(u64(this->code.get_code()), memory_order_release);
+        flush_instruction_cache(this->stub, stub_size);
+    }
+
+    patchable_function_t::~patchable_function_t() {
+        dealloc(this->stub, stub_size);
+    }
+
+    auto patchable_function_t::target_slot() const -> atomic<u64> & {
+        // Memory from alloc_executable is page aligned, so the slot is 8 byte aligned
+        return *reinterpret_cast<atomic<u64> *>(this->stub + target_slot_offset);
+    }
+
+    auto patchable_function_t::get_entry() const -> jit_func_t {
+        return reinterpret_cast<jit_func_t>(this->stub);
+    }
+
+    auto patchable_function_t::patch(function_t new_code) -> void {
+        if (new_code.is_empty())
+            throw logic_error("patchable function needs code");
+
+        this->target_slot().store(u64(new_code.get_code()), memory_order_seq_cst);
+        function_t old_code = exchange(this->code, move(new_code));
+        {
+            // Threads entering a guard from now on see the new target
+            lock_guard<mutex> lock(reclaim_mutex);
+            retired_code.push_back({move(old_code), global_epoch.fetch_add(1, memory_order_seq_cst)});
+        }
+        reclaim_retired_code();
+    }
+
+    auto patchable_function_t::operator()() const -> i64 {
+        epoch_guard_t guard;
+        stats_add(stat_t::NativeCallCount, 1);
+        return this->get_entry()();
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+
+#include "../int.hxx"
+#include "jit.hxx"
+
+namespace jit {
+    // Marks the calling thread as possibly running code of patchable functions while it is alive.
+    // Code replaced by `patchable_function_t::patch` is only freed once every thread that was inside a guard
+    // at the time of the patch has left it. Guards may be nested.
+    class epoch_guard_t {
+    public:
+        epoch_guard_t();
+
+        epoch_guard_t(const epoch_guard_t &) = delete;
+
+        auto operator=(const epoch_guard_t &) -> epoch_guard_t & = delete;
+
+        ~epoch_guard_t();
+    };
+
+    // A function with a stable entry point that can be atomically retargeted to new code.
+    //
+    // The entry is a 16 byte stub `jmp [rip + 2]; ud2` followed by an aligned 8 byte target slot, so retargeting
+    // is a single atomic store and does not modify instructions another thread may be executing.
+    class patchable_function_t {
+        u8 *stub;
+        function_t code;
+
+        auto target_slot() const -> std::atomic<u64> &;
+
+    public:
+        explicit patchable_function_t(function_t code);
+
+        patchable_function_t(const patchable_function_t &) = delete;
+
+        auto operator=(const patchable_function_t &) -> patchable_function_t & = delete;
+
+        // No thread may call the entry anymore
+        ~patchable_function_t();
+
+        // Callers may keep this pointer, it stays valid and follows patches for the lifetime of the object
+        [[nodiscard]] auto get_entry() const -> jit_func_t;
+
+        // Retargets the entry to `new_code` and retires the old code. Calls that start after `patch` returns run
+        // the new code, calls already running finish in the old code.
+        // Patches of the same function must not run concurrently.
+        auto patch(function_t new_code) -> void;
+
+        // Calls the entry inside an `epoch_guard_t`
+        auto operator()() const -> i64;
+    };
+
+    // Frees retired code that no thread can be running anymore. Returns the number of freed code blocks.
+    // Also called by every `patch`.
+    auto reclaim_retired_code() -> u64;
+}
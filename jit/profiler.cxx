@@ -0,0 +1,111 @@
+#include "profiler.hxx"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+
+#include "../assembly/parse/parse.hxx"
+
+using namespace std;
+
+namespace jit {
+    // 1-based line and text of the line containing `offset`
+    static auto source_line(const string &source, u64 offset) -> pair<u64, string> {
+        u64 line = 1 + u64(count(source.begin(), source.begin() + i64(offset), '\n'));
+        u64 begin = source.rfind('\n', offset == 0 ? 0 : offset - 1);
+        begin = begin == string::npos || offset == 0 ? 0 : begin + 1;
+        u64 end = source.find('\n', offset);
+        return {line, source.substr(begin, (end == string::npos ? source.size() : end) - begin)};
+    }
+
+    auto profile_t::print_flat(ostream &out) const -> void {
+        for (const profile_entry_t &entry: this->entries) {
+            double share = this->sample_count == 0 ? 0 : 100.0 * double(entry.samples) / double(this->sample_count);
+            out << setw(8) << entry.samples << " " << fixed << setprecision(2) << setw(6) << share << "%  "
+                << entry.function;
+            if (entry.line != 0)
+                out << ":" << entry.line << "  " << entry.text;
+            else
+                out << " mnemo " << entry.mnemo_index;
+            out << "\n";
+        }
+    }
+
+    auto profile_t::print_folded(ostream &out) const -> void {
+        u64 attributed = 0;
+        for (const profile_entry_t &entry: this->entries) {
+            out << entry.function << ";";
+            if (entry.line != 0)
+                out << "line " << entry.line << ": " << entry.text;
+            else
+                out << "mnemo " << entry.mnemo_index;
+            out << " " << entry.samples << "\n";
+            attributed += entry.samples;
+        }
+        if (this->sample_count > attributed)
+            out << "[other] " << this->sample_count - attributed << "\n";
+    }
+
+    auto profiler_t::add_code(const function_t &function, assembly::source_map_t source_map, const string &name,
+                              string source) -> void {
+        if (function.is_empty())
+            throw logic_error("profiled function should not be empty");
+        this->code.push_back({u64(function.get_code()), function.get_size(), name, move(source_map),
+                              move(source)});
+    }
+
+    auto profiler_t::compile(const string &source, const string &name) -> function_t {
+        assembly::parse::ParserResultResult<assembly::parse::parsed_source_t> parsed =
+                assembly::parse::parse_with_source_offsets(source);
+        if (!parsed.is_ok())
+            throw runtime_error(string("parsing error: ") + parsed.error().what);
+        assembly::assemble_options options{};
+        options.source_map = true;
+        options.source_offsets = parsed.value().data.source_offsets;
+        assembly::assemble_result result = assembly::assemble_detailed(parsed.value().data.mnemos, options);
+        function_t function(result.code, name);
+        this->add_code(function, move(result.source_map), name, source);
+        return function;
+    }
+
+    auto profiler_t::start(const sampler_options &options) -> bool {
+        return sampler_start(options);
+    }
+
+    auto profiler_t::stop() -> profile_t {
+        sampler_result samples = sampler_stop();
+
+        // Samples by code index and mnemo
+        map<pair<u64, u64>, u64> counts{};
+        for (u64 address: samples.addresses) {
+            for (u64 i = 0; i < this->code.size(); i++) {
+                const code_t &code = this->code[i];
+                if (address < code.begin || address >= code.begin + code.size)
+                    continue;
+                i64 mnemo = code.source_map.find_mnemo(address - code.begin);
+                if (mnemo >= 0)
+                    counts[{i, u64(mnemo)}]++;
+                break;
+            }
+        }
+
+        profile_t profile{};
+        profile.sample_count = samples.addresses.size();
+        profile.dropped_count = samples.dropped_count;
+        for (const auto &[key, samples_count]: counts) {
+            const code_t &code = this->code[key.first];
+            profile_entry_t entry{code.name, key.second, 0, {}, samples_count};
+            i64 source_offset = key.second < code.source_map.source_offsets.size()
+                                ? i64(code.source_map.source_offsets[key.second]) : -1;
+            if (source_offset >= 0 && !code.source.empty())
+                tie(entry.line, entry.text) = source_line(code.source, u64(source_offset));
+            profile.entries.push_back(move(entry));
+        }
+        stable_sort(profile.entries.begin(), profile.entries.end(), [](const auto &a, const auto &b) {
+            return a.samples > b.samples;
+        });
+        return profile;
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <iosfwd>
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+#include "../assembly/assembly.hxx"
+#include "../os/sampler.hxx"
+#include "jit.hxx"
+
+namespace jit {
+    // Samples attributed to one instruction of generated code
+    struct profile_entry_t {
+        string function;
+        u64 mnemo_index;
+
+        // 1-based line in the source, 0 if the source is unknown
+        u64 line;
+
+        // Source line without the newline, empty if the source is unknown
+        string text;
+
+        u64 samples;
+    };
+
+    struct profile_t {
+        // Sorted by descending samples
+        vector<profile_entry_t> entries;
+
+        // All samples, including those outside of registered code
+        u64 sample_count;
+
+        // Samples lost because the sampler buffer was full
+        u64 dropped_count;
+
+        // One line per instruction: samples, share of all samples, function, line and source
+        auto print_flat(std::ostream &out) const -> void;
+
+        // Folded stacks "function;line N: source count" for flamegraph.pl. Samples outside of registered code
+        // are reported as "[other]".
+        auto print_folded(std::ostream &out) const -> void;
+    };
+
+    // Maps samples of `sampler_start` back to generated code through source maps. Only one profiler may sample
+    // at a time.
+    class profiler_t {
+        struct code_t {
+            u64 begin;
+            u64 size;
+            string name;
+            assembly::source_map_t source_map;
+            string source;
+        };
+
+        vector<code_t> code;
+
+    public:
+        // `function` must stay loaded until `stop`. `source` is the text that the source map offsets refer to.
+        auto add_code(const function_t &function, assembly::source_map_t source_map, const string &name,
+                      string source = {}) -> void;
+
+        // Parses and assembles `source` with a source map and registers the result. Throws `runtime_error` on
+        // parsing errors.
+        auto compile(const string &source, const string &name) -> function_t;
+
+        // Returns false if sampling is unavailable
+        auto start(const sampler_options &options = {}) -> bool;
+
+        auto stop() -> profile_t;
+    };
+}
@@ -0,0 +1,36 @@
+#include "tiered.hxx"
+
+#include "compile.hxx"
+#include "interpreter.hxx"
+#include "../os/stats.hxx"
+
+using namespace std;
+
+namespace jit {
+    tiered_function_t::tiered_function_t(vector<assembly::mnemo_t> mnemos, tiering_options options)
+            : mnemos(move(mnemos)), options(options), interpretable(is_interpretable(this->mnemos)) {}
+
+    auto tiered_function_t::operator()() -> i64 {
+        u64 count = this->call_count.fetch_add(1, memory_order_relaxed) + 1;
+        if (!this->promoted.load(memory_order_acquire) &&
+            (!this->interpretable || count > this->options.promotion_threshold)) {
+            call_once(this->promotion, [this]() {
+                this->native = compile(this->mnemos, this->options.name);
+                this->promoted.store(true, memory_order_release);
+            });
+        }
+
+        if (this->promoted.load(memory_order_acquire))
+            return this->native();
+        stats_add(stat_t::InterpretedCallCount, 1);
+        return interpret(this->mnemos);
+    }
+
+    auto tiered_function_t::is_native() const -> bool {
+        return this->promoted.load(memory_order_acquire);
+    }
+
+    auto tiered_function_t::get_call_count() const -> u64 {
+        return this->call_count.load(memory_order_relaxed);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+#include "../assembly/assembly.hxx"
+#include "jit.hxx"
+
+namespace jit {
+    struct tiering_options {
+        // Number of interpreted calls after which the function is assembled and runs natively
+        u64 promotion_threshold = 16;
+
+        // Name of the native code in profilers
+        string name;
+    };
+
+    // A function that starts in the interpreter and is promoted to native code once it has been called
+    // `promotion_threshold` times. Functions that can not be interpreted are assembled on the first call.
+    // It can be called from several threads at once, the code is then assembled by exactly one of them.
+    class tiered_function_t {
+        vector<assembly::mnemo_t> mnemos;
+        tiering_options options;
+        bool interpretable;
+        std::atomic<u64> call_count = 0;
+
+        std::once_flag promotion;
+
+        // Set once `native` is assembled, `native` is not written after that
+        std::atomic<bool> promoted = false;
+
+        // Assembled code, empty until promotion
+        function_t native;
+
+    public:
+        explicit tiered_function_t(vector<assembly::mnemo_t> mnemos, tiering_options options = {});
+
+        auto operator()() -> i64;
+
+        [[nodiscard]] auto is_native() const -> bool;
+
+        [[nodiscard]] auto get_call_count() const -> u64;
+    };
+}
@@ -1,9 +1,13 @@
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <stdexcept>
 
 #include "tests/assembly.hxx"
 #include "parsec/tests/tests.hxx"
 #include "assembly/parse/parse.hxx"
 #include "jit/jit.hxx"
+#include "test/test.hxx"
 
 auto eval(parsec::strive s) -> i64 {
     auto mnemos = assembly::parse::parse(s).value().data;
@@ -11,10 +15,49 @@ auto eval(parsec::strive s) -> i64 {
     return jit::eval_mc(bytes.data(), bytes.size());
 }
 
-int main() {
+// Usage: cplastane [--perf-record baseline.tsv | --perf-compare baseline.tsv] [--perf-tolerance 0.5]
+// A baseline only holds for the machine that recorded it, see `test::PerfOptions` and the README.
+// Exits with 1 if a test or a timing check fails.
+int main(int argc, char **argv) {
+    test::PerfOptions perf_options{};
+    for (int i = 1; i < argc; i += 2) {
+        std::string flag = argv[i];
+        if (i + 1 == argc) {
+            std::cerr << "Missing value of option " << flag << "\n";
+            return 1;
+        }
+        if (flag == "--perf-record" || flag == "--perf-compare") {
+            perf_options.mode = flag == "--perf-record" ? test::PerfMode::Record : test::PerfMode::Compare;
+            perf_options.baseline_path = argv[i + 1];
+        } else if (flag == "--perf-tolerance") {
+            char *end;
+            perf_options.tolerance = std::strtod(argv[i + 1], &end);
+            // Also rejects NaN, which compares false
+            if (*argv[i + 1] == '\0' || *end != '\0' || !(perf_options.tolerance >= 0) ||
+                std::isinf(perf_options.tolerance)) {
+                std::cerr << "Invalid value of option " << flag << "\n";
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown option " << flag << "\n";
+            return 1;
+        }
+    }
+
+    bool success;
+    try {
+        test::set_perf_options(perf_options);
+        success = tests::test_assembly();
+        test::save_perf_baseline();
+    } catch (const std::runtime_error &e) {
+        // The baseline file can not be read or written
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
 //    syntax::parse::test_parser();
-    tests::test_assembly();
     //parsec::tests::test();
 
     //assembly::parse::test();
+    return success ? 0 : 1;
 }
@@ -1,5 +1,8 @@
 #include "alloc.hxx"
 
+#include "stats.hxx"
+#include "trace.hxx"
+
 #if defined(unix) || defined(__unix__) || defined(__unix)
 #define CPLASTANE_UNIX
 #endif
@@ -8,22 +11,60 @@
 #define CPLASTANE_WIN
 #endif
 
+void *alloc_executable(size_t size) {
+    TRACE_SPAN("alloc_executable");
+    void *mem = map_executable(size);
+    stats_add(stat_t::AllocCount, 1);
+    stats_add(stat_t::BytesUsed, i64(size));
+    return mem;
+}
+
+void dealloc(void *mem, size_t size) {
+    unmap_executable(mem, size);
+    stats_add(stat_t::FreeCount, 1);
+    stats_add(stat_t::BytesUsed, -i64(size));
+}
+
 #ifdef CPLASTANE_UNIX
 
 #include <stdexcept>
 #include <sys/mman.h>
+#include <unistd.h>
 
-void *alloc_executable(size_t size) {
+// Mappings are whole pages and anonymous memory is accounted as committed when mapped
+static void record_mapping(size_t size, i64 sign) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    i64 mapped = i64((size + page_size - 1) / page_size * page_size);
+    stats_add(stat_t::BytesReserved, sign * mapped);
+    stats_add(stat_t::BytesCommitted, sign * mapped);
+}
+
+void *map_executable(size_t size) {
+    TRACE_SPAN("map_executable");
     void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     if (mem == MAP_FAILED)
         throw std::runtime_error("allocation failed");
+    record_mapping(size, 1);
     return mem;
 }
 
-void dealloc(void *mem, size_t size) {
+void unmap_executable(void *mem, size_t size) {
     int i = munmap(mem, size);
     if (i == -1)
         throw std::runtime_error("deallocation failed");
+    record_mapping(size, -1);
+}
+
+void protect_code(void *mem, size_t size) {
+    int i = mprotect(mem, size, PROT_READ | PROT_EXEC);
+    if (i == -1)
+        throw std::runtime_error("protection failed");
+}
+
+void protect_data(void *mem, size_t size) {
+    int i = mprotect(mem, size, PROT_READ | PROT_WRITE);
+    if (i == -1)
+        throw std::runtime_error("protection failed");
 }
 
 void flush_instruction_cache(void *mem, size_t size) {
@@ -38,17 +79,43 @@ void flush_instruction_cache(void *mem, size_t size) {
 #include <stdexcept>
 #include <Windows.h>
 
-void *alloc_executable(size_t size) {
+// Address space is reserved in allocation granularity units, memory is committed in pages
+static void record_mapping(size_t size, i64 sign) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    size_t granularity = info.dwAllocationGranularity;
+    size_t page_size = info.dwPageSize;
+    stats_add(stat_t::BytesReserved, sign * i64((size + granularity - 1) / granularity * granularity));
+    stats_add(stat_t::BytesCommitted, sign * i64((size + page_size - 1) / page_size * page_size));
+}
+
+void *map_executable(size_t size) {
     void *mem = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
     if (mem == nullptr)
         throw std::runtime_error("allocation failed");
+    record_mapping(size, 1);
     return mem;
 }
 
-void dealloc(void *mem, size_t) {
+void unmap_executable(void *mem, size_t size) {
     BOOL b = VirtualFree(mem, 0, MEM_RELEASE);
     if (b == 0)
         throw std::runtime_error("deallocation failed");
+    record_mapping(size, -1);
+}
+
+void protect_code(void *mem, size_t size) {
+    DWORD old_protection;
+    BOOL b = VirtualProtect(mem, size, PAGE_EXECUTE_READ, &old_protection);
+    if (b == 0)
+        throw std::runtime_error("protection failed");
+}
+
+void protect_data(void *mem, size_t size) {
+    DWORD old_protection;
+    BOOL b = VirtualProtect(mem, size, PAGE_READWRITE, &old_protection);
+    if (b == 0)
+        throw std::runtime_error("protection failed");
 }
 
 void flush_instruction_cache(void *mem, size_t size) {
@@ -6,6 +6,18 @@ void *alloc_executable(size_t size);
 
 void dealloc(void *mem, size_t size);
 
+// Like `alloc_executable` and `dealloc`, but only accounted as reserved and committed memory in os/stats.hxx.
+// For allocators which carve the mapping into blocks and account for the blocks themselves.
+void *map_executable(size_t size);
+
+void unmap_executable(void *mem, size_t size);
+
+// Makes whole pages of a mapping read-only and executable, once the code on them is written
+void protect_code(void *mem, size_t size);
+
+// Makes whole pages of a mapping read-write and no longer executable, for data which lives next to code
+void protect_data(void *mem, size_t size);
+
 // Applications should call FlushInstructionCache if they generate or modify code in memory.
 // The CPU cannot detect the change, and may execute the old code it cached.
 void flush_instruction_cache(void *mem, size_t size);
\ No newline at end of file
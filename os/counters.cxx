@@ -0,0 +1,145 @@
+#include "counters.hxx"
+
+#if defined(__linux__)
+
+#include <cpuid.h>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(sizeof(cpu_set_t) <= 128, "cpu_pin_t::previous is too small");
+
+// Raw uops event for the CPU vendor, 0 if unknown
+static auto uops_raw_event() -> u64 {
+    u32 eax, ebx, ecx, edx;
+    if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+        return 0;
+    char vendor[13] = {};
+    memcpy(vendor + 0, &ebx, 4);
+    memcpy(vendor + 4, &edx, 4);
+    memcpy(vendor + 8, &ecx, 4);
+    if (strcmp(vendor, "GenuineIntel") == 0)
+        return 0x010e; // UOPS_ISSUED.ANY: event 0x0e, umask 0x01
+    if (strcmp(vendor, "AuthenticAMD") == 0)
+        return 0x00c1; // Retired uops: event 0xc1
+    return 0;
+}
+
+static auto open_counter(u32 type, u64 config) -> int {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+hardware_counters_t::hardware_counters_t() {
+    this->fds[size_t(hardware_counter_t::Cycles)] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    this->fds[size_t(hardware_counter_t::Instructions)] = open_counter(PERF_TYPE_HARDWARE,
+                                                                       PERF_COUNT_HW_INSTRUCTIONS);
+    u64 uops = uops_raw_event();
+    this->fds[size_t(hardware_counter_t::Uops)] = uops == 0 ? -1 : open_counter(PERF_TYPE_RAW, uops);
+    this->fds[size_t(hardware_counter_t::BranchMisses)] = open_counter(PERF_TYPE_HARDWARE,
+                                                                       PERF_COUNT_HW_BRANCH_MISSES);
+}
+
+hardware_counters_t::~hardware_counters_t() {
+    for (int fd: this->fds) {
+        if (fd != -1)
+            close(fd);
+    }
+}
+
+auto hardware_counters_t::is_available(hardware_counter_t counter) const -> bool {
+    return this->fds[size_t(counter)] != -1;
+}
+
+auto hardware_counters_t::start() -> void {
+    for (int fd: this->fds) {
+        if (fd != -1) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+auto hardware_counters_t::stop() -> void {
+    for (int fd: this->fds) {
+        if (fd != -1)
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+}
+
+auto hardware_counters_t::read(hardware_counter_t counter) const -> u64 {
+    u64 value = 0;
+    int fd = this->fds[size_t(counter)];
+    if (fd == -1 || ::read(fd, &value, sizeof(value)) != sizeof(value))
+        return 0;
+    return value;
+}
+
+cpu_pin_t::cpu_pin_t(int cpu) {
+    cpu_set_t previous_set;
+    CPU_ZERO(&previous_set);
+    if (sched_getaffinity(0, sizeof(previous_set), &previous_set) != 0)
+        return;
+    memcpy(this->previous, &previous_set, sizeof(previous_set));
+
+    if (cpu == -1)
+        cpu = sched_getcpu();
+    if (cpu < 0)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    this->pinned = sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+cpu_pin_t::~cpu_pin_t() {
+    if (this->pinned) {
+        cpu_set_t previous_set;
+        memcpy(&previous_set, this->previous, sizeof(previous_set));
+        sched_setaffinity(0, sizeof(previous_set), &previous_set);
+    }
+}
+
+auto cpu_pin_t::is_pinned() const -> bool {
+    return this->pinned;
+}
+
+#else
+
+hardware_counters_t::hardware_counters_t() {
+    for (int &fd: this->fds)
+        fd = -1;
+}
+
+hardware_counters_t::~hardware_counters_t() = default;
+
+auto hardware_counters_t::is_available(hardware_counter_t) const -> bool {
+    return false;
+}
+
+auto hardware_counters_t::start() -> void {}
+
+auto hardware_counters_t::stop() -> void {}
+
+auto hardware_counters_t::read(hardware_counter_t) const -> u64 {
+    return 0;
+}
+
+cpu_pin_t::cpu_pin_t(int) {}
+
+cpu_pin_t::~cpu_pin_t() = default;
+
+auto cpu_pin_t::is_pinned() const -> bool {
+    return false;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../int.hxx"
+
+// Hardware performance counters of the calling thread through Linux `perf_event_open`, counting user space only.
+// Counters that the kernel, CPU or permissions do not provide are reported as unavailable.
+// On other systems no counter is available.
+
+enum class hardware_counter_t {
+    Cycles,
+    Instructions,
+    Uops, // Raw event: UOPS_ISSUED.ANY on Intel, retired uops on AMD
+    BranchMisses,
+};
+
+static constexpr size_t hardware_counter_count = 4;
+
+class hardware_counters_t {
+    int fds[hardware_counter_count];
+
+public:
+    hardware_counters_t();
+
+    hardware_counters_t(const hardware_counters_t &) = delete;
+
+    auto operator=(const hardware_counters_t &) -> hardware_counters_t & = delete;
+
+    ~hardware_counters_t();
+
+    [[nodiscard]] auto is_available(hardware_counter_t counter) const -> bool;
+
+    // Resets and enables all available counters
+    auto start() -> void;
+
+    auto stop() -> void;
+
+    [[nodiscard]] auto read(hardware_counter_t counter) const -> u64;
+};
+
+// Pins the calling thread to one CPU while alive and restores its previous affinity afterwards
+class cpu_pin_t {
+    // Previous affinity mask, large enough for a cpu_set_t
+    u8 previous[128];
+    bool pinned = false;
+
+public:
+    // cpu == -1 pins to the CPU the thread is currently running on
+    explicit cpu_pin_t(int cpu);
+
+    cpu_pin_t(const cpu_pin_t &) = delete;
+
+    auto operator=(const cpu_pin_t &) -> cpu_pin_t & = delete;
+
+    ~cpu_pin_t();
+
+    [[nodiscard]] auto is_pinned() const -> bool;
+};
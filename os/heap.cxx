@@ -0,0 +1,109 @@
+#include "heap.hxx"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef CPLASTANE_ALLOC_ACCOUNTING
+
+// Trivially destructible, so allocations during thread exit can still be counted
+static thread_local heap_counts_t thread_heap_counts{};
+
+static auto counted_alloc(size_t size, size_t alignment) noexcept -> void * {
+    thread_heap_counts.allocations++;
+    thread_heap_counts.bytes += size;
+    if (alignment <= alignof(std::max_align_t))
+        return malloc(size == 0 ? 1 : size);
+    // aligned_alloc needs a size that is a non-zero multiple of the alignment
+    return aligned_alloc(alignment, size == 0 ? alignment : (size + alignment - 1) / alignment * alignment);
+}
+
+static auto counted_alloc_or_throw(size_t size, size_t alignment) -> void * {
+    void *mem = counted_alloc(size, alignment);
+    if (mem == nullptr)
+        throw std::bad_alloc();
+    return mem;
+}
+
+auto heap_counts() -> heap_counts_t {
+    return thread_heap_counts;
+}
+
+void *operator new(size_t size) {
+    return counted_alloc_or_throw(size, 0);
+}
+
+void *operator new[](size_t size) {
+    return counted_alloc_or_throw(size, 0);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return counted_alloc_or_throw(size, size_t(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return counted_alloc_or_throw(size, size_t(alignment));
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return counted_alloc(size, size_t(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return counted_alloc(size, size_t(alignment));
+}
+
+void operator delete(void *mem) noexcept {
+    free(mem);
+}
+
+void operator delete[](void *mem) noexcept {
+    free(mem);
+}
+
+void operator delete(void *mem, size_t) noexcept {
+    free(mem);
+}
+
+void operator delete[](void *mem, size_t) noexcept {
+    free(mem);
+}
+
+void operator delete(void *mem, std::align_val_t) noexcept {
+    free(mem);
+}
+
+void operator delete[](void *mem, std::align_val_t) noexcept {
+    free(mem);
+}
+
+void operator delete(void *mem, size_t, std::align_val_t) noexcept {
+    free(mem);
+}
+
+void operator delete[](void *mem, size_t, std::align_val_t) noexcept {
+    free(mem);
+}
+
+void operator delete(void *mem, const std::nothrow_t &) noexcept {
+    free(mem);
+}
+
+void operator delete[](void *mem, const std::nothrow_t &) noexcept {
+    free(mem);
+}
+
+#else
+
+auto heap_counts() -> heap_counts_t {
+    return {};
+}
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../int.hxx"
+
+// Heap allocation accounting. With CPLASTANE_ALLOC_ACCOUNTING defined, the global `operator new` is replaced and
+// counts every allocation of the calling thread, which costs a thread-local increment per allocation.
+// Without it no allocation is counted.
+
+#ifdef CPLASTANE_ALLOC_ACCOUNTING
+static constexpr bool heap_accounting_enabled = true;
+#else
+static constexpr bool heap_accounting_enabled = false;
+#endif
+
+struct heap_counts_t {
+    u64 allocations;
+    u64 bytes;
+
+    auto operator-(const heap_counts_t &other) const -> heap_counts_t {
+        return {this->allocations - other.allocations, this->bytes - other.bytes};
+    }
+};
+
+// Allocations of the calling thread since it started
+auto heap_counts() -> heap_counts_t;
+
+// Allocations of the calling thread while `f` runs
+template<typename F>
+auto count_allocations(F &&f) -> heap_counts_t {
+    heap_counts_t before = heap_counts();
+    f();
+    return heap_counts() - before;
+}
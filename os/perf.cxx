@@ -0,0 +1,176 @@
+#include "perf.hxx"
+
+#if defined(unix) || defined(__unix__) || defined(__unix)
+#define CPLASTANE_UNIX
+#endif
+
+#ifdef CPLASTANE_UNIX
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../int.hxx"
+
+// Layout of the jitdump format is described in perf's tools/perf/Documentation/jitdump-specification.txt
+
+static constexpr u32 jitdump_magic = 0x4A695444;
+static constexpr u32 jitdump_version = 1;
+static constexpr u32 jitdump_elf_mach_x86_64 = 62;
+static constexpr u32 jitdump_code_load = 0;
+static constexpr u32 jitdump_code_close = 3;
+
+struct jitdump_header {
+    u32 magic;
+    u32 version;
+    u32 total_size;
+    u32 elf_mach;
+    u32 pad1;
+    u32 pid;
+    u64 timestamp;
+    u64 flags;
+};
+
+struct jitdump_record_header {
+    u32 id;
+    u32 total_size;
+    u64 timestamp;
+};
+
+// Followed by a null-terminated name and the code bytes
+struct jitdump_code_load_record {
+    jitdump_record_header header;
+    u32 pid;
+    u32 tid;
+    u64 vma;
+    u64 code_addr;
+    u64 code_size;
+    u64 code_index;
+};
+
+static std::mutex perf_mutex;
+static std::atomic<bool> perf_enabled{false};
+static FILE *perf_map_file = nullptr;
+static int jitdump_fd = -1;
+// perf finds the jitdump file through an executable mapping of it
+static void *jitdump_marker = nullptr;
+static u64 jitdump_code_index = 0;
+
+// perf timestamps jitdump records with CLOCK_MONOTONIC when recording with `-k mono`
+static u64 perf_timestamp() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return u64(ts.tv_sec) * 1000000000 + u64(ts.tv_nsec);
+}
+
+static void write_all(int fd, const void *data, size_t size) {
+    const char *p = reinterpret_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0)
+            throw std::runtime_error("jitdump write failed");
+        p += written;
+        size -= size_t(written);
+    }
+}
+
+static void close_files() {
+    if (perf_map_file != nullptr) {
+        fclose(perf_map_file);
+        perf_map_file = nullptr;
+    }
+    if (jitdump_fd != -1) {
+        jitdump_record_header record{jitdump_code_close, sizeof(jitdump_record_header), perf_timestamp()};
+        write_all(jitdump_fd, &record, sizeof(record));
+        munmap(jitdump_marker, size_t(sysconf(_SC_PAGESIZE)));
+        close(jitdump_fd);
+        jitdump_marker = nullptr;
+        jitdump_fd = -1;
+    }
+}
+
+void perf_enable(const perf_options &options) {
+    std::lock_guard<std::mutex> lock(perf_mutex);
+    close_files();
+
+    std::string pid = std::to_string(getpid());
+    if (options.map) {
+        std::string path = options.directory + "/perf-" + pid + ".map";
+        perf_map_file = fopen(path.c_str(), "a");
+        if (perf_map_file == nullptr)
+            throw std::runtime_error("could not open " + path);
+    }
+    if (options.jitdump) {
+        std::string path = options.directory + "/jit-" + pid + ".dump";
+        jitdump_fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0666);
+        if (jitdump_fd == -1)
+            throw std::runtime_error("could not open " + path);
+        jitdump_marker = mmap(nullptr, size_t(sysconf(_SC_PAGESIZE)), PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                              jitdump_fd, 0);
+        if (jitdump_marker == MAP_FAILED) {
+            close(jitdump_fd);
+            jitdump_fd = -1;
+            throw std::runtime_error("could not map " + path);
+        }
+        jitdump_header header{jitdump_magic, jitdump_version, sizeof(jitdump_header), jitdump_elf_mach_x86_64, 0,
+                              u32(getpid()), perf_timestamp(), 0};
+        write_all(jitdump_fd, &header, sizeof(header));
+    }
+    perf_enabled.store(perf_map_file != nullptr || jitdump_fd != -1, std::memory_order_release);
+}
+
+void perf_disable() {
+    std::lock_guard<std::mutex> lock(perf_mutex);
+    perf_enabled.store(false, std::memory_order_release);
+    close_files();
+}
+
+bool perf_is_enabled() {
+    return perf_enabled.load(std::memory_order_acquire);
+}
+
+void perf_register_code(const void *code, size_t size, const std::string &name) {
+    if (!perf_is_enabled())
+        return;
+    std::lock_guard<std::mutex> lock(perf_mutex);
+    if (perf_map_file != nullptr) {
+        fprintf(perf_map_file, "%lx %lx %s\n", u64(code), u64(size), name.c_str());
+        fflush(perf_map_file);
+    }
+    if (jitdump_fd != -1) {
+        jitdump_code_load_record record{};
+        record.header.id = jitdump_code_load;
+        record.header.total_size = u32(sizeof(record) + name.size() + 1 + size);
+        record.header.timestamp = perf_timestamp();
+        record.pid = u32(getpid());
+        record.tid = u32(gettid());
+        record.vma = u64(code);
+        record.code_addr = u64(code);
+        record.code_size = size;
+        record.code_index = jitdump_code_index++;
+        write_all(jitdump_fd, &record, sizeof(record));
+        write_all(jitdump_fd, name.c_str(), name.size() + 1);
+        write_all(jitdump_fd, code, size);
+    }
+}
+
+#else
+
+void perf_enable(const perf_options &) {}
+
+void perf_disable() {}
+
+bool perf_is_enabled() {
+    return false;
+}
+
+void perf_register_code(const void *, size_t, const std::string &) {}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Linux `perf` integration for generated code. Nothing is written until `perf_enable` is called.
+// On other systems all functions do nothing.
+
+struct perf_options {
+    // Write `<directory>/perf-<pid>.map` with one "START SIZE name" line per code block.
+    // `perf report` only looks for the map in /tmp.
+    bool map = true;
+
+    // Write `<directory>/jit-<pid>.dump` in the jitdump format, which also contains code bytes, so
+    // `perf annotate` can disassemble generated code. Record with `perf record -k mono` and merge with `perf inject --jit`.
+    bool jitdump = false;
+
+    std::string directory = "/tmp";
+};
+
+void perf_enable(const perf_options &options);
+
+// Closes the files, already written entries are kept
+void perf_disable();
+
+bool perf_is_enabled();
+
+// Records a block of executable code under `name`
+void perf_register_code(const void *code, size_t size, const std::string &name);
@@ -0,0 +1,104 @@
+#include "sampler.hxx"
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+#if defined(__linux__) && defined(__x86_64__)
+
+#include <csignal>
+#include <sys/time.h>
+#include <ucontext.h>
+
+static std::mutex sampler_mutex;
+static vector<u64> sample_buffer;
+static std::atomic<bool> sampling{false};
+static std::atomic<u64> sample_count{0};
+// Handlers that may still write to `sample_buffer`, so it is only read once there are none. Accesses of
+// `sampling` and `handlers_running` are sequentially consistent: a handler that starts after `sampler_stop` saw no
+// running handlers also sees `sampling` cleared.
+static std::atomic<u32> handlers_running{0};
+static bool handler_installed = false;
+
+static void on_sigprof(int, siginfo_t *, void *context) {
+    handlers_running.fetch_add(1);
+    if (sampling.load()) {
+        u64 i = sample_count.fetch_add(1, std::memory_order_relaxed);
+        if (i < sample_buffer.size())
+            sample_buffer[i] = u64(static_cast<ucontext_t *>(context)->uc_mcontext.gregs[REG_RIP]);
+    }
+    handlers_running.fetch_sub(1);
+}
+
+static auto set_timer(u64 interval_us) -> bool {
+    itimerval timer{};
+    timer.it_interval.tv_sec = time_t(interval_us / 1000000);
+    timer.it_interval.tv_usec = suseconds_t(interval_us % 1000000);
+    timer.it_value = timer.it_interval;
+    return setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+}
+
+auto sampler_start(const sampler_options &options) -> bool {
+    std::lock_guard<std::mutex> lock(sampler_mutex);
+    if (sampling.load(std::memory_order_relaxed))
+        throw std::logic_error("sampler is already running");
+    if (options.interval_us == 0)
+        throw std::logic_error("sampling interval should not be zero");
+
+    // The handler stays installed, so a SIGPROF still pending after `sampler_stop` is ignored instead of
+    // terminating the process
+    if (!handler_installed) {
+        struct sigaction action{};
+        action.sa_sigaction = on_sigprof;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, nullptr) != 0)
+            return false;
+        handler_installed = true;
+    }
+
+    sample_buffer.assign(options.capacity, 0);
+    sample_count.store(0, std::memory_order_relaxed);
+    sampling.store(true, std::memory_order_release);
+    if (!set_timer(options.interval_us)) {
+        sampling.store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+auto sampler_stop() -> sampler_result {
+    std::lock_guard<std::mutex> lock(sampler_mutex);
+    if (!sampling.load(std::memory_order_relaxed))
+        return {};
+    itimerval disarmed{};
+    setitimer(ITIMER_PROF, &disarmed, nullptr);
+    sampling.store(false);
+    while (handlers_running.load() != 0) {}
+
+    u64 count = sample_count.load(std::memory_order_relaxed);
+    sampler_result result{};
+    result.addresses.assign(sample_buffer.begin(), sample_buffer.begin() + i64(std::min(count, sample_buffer.size())));
+    result.dropped_count = count - result.addresses.size();
+    return result;
+}
+
+auto sampler_is_running() -> bool {
+    return sampling.load(std::memory_order_acquire);
+}
+
+#else
+
+auto sampler_start(const sampler_options &) -> bool {
+    return false;
+}
+
+auto sampler_stop() -> sampler_result {
+    return {};
+}
+
+auto sampler_is_running() -> bool {
+    return false;
+}
+
+#endif
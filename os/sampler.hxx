@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+
+// Statistical sampling of the instruction pointer. `setitimer(ITIMER_PROF)` raises `SIGPROF` in whichever thread
+// is running every `interval_us` of CPU time consumed by the process, and the handler stores the interrupted
+// instruction address in a preallocated buffer, so it stays async-signal-safe.
+// On systems other than Linux x86-64 sampling is unavailable.
+
+struct sampler_options {
+    u64 interval_us = 1000;
+
+    // Samples beyond this many are dropped
+    u64 capacity = 1 << 16;
+};
+
+struct sampler_result {
+    // Sampled instruction addresses in the order they were taken
+    vector<u64> addresses;
+
+    u64 dropped_count;
+};
+
+// Returns false if sampling is unavailable. Throws `logic_error` if sampling is already running.
+auto sampler_start(const sampler_options &options = {}) -> bool;
+
+// Stops sampling and returns the samples taken since `sampler_start`
+auto sampler_stop() -> sampler_result;
+
+auto sampler_is_running() -> bool;
@@ -0,0 +1,180 @@
+#include "stats.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+// Counters of one thread. Only the owning thread writes, so increments are a relaxed load and store.
+struct stats_record_t {
+    atomic<u64> values[stat_count];
+    atomic<u64> buckets[compile_phase_count][latency_bucket_count];
+    atomic<u64> total_ns[compile_phase_count];
+    // Allocations, bytes and items
+    atomic<u64> allocations[compile_phase_count][3];
+};
+
+// Guards the thread registry and the totals of exited threads. Recording does not take it.
+static mutex stats_mutex;
+static vector<stats_record_t *> stats_records;
+static stats_t exited_stats;
+
+static auto add_relaxed(atomic<u64> &counter, u64 delta) -> void {
+    counter.store(counter.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+// Adds a record to stats. Gauges wrap around per thread, but their sum is exact.
+static auto accumulate(stats_t &stats, const stats_record_t &record) -> void {
+    for (size_t i = 0; i < stat_count; i++)
+        stats.values[i] += record.values[i].load(memory_order_relaxed);
+    for (size_t phase = 0; phase < compile_phase_count; phase++) {
+        latency_histogram_t &histogram = stats.latencies[phase];
+        for (size_t i = 0; i < latency_bucket_count; i++) {
+            u64 n = record.buckets[phase][i].load(memory_order_relaxed);
+            histogram.buckets[i] += n;
+            histogram.count += n;
+        }
+        histogram.total_ns += record.total_ns[phase].load(memory_order_relaxed);
+        stats.allocations[phase].allocations += record.allocations[phase][0].load(memory_order_relaxed);
+        stats.allocations[phase].bytes += record.allocations[phase][1].load(memory_order_relaxed);
+        stats.allocations[phase].items += record.allocations[phase][2].load(memory_order_relaxed);
+    }
+}
+
+// Registers the thread on its first record and folds its counters into exited_stats on thread exit
+struct stats_registration_t {
+    stats_record_t record{};
+
+    stats_registration_t() {
+        lock_guard<mutex> lock(stats_mutex);
+        stats_records.push_back(&this->record);
+    }
+
+    ~stats_registration_t() {
+        lock_guard<mutex> lock(stats_mutex);
+        accumulate(exited_stats, this->record);
+        erase(stats_records, &this->record);
+    }
+};
+
+static auto this_thread_record() -> stats_record_t & {
+    static thread_local stats_registration_t registration;
+    return registration.record;
+}
+
+auto stats_t::get(stat_t stat) const -> u64 {
+    return this->values[size_t(stat)];
+}
+
+auto stats_t::get_live_blocks() const -> u64 {
+    return this->get(stat_t::AllocCount) - this->get(stat_t::FreeCount);
+}
+
+auto stats_t::get_fragmentation() const -> double {
+    u64 committed = this->get(stat_t::BytesCommitted);
+    if (committed == 0)
+        return 0;
+    return 1 - double(this->get(stat_t::BytesUsed)) / double(committed);
+}
+
+auto stats_t::get_allocations_per_item(compile_phase_t phase) const -> double {
+    const phase_allocations_t &allocations = this->allocations[size_t(phase)];
+    if (allocations.items == 0)
+        return 0;
+    return double(allocations.allocations) / double(allocations.items);
+}
+
+auto stats_add(stat_t stat, i64 delta) -> void {
+    add_relaxed(this_thread_record().values[size_t(stat)], u64(delta));
+}
+
+auto stats_record_latency(compile_phase_t phase, u64 ns) -> void {
+    stats_record_t &record = this_thread_record();
+    size_t bucket = min(size_t(bit_width(ns)), latency_bucket_count - 1);
+    add_relaxed(record.buckets[size_t(phase)][bucket], 1);
+    add_relaxed(record.total_ns[size_t(phase)], ns);
+}
+
+auto stats_record_allocations(compile_phase_t phase, heap_counts_t counts, u64 items) -> void {
+    stats_record_t &record = this_thread_record();
+    add_relaxed(record.allocations[size_t(phase)][0], counts.allocations);
+    add_relaxed(record.allocations[size_t(phase)][1], counts.bytes);
+    add_relaxed(record.allocations[size_t(phase)][2], items);
+}
+
+auto stats_read() -> stats_t {
+    lock_guard<mutex> lock(stats_mutex);
+    stats_t stats = exited_stats;
+    for (stats_record_t *record: stats_records)
+        accumulate(stats, *record);
+    return stats;
+}
+
+auto stats_format(const stats_t &stats) -> string {
+    static constexpr const char *stat_names[stat_count] = {
+            "alloc_count", "free_count", "bytes_reserved", "bytes_committed", "bytes_used", "compile_count",
+            "native_call_count", "interpreted_call_count",
+    };
+    static constexpr bool stat_is_gauge[stat_count] = {false, false, true, true, true, false, false, false};
+    static constexpr const char *phase_names[compile_phase_count] = {"parse", "assemble", "load"};
+
+    ostringstream out;
+    for (size_t i = 0; i < stat_count; i++) {
+        out << "# TYPE cplastane_jit_" << stat_names[i] << " " << (stat_is_gauge[i] ? "gauge" : "counter") << "\n"
+            << "cplastane_jit_" << stat_names[i] << " " << stats.values[i] << "\n";
+    }
+    out << "# TYPE cplastane_jit_live_blocks gauge\n"
+        << "cplastane_jit_live_blocks " << stats.get_live_blocks() << "\n"
+        << "# TYPE cplastane_jit_fragmentation gauge\n"
+        << "cplastane_jit_fragmentation " << stats.get_fragmentation() << "\n"
+        << "# TYPE cplastane_jit_compile_latency_ns histogram\n";
+    for (size_t phase = 0; phase < compile_phase_count; phase++) {
+        const latency_histogram_t &histogram = stats.latencies[phase];
+        u64 cumulative = 0;
+        for (size_t i = 0; i + 1 < latency_bucket_count; i++) {
+            cumulative += histogram.buckets[i];
+            out << "cplastane_jit_compile_latency_ns_bucket{phase=\"" << phase_names[phase] << "\",le=\""
+                << (u64(1) << i) - 1 << "\"} " << cumulative << "\n";
+        }
+        out << "cplastane_jit_compile_latency_ns_bucket{phase=\"" << phase_names[phase] << "\",le=\"+Inf\"} "
+            << histogram.count << "\n"
+            << "cplastane_jit_compile_latency_ns_sum{phase=\"" << phase_names[phase] << "\"} "
+            << histogram.total_ns << "\n"
+            << "cplastane_jit_compile_latency_ns_count{phase=\"" << phase_names[phase] << "\"} "
+            << histogram.count << "\n";
+    }
+    out << "# TYPE cplastane_jit_phase_allocations counter\n"
+        << "# TYPE cplastane_jit_phase_allocated_bytes counter\n"
+        << "# TYPE cplastane_jit_phase_items counter\n";
+    for (size_t phase = 0; phase < compile_phase_count; phase++) {
+        const phase_allocations_t &allocations = stats.allocations[phase];
+        out << "cplastane_jit_phase_allocations{phase=\"" << phase_names[phase] << "\"} "
+            << allocations.allocations << "\n"
+            << "cplastane_jit_phase_allocated_bytes{phase=\"" << phase_names[phase] << "\"} " << allocations.bytes
+            << "\n"
+            << "cplastane_jit_phase_items{phase=\"" << phase_names[phase] << "\"} " << allocations.items << "\n";
+    }
+    return out.str();
+}
+
+static auto now_ns() -> u64 {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+stats_timer_t::stats_timer_t(compile_phase_t phase) : phase(phase), start_ns(now_ns()), start_heap(heap_counts()) {}
+
+auto stats_timer_t::set_items(u64 count) -> void {
+    this->items = count;
+}
+
+stats_timer_t::~stats_timer_t() {
+    // Read before recording, which allocates the thread's record on first use
+    heap_counts_t heap = heap_counts() - this->start_heap;
+    stats_record_latency(this->phase, now_ns() - this->start_ns);
+    stats_record_allocations(this->phase, heap, this->items);
+}
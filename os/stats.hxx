@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "../int.hxx"
+#include "heap.hxx"
+
+// Process-wide statistics of executable memory and JIT activity. Every thread writes its own counters without
+// synchronization and `stats_read` sums over all threads, so recording never contends with other threads.
+
+enum class stat_t {
+    AllocCount,
+    FreeCount,
+    // Gauges of live executable memory
+    BytesReserved, // Address space
+    BytesCommitted, // Backed by memory
+    BytesUsed, // Requested by callers
+    CompileCount,
+    NativeCallCount, // Calls through function_t and patchable_function_t, not through raw entry pointers
+    InterpretedCallCount,
+};
+
+static constexpr size_t stat_count = 8;
+
+enum class compile_phase_t {
+    Parse,
+    Assemble,
+    Load, // Copy to executable memory and profiler registration
+};
+
+static constexpr size_t compile_phase_count = 3;
+
+// Bucket i counts latencies below 2^i ns that did not fit an earlier bucket, the last bucket counts the rest
+static constexpr size_t latency_bucket_count = 32;
+
+struct latency_histogram_t {
+    u64 buckets[latency_bucket_count];
+    u64 count;
+    u64 total_ns;
+};
+
+// Heap allocations made during a compile phase, only counted with CPLASTANE_ALLOC_ACCOUNTING, see os/heap.hxx
+struct phase_allocations_t {
+    u64 allocations;
+    u64 bytes;
+    // Parsed lines, assembled mnemos or loaded blocks
+    u64 items;
+};
+
+struct stats_t {
+    u64 values[stat_count];
+    latency_histogram_t latencies[compile_phase_count];
+    phase_allocations_t allocations[compile_phase_count];
+
+    [[nodiscard]] auto get(stat_t stat) const -> u64;
+
+    [[nodiscard]] auto get_live_blocks() const -> u64;
+
+    // Share of committed executable memory not used by code, 0 when nothing is committed
+    [[nodiscard]] auto get_fragmentation() const -> double;
+
+    // Heap allocations per parsed line, assembled mnemo or loaded block, 0 without items
+    [[nodiscard]] auto get_allocations_per_item(compile_phase_t phase) const -> double;
+};
+
+// Gauges are decremented with negative deltas, possibly on a different thread than the one that incremented them
+auto stats_add(stat_t stat, i64 delta) -> void;
+
+auto stats_record_latency(compile_phase_t phase, u64 ns) -> void;
+
+auto stats_record_allocations(compile_phase_t phase, heap_counts_t counts, u64 items) -> void;
+
+auto stats_read() -> stats_t;
+
+// Prometheus text exposition format
+auto stats_format(const stats_t &stats) -> std::string;
+
+// Records the time from construction to destruction as a compile phase latency, and the heap allocations of the
+// thread in between as allocations of the phase
+class stats_timer_t {
+    compile_phase_t phase;
+    u64 start_ns;
+    heap_counts_t start_heap;
+    u64 items = 0;
+
+public:
+    explicit stats_timer_t(compile_phase_t phase);
+
+    // Number of lines, mnemos or blocks the phase processed
+    auto set_items(u64 count) -> void;
+
+    stats_timer_t(const stats_timer_t &) = delete;
+
+    auto operator=(const stats_timer_t &) -> stats_timer_t & = delete;
+
+    ~stats_timer_t();
+};
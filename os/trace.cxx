@@ -0,0 +1,137 @@
+#include "trace.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+atomic<bool> trace_enabled{false};
+
+// Slots are atomics, so reading a buffer while its thread records only ever yields whole stale or new values
+struct trace_slot_t {
+    atomic<const char *> name;
+    atomic<u64> start_ns;
+    atomic<u64> duration_ns;
+};
+
+// Ring buffer of one thread. Only the owning thread writes. Buffers of exited threads are kept for `trace_read`
+// and adopted by new threads after their events were cleared by `trace_start`.
+struct trace_buffer_t {
+    trace_slot_t slots[trace_buffer_capacity];
+    // Events ever recorded since `trace_start`, the newest is at (count - 1) % capacity
+    atomic<u64> count{0};
+    u32 thread;
+    bool owned;
+};
+
+// Guards the buffer registry. Recording does not take it.
+static mutex trace_mutex;
+static vector<unique_ptr<trace_buffer_t>> trace_buffers;
+static atomic<u64> trace_epoch_ns{0};
+
+static auto steady_ns() -> u64 {
+    return u64(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Releases the buffer of the thread when it exits
+struct trace_registration_t {
+    trace_buffer_t *buffer = nullptr;
+
+    ~trace_registration_t() {
+        if (this->buffer == nullptr)
+            return;
+        lock_guard<mutex> lock(trace_mutex);
+        this->buffer->owned = false;
+    }
+};
+
+static auto this_thread_buffer() -> trace_buffer_t & {
+    static thread_local trace_registration_t registration;
+    if (registration.buffer != nullptr)
+        return *registration.buffer;
+
+    lock_guard<mutex> lock(trace_mutex);
+    for (unique_ptr<trace_buffer_t> &buffer: trace_buffers) {
+        if (!buffer->owned && buffer->count.load(memory_order_relaxed) == 0) {
+            buffer->owned = true;
+            registration.buffer = buffer.get();
+            return *buffer;
+        }
+    }
+    trace_buffers.push_back(make_unique<trace_buffer_t>());
+    registration.buffer = trace_buffers.back().get();
+    registration.buffer->thread = u32(trace_buffers.size() - 1);
+    registration.buffer->owned = true;
+    return *registration.buffer;
+}
+
+auto trace_now_ns() -> u64 {
+    // Never 0, which marks spans started while tracing was off
+    return steady_ns() - trace_epoch_ns.load(memory_order_relaxed) + 1;
+}
+
+auto trace_record(const char *name, u64 start_ns, u64 end_ns) -> void {
+    // The span started before `trace_start` moved the epoch
+    if (end_ns < start_ns)
+        return;
+    trace_buffer_t &buffer = this_thread_buffer();
+    u64 count = buffer.count.load(memory_order_relaxed);
+    trace_slot_t &slot = buffer.slots[count % trace_buffer_capacity];
+    slot.name.store(name, memory_order_relaxed);
+    slot.start_ns.store(start_ns - 1, memory_order_relaxed);
+    slot.duration_ns.store(end_ns - start_ns, memory_order_relaxed);
+    buffer.count.store(count + 1, memory_order_release);
+}
+
+auto trace_start() -> void {
+    lock_guard<mutex> lock(trace_mutex);
+    for (unique_ptr<trace_buffer_t> &buffer: trace_buffers)
+        buffer->count.store(0, memory_order_relaxed);
+    trace_epoch_ns.store(steady_ns(), memory_order_relaxed);
+    trace_enabled.store(true, memory_order_release);
+}
+
+auto trace_stop() -> void {
+    trace_enabled.store(false, memory_order_release);
+}
+
+auto trace_read() -> vector<trace_event_t> {
+    lock_guard<mutex> lock(trace_mutex);
+    vector<trace_event_t> events{};
+    for (unique_ptr<trace_buffer_t> &buffer: trace_buffers) {
+        u64 count = buffer->count.load(memory_order_acquire);
+        for (u64 i = count - min(count, trace_buffer_capacity); i < count; i++) {
+            const trace_slot_t &slot = buffer->slots[i % trace_buffer_capacity];
+            events.push_back({slot.name.load(memory_order_relaxed), slot.start_ns.load(memory_order_relaxed),
+                              slot.duration_ns.load(memory_order_relaxed), buffer->thread});
+        }
+    }
+    stable_sort(events.begin(), events.end(), [](const trace_event_t &a, const trace_event_t &b) {
+        return a.start_ns < b.start_ns;
+    });
+    return events;
+}
+
+auto trace_format_chrome(const vector<trace_event_t> &events) -> string {
+    ostringstream out;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (u64 i = 0; i < events.size(); i++) {
+        const trace_event_t &event = events[i];
+        out << (i == 0 ? "" : ",") << "\n{\"name\":\"";
+        for (const char *c = event.name; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\')
+                out << '\\';
+            out << *c;
+        }
+        // Timestamps are in microseconds
+        out << "\",\"cat\":\"jit\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread << fixed << setprecision(3)
+            << ",\"ts\":" << double(event.start_ns) / 1000 << ",\"dur\":" << double(event.duration_ns) / 1000
+            << "}";
+    }
+    out << "\n]}\n";
+    return out.str();
+}
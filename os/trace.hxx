@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "../int.hxx"
+#include "../strvec.hxx"
+
+// Scoped trace spans of the JIT pipeline, exported as Chrome trace-event JSON for chrome://tracing and Perfetto.
+// Every thread records finished spans into its own ring buffer of `trace_buffer_capacity` events, so recording
+// takes no lock and the newest events win. Spans only record between `trace_start` and `trace_stop`.
+//
+// Without CPLASTANE_TRACING defined, `TRACE_SPAN` expands to nothing and no span is ever recorded.
+
+#define CPLASTANE_TRACE_CONCAT_(a, b) a##b
+#define CPLASTANE_TRACE_CONCAT(a, b) CPLASTANE_TRACE_CONCAT_(a, b)
+
+#ifdef CPLASTANE_TRACING
+// Records the enclosing scope under `name`, which should be a string literal
+#define TRACE_SPAN(name) trace_span_t CPLASTANE_TRACE_CONCAT(trace_span_, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) ((void) 0)
+#endif
+
+static constexpr u64 trace_buffer_capacity = 4096;
+
+struct trace_event_t {
+    const char *name;
+
+    // Nanoseconds since `trace_start`
+    u64 start_ns;
+    u64 duration_ns;
+
+    // Threads are numbered from 0 in order of their first recorded span
+    u32 thread;
+};
+
+// Clears recorded events and starts recording
+auto trace_start() -> void;
+
+auto trace_stop() -> void;
+
+// Recorded events of all threads by start time, including threads which exited
+auto trace_read() -> vector<trace_event_t>;
+
+// Chrome trace-event JSON with one complete ("X") event per span
+auto trace_format_chrome(const vector<trace_event_t> &events) -> std::string;
+
+extern std::atomic<bool> trace_enabled;
+
+auto trace_now_ns() -> u64;
+
+auto trace_record(const char *name, u64 start_ns, u64 end_ns) -> void;
+
+class trace_span_t {
+    const char *name;
+    // 0 if tracing was off when the span started
+    u64 start_ns = 0;
+
+public:
+    explicit trace_span_t(const char *name) : name(name) {
+        if (trace_enabled.load(std::memory_order_relaxed))
+            this->start_ns = trace_now_ns();
+    }
+
+    trace_span_t(const trace_span_t &) = delete;
+
+    auto operator=(const trace_span_t &) -> trace_span_t & = delete;
+
+    ~trace_span_t() {
+        if (this->start_ns != 0)
+            trace_record(this->name, this->start_ns, trace_now_ns());
+    }
+};
@@ -66,7 +66,7 @@ namespace parsec {
         strive tail;
         T data;
 
-        ParserResult(strive tail, T data) : tail(tail), data(data) {}
+        ParserResult(strive tail, T data) : tail(tail), data(std::move(data)) {}
     };
 
     template<typename T>
@@ -93,4 +93,18 @@ namespace parsec {
         }
         return make_option(ParserResult(tail.substr(prefix.get_size()), on_success));
     }
+
+    inline auto is_word_char(char c) -> bool {
+        return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || c == '_';
+    }
+
+    // Same as consume_prefix_str but fails if prefix is immediately followed by a word character.
+    // Used for keywords where one is a prefix of another, like "mov" and "movd".
+    template<typename T>
+    auto consume_word_str(strive tail, strive word, T on_success) -> OptionParserResult<T> {
+        OptionParserResult<T> result = consume_prefix_str(tail, word, on_success);
+        if (result && !result.value().tail.empty() && is_word_char(result.value().tail.front()))
+            return OptionParserResult<T>();
+        return result;
+    }
 }
@@ -1,8 +1,85 @@
 #include "test.hxx"
 
+#include <fstream>
+#include <map>
+#include <sstream>
+
 using namespace std;
 
 namespace test {
+    static PerfOptions perf_options{};
+
+    // Loaded from the baseline file in Compare mode, collected from timed tests in Record mode
+    static map<string, PerfRecord> perf_records{};
+
+    auto set_perf_options(const PerfOptions &options) -> void {
+        perf_options = options;
+        perf_records.clear();
+        if (options.mode != PerfMode::Compare)
+            return;
+
+        ifstream in(options.baseline_path);
+        if (!in)
+            throw runtime_error("can not read perf baseline " + options.baseline_path);
+        for (string line; getline(in, line);) {
+            u64 tab = line.find('\t');
+            if (line.empty() || line[0] == '#' || tab == string::npos)
+                continue;
+            PerfRecord record{};
+            string allocations;
+            istringstream(line.substr(tab + 1)) >> record.min_ns >> record.median_ns >> allocations;
+            record.allocations_counted = allocations != "-";
+            if (record.allocations_counted)
+                record.allocations = stoull(allocations);
+            perf_records[line.substr(0, tab)] = record;
+        }
+    }
+
+    auto save_perf_baseline() -> void {
+        if (perf_options.mode != PerfMode::Record)
+            return;
+        ofstream out(perf_options.baseline_path);
+        if (!out)
+            throw runtime_error("can not write perf baseline " + perf_options.baseline_path);
+        out << "# Absolute timings, only comparable on the machine and build that recorded them\n";
+        for (const auto &[name, record]: perf_records) {
+            out << name << "\t" << u64(record.min_ns) << "\t" << u64(record.median_ns) << "\t";
+            if (record.allocations_counted)
+                out << record.allocations << "\n";
+            else
+                out << "-\n";
+        }
+    }
+
+    auto check_perf_record(const string &name, const PerfRecord &record) -> bool {
+        if (perf_options.mode == PerfMode::Record) {
+            perf_records[name] = record;
+            return true;
+        }
+        if (perf_options.mode == PerfMode::Off)
+            return true;
+
+        auto it = perf_records.find(name);
+        if (it == perf_records.end()) {
+            cout << "[+] Timing check skipped, the test has no baseline.\n";
+            return true;
+        }
+        const PerfRecord &baseline = it->second;
+        double change = record.median_ns / baseline.median_ns - 1;
+        bool is_fast_enough = change <= perf_options.tolerance;
+        // Heap accounting may be compiled out in the build that recorded the baseline or in this one
+        bool is_counted = record.allocations_counted && baseline.allocations_counted;
+        bool allocates_no_more = !is_counted || record.allocations <= baseline.allocations;
+        cout << fixed << setprecision(1)
+             << (is_fast_enough ? "[+] Timing check successful" : "[/] Timing check failed") << ", median "
+             << (change >= 0 ? "+" : "") << change * 100 << "% against " << baseline.median_ns / 1000
+             << " us in the baseline, tolerance " << perf_options.tolerance * 100 << "%.\n";
+        if (!allocates_no_more)
+            cout << "[/] Allocation check failed, " << record.allocations << " allocations per run against "
+                 << baseline.allocations << " in the baseline.\n";
+        return is_fast_enough && allocates_no_more;
+    }
+
     // Returns a tuple of (number of successfuly completed test, number of tests)
     auto run_test_group(const TestGroup &test_group) -> TestGroupResult {
         u64 success_counter = 0;
@@ -1,11 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <functional>
 #include <array>
+#include <iomanip>
+#include <memory>
+#include <stdexcept>
 
 #include "../int.hxx"
 #include "../strvec.hxx"
+#include "../os/heap.hxx"
 
 #include <utility>
 #include <variant>
@@ -15,6 +21,11 @@ namespace test {
     public:
         [[nodiscard]] virtual auto run() const & -> bool = 0;
 
+        [[nodiscard]] virtual auto get_name() const -> const string & = 0;
+
+        // Runs the tested code once without checking or printing its result, used for timing
+        virtual auto run_process() const -> void = 0;
+
         virtual ~TestBase() = default;
     };
 
@@ -58,6 +69,14 @@ namespace test {
             }
             return do_outputs_compare;
         }
+
+        [[nodiscard]] auto get_name() const -> const string & override {
+            return this->name;
+        }
+
+        auto run_process() const -> void override {
+            (void) this->process(this->input);
+        }
     };
 
     class BoolTest : public TestBase {
@@ -73,11 +92,140 @@ namespace test {
             return embed.run();
         }
 
+        [[nodiscard]] auto get_name() const -> const string & override {
+            return embed.get_name();
+        }
+
+        auto run_process() const -> void override {
+            embed.run_process();
+        }
+
         BoolTest(string &&name, const std::function<bool()> &process) : embed(move(name), std::monostate(), true,
                                                                               [=](std::monostate) -> bool { return process(); },
                                                                               print_bool) {}
     };
 
+    // Fails if `process` makes more than `max_allocations` heap allocations on the calling thread, so a budget of 0
+    // enforces an allocation-free path. Passes without counting if heap accounting is compiled out.
+    class AllocationTest : public TestBase {
+        string name;
+        u64 max_allocations;
+        std::function<void()> process;
+
+    public:
+        AllocationTest(string &&name, u64 max_allocations, std::function<void()> process)
+                : name(std::move(name)), max_allocations(max_allocations), process(std::move(process)) {}
+
+        [[nodiscard]] auto run() const & -> bool override {
+            std::cout << ">> Test \"" << this->name << "\".\n";
+            if (!heap_accounting_enabled) {
+                this->process();
+                std::cout << "[+] Heap allocations are not counted in this build.\n";
+                return true;
+            }
+            heap_counts_t counts = count_allocations(this->process);
+            bool within_budget = counts.allocations <= this->max_allocations;
+            std::cout << (within_budget ? "[+] Allocation check successful.\n" : "[/] Allocation check failed.\n")
+                      << "Allocations: " << counts.allocations << " (" << counts.bytes << " bytes), budget "
+                      << this->max_allocations << ".\n";
+            return within_budget;
+        }
+
+        [[nodiscard]] auto get_name() const -> const string & override {
+            return this->name;
+        }
+
+        auto run_process() const -> void override {
+            this->process();
+        }
+    };
+
+    enum class PerfMode {
+        // Timed tests report their timing but never fail on it
+        Off,
+        // Timings are kept and written to the baseline file by `save_perf_baseline`
+        Record,
+        // Timed tests fail when they are slower or allocate more than in the baseline file
+        Compare,
+    };
+
+    struct PerfOptions {
+        PerfMode mode = PerfMode::Off;
+
+        // Tab separated lines of test name, min and median nanoseconds and allocations per run, "-" if uncounted.
+        // Lines starting with '#' are comments. Timings are absolute, so a baseline is only valid on the machine
+        // and build type that recorded it; record a new one before comparing anywhere else.
+        string baseline_path;
+
+        // Allowed relative increase of the median over the baseline. Timings of debug builds on shared machines vary
+        // by about 20% between runs.
+        double tolerance = 0.5;
+    };
+
+    struct PerfRecord {
+        double min_ns;
+        double median_ns;
+        // Median over runs, only meaningful if heap accounting was compiled in
+        u64 allocations;
+        bool allocations_counted;
+    };
+
+    // Loads the baseline file in Compare mode, throws `runtime_error` if it can not be read
+    auto set_perf_options(const PerfOptions &options) -> void;
+
+    // Writes timings recorded in Record mode to the baseline file
+    auto save_perf_baseline() -> void;
+
+    // Checks a test's timing against the baseline, printing the result. Passes in Off and Record mode.
+    auto check_perf_record(const string &name, const PerfRecord &record) -> bool;
+
+    // Runs a test, then times `repeat_count` more runs of its process. Takes ownership of the test.
+    class TimedTest : public TestBase {
+        std::unique_ptr<const TestBase> test;
+        u64 repeat_count;
+
+    public:
+        explicit TimedTest(const TestBase *test, u64 repeat_count = 10) : test(test), repeat_count(repeat_count) {
+            if (repeat_count == 0)
+                throw std::logic_error("timed test should run at least once");
+        }
+
+        [[nodiscard]] auto run() const & -> bool override {
+            if (!this->test->run())
+                return false;
+
+            vector<double> times{};
+            vector<u64> allocations{};
+            for (u64 i = 0; i < this->repeat_count; i++) {
+                auto start = std::chrono::steady_clock::now();
+                heap_counts_t counts = count_allocations([this]() { this->test->run_process(); });
+                times.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+                                        .count());
+                allocations.push_back(counts.allocations);
+            }
+            std::sort(times.begin(), times.end());
+            std::sort(allocations.begin(), allocations.end());
+            PerfRecord record = {
+                    .min_ns = times.front(),
+                    .median_ns = times[times.size() / 2],
+                    .allocations = allocations[allocations.size() / 2],
+                    .allocations_counted = heap_accounting_enabled,
+            };
+            std::cout << std::fixed << std::setprecision(1) << "Timing: min " << record.min_ns / 1000
+                      << " us, median " << record.median_ns / 1000 << " us over " << this->repeat_count << " runs, "
+                      << record.allocations << " allocations per run.\n";
+            return check_perf_record(this->get_name(), record);
+        }
+
+        [[nodiscard]] auto get_name() const -> const string & override {
+            return this->test->get_name();
+        }
+
+        auto run_process() const -> void override {
+            this->test->run_process();
+        }
+    };
+
     using TestGroup = vector<const TestBase *>;
 
     using TestGroupResult = std::tuple<u64, u64>;
@@ -87,8 +235,9 @@ namespace test {
 
     auto log_run_test_group(const TestGroup &test_group) -> void;
 
+    // Returns true if every test of every group succeeded
     template<size_t N>
-    auto log_combine_test_groups_results(std::array<TestGroupResult, N> test_group_results) -> void {
+    auto log_combine_test_groups_results(std::array<TestGroupResult, N> test_group_results) -> bool {
         u64 combined_success_counter = 0;
         u64 combined_test_group_size = 0;
 
@@ -100,5 +249,6 @@ namespace test {
         std::cout << "\n";
         std::cout << "Testing complete (combined result) [" << combined_success_counter << " / "
                   << combined_test_group_size << "].\n";
+        return combined_success_counter == combined_test_group_size;
     }
 }
\ No newline at end of file
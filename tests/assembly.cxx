@@ -1,11 +1,35 @@
 #include "assembly.hxx"
 
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
 
 #include "../assembly/assembly.hxx"
+#include "../assembly/elf/elf.hxx"
 #include "../jit/jit.hxx"
+#include "../jit/bench.hxx"
+#include "../jit/cache.hxx"
+#include "../jit/compile.hxx"
+#include "../jit/disk_cache.hxx"
+#include "../jit/instrument.hxx"
+#include "../jit/interpreter.hxx"
+#include "../jit/module.hxx"
+#include "../jit/patch.hxx"
+#include "../jit/profiler.hxx"
+#include "../jit/tiered.hxx"
+#include "../os/perf.hxx"
+#include "../os/stats.hxx"
+#include "../os/trace.hxx"
 #include "../test/test.hxx"
 #include "../assembly/parse/parse.hxx"
+#include "../assembly/corpus/corpus.hxx"
 
 using namespace std;
 
@@ -98,6 +122,22 @@ namespace tests {
                                   process, output_printer
                 ),
 
+                // bytecode test
+                // mov rax, [rbp]             ; mod 00 with rbp means RIP-relative, so a zero disp8 is used
+                // mov eax, [ebp]
+                // mov rax, [rbp + rcx * 2]   ; SIB base 101 with mod 00 means no base
+                // add [rbp + 8], rax
+                new bytecode_test("`rbp` base bytecode test",
+                                  move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                          "mov QWORD rax, [rbp]\n"
+                                          "mov DWORD eax, [ebp]\n"
+                                          "mov QWORD rax, [rbp + rcx * 2]\n"
+                                          "add QWORD [rbp + 8], rax\n")).data),
+                                  {0x48, 0x8b, 0x45, 0x00, 0x67, 0x8b, 0x45, 0x00, 0x48, 0x8b, 0x44, 0x4d, 0x00, 0x48,
+                                   0x01, 0x45, 0x08},
+                                  process, output_printer
+                ),
+
                 // bytecode test
                 // push rbx
                 // push 100
@@ -117,17 +157,374 @@ namespace tests {
                                    0x67, 0x8f, 0x44, 0x86, 0xf6},
                                   process, output_printer
                 ),
+
+                // bytecode test
+                // sub rax, 1000
+                // and al, 15
+                // xor esi, esi
+                // cmp dword [rbx], 5
+                // test eax, 4096
+                // lea rax, [rbx + rcx * 4 + 8]
+                // imul eax, ecx, 10
+                // sar eax, cl
+                // neg rcx
+                new bytecode_test("Integer ALU bytecode test",
+                                  move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                          "sub QWORD rax, 1000\n"
+                                          "and BYTE al, 15\n"
+                                          "xor DWORD esi, esi\n"
+                                          "cmp DWORD [rbx], 5\n"
+                                          "test DWORD eax, 4096\n"
+                                          "lea QWORD rax, [rbx + rcx * 4 + 8]\n"
+                                          "imul DWORD eax, ecx, 10\n"
+                                          "sar DWORD eax, cl\n"
+                                          "neg QWORD rcx\n")).data),
+                                  {0x48, 0x2d, 0xe8, 0x03, 0x00, 0x00, 0x24, 0x0f, 0x31, 0xf6, 0x83, 0x3b, 0x05, 0xa9,
+                                   0x00, 0x10, 0x00, 0x00, 0x48, 0x8d, 0x44, 0x8b, 0x08, 0x6b, 0xc1, 0x0a, 0xd3, 0xf8,
+                                   0x48, 0xf7, 0xd9},
+                                  process, output_printer
+                ),
+
+                // bytecode test
+                // popcnt rax, rcx
+                // tzcnt rdx, [rsp + 8]
+                // andn rax, rbx, rcx
+                // bextr eax, ecx, edx
+                // blsr rax, rcx
+                // pext eax, ebx, ecx
+                // cmovne rax, rcx
+                // setnle byte [rsi]
+                new bytecode_test("Bit manipulation and conditional bytecode test",
+                                  move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                          "popcnt QWORD rax, rcx\n"
+                                          "tzcnt QWORD rdx, [rsp + 8]\n"
+                                          "andn QWORD rax, rbx, rcx\n"
+                                          "bextr DWORD eax, ecx, edx\n"
+                                          "blsr QWORD rax, rcx\n"
+                                          "pext DWORD eax, ebx, ecx\n"
+                                          "cmovne QWORD rax, rcx\n"
+                                          "setnle BYTE [rsi]\n")).data),
+                                  {0xf3, 0x48, 0x0f, 0xb8, 0xc1, 0xf3, 0x48, 0x0f, 0xbc, 0x54, 0x24, 0x08, 0xc4, 0xe2,
+                                   0xe0, 0xf2, 0xc1, 0xc4, 0xe2, 0x68, 0xf7, 0xc1, 0xc4, 0xe2, 0xf8, 0xf3, 0xc9, 0xc4,
+                                   0xe2, 0x62, 0xf5, 0xc1, 0x48, 0x0f, 0x45, 0xc1, 0x0f, 0x9f, 0x06},
+                                  process, output_printer
+                ),
+
+                // bytecode test
+                // top:
+                // dec rcx
+                // jnz top   ; rel8
+                // jmp end   ; rel8
+                // call top  ; rel32
+                // loop top  ; rel8
+                // end:
+                // jmp rax
+                new bytecode_test("Branch bytecode test",
+                                  move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                          "top:\n"
+                                          "dec QWORD rcx\n"
+                                          "jnz top\n"
+                                          "jmp end\n"
+                                          "call top\n"
+                                          "loop top\n"
+                                          "end:\n"
+                                          "jmp QWORD rax\n")).data),
+                                  {0x48, 0xff, 0xc9, 0x75, 0xfb, 0xeb, 0x07, 0xe8, 0xf4, 0xff, 0xff, 0xff, 0xe2, 0xf2,
+                                   0xff, 0xe0},
+                                  process, output_printer
+                ),
+
+                // bytecode test
+                // mov eax, 1
+                // align 16  ; 9 byte and 2 byte NOPs
+                // ret
+                new bytecode_test("Alignment bytecode test",
+                                  move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                          "mov DWORD eax, 1\n"
+                                          "align 16\n"
+                                          "ret\n")).data),
+                                  {0xb8, 0x01, 0x00, 0x00, 0x00, 0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                   0x66, 0x90, 0xc3},
+                                  process, output_printer
+                ),
+
+                // bytecode test
+                // mov ecx, 5                 ; zero-extended imm32
+                // mov rdx, -2                ; sign-extended imm32
+                // mov rax, [rip + c]
+                // ret
+                // int3 * 4                   ; constant pool alignment
+                // c: dq 0x1122334455667788
+                new bytecode_test("Constant pool bytecode test",
+                                  move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                          "mov QWORD rcx, 5\n"
+                                          "mov QWORD rdx, -2\n"
+                                          "mov QWORD rax, [const 0x1122334455667788]\n"
+                                          "ret\n")).data),
+                                  {0xb9, 0x05, 0x00, 0x00, 0x00, 0x48, 0xc7, 0xc2, 0xfe, 0xff, 0xff, 0xff, 0x48, 0x8b,
+                                   0x05, 0x05, 0x00, 0x00, 0x00, 0xc3, 0xcc, 0xcc, 0xcc, 0xcc, 0x88, 0x77, 0x66, 0x55,
+                                   0x44, 0x33, 0x22, 0x11},
+                                  process, output_printer
+                ),
+
+                // bytecode test
+                // movdqu xmm0, [rax]
+                // movdqu [rsi+16], xmm1
+                // paddd xmm0, xmm1
+                // pxor xmm2, xmm2
+                // pmovmskb eax, xmm0
+                // pshufb xmm1, xmm2
+                // movq rax, xmm0
+                // movd xmm1, ecx
+                // movq xmm2, xmm1            ; zeroes the upper half of xmm2
+                new bytecode_test("SSE bytecode test",
+                                  move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                          "movdqu XMMWORD xmm0, [rax]\n"
+                                          "movdqu XMMWORD [rsi + 16], xmm1\n"
+                                          "paddd XMMWORD xmm0, xmm1\n"
+                                          "pxor XMMWORD xmm2, xmm2\n"
+                                          "pmovmskb XMMWORD eax, xmm0\n"
+                                          "pshufb XMMWORD xmm1, xmm2\n"
+                                          "movq XMMWORD rax, xmm0\n"
+                                          "movd XMMWORD xmm1, ecx\n"
+                                          "movq XMMWORD xmm2, xmm1\n")).data),
+                                  {0xf3, 0x0f, 0x6f, 0x00, 0xf3, 0x0f, 0x7f, 0x4e, 0x10, 0x66, 0x0f, 0xfe, 0xc1, 0x66,
+                                   0x0f, 0xef, 0xd2, 0x66, 0x0f, 0xd7, 0xc0, 0x66, 0x0f, 0x38, 0x00, 0xca, 0x66, 0x48,
+                                   0x0f, 0x7e, 0xc0, 0x66, 0x0f, 0x6e, 0xc9, 0xf3, 0x0f, 0x7e, 0xd1},
+                                  process, output_printer
+                ),
+
+                // bytecode test
+                // vmovdqu ymm0, [rax]
+                // vpaddd ymm0, ymm1, ymm2
+                // vpaddd xmm0, xmm1, [rsp+8]
+                // vpmovmskb eax, ymm1
+                // vpbroadcastd ymm0, xmm1
+                // vpbroadcastq ymm3, [rsp-8]
+                // vmovq rax, xmm0
+                // vmovq xmm0, xmm1           ; zeroes the upper half of xmm0
+                // vzeroupper
+                new bytecode_test("AVX bytecode test",
+                                  move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                          "vmovdqu YMMWORD ymm0, [rax]\n"
+                                          "vpaddd YMMWORD ymm0, ymm1, ymm2\n"
+                                          "vpaddd XMMWORD xmm0, xmm1, [rsp + 8]\n"
+                                          "vpmovmskb YMMWORD eax, ymm1\n"
+                                          "vpbroadcastd YMMWORD ymm0, xmm1\n"
+                                          "vpbroadcastq YMMWORD ymm3, [rsp + -8]\n"
+                                          "vmovq XMMWORD rax, xmm0\n"
+                                          "vmovq XMMWORD xmm0, xmm1\n"
+                                          "vzeroupper\n")).data),
+                                  {0xc5, 0xfe, 0x6f, 0x00, 0xc5, 0xf5, 0xfe, 0xc2, 0xc5, 0xf1, 0xfe, 0x44, 0x24, 0x08,
+                                   0xc5, 0xfd, 0xd7, 0xc1, 0xc4, 0xe2, 0x7d, 0x58, 0xc1, 0xc4, 0xe2, 0x7d, 0x59, 0x5c,
+                                   0x24, 0xf8, 0xc4, 0xe1, 0xf9, 0x7e, 0xc0, 0xc5, 0xfa, 0x7e, 0xc1, 0xc5, 0xf8, 0x77},
+                                  process, output_printer
+                ),
+
+                // movd needs exactly one xmm operand, movq at least one, and pmovmskb needs a general purpose
+                // destination. Other operand combinations have no encoding.
+                new test::BoolTest("Invalid vector transfer operands are rejected", []() -> bool {
+                    const char *sources[] = {
+                            "movd XMMWORD xmm0, xmm1\n",
+                            "movq XMMWORD rax, rcx\n",
+                            "vmovd XMMWORD xmm0, xmm1\n",
+                            "vmovq XMMWORD rax, rcx\n",
+                            "pmovmskb XMMWORD xmm0, xmm1\n",
+                            "vpmovmskb YMMWORD ymm0, ymm1\n",
+                    };
+                    for (const char *source : sources) {
+                        try {
+                            assembly::assemble(assembly::parse::unwrap_or_log_error(
+                                    assembly::parse::parse(source)).data);
+                            return false;
+                        } catch (logic_error &) {
+                        }
+                    }
+                    return true;
+                }),
         };
 
+        // `jmp b` does not fit in rel8 on the first pass. Growing it pushes `jnz a` out of rel8 range on the
+        // second pass, and the third pass confirms the layout. Only `jmp c` stays short.
+        tests.push_back(new test::BoolTest("Branch relaxation converges", []() -> bool {
+            string source = "a:\n"
+                            "jmp b\n";
+            for (u64 i = 0; i < 13; i++)
+                source += "mov QWORD [rsp + 8], 0x10000\n";
+            source += "mov DWORD eax, 1\n"
+                      "jnz a\n"
+                      "mov QWORD [rsp + 8], 0x10000\n"
+                      "b:\n"
+                      "jmp c\n"
+                      "c:\n"
+                      "ret\n";
+            assembly::assemble_result result = assembly::assemble_detailed(
+                    assembly::parse::unwrap_or_log_error(assembly::parse::parse(source)).data);
+            return result.relaxation_iterations == 3 && result.relaxation_bytes_saved == 3 &&
+                   result.code.size() == 145;
+        }));
+
+        // Threads intern overlapping names at the same time, every name gets exactly one label
+        tests.push_back(new test::BoolTest("Concurrent label interning", []() -> bool {
+            constexpr u64 thread_count = 4;
+            constexpr u64 name_count = 1000;
+            vector<vector<assembly::label_t>> labels(thread_count, vector<assembly::label_t>(name_count));
+            vector<thread> threads{};
+            for (u64 t = 0; t < thread_count; t++) {
+                threads.emplace_back([&labels, t]() {
+                    for (u64 n = 0; n < name_count; n++)
+                        labels[t][n] = assembly::intern_label("interned" + to_string(n));
+                });
+            }
+            for (thread &t: threads)
+                t.join();
+
+            bool ok = true;
+            for (u64 n = 0; n < name_count; n++) {
+                ok = ok && assembly::label_name(labels[0][n]) == "interned" + to_string(n);
+                for (u64 t = 1; t < thread_count; t++)
+                    ok = ok && labels[t][n] == labels[0][n];
+            }
+            return ok;
+        }));
+
+        // Equal constants share a pool entry, and the pool starts aligned to its largest constant
+        tests.push_back(new test::BoolTest("Constant pool deduplication", []() -> bool {
+            assembly::assemble_result result = assembly::assemble_detailed(
+                    assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                            "mov QWORD rax, [const 7]\n"
+                            "movdqu XMMWORD xmm0, [const 1, 2]\n"
+                            "add QWORD rax, [const 7]\n"
+                            "paddq XMMWORD xmm0, [const 1, 2]\n"
+                            "ret\n")).data);
+            return result.constant_count == 2 && result.constant_pool_offset % 16 == 0 &&
+                   result.code.size() == result.constant_pool_offset + 24;
+        }));
+
+        // External calls and constants become relocations, checked against GNU as output:
+        // R_X86_64_PLT32 helper - 4 at 1 and R_X86_64_PC32 .rodata - 4 at 8
+        tests.push_back(new test::BoolTest("Relocatable code and ELF object", []() -> bool {
+            vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                    "kernel:\n"
+                    "call helper\n"
+                    "add QWORD rax, [const 100]\n"
+                    "ret\n")).data;
+            assembly::assemble_options options{};
+            options.relocatable = true;
+            assembly::assemble_result result = assembly::assemble_detailed(mnemos, options);
+            bool relocations = result.relocations.size() == 2 &&
+                               result.relocations[0].offset == 1 && result.relocations[0].addend == -4 &&
+                               result.relocations[0].target == assembly::relocation_t::target_t::Label &&
+                               result.relocations[1].offset == 8 && result.relocations[1].addend == -4 &&
+                               result.relocations[1].target == assembly::relocation_t::target_t::Rodata &&
+                               result.code.size() == 13 && result.rodata.size() == 8;
+
+            vector<u8> object = assembly::elf::write_object(mnemos, {.exported = {"kernel"}});
+            string text(object.begin(), object.end());
+            bool header = text.substr(0, 4) == "\x7f" "ELF" && object[16] == 1 /* ET_REL */ && object[18] == 62;
+            bool names = text.find(string("kernel") + '\0') != string::npos &&
+                         text.find(string("helper") + '\0') != string::npos &&
+                         text.find(string(".rela.text") + '\0') != string::npos;
+            return relocations && header && names;
+        }));
+
+        // The rel32 of `jmp helper` is at 1, before the padding `align` inserts after it
+        tests.push_back(new test::BoolTest("Relocation of a branch followed by alignment padding", []() -> bool {
+            assembly::assemble_options options{};
+            options.relocatable = true;
+            assembly::assemble_result result = assembly::assemble_detailed(
+                    assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                            "jmp helper\n"
+                            "align 16\n"
+                            "ret\n")).data, options);
+            return result.relocations.size() == 1 && result.relocations[0].offset == 1 &&
+                   result.code.size() == 17;
+        }));
+
+        // The error block is moved to the end and `jle body` becomes `jg error`, so the loop takes one branch per
+        // iteration instead of two
+        tests.push_back(new test::BoolTest("Profile-guided block layout", []() -> bool {
+            vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                    "mov QWORD rcx, 100\n"
+                    "mov QWORD rax, 0\n"
+                    "top:\n"
+                    "cmp QWORD rcx, 1000\n"
+                    "jle body\n"
+                    "mov QWORD rax, -1\n"
+                    "ret\n"
+                    "body:\n"
+                    "add QWORD rax, rcx\n"
+                    "dec QWORD rcx\n"
+                    "jnz top\n"
+                    "ret\n")).data;
+            assembly::assemble_options options{};
+            options.block_counts = {1, 100, 0, 100, 1};
+            assembly::assemble_result result = assembly::assemble_detailed(mnemos, options);
+            return jit::eval_mc(result.code.data(), result.code.size()) == 5050 && result.layout.applied &&
+                   result.layout.taken_branches_before == 200 && result.layout.taken_branches_after == 100 &&
+                   result.layout.cold_block_count == 1 && result.code[result.code.size() - 1] == 0xc3;
+        }));
+
+        // Counted blocks of the loop above are exactly the profile of the layout test. Mnemo probes sit between
+        // `cmp` and `jle`, so a wrong result would mean they clobbered flags or `rax`.
+        tests.push_back(new test::BoolTest("Basic block and mnemo counters", []() -> bool {
+            vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                    "mov QWORD rcx, 100\n"
+                    "mov QWORD rax, 0\n"
+                    "top:\n"
+                    "cmp QWORD rcx, 1000\n"
+                    "jle body\n"
+                    "mov QWORD rax, -1\n"
+                    "ret\n"
+                    "body:\n"
+                    "add QWORD rax, rcx\n"
+                    "dec QWORD rcx\n"
+                    "jnz top\n"
+                    "ret\n")).data;
+            jit::instrumented_function_t blocks(mnemos);
+            jit::instrumented_function_t each_mnemo(mnemos, assembly::instrument_t::Mnemos);
+            if (blocks() != 5050 || blocks() != 5050 || each_mnemo() != 5050)
+                return false;
+            vector<u64> expected_mnemo_counts = {1, 1, 0, 100, 100, 0, 0, 0, 100, 100, 100, 1};
+            // Counters are on their own page, away from the instructions
+            assembly::assemble_result probed =
+                    assembly::assemble_detailed(mnemos, {.instrument = assembly::instrument_t::Blocks});
+            return blocks.get_counts() == vector<u64>{2, 200, 0, 200, 2} &&
+                   each_mnemo.get_counts() == expected_mnemo_counts &&
+                   assembly::assemble(mnemos).size() < blocks.get_function().get_size() &&
+                   probed.code.size() == blocks.get_function().get_size() &&
+                   probed.counter_offset % assembly::counter_alignment == 0 &&
+                   u64(blocks.get_function().get_code()) % assembly::counter_alignment == 0;
+        }));
+
+        // Loop head `top` is at offset 10. It is padded to 16 only when the padding fits in the budget,
+        // which is 1 byte with the default 10% of 17 bytes of code.
+        tests.push_back(new test::BoolTest("Auto alignment of loop heads", []() -> bool {
+            vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                    "mov DWORD eax, 0\n"
+                    "mov DWORD ecx, 5\n"
+                    "top:\n"
+                    "add DWORD eax, ecx\n"
+                    "dec DWORD ecx\n"
+                    "jnz top\n"
+                    "ret\n")).data;
+            assembly::assemble_options options{};
+            options.auto_align = true;
+            assembly::assemble_result over_budget = assembly::assemble_detailed(mnemos, options);
+            options.auto_align_budget_percent = 100;
+            assembly::assemble_result aligned = assembly::assemble_detailed(mnemos, options);
+            options.auto_align_max_skip = 5;
+            assembly::assemble_result over_max_skip = assembly::assemble_detailed(mnemos, options);
+            return over_budget.alignment_padding == 0 && over_budget.code.size() == 17 &&
+                   aligned.alignment_padding == 6 && aligned.code.size() == 23 && aligned.code[16] == 0x01 &&
+                   over_max_skip.alignment_padding == 0;
+        }));
+
         return test::run_test_group(tests);
     }
 
-    // Test group of tests that execute bytecode
-    static auto run_exec_tests() -> test::TestGroupResult {
-        auto process = [](const vector<mnemo_t> &mnemos) -> i64 {
-            vector<u8> bytecode = assembly::assemble(mnemos);
-            return jit::eval_mc(bytecode.data(), bytecode.size());
-        };
+    // Test group of tests that execute mnemos with `process`
+    static auto run_exec_tests(const function<i64(const vector<mnemo_t> &)> &process) -> test::TestGroupResult {
         auto output_printer = [](const i64 &num1) -> void {
             cout << "(" << num1 << ")";
         };
@@ -237,6 +634,353 @@ namespace tests {
                                       "mov BYTE [rsp + -8], 0\n"
                                       "mov QWORD rax, [rsp + -8]\n"
                                       "ret\n")).data), u64_to_i64(0xffffffff8f8f8f00), process, output_printer),
+
+                // Sign-extended imm8 form must not be used for 128..255.
+                //
+                // mov eax, 0
+                // add eax, 200
+                // ret
+                new exec_test("`add imm` above i8 range",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov DWORD eax, 0\n"
+                                      "add DWORD eax, 200\n"
+                                      "ret\n")).data), 200, process, output_printer),
+
+                // ((7 * 6 - 2) << 3 | 1) ^ 0xff = 0x1be
+                //
+                // mov rax, 7
+                // mov rcx, 6
+                // imul rax, rcx
+                // sub rax, 2
+                // shl rax, 3
+                // or rax, 1
+                // xor rax, 0xff
+                // ret
+                new exec_test("`imul/sub/shl/or/xor`",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov QWORD rax, 7\n"
+                                      "mov QWORD rcx, 6\n"
+                                      "imul QWORD rax, rcx\n"
+                                      "sub QWORD rax, 2\n"
+                                      "shl QWORD rax, 3\n"
+                                      "or QWORD rax, 1\n"
+                                      "xor QWORD rax, 0xFF\n"
+                                      "ret\n")).data), 0x1be, process, output_printer),
+
+                // lea rcx, [rax + rax * 2 + 5] computes 3 * rax + 5, neg/not/inc/dec/sar round trip.
+                //
+                // mov rax, 10
+                // lea rcx, [rax + rax * 2 + 5] ; 35
+                // imul rax, rcx, -3             ; -105
+                // sar rax, 1                    ; -53
+                // neg rax                       ; 53
+                // not rax                       ; -54
+                // inc rax                       ; -53
+                // dec rax                       ; -54
+                // ret
+                new exec_test("`lea/imul/sar/neg/not/inc/dec`",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov QWORD rax, 10\n"
+                                      "lea QWORD rcx, [rax + rax * 2 + 5]\n"
+                                      "imul QWORD rax, rcx, -3\n"
+                                      "sar QWORD rax, 1\n"
+                                      "neg QWORD rax\n"
+                                      "not QWORD rax\n"
+                                      "inc QWORD rax\n"
+                                      "dec QWORD rax\n"
+                                      "ret\n")).data), -54, process, output_printer),
+
+                // and/cmp/test only change flags or the masked value.
+                //
+                // mov rax, 0x1234
+                // and rax, 0xff0
+                // cmp rax, 0
+                // test rax, rax
+                // ret
+                new exec_test("`and/cmp/test`",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov QWORD rax, 0x1234\n"
+                                      "and QWORD rax, 0xFF0\n"
+                                      "cmp QWORD rax, 0\n"
+                                      "test QWORD rax, rax\n"
+                                      "ret\n")).data), 0x230, process, output_printer),
+
+                // Branchless max(rcx, rdx) with a flag materialized by setcc.
+                //
+                // mov rcx, 17
+                // mov rdx, 42
+                // mov rax, rcx
+                // cmp rcx, rdx
+                // cmovl rax, rdx       ; rax = 42
+                // setl cl              ; cl = 1
+                // shl rax, 1           ; rax = 84
+                // add al, cl           ; rax = 85
+                // ret
+                new exec_test("`cmovcc/setcc` max",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov QWORD rcx, 17\n"
+                                      "mov QWORD rdx, 42\n"
+                                      "mov QWORD rax, rcx\n"
+                                      "cmp QWORD rcx, rdx\n"
+                                      "cmovl QWORD rax, rdx\n"
+                                      "setl BYTE cl\n"
+                                      "shl QWORD rax, 1\n"
+                                      "add BYTE al, cl\n"
+                                      "ret\n")).data), 85, process, output_printer),
+
+                // Sum of 1..10
+                //
+                // mov rax, 0
+                // mov rcx, 10
+                // top:
+                // add rax, rcx
+                // dec rcx
+                // jnz top
+                // ret
+                new exec_test("`jnz` loop",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov QWORD rax, 0\n"
+                                      "mov QWORD rcx, 10\n"
+                                      "top:\n"
+                                      "add QWORD rax, rcx\n"
+                                      "dec QWORD rcx\n"
+                                      "jnz top\n"
+                                      "ret\n")).data), 55, process, output_printer),
+
+                // mov rax, 1
+                // call double
+                // call double
+                // ret
+                // double:
+                // add rax, rax
+                // ret
+                new exec_test("`call` local function",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov QWORD rax, 1\n"
+                                      "call double\n"
+                                      "call double\n"
+                                      "ret\n"
+                                      "double:\n"
+                                      "add QWORD rax, rax\n"
+                                      "ret\n")).data), 4, process, output_printer),
+
+                // mov rcx, 5
+                // mov rax, 0
+                // again:
+                // add rax, 3
+                // loop again
+                // cmp rax, 15
+                // je done
+                // mov rax, -1
+                // done:
+                // ret
+                new exec_test("`loop/je`",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov QWORD rcx, 5\n"
+                                      "mov QWORD rax, 0\n"
+                                      "again:\n"
+                                      "add QWORD rax, 3\n"
+                                      "loop again\n"
+                                      "cmp QWORD rax, 15\n"
+                                      "je done\n"
+                                      "mov QWORD rax, -1\n"
+                                      "done:\n"
+                                      "ret\n")).data), 15, process, output_printer),
+
+                // mov eax, 0
+                // mov ecx, 5
+                // align 16
+                // top:
+                // add eax, ecx
+                // dec ecx
+                // jnz top
+                // ret
+                new exec_test("`align` loop head",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov DWORD eax, 0\n"
+                                      "mov DWORD ecx, 5\n"
+                                      "align 16\n"
+                                      "top:\n"
+                                      "add DWORD eax, ecx\n"
+                                      "dec DWORD ecx\n"
+                                      "jnz top\n"
+                                      "ret\n")).data), 15, process, output_printer),
+
+                // The branch ends before the padding of `align`, so its displacement does not include it
+                // mov eax, 7
+                // jmp done
+                // align 16
+                // mov eax, 1
+                // done:
+                // ret
+                new exec_test("Branch followed by alignment padding",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov DWORD eax, 7\n"
+                                      "jmp done\n"
+                                      "align 16\n"
+                                      "mov DWORD eax, 1\n"
+                                      "done:\n"
+                                      "ret\n")).data), 7, process, output_printer),
+
+                // mov rax, [rip + c1]      ; 0x0000000100000002
+                // movdqu xmm0, [rip + c2]  ; {3, 4}
+                // paddq xmm0, [rip + c2]   ; {6, 8}
+                // movq rcx, xmm0
+                // add rax, rcx
+                // add rax, [rip + c1]
+                // ret
+                new exec_test("Constant pool loads",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov QWORD rax, [const 0x0000000100000002]\n"
+                                      "movdqu XMMWORD xmm0, [const 3, 4]\n"
+                                      "paddq XMMWORD xmm0, [const 3, 4]\n"
+                                      "movq XMMWORD rcx, xmm0\n"
+                                      "add QWORD rax, rcx\n"
+                                      "add QWORD rax, [const 0x0000000100000002]\n"
+                                      "ret\n")).data), 0x20000000a, process, output_printer),
+
+                // SSE2 is part of x86-64 baseline.
+                //
+                // mov rax, 0x0000000200000001
+                // mov [rsp - 16], rax
+                // mov rax, 0x0000000400000003
+                // mov [rsp - 8], rax
+                // movdqu xmm0, [rsp - 16]
+                // paddd xmm0, xmm0
+                // movq rax, xmm0
+                // ret
+                new exec_test("SSE `paddd`",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "mov QWORD rax, 0x0000000200000001\n"
+                                      "mov QWORD [rsp + -16], rax\n"
+                                      "mov QWORD rax, 0x0000000400000003\n"
+                                      "mov QWORD [rsp + -8], rax\n"
+                                      "movdqu XMMWORD xmm0, [rsp + -16]\n"
+                                      "paddd XMMWORD xmm0, xmm0\n"
+                                      "movq XMMWORD rax, xmm0\n"
+                                      "ret\n")).data), 0x0000000400000002, process, output_printer),
+
+                // pcmpeqb xmm0, xmm0
+                // pmovmskb eax, xmm0
+                // ret
+                new exec_test("SSE `pcmpeqb/pmovmskb`",
+                              move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                      "pcmpeqb XMMWORD xmm0, xmm0\n"
+                                      "pmovmskb XMMWORD eax, xmm0\n"
+                                      "ret\n")).data), 0xffff, process, output_printer),
+        };
+
+        if (__builtin_cpu_supports("popcnt")) {
+            // mov rcx, 0xf0f0
+            // popcnt rax, rcx
+            // ret
+            tests.push_back(new exec_test("`popcnt`",
+                                          move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                                  "mov QWORD rcx, 0xF0F0\n"
+                                                  "popcnt QWORD rax, rcx\n"
+                                                  "ret\n")).data), 8, process, output_printer));
+        }
+
+        if (__builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2")) {
+            // tzcnt(0x50) = 4, blsr(0x50) = 0x40, pext(0xff00, 0x0ff0) = 0xf0
+            //
+            // mov rcx, 0x50
+            // tzcnt rax, rcx        ; 4
+            // blsr rdx, rcx         ; 0x40
+            // add rax, rdx          ; 0x44
+            // mov rcx, 0xff00
+            // mov rdx, 0x0ff0
+            // pext rcx, rcx, rdx    ; 0xf0
+            // andn rdx, rdx, rcx    ; 0xf0 & ~0x0ff0 = 0
+            // add rax, rcx          ; 0x134
+            // add rax, rdx
+            // ret
+            tests.push_back(new exec_test("BMI `tzcnt/blsr/pext/andn`",
+                                          move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                                  "mov QWORD rcx, 0x50\n"
+                                                  "tzcnt QWORD rax, rcx\n"
+                                                  "blsr QWORD rdx, rcx\n"
+                                                  "add QWORD rax, rdx\n"
+                                                  "mov QWORD rcx, 0xFF00\n"
+                                                  "mov QWORD rdx, 0x0FF0\n"
+                                                  "pext QWORD rcx, rcx, rdx\n"
+                                                  "andn QWORD rdx, rdx, rcx\n"
+                                                  "add QWORD rax, rcx\n"
+                                                  "add QWORD rax, rdx\n"
+                                                  "ret\n")).data), 0x134, process, output_printer));
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+            // Upper half of the stored ymm0 overwrites the broadcast source.
+            //
+            // mov dword [rsp - 8], 7
+            // vpbroadcastd ymm0, [rsp - 8]
+            // vpaddd ymm0, ymm0, ymm0
+            // vmovdqu [rsp - 32], ymm0
+            // vzeroupper
+            // mov rax, [rsp - 8]
+            // ret
+            tests.push_back(new exec_test("AVX2 `vpbroadcastd/vpaddd`",
+                                          move(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                                  "mov DWORD [rsp + -8], 7\n"
+                                                  "vpbroadcastd YMMWORD ymm0, [rsp + -8]\n"
+                                                  "vpaddd YMMWORD ymm0, ymm0, ymm0\n"
+                                                  "vmovdqu YMMWORD [rsp + -32], ymm0\n"
+                                                  "vzeroupper\n"
+                                                  "mov QWORD rax, [rsp + -8]\n"
+                                                  "ret\n")).data), 0x0000000e0000000e, process, output_printer));
+        }
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    // Test group of tests for interpreter to native code promotion
+    static auto run_tiering_tests() -> test::TestGroupResult {
+        test::TestGroup tests = {
+                new test::BoolTest("Promotion after threshold", []() -> bool {
+                    jit::tiered_function_t f(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                            "mov QWORD rax, 1\n"
+                            "shl QWORD rax, 40\n"
+                            "ret\n")).data, {.promotion_threshold = 2});
+                    bool interpreted = f() == (i64(1) << 40) && f() == (i64(1) << 40) && !f.is_native();
+                    return interpreted && f() == (i64(1) << 40) && f.is_native() && f.get_call_count() == 3;
+                }),
+                new test::BoolTest("Vector mnemos run natively", []() -> bool {
+                    jit::tiered_function_t f(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                            "pxor XMMWORD xmm0, xmm0\n"
+                            "movq XMMWORD rax, xmm0\n"
+                            "ret\n")).data);
+                    return f() == 0 && f.is_native();
+                }),
+                // Threads cross the threshold together, the function is compiled once and every call is counted
+                new test::BoolTest("Concurrent calls during promotion", []() -> bool {
+                    constexpr u64 thread_count = 4;
+                    constexpr u64 calls_per_thread = 100;
+                    jit::tiered_function_t f(assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                            "mov QWORD rax, 5\n"
+                            "ret\n")).data, {.promotion_threshold = 50});
+                    stats_t before = stats_read();
+                    atomic<bool> ok = true;
+                    vector<thread> threads{};
+                    for (u64 t = 0; t < thread_count; t++) {
+                        threads.emplace_back([&]() {
+                            for (u64 c = 0; c < calls_per_thread; c++) {
+                                if (f() != 5)
+                                    ok = false;
+                            }
+                        });
+                    }
+                    for (thread &t: threads)
+                        t.join();
+                    return ok && f.is_native() && f.get_call_count() == thread_count * calls_per_thread &&
+                           stats_read().get(stat_t::CompileCount) - before.get(stat_t::CompileCount) == 1;
+                }),
         };
 
         auto results = test::run_test_group(tests);
@@ -248,7 +992,797 @@ namespace tests {
         return results;
     }
 
-    auto test_assembly() -> void {
-        test::log_combine_test_groups_results<2>({run_bytecode_tests(), run_exec_tests()});
+    // Test group of tests for background compilation
+    static auto run_compile_async_tests() -> test::TestGroupResult {
+        test::TestGroup tests = {
+                // Several threads submit jobs at the same time, each job returns its own index
+                new test::BoolTest("Concurrent `compile_async`", []() -> bool {
+                    constexpr u64 thread_count = 4;
+                    constexpr u64 jobs_per_thread = 16;
+                    vector<future<jit::function_t>> futures(thread_count * jobs_per_thread);
+                    vector<thread> threads{};
+                    for (u64 t = 0; t < thread_count; t++) {
+                        threads.emplace_back([&futures, t]() {
+                            for (u64 j = 0; j < jobs_per_thread; j++) {
+                                u64 index = t * jobs_per_thread + j;
+                                auto priority = j % 2 == 0 ? jit::compile_priority_t::Normal
+                                                           : jit::compile_priority_t::High;
+                                futures[index] = jit::compile_async(
+                                        "mov QWORD rax, " + to_string(index) + "\nret\n", priority);
+                            }
+                        });
+                    }
+                    for (thread &t: threads)
+                        t.join();
+
+                    bool ok = true;
+                    for (u64 i = 0; i < futures.size(); i++)
+                        ok = ok && futures[i].get()() == i64(i);
+                    return ok;
+                }),
+                // A High job is taken by an idle worker instead of waiting behind a long Normal compile
+                new test::BoolTest("`compile_async` High job overtakes a long Normal job", []() -> bool {
+                    if (thread::hardware_concurrency() <= 2) {
+                        cout << "The compiler pool has a single worker, skipping\n";
+                        return true;
+                    }
+                    string source = "mov QWORD rax, 0\n";
+                    for (u64 i = 0; i < 100000; i++)
+                        source += "add QWORD rax, 1\n";
+                    future<jit::function_t> slow = jit::compile_async(source + "ret\n");
+                    future<jit::function_t> fast = jit::compile_async(string("mov DWORD eax, 3\nret\n"),
+                                                                      jit::compile_priority_t::High);
+                    bool overtook = fast.get()() == 3 && slow.wait_for(chrono::seconds(0)) != future_status::ready;
+                    return slow.get()() == 100000 && overtook;
+                }),
+                new test::BoolTest("`compile_async` of mnemos", []() -> bool {
+                    future<jit::function_t> f = jit::compile_async(
+                            assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                    "mov DWORD eax, 7\n"
+                                    "ret\n")).data);
+                    return f.get()() == 7;
+                }),
+                new test::BoolTest("`compile_async` reports parsing errors", []() -> bool {
+                    future<jit::function_t> f = jit::compile_async(string("mov QWORD rax, ???\n"));
+                    try {
+                        f.get();
+                    } catch (const runtime_error &) {
+                        return true;
+                    }
+                    return false;
+                }),
+        };
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    // Test group of tests for profiler output
+    static auto run_perf_tests() -> test::TestGroupResult {
+        auto read_file = [](const filesystem::path &path) -> string {
+            ifstream file(path, ios::binary);
+            stringstream ss;
+            ss << file.rdbuf();
+            return ss.str();
+        };
+
+        test::TestGroup tests = {
+                new test::BoolTest("perf map and jitdump entries", [=]() -> bool {
+                    filesystem::path directory = filesystem::temp_directory_path() / "cplastane_perf_test";
+                    filesystem::create_directories(directory);
+                    perf_enable({.map = true, .jitdump = true, .directory = directory.string()});
+                    jit::function_t f = jit::compile(string("mov DWORD eax, 42\nret\n"), "perf_test_function");
+                    perf_disable();
+
+                    string pid = to_string(getpid());
+                    string map = read_file(directory / ("perf-" + pid + ".map"));
+                    string dump = read_file(directory / ("jit-" + pid + ".dump"));
+                    filesystem::remove_all(directory);
+
+                    stringstream line;
+                    line << hex << u64(f.get_code()) << " " << f.get_size() << " perf_test_function\n";
+                    string code(reinterpret_cast<const char *>(f.get_code()), f.get_size());
+                    return f() == 42 && map.find(line.str()) != string::npos && dump.substr(0, 4) == "DTiJ" &&
+                           dump.find(string("perf_test_function") + '\0' + code) != string::npos;
+                }),
+        };
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    // Test group of tests for patchable function entries
+    static auto run_patch_tests() -> test::TestGroupResult {
+        auto returning = [](i64 n) -> jit::function_t {
+            return jit::compile("mov QWORD rax, " + to_string(n) + "\nret\n");
+        };
+
+        test::TestGroup tests = {
+                new test::BoolTest("Patched entry runs new code", [=]() -> bool {
+                    jit::patchable_function_t f(returning(1));
+                    jit::jit_func_t entry = f.get_entry();
+                    bool before = entry() == 1;
+
+                    u64 freed_inside_guard;
+                    {
+                        // The old code may still be running while this thread is inside a guard
+                        jit::epoch_guard_t guard;
+                        f.patch(returning(2));
+                        freed_inside_guard = jit::reclaim_retired_code();
+                    }
+                    u64 freed_after_guard = jit::reclaim_retired_code();
+                    return before && entry() == 2 && f() == 2 && freed_inside_guard == 0 && freed_after_guard == 1;
+                }),
+                // Callers never see an older version than the one they saw last
+                new test::BoolTest("Concurrent calls and patches", [=]() -> bool {
+                    constexpr i64 patch_count = 200;
+                    jit::patchable_function_t f(returning(0));
+                    atomic<bool> ok = true;
+                    vector<thread> callers{};
+                    for (u64 t = 0; t < 3; t++) {
+                        callers.emplace_back([&]() {
+                            i64 last = 0;
+                            while (last != patch_count) {
+                                i64 n = f();
+                                if (n < last || n > patch_count)
+                                    ok = false;
+                                last = n;
+                            }
+                        });
+                    }
+                    for (i64 i = 1; i <= patch_count; i++)
+                        f.patch(returning(i));
+                    for (thread &t: callers)
+                        t.join();
+                    jit::reclaim_retired_code();
+                    return ok;
+                }),
+        };
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    // Test group of tests for the microbenchmark runner
+    static auto run_bench_tests() -> test::TestGroupResult {
+        auto parse = [](const string &source) -> vector<mnemo_t> {
+            return assembly::parse::unwrap_or_log_error(assembly::parse::parse(source)).data;
+        };
+        jit::bench_options options = {.unroll_count = 10, .loop_count = 10, .warmup_count = 1,
+                                      .measurement_count = 11};
+
+        test::TestGroup tests = {
+                new test::BoolTest("Bench of a dependent chain", [=]() -> bool {
+                    jit::bench_result result = jit::bench(parse("imul QWORD rax, rcx\n"), options);
+                    // Hardware counters depend on the environment, only check them when they are available
+                    bool instructions_ok = !result.instructions.available ||
+                                           (result.instructions.median > 0.5 && result.instructions.median < 1.5);
+                    return result.tsc.available && result.tsc.median > 0 && result.ns.available && instructions_ok;
+                }),
+                new test::BoolTest("Bench rejects unrolled labels", [=]() -> bool {
+                    try {
+                        jit::bench(parse("l:\njmp l\n"), options);
+                        return false;
+                    } catch (logic_error &) {
+                        return true;
+                    }
+                }),
+        };
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    // Test group of tests for JIT statistics
+    static auto run_stats_tests() -> test::TestGroupResult {
+        static const char *arena_source = "arena_loop:\n"
+                                          "add QWORD rax, [rbx + rcx * 8 + 16]\n"
+                                          "sub QWORD rcx, 1\n"
+                                          "jnz arena_loop\n"
+                                          "ret\n";
+        test::TestGroup tests = {
+                new test::BoolTest("Allocation, compile and call counts", []() -> bool {
+                    stats_t before = stats_read();
+                    stats_t during{};
+                    {
+                        jit::function_t f = jit::compile("mov QWORD rax, 1\nret\n");
+                        f();
+                        f();
+                        during = stats_read();
+                    }
+                    stats_t after = stats_read();
+
+                    auto delta = [&](const stats_t &stats, stat_t stat) -> i64 {
+                        return i64(stats.get(stat) - before.get(stat));
+                    };
+                    auto phase_delta = [&](const stats_t &stats, compile_phase_t phase) -> u64 {
+                        return stats.latencies[size_t(phase)].count - before.latencies[size_t(phase)].count;
+                    };
+                    return delta(during, stat_t::CompileCount) == 1 && delta(during, stat_t::AllocCount) == 1 &&
+                           delta(during, stat_t::NativeCallCount) == 2 &&
+                           during.get(stat_t::BytesCommitted) >= during.get(stat_t::BytesUsed) &&
+                           delta(during, stat_t::BytesUsed) > 0 &&
+                           during.get_live_blocks() == before.get_live_blocks() + 1 &&
+                           phase_delta(during, compile_phase_t::Parse) == 1 &&
+                           phase_delta(during, compile_phase_t::Assemble) == 1 &&
+                           phase_delta(during, compile_phase_t::Load) == 1 &&
+                           delta(after, stat_t::FreeCount) == 1 && delta(after, stat_t::BytesUsed) == 0 &&
+                           after.get_live_blocks() == before.get_live_blocks();
+                }),
+                // Instrumented code has a mapping of its own for its counters, accounted like any other block
+                new test::BoolTest("Instrumented function allocation counts", []() -> bool {
+                    vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                            "mov QWORD rax, 1\nret\n")).data;
+                    stats_t before = stats_read();
+                    stats_t during{};
+                    {
+                        jit::instrumented_function_t f(mnemos);
+                        if (f() != 1)
+                            return false;
+                        during = stats_read();
+                    }
+                    stats_t after = stats_read();
+                    auto delta = [&](const stats_t &stats, stat_t stat) -> i64 {
+                        return i64(stats.get(stat) - before.get(stat));
+                    };
+                    return delta(during, stat_t::AllocCount) == 1 && delta(during, stat_t::BytesUsed) > 0 &&
+                           delta(after, stat_t::FreeCount) == 1 && delta(after, stat_t::BytesUsed) == 0 &&
+                           delta(after, stat_t::BytesCommitted) == 0;
+                }),
+                // Every thread frees the blocks compiled by the next one, through its arena's remote free stack
+                new test::BoolTest("Executable blocks freed on other threads", []() -> bool {
+                    constexpr u64 thread_count = 4;
+                    constexpr i64 function_count = 200;
+                    u64 live_before = stats_read().get_live_blocks();
+                    vector<vector<jit::function_t>> compiled(thread_count);
+                    atomic<bool> ok = true;
+                    auto run = [&](auto body) {
+                        vector<thread> threads{};
+                        for (u64 t = 0; t < thread_count; t++)
+                            threads.emplace_back(body, t);
+                        for (thread &t: threads)
+                            t.join();
+                    };
+                    for (u64 round = 0; round < 3; round++) {
+                        run([&](u64 t) {
+                            for (i64 i = 0; i < function_count; i++) {
+                                // Different sizes land in different size classes
+                                string source = "mov QWORD rax, " + to_string(i) + "\n";
+                                for (i64 j = 0; j < i % 40; j++)
+                                    source += "add QWORD rax, 0\n";
+                                compiled[t].push_back(jit::compile(source + "ret\n"));
+                            }
+                        });
+                        run([&](u64 t) {
+                            vector<jit::function_t> &functions = compiled[(t + 1) % thread_count];
+                            for (i64 i = 0; i < function_count; i++) {
+                                if (functions[i]() != i)
+                                    ok = false;
+                            }
+                            functions.clear();
+                        });
+                    }
+                    return ok && stats_read().get_live_blocks() == live_before;
+                }),
+                // 40 KB functions take 64 KiB blocks and fill several chunks, which are unmapped again once every block
+                // in them is freed
+                new test::BoolTest("Empty chunks are returned to the OS", []() -> bool {
+                    u64 committed_before = stats_read().get(stat_t::BytesCommitted);
+                    u64 committed_during = 0;
+                    thread([&]() {
+                        string source{};
+                        for (u64 i = 0; i < 8000; i++)
+                            source += "mov QWORD rax, 1\n";
+                        vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(
+                                assembly::parse::parse(source + "ret\n")).data;
+                        vector<jit::function_t> functions{};
+                        for (u64 i = 0; i < 64; i++)
+                            functions.push_back(jit::compile(mnemos));
+                        committed_during = stats_read().get(stat_t::BytesCommitted);
+                    }).join();
+                    // The last chunk stays with the abandoned arena
+                    u64 committed_after = stats_read().get(stat_t::BytesCommitted);
+                    return committed_during >= committed_before + 3 * 1024 * 1024 &&
+                           committed_after <= committed_before + 1024 * 1024;
+                }),
+                new test::BoolTest("Counters of exited threads are kept", []() -> bool {
+                    u64 before = stats_read().get(stat_t::CompileCount);
+                    thread([]() { jit::compile("ret\n"); }).join();
+                    return stats_read().get(stat_t::CompileCount) == before + 1 &&
+                           stats_format(stats_read()).find("cplastane_jit_compile_count ") != string::npos;
+                }),
+                new test::AllocationTest("Calls of compiled code do not allocate", 0, [f = make_shared<jit::function_t>(
+                        jit::compile("mov QWORD rax, 1\nret\n"))]() {
+                    for (u64 i = 0; i < 100; i++)
+                        (*f)();
+                }),
+                // Budgets are the current counts, so they catch regressions
+                new test::AllocationTest("Parsing a line", 1, []() {
+                    (void) assembly::parse::parse("mov QWORD rax, [rbx + rcx * 8 + 16]\n");
+                }),
+                new test::AllocationTest("Assembling 50 mnemos", 15, [mnemos = vector<mnemo_t>(
+                        50, assembly::parse::unwrap_or_log_error(assembly::parse::parse(
+                                "add QWORD rax, [rbx + rcx * 8 + 16]\n")).data[0])]() {
+                    (void) assembly::assemble(mnemos);
+                }),
+                // Once labels are interned, parsing and assembling into a reused arena stays off the global heap
+                new test::TimedTest(new test::AllocationTest("Parsing and assembling into an arena", 0, [arena = []() {
+                    // Warm up interns the label before measuring
+                    auto buffer = make_shared<vector<u8>>(1 << 16);
+                    auto resource = make_shared<pmr::monotonic_buffer_resource>(
+                            buffer->data(), buffer->size(), pmr::null_memory_resource());
+                    (void) assembly::parse::parse(arena_source, resource.get());
+                    resource->release();
+                    return make_tuple(buffer, resource);
+                }()]() {
+                    pmr::monotonic_buffer_resource &resource = *get<1>(arena);
+                    for (u64 i = 0; i < 10; i++) {
+                        {
+                            auto parsed = assembly::parse::parse(arena_source, &resource);
+                            if (!parsed)
+                                throw logic_error("parsing error");
+                            pmr::vector<u8> code = assembly::assemble(parsed.value().data, &resource);
+                            if (code.empty())
+                                throw logic_error("empty code");
+                        }
+                        resource.release();
+                    }
+                }), 20),
+                // Phases of a compilation on another thread end up on their own track, each span nested in the
+                // thread's timeline without overlapping its siblings
+                new test::BoolTest("Trace spans", []() -> bool {
+                    trace_start();
+                    thread([]() { jit::compile("mov QWORD rax, 1\nret\n")(); }).join();
+                    vector<u8> code = assembly::assemble(assembly::parse::unwrap_or_log_error(
+                            assembly::parse::parse("mov QWORD rax, 2\nret\n")).data);
+                    i64 result = jit::eval_mc(code.data(), code.size());
+                    trace_stop();
+                    jit::compile("ret\n");
+                    vector<trace_event_t> events = trace_read();
+                    string json = trace_format_chrome(events);
+#ifdef CPLASTANE_TRACING
+                    auto count = [&](const string &name, u32 thread) -> u64 {
+                        return u64(count_if(events.begin(), events.end(), [&](const trace_event_t &event) {
+                            return event.name == name && event.thread == thread;
+                        }));
+                    };
+                    if (events.empty())
+                        return false;
+                    u32 other = events.front().thread;
+                    u32 main_thread = events.back().thread;
+                    for (u64 i = 0; i + 1 < events.size(); i++) {
+                        const trace_event_t &a = events[i], &b = events[i + 1];
+                        bool nested = b.start_ns + b.duration_ns <= a.start_ns + a.duration_ns;
+                        if (a.thread == b.thread && b.start_ns < a.start_ns + a.duration_ns && !nested)
+                            return false;
+                    }
+                    return result == 2 && other != main_thread &&
+                           count("parse", other) == 1 && count("assemble", other) == 1 &&
+                           count("arena_alloc", other) == 1 && count("copy", other) == 1 &&
+                           count("execute", other) == 1 && count("parse", main_thread) == 1 &&
+                           count("execute", main_thread) == 1 && json.find("\"ph\":\"X\"") != string::npos;
+#else
+                    return result == 2 && events.empty() && json.find("\"traceEvents\":[") != string::npos;
+#endif
+                }),
+                new test::BoolTest("Heap allocations per compile phase", []() -> bool {
+                    string source = "mov QWORD rax, 0\n";
+                    for (u64 i = 0; i < 50; i++)
+                        source += "l" + to_string(i) + ":\nadd QWORD rax, " + to_string(i) + "\n";
+                    stats_t before = stats_read();
+                    i64 result = jit::compile(source + "ret\n")();
+                    stats_t after = stats_read();
+                    auto delta = [&](compile_phase_t phase) -> phase_allocations_t {
+                        const phase_allocations_t &a = after.allocations[size_t(phase)];
+                        const phase_allocations_t &b = before.allocations[size_t(phase)];
+                        return {a.allocations - b.allocations, a.bytes - b.bytes, a.items - b.items};
+                    };
+                    phase_allocations_t parse = delta(compile_phase_t::Parse);
+                    phase_allocations_t assemble = delta(compile_phase_t::Assemble);
+                    phase_allocations_t load = delta(compile_phase_t::Load);
+                    bool counted = heap_accounting_enabled ? parse.allocations > 0 && assemble.allocations > 0
+                                                           : parse.allocations == 0 && assemble.allocations == 0;
+                    return result == 1225 && counted && parse.items == 102 && assemble.items == 102 &&
+                           load.items == 1 && load.allocations == 0 &&
+                           stats_format(after).find("cplastane_jit_phase_allocations{phase=\"parse\"}") != string::npos;
+                }),
+                new test::BoolTest("Empty over-aligned allocation", []() -> bool {
+                    void *mem = ::operator new(0, std::align_val_t(64));
+                    bool aligned = mem != nullptr && u64(mem) % 64 == 0;
+                    ::operator delete(mem, std::align_val_t(64));
+                    return aligned;
+                }),
+        };
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    // Test group of tests for the code cache
+    static auto run_cache_tests() -> test::TestGroupResult {
+        auto returning = [](i64 n) -> string {
+            return "mov QWORD rax, " + to_string(n) + "\nret\n";
+        };
+
+        test::TestGroup tests = {
+                new test::BoolTest("Hits and least recently used eviction", [=]() -> bool {
+                    // `mov eax, imm32; ret` and the trap are 8 bytes, so two blocks fit
+                    jit::code_cache_t cache({.byte_budget = 16});
+                    // Separate statements, so no handle is alive when the next block is inserted
+                    bool calls = (*cache.get(returning(1)))() == 1;
+                    calls = calls && (*cache.get(returning(2)))() == 2;
+                    calls = calls && (*cache.get(returning(1)))() == 1;
+                    calls = calls && (*cache.get(returning(3)))() == 3;
+                    // 2 was least recently used
+                    jit::code_cache_stats before = cache.get_stats();
+                    cache.get(returning(1));
+                    cache.get(returning(2));
+                    jit::code_cache_stats after = cache.get_stats();
+                    return calls && before.hits == 1 && before.misses == 3 && before.evictions == 1 &&
+                           before.byte_count == 16 && after.hits == 2 && after.misses == 4 && after.evictions == 2;
+                }),
+                new test::BoolTest("Pinned blocks are not evicted", [=]() -> bool {
+                    jit::code_cache_t cache({.byte_budget = 8});
+                    jit::code_handle_t pinned = cache.get(returning(1));
+                    cache.get(returning(2));
+                    jit::code_cache_stats over_budget = cache.get_stats();
+                    pinned.reset();
+                    cache.trim();
+                    jit::code_cache_stats trimmed = cache.get_stats();
+                    return over_budget.entry_count == 2 && over_budget.evictions == 0 && trimmed.entry_count == 1 &&
+                           trimmed.byte_count == 8 && (*cache.get(returning(2)))() == 2 && cache.get_stats().hits == 1;
+                }),
+                new test::BoolTest("Disk cache survives reopening", [=]() -> bool {
+                    filesystem::path directory = filesystem::temp_directory_path() / "cplastane_disk_cache_test";
+                    filesystem::remove_all(directory);
+                    jit::disk_cache_stats cold{};
+                    {
+                        jit::disk_cache_t cache(directory.string());
+                        cache.compile(returning(1));
+                        cache.compile(returning(2));
+                        cold = cache.get_stats();
+                    }
+                    jit::disk_cache_t cache(directory.string());
+                    bool calls = cache.compile(returning(1))() == 1 && cache.compile(returning(2))() == 2;
+                    jit::disk_cache_stats warm = cache.get_stats();
+                    filesystem::remove_all(directory);
+                    return calls && cold.misses == 2 && cold.loaded == 0 && warm.loaded == 2 && warm.hits == 2 &&
+                           warm.misses == 0 && warm.skipped == 0;
+                }),
+                new test::BoolTest("Disk cache skips corrupt entries", [=]() -> bool {
+                    filesystem::path directory = filesystem::temp_directory_path() / "cplastane_disk_cache_test";
+                    filesystem::path file = directory / "code.cache";
+                    filesystem::remove_all(directory);
+                    {
+                        jit::disk_cache_t cache(directory.string());
+                        cache.compile(returning(1));
+                    }
+                    {
+                        // Flip a code byte of the first record and leave a torn record at the end
+                        fstream stream(file, ios::in | ios::out | ios::binary);
+                        stream.seekp(16 + 56);
+                        stream.put(char(0x90));
+                        stream.seekp(0, ios::end);
+                        stream.write("\x43\x4f\x44\x45\x01", 5);
+                    }
+                    jit::disk_cache_stats loaded{};
+                    bool call;
+                    {
+                        jit::disk_cache_t cache(directory.string());
+                        loaded = cache.get_stats();
+                        call = cache.compile(returning(1))() == 1;
+                    }
+                    jit::disk_cache_t cache(directory.string());
+                    bool call_after_rewrite = cache.compile(returning(1))() == 1;
+                    jit::disk_cache_stats reopened = cache.get_stats();
+                    filesystem::remove_all(directory);
+                    // The torn record stays in the file and is skipped again
+                    return call && call_after_rewrite && loaded.loaded == 1 && loaded.skipped == 1 &&
+                           reopened.loaded == 2 && reopened.skipped == 1 && reopened.hits == 1;
+                }),
+                // Records of 64 bytes start at 16, 80 and 144. The first one gets a wrong code size, which its checksum
+                // covers, and the second one a bad magic. The third one is still found.
+                new test::BoolTest("Disk cache skips corrupt records in the middle", [=]() -> bool {
+                    filesystem::path directory = filesystem::temp_directory_path() / "cplastane_disk_cache_test";
+                    filesystem::path file = directory / "code.cache";
+                    filesystem::remove_all(directory);
+                    {
+                        jit::disk_cache_t cache(directory.string());
+                        for (i64 i = 1; i <= 3; i++)
+                            cache.compile(returning(i));
+                    }
+                    {
+                        fstream stream(file, ios::in | ios::out | ios::binary);
+                        stream.seekp(16 + 8);
+                        stream.put(0);
+                        stream.seekp(80);
+                        stream.put(0);
+                    }
+                    jit::disk_cache_t cache(directory.string());
+                    bool calls = cache.compile(returning(1))() == 1 && cache.compile(returning(2))() == 2 &&
+                                 cache.compile(returning(3))() == 3;
+                    jit::disk_cache_stats stats = cache.get_stats();
+                    filesystem::remove_all(directory);
+                    return calls && stats.loaded == 2 && stats.skipped == 2 && stats.hits == 1 && stats.misses == 2;
+                }),
+                // A file of an other format is replaced by a new file, a reader of the old one still sees all of it
+                new test::BoolTest("Disk cache replaces a file of an other format", [=]() -> bool {
+                    filesystem::path directory = filesystem::temp_directory_path() / "cplastane_disk_cache_test";
+                    filesystem::path file = directory / "code.cache";
+                    filesystem::remove_all(directory);
+                    filesystem::create_directories(directory);
+                    ofstream(file, ios::binary) << string(4096, 'x');
+                    ifstream old_file(file, ios::binary);
+                    bool call;
+                    {
+                        jit::disk_cache_t cache(directory.string());
+                        call = cache.compile(returning(1))() == 1;
+                    }
+                    string old_contents((istreambuf_iterator<char>(old_file)), istreambuf_iterator<char>());
+                    jit::disk_cache_t cache(directory.string());
+                    bool hit = cache.compile(returning(1))() == 1;
+                    jit::disk_cache_stats stats = cache.get_stats();
+                    u64 entries = 0;
+                    for (const filesystem::directory_entry &entry: filesystem::directory_iterator(directory))
+                        entries++;
+                    filesystem::remove_all(directory);
+                    return call && hit && old_contents == string(4096, 'x') && stats.loaded == 1 &&
+                           stats.skipped == 0 && entries == 1;
+                }),
+        };
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    // Test group of tests for module linking
+    static auto run_module_tests() -> test::TestGroupResult {
+        auto function = [](const string &name, const string &source) -> jit::module_function_t {
+            return {name, assembly::parse::unwrap_or_log_error(assembly::parse::parse(source)).data};
+        };
+
+        test::TestGroup tests = {
+                new test::BoolTest("Calls between module functions", [=]() -> bool {
+                    jit::module_t module = jit::link_module({
+                            function("main", "mov QWORD rdi, 7\n"
+                                             "call square\n"
+                                             "add QWORD rax, [const 1]\n"
+                                             "ret\n"),
+                            function("square", "mov QWORD rax, rdi\n"
+                                               "imul QWORD rax, rdi\n"
+                                               "jmp add_ten\n"),
+                            function("add_ten", "add QWORD rax, [const 10]\n"
+                                                "ret\n"),
+                    });
+                    bool aligned = true;
+                    for (const char *name: {"main", "square", "add_ten"})
+                        aligned = aligned && u64(module.get_entry(name)) % 16 == 0;
+                    // Contiguous layout: main at 0 (19 bytes), square at 32 (12 bytes), add_ten at 48 (8 bytes),
+                    // then 16 bytes of constants
+                    return module("main") == 60 && aligned && module.get_code().get_size() == 72;
+                }),
+                new test::BoolTest("Profile-guided module layout", [=]() -> bool {
+                    vector<jit::module_function_t> functions = {
+                            function("unused", "mov QWORD rax, 7\n"
+                                               "ret\n"),
+                            function("add_one", "add QWORD rax, 1\n"
+                                                "ret\n"),
+                            function("main", "mov QWORD rcx, 10\n"
+                                             "mov QWORD rax, 0\n"
+                                             "top:\n"
+                                             "cmp QWORD rcx, 1000\n"
+                                             "jle body\n"
+                                             "mov QWORD rax, -1\n"
+                                             "ret\n"
+                                             "body:\n"
+                                             "call add_one\n"
+                                             "dec QWORD rcx\n"
+                                             "jnz top\n"
+                                             "ret\n"),
+                    };
+                    jit::module_layout_t layout = jit::layout_module(
+                            functions, {{"main", {1, 10, 0, 10, 1}}, {"add_one", {10}}});
+                    vector<string> names{};
+                    for (const jit::module_function_t &f: layout.functions)
+                        names.push_back(f.name);
+                    jit::module_t module = jit::link_module(layout.functions);
+                    return names == vector<string>{"add_one", "main", "unused", "main.cold"} && module("main") == 10 &&
+                           layout.report.cold_block_count == 1;
+                }),
+                new test::BoolTest("Calls to unknown functions are rejected", [=]() -> bool {
+                    try {
+                        jit::link_module({function("main", "call missing\nret\n")});
+                        return false;
+                    } catch (logic_error &) {
+                        return true;
+                    }
+                }),
+        };
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    static auto run_profiler_tests() -> test::TestGroupResult {
+        test::TestGroup tests = {
+                // `mov` takes 5 bytes, `add` 7 and `ret` 1. The label takes no bytes and the int3 gap before the
+                // constant is not code. With probes, every mnemo has 7 probe instructions mapped to it.
+                new test::BoolTest("Source map", []() -> bool {
+                    string source = "mov DWORD eax, 1\n"
+                                    "end:\n"
+                                    "add QWORD rax, [const 2]\n"
+                                    "ret\n";
+                    assembly::parse::parsed_source_t parsed = assembly::parse::unwrap_or_log_error(
+                            assembly::parse::parse_with_source_offsets(source)).data;
+                    assembly::assemble_options options{};
+                    options.source_map = true;
+                    options.source_offsets = parsed.source_offsets;
+                    assembly::source_map_t map = assembly::assemble_detailed(parsed.mnemos, options).source_map;
+                    options.instrument = assembly::instrument_t::Mnemos;
+                    assembly::source_map_t probed = assembly::assemble_detailed(parsed.mnemos, options).source_map;
+                    return parsed.source_offsets == vector<u64>{0, 17, 22, 47} && map.entries.size() == 3 &&
+                           map.code_size == 13 && map.find_mnemo(0) == 0 && map.find_mnemo(4) == 0 &&
+                           map.find_mnemo(5) == 2 && map.find_source_offset(12) == 47 && map.find_mnemo(13) == -1 &&
+                           probed.entries.size() == 3 * 8 && probed.find_mnemo(0) == 0 &&
+                           probed.find_mnemo(probed.code_size - 1) == 3 && probed.find_mnemo(probed.code_size - 2) == 3;
+                }),
+
+                // Nearly all CPU time is spent in the loop, so the samples that hit generated code land on its lines
+                new test::BoolTest("Sampling profiler", []() -> bool {
+                    jit::profiler_t profiler{};
+                    jit::function_t spin = profiler.compile("mov QWORD rcx, 400000000\n"
+                                                            "top:\n"
+                                                            "add QWORD rax, rcx\n"
+                                                            "dec QWORD rcx\n"
+                                                            "jnz top\n"
+                                                            "ret\n", "spin");
+                    if (!profiler.start({.interval_us = 1000})) {
+                        cout << "Sampling is unavailable, skipping\n";
+                        return true;
+                    }
+                    spin();
+                    jit::profile_t profile = profiler.stop();
+                    u64 in_loop = 0;
+                    for (const jit::profile_entry_t &entry: profile.entries) {
+                        if (entry.function != "spin" || entry.line < 3 || entry.line > 5)
+                            return false;
+                        in_loop += entry.samples;
+                    }
+                    if (in_loop == 0 || in_loop * 2 <= profile.sample_count)
+                        return false;
+
+                    // One line per entry, hottest first, naming the function, line and source
+                    ostringstream flat;
+                    profile.print_flat(flat);
+                    istringstream lines(flat.str());
+                    string line;
+                    for (const jit::profile_entry_t &entry: profile.entries) {
+                        string location = "%  spin:" + to_string(entry.line) + "  " + entry.text;
+                        if (!getline(lines, line) || line.find(location) == string::npos ||
+                            stoull(line) != entry.samples)
+                            return false;
+                    }
+                    return !getline(lines, line);
+                }),
+        };
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    // Random programs over every form the assembler accepts, see assembly/corpus/corpus.hxx
+    static auto run_corpus_tests() -> test::TestGroupResult {
+        test::TestGroup tests = {
+                // Generated once, so only parsing and assembling are timed
+                new test::TimedTest(new test::BoolTest("Generated corpus parses and assembles", [
+                        corpus = assembly::corpus::generate_corpus({.line_count = 5000})]() -> bool {
+                    vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(
+                            assembly::parse::parse(corpus.source)).data;
+                    u64 instruction_count = count_if(mnemos.begin(), mnemos.end(), [](const mnemo_t &mnemo) {
+                        return mnemo.tag != mnemo_t::tag_t::Label;
+                    });
+                    vector<u8> code = assembly::assemble(mnemos);
+                    return instruction_count == corpus.line_count + 1 && !code.empty();
+                }), 5),
+
+                // Forward branches, alignment and constants of many shapes mixed in one function. Programs without
+                // vector forms return the same value as the interpreter, the others the same value on every call.
+                new test::BoolTest("Generated executable corpora run", []() -> bool {
+                    for (u64 seed = 1; seed <= 100; seed++) {
+                        assembly::corpus::corpus_t corpus = assembly::corpus::generate_corpus({
+                                .line_count = 256,
+                                .seed = seed,
+                                .executable = true,
+                                .interpretable = true,
+                        });
+                        vector<mnemo_t> mnemos = assembly::parse::unwrap_or_log_error(
+                                assembly::parse::parse(corpus.source)).data;
+                        if (!jit::is_interpretable(mnemos))
+                            return false;
+                        i64 native = jit::compile(mnemos)();
+                        i64 interpreted = jit::interpret(mnemos);
+                        if (native != interpreted) {
+                            cout << "Seed " << seed << " returned " << native << ", interpreted " << interpreted
+                                 << "\n";
+                            return false;
+                        }
+                    }
+                    for (u64 seed = 1; seed <= 20; seed++) {
+                        jit::function_t f = jit::compile(assembly::corpus::generate_corpus({
+                                .line_count = 256,
+                                .seed = seed,
+                                .executable = true,
+                        }).source);
+                        if (f() != f())
+                            return false;
+                    }
+                    return true;
+                }),
+        };
+
+        auto results = test::run_test_group(tests);
+
+        for (auto &test : tests) {
+            delete test;
+        }
+
+        return results;
+    }
+
+    auto test_assembly() -> bool {
+        auto native = [](const vector<mnemo_t> &mnemos) -> i64 {
+            vector<u8> bytecode = assembly::assemble(mnemos);
+            return jit::eval_mc(bytecode.data(), bytecode.size());
+        };
+        // Interpreter tier, falls back to native code for mnemos the interpreter does not support
+        auto tiered = [](const vector<mnemo_t> &mnemos) -> i64 {
+            jit::tiered_function_t f(mnemos, {.promotion_threshold = numeric_limits<u64>::max()});
+            return f();
+        };
+        return test::log_combine_test_groups_results<13>(
+                {run_bytecode_tests(), run_exec_tests(native), run_exec_tests(tiered), run_tiering_tests(),
+                 run_compile_async_tests(), run_perf_tests(), run_patch_tests(), run_bench_tests(),
+                 run_stats_tests(), run_cache_tests(), run_module_tests(), run_profiler_tests(),
+                 run_corpus_tests()});
     }
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
 namespace tests {
-    auto test_assembly() -> void;
+    // Returns true if all tests succeeded, timing checks included
+    auto test_assembly() -> bool;
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+// Lock-free unbounded multi-producer single-consumer queue (Dmitry Vyukov's intrusive MPSC node queue).
+// `push` may be called from any thread and never blocks, `pop` may only be called from one consumer thread.
+template<typename T>
+class MpscQueue {
+    struct Node {
+        std::atomic<Node *> next{nullptr};
+        std::optional<T> value;
+    };
+
+    // Producers append at head, consumer takes from tail. `stub` keeps the queue non-empty.
+    std::atomic<Node *> head;
+    Node *tail;
+    Node stub;
+
+    auto push_node(Node *node) -> void {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node *prev = this->head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    auto take(Node *node, Node *next) -> std::optional<T> {
+        this->tail = next;
+        std::optional<T> value = std::move(node->value);
+        delete node;
+        return value;
+    }
+
+public:
+    MpscQueue() : head(&this->stub), tail(&this->stub) {}
+
+    MpscQueue(const MpscQueue &) = delete;
+
+    auto operator=(const MpscQueue &) -> MpscQueue & = delete;
+
+    ~MpscQueue() {
+        while (this->pop()) {}
+    }
+
+    auto push(T value) -> void {
+        auto *node = new Node();
+        node->value.emplace(std::move(value));
+        this->push_node(node);
+    }
+
+    // Returns an empty optional if the queue is empty or a producer has not finished linking its node yet
+    auto pop() -> std::optional<T> {
+        Node *tail = this->tail;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (tail == &this->stub) {
+            if (next == nullptr)
+                return std::nullopt;
+            this->tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr)
+            return this->take(tail, next);
+
+        if (tail != this->head.load(std::memory_order_acquire))
+            return std::nullopt;
+
+        // tail is the last node, put stub behind it so tail can be taken
+        this->push_node(&this->stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next != nullptr)
+            return this->take(tail, next);
+        return std::nullopt;
+    }
+};
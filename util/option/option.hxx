@@ -23,8 +23,10 @@ public:
         return Option<U>();
     }
 
-    // Haskell Monad.<|>, Rust Option::or_else()
-    auto choice(std::function<Option<T>()> k) -> Option<T> {
+    // Haskell Monad.<|>, Rust Option::or_else(). Takes the callable as is, wrapping it in std::function could
+    // allocate on every call.
+    template<typename F>
+    auto choice(F &&k) -> Option<T> {
         if (this->has_value())
             return *this;
         return k();
@@ -2,6 +2,7 @@
 
 #include <variant>
 #include <functional>
+#include <stdexcept>
 
 template<typename T, typename E>
 class Result : std::variant<T, E> {
@@ -29,8 +30,10 @@ public:
         return *this;
     }
 
-    // Haskell Monad.<|>, Rust Result::or_else()
-    auto choice(std::function<Result<T, E>()> k) const -> Result<T, E> {
+    // Haskell Monad.<|>, Rust Result::or_else(). Takes the callable as is, wrapping it in std::function could
+    // allocate on every call.
+    template<typename F>
+    auto choice(F &&k) const -> Result<T, E> {
         if (this->is_ok())
             return *this;
         return k();
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <array>
+#include <string_view>
+
+#include "../int.hxx"
 #include "../strvec.hxx"
 
-auto is_prefix(std::string_view s, std::string_view prefix) -> bool;
\ No newline at end of file
+auto is_prefix(std::string_view s, std::string_view prefix) -> bool;
+
+// SHA-256 digest as specified in FIPS 180-4
+auto sha256(std::string_view data) -> std::array<u8, 32>;